@@ -0,0 +1,296 @@
+#include "EdgeVision.h"
+#include <ctype.h>
+#include <sys/utsname.h>
+
+/***********************
+ **
+ ** Autotuner
+ **
+ ** The fastest kernel variant, band height and thread count differ between
+ ** the Cortex-A9 of the board and a desktop or server CPU, and with the
+ ** frame size. --autotune times the gradient pipeline on synthetic frames
+ ** of three size classes and writes the best setting of each to a text
+ ** profile. Later runs load the profile at startup and look the setting up
+ ** by frame size, so tuning costs nothing per frame. The search takes the
+ ** variant first (default band, one thread), then every band height and
+ ** thread count with that variant. Each candidate is timed as the best of a
+ ** few repeats, so a tuning run takes a few seconds.
+ **
+ **********************/
+
+#define TUNE_MIN_REPEAT   3
+#define TUNE_MAX_REPEAT   50
+#define TUNE_MIN_SECONDS  0.03      // per candidate, so short frames are timed reliably
+
+// Size classes: frames up to maxBytes use the setting tuned on the synthetic frame
+static const struct {
+    const char *name;
+    size_t maxBytes;
+    int width, height;              // 3 channels
+} tuneClasses[TUNE_CLASSES] = {
+    { "small",  1u << 20, 512,  512  },
+    { "medium", 8u << 20, 1280, 960  },
+    { "large",  0,        1920, 1440 },
+};
+
+static const int tuneBandRows[] = { 8, 16, 32, 64, 128, 256 };
+
+static const char *variantNames[VARIANT_COUNT] = { "specialized", "generic" };
+
+const char *KernelVariantName(KernelVariant variant)
+{
+    if (variant < 0 || variant >= VARIANT_COUNT)
+        return "unknown";
+    return variantNames[variant];
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Machine and CPU model, without spaces, e.g. "x86_64/AMD_EPYC_7B13"
+static void hostName(char *name, size_t size)
+{
+    struct utsname uts;
+    char line[256], model[128] = "unknown";
+
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo) {
+        while (fgets(line, sizeof(line), cpuinfo)) {
+            char *colon = strchr(line, ':');
+            if (!colon || (strncmp(line, "model name", 10) != 0 && strncmp(line, "Processor", 9) != 0))
+                continue;
+            colon++;
+            while (*colon == ' ' || *colon == '\t')
+                colon++;
+            snprintf(model, sizeof(model), "%s", colon);
+            break;
+        }
+        fclose(cpuinfo);
+    }
+
+    snprintf(name, size, "%s/%s", uname(&uts) == 0 ? uts.machine : "unknown", model);
+    for (char *p = name; *p; p++) {
+        if (*p == '\n')
+            *p = '\0';
+        else if (isspace((unsigned char)*p))
+            *p = '_';
+    }
+}
+
+/**
+ * The built-in setting: the specialized kernels, PIPELINE_BAND_ROWS rows
+ * per band and one thread, i.e. the behaviour without a profile.
+ */
+void TuneProfileDefaults(TuneProfile *profile)
+{
+    memset(profile, 0, sizeof(*profile));
+    hostName(profile->host, sizeof(profile->host));
+    profile->cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (profile->cpus < 1)
+        profile->cpus = 1;
+    for (int c = 0; c < TUNE_CLASSES; c++) {
+        profile->classes[c].maxBytes = tuneClasses[c].maxBytes;
+        profile->classes[c].variant = VARIANT_SPECIALIZED;
+        profile->classes[c].bandRows = PIPELINE_BAND_ROWS;
+        profile->classes[c].threads = 1;
+    }
+}
+
+/**
+ * Setting for a frame of `frameBytes` bytes.
+ */
+const TuneSetting *TuneProfileLookup(const TuneProfile *profile, size_t frameBytes)
+{
+    for (int c = 0; c < TUNE_CLASSES - 1; c++) {
+        if (frameBytes <= profile->classes[c].maxBytes)
+            return &profile->classes[c];
+    }
+    return &profile->classes[TUNE_CLASSES - 1];
+}
+
+/**
+ * Read a profile written by TuneProfileSave(). Returns 0 on success, 1 if
+ * it was tuned on another host (`profile` then keeps the defaults), and
+ * -1 if it cannot be read or is malformed.
+ */
+int TuneProfileLoad(TuneProfile *profile, const char *path)
+{
+    TuneProfile loaded;
+    char line[256], host[sizeof(loaded.host)], name[16], variant[16];
+    int version = 0, classes = 0;
+
+    TuneProfileDefaults(profile);
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    loaded = *profile;
+    loaded.host[0] = '\0';
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long maxBytes;
+        TuneSetting setting;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "version %d", &version) == 1)
+            continue;
+        if (sscanf(line, "host %127s", host) == 1) {
+            snprintf(loaded.host, sizeof(loaded.host), "%s", host);
+            continue;
+        }
+        if (sscanf(line, "cpus %d", &loaded.cpus) == 1)
+            continue;
+        if (sscanf(line, "class %15s %llu %15s %d %d %lf", name, &maxBytes, variant, &setting.bandRows,
+                   &setting.threads, &setting.mbPerSecond) == 6) {
+            int c = 0;
+            while (c < TUNE_CLASSES && strcmp(name, tuneClasses[c].name) != 0)
+                c++;
+            setting.variant = strcmp(variant, "generic") == 0 ? VARIANT_GENERIC : VARIANT_SPECIALIZED;
+            setting.maxBytes = (size_t)maxBytes;
+            if (c == TUNE_CLASSES || setting.bandRows < 1 || setting.threads < 1 ||
+                setting.threads > TUNE_MAX_THREADS)
+                break;
+            loaded.classes[c] = setting;
+            classes |= 1 << c;
+            continue;
+        }
+        break;
+    }
+    const int complete = feof(file) && version == TUNE_PROFILE_VERSION && classes == (1 << TUNE_CLASSES) - 1;
+    fclose(file);
+
+    if (!complete)
+        return -1;
+    if (strcmp(loaded.host, profile->host) != 0 || loaded.cpus != profile->cpus)
+        return 1;
+    *profile = loaded;
+    return 0;
+}
+
+/**
+ * Write `profile` as text to `path`. Returns 0 on success, -1 on failure.
+ */
+int TuneProfileSave(const TuneProfile *profile, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    fprintf(file, "# EdgeVision tuning profile, written by --autotune\n");
+    fprintf(file, "# class NAME MAX_BYTES VARIANT BAND_ROWS THREADS MB_PER_S\n");
+    fprintf(file, "version %d\n", TUNE_PROFILE_VERSION);
+    fprintf(file, "host %s\n", profile->host);
+    fprintf(file, "cpus %d\n", profile->cpus);
+    for (int c = 0; c < TUNE_CLASSES; c++) {
+        const TuneSetting *setting = &profile->classes[c];
+        fprintf(file, "class %s %llu %s %d %d %.1f\n", tuneClasses[c].name, (unsigned long long)setting->maxBytes,
+                KernelVariantName(setting->variant), setting->bandRows, setting->threads, setting->mbPerSecond);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Best time of one pass of the gradient pipeline over the frame
+static double timeSetting(BandPool *pool, unsigned char *input, unsigned char *output, int width, int height,
+                          const TuneSetting *setting)
+{
+    double best = 0, spent = 0;
+    for (int repeat = 0; repeat < TUNE_MIN_REPEAT || (spent < TUNE_MIN_SECONDS && repeat < TUNE_MAX_REPEAT);
+         repeat++) {
+        const double start = nowSeconds();
+        for (int y = 0; y < height; y += setting->bandRows) {
+            const int y1 = height - y < setting->bandRows ? height : y + setting->bandRows;
+            BandPoolRows(pool, setting->threads, input, output, width, height, 3, OP_Sobel, setting->variant,
+                         DENOISE_NONE, y, y1, BORDER_SKIP, 0, NULL);
+        }
+        const double elapsed = nowSeconds() - start;
+        spent += elapsed;
+        if (repeat == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static void tryCandidate(BandPool *pool, unsigned char *input, unsigned char *output, int width, int height,
+                         const TuneSetting *candidate, TuneSetting *best, double *bestSeconds)
+{
+    const double seconds = timeSetting(pool, input, output, width, height, candidate);
+    if (seconds < *bestSeconds) {
+        *best = *candidate;
+        *bestSeconds = seconds;
+    }
+}
+
+/**
+ * Tune every size class on this host and fill `profile` with the results.
+ * Returns 0 on success, -1 if the frames or threads cannot be set up.
+ */
+int Autotune(TuneProfile *profile)
+{
+    BandPool pool;
+    TuneProfileDefaults(profile);
+    const int maxThreads = profile->cpus < TUNE_MAX_THREADS ? profile->cpus : TUNE_MAX_THREADS;
+    if (BandPoolInit(&pool, maxThreads) != 0)
+        return -1;
+
+    printf("Autotune : %s, %d CPU(s)\n", profile->host, profile->cpus);
+    const double started = nowSeconds();
+    for (int c = 0; c < TUNE_CLASSES; c++) {
+        const int width = tuneClasses[c].width, height = tuneClasses[c].height;
+        const size_t bytes = (size_t)width * height * 3;
+        unsigned char *input = (unsigned char *)malloc(bytes);
+        unsigned char *output = (unsigned char *)malloc(bytes);
+        if (!input || !output) {
+            free(input);
+            free(output);
+            BandPoolClose(&pool);
+            return -1;
+        }
+
+        // Smooth ramps plus pseudo-random texture, like the benchmark frames
+        unsigned int seed = 12345;
+        for (size_t i = 0; i < bytes; i++) {
+            seed = seed * 1103515245u + 12345u;
+            input[i] = (unsigned char)((i / 3 % width + i / 3 / width) ^ ((seed >> 16) & 0x3F));
+        }
+
+        TuneSetting best = profile->classes[c], candidate = best;
+        timeSetting(&pool, input, output, width, height, &best);   // fault the pages in
+        double bestSeconds = timeSetting(&pool, input, output, width, height, &best);
+
+        candidate.variant = VARIANT_GENERIC;
+        tryCandidate(&pool, input, output, width, height, &candidate, &best, &bestSeconds);
+
+        // Thread counts 1, 2, 4, ... and all CPUs
+        int threadCounts[8], threadChoices = 0;
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+            threadCounts[threadChoices++] = threads;
+        threadCounts[threadChoices++] = maxThreads;
+
+        const KernelVariant variant = best.variant;
+        for (int t = 0; t < threadChoices; t++) {
+            for (size_t b = 0; b < sizeof(tuneBandRows) / sizeof(tuneBandRows[0]); b++) {
+                candidate = best;
+                candidate.variant = variant;
+                candidate.bandRows = tuneBandRows[b];
+                candidate.threads = threadCounts[t];
+                if (candidate.bandRows != best.bandRows || candidate.threads != best.threads)
+                    tryCandidate(&pool, input, output, width, height, &candidate, &best, &bestSeconds);
+            }
+        }
+
+        best.mbPerSecond = bytes / bestSeconds / 1e6;
+        profile->classes[c] = best;
+        printf("Autotune %-6s : %s kernel, %d-row bands, %d thread(s), %.1f MB/s\n", tuneClasses[c].name,
+               KernelVariantName(best.variant), best.bandRows, best.threads, best.mbPerSecond);
+        free(input);
+        free(output);
+    }
+    printf("Autotune : %.2f seconds\n", nowSeconds() - started);
+
+    BandPoolClose(&pool);
+    return 0;
+}
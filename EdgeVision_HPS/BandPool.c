@@ -0,0 +1,161 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Band pool
+ **
+ ** The gradient pipeline computes a frame one band of rows at a time, so
+ ** the writer can encode finished rows in the meantime. With more than one
+ ** thread a band is cut into equal slices of rows: the caller computes the
+ ** first slice and parked helper threads the others, and BandPoolRows()
+ ** returns once the whole band is done. Slices keep their own statistics,
+ ** which are merged at the end, so no counter is shared.
+ **
+ **********************/
+
+static int runSlice(BandPool *pool, int slice)
+{
+    const long rows = pool->y1 - pool->y0;
+    const int y0 = pool->y0 + (int)(rows * slice / pool->slices);
+    const int y1 = pool->y0 + (int)(rows * (slice + 1) / pool->slices);
+    if (y0 >= y1)
+        return 0;
+    return SobelRows(pool->input, pool->output, pool->width, pool->height, pool->bytesPerPixel, pool->op,
+                     pool->variant, pool->denoise, y0, y1, pool->border, pool->borderValue,
+                     pool->collect ? &pool->sliceStats[slice] : NULL);
+}
+
+static void *bandWorker(void *arg)
+{
+    BandPool *pool = (BandPool *)arg;
+    long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stopping && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->stopping)
+            break;
+        seen = pool->generation;
+        const int slice = pool->nextSlice++;
+        pthread_mutex_unlock(&pool->lock);
+
+        // Helpers beyond the slices of this band have nothing to do
+        const int status = slice < pool->slices ? runSlice(pool, slice) : 0;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->failed |= status != 0;
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Start threads - 1 helper threads (none for one thread). If fewer can be
+ * started, the pool works with those. Returns 0 on success, -1 on failure.
+ */
+int BandPoolInit(BandPool *pool, int threads)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (threads < 1)
+        threads = 1;
+    if (threads > TUNE_MAX_THREADS)
+        threads = TUNE_MAX_THREADS;
+
+    pool->sliceStats = (SobelStats *)calloc(threads, sizeof(SobelStats));
+    pool->threads = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    if (!pool->sliceStats || !pool->threads) {
+        free(pool->sliceStats);
+        free(pool->threads);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, bandWorker, pool) != 0)
+            break;
+        pool->threadCount++;
+    }
+    return 0;
+}
+
+/**
+ * SobelRows() for rows [y0,y1), split over up to `threads` threads
+ * (the caller included). The output is the same for any thread count.
+ * Returns 0 on success, -1 if any slice failed.
+ */
+int BandPoolRows(BandPool *pool, int threads, unsigned char *input, unsigned char *output, int width, int height,
+                 int bytesPerPixel, SobelOperator op, KernelVariant variant, SobelDenoise denoise, int y0, int y1,
+                 SobelBorder border, int borderValue, SobelStats *stats)
+{
+    int slices = threads < pool->threadCount + 1 ? threads : pool->threadCount + 1;
+    if (slices > y1 - y0)
+        slices = y1 - y0;
+    if (slices <= 1)
+        return SobelRows(input, output, width, height, bytesPerPixel, op, variant, denoise, y0, y1, border,
+                         borderValue, stats);
+
+    pool->input = input;
+    pool->output = output;
+    pool->width = width;
+    pool->height = height;
+    pool->bytesPerPixel = bytesPerPixel;
+    pool->op = op;
+    pool->variant = variant;
+    pool->denoise = denoise;
+    pool->y0 = y0;
+    pool->y1 = y1;
+    pool->slices = slices;
+    pool->border = border;
+    pool->borderValue = borderValue;
+    pool->collect = stats != NULL;
+    if (stats)
+        memset(pool->sliceStats, 0, slices * sizeof(SobelStats));
+
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    pool->nextSlice = 1;
+    pool->pending = pool->threadCount;
+    pool->failed = 0;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    const int status = runSlice(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->failed |= status != 0;
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    const int failed = pool->failed;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stats) {
+        for (int slice = 0; slice < slices; slice++)
+            SobelStatsMerge(stats, &pool->sliceStats[slice]);
+    }
+    return failed ? -1 : 0;
+}
+
+void BandPoolClose(BandPool *pool)
+{
+    if (!pool->threads)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threadCount; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->sliceStats);
+    pool->threads = NULL;
+    pool->sliceStats = NULL;
+}
@@ -0,0 +1,254 @@
+/************************************************************************
+ **
+** SOBEL kernel benchmark
+**
+** Times EdgeVisionProcess() on synthetic frames for every operator,
+** channel count and backend, so kernel changes can be compared (and
+** profiled with perf) without the file I/O of SOBEL_HPS. A mixed batch of
+** small frames and one panorama is then run with the static and the
+** work-stealing schedule to show how evenly the workers are loaded.
+**
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "EdgeVisionLib.h"
+
+#define BENCH_DEFAULT_REPEAT  9
+#define BENCH_MAX_SIZES       8
+#define BENCH_BATCH_SMALL     12     // 512x512 grey frames in the mixed batch
+
+typedef struct {
+    int width, height;
+} BenchSize;
+
+static const char *operatorNames[] = { "sobel", "scharr", "prewitt" };
+static const char *backendNames[] = { "cpu", "generic" };
+
+// Rows per operator: the two EdgeVisionMode values, then the gradient with edge statistics
+#define BENCH_MODE_STATS  (EDGEVISION_MODE_CANNY + 1)
+static const char *modeNames[] = { "gradient", "canny", "stats" };
+
+static double nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Smooth ramps plus pseudo-random texture, so every branch of the kernels runs
+static void fillFrame(EdgeVisionImage *image)
+{
+    unsigned int seed = 12345;
+    for (int y = 0; y < image->height; y++) {
+        unsigned char *row = image->pixels + (size_t)y * image->stride;
+        for (int x = 0; x < image->width * image->channels; x++) {
+            seed = seed * 1103515245u + 12345u;
+            row[x] = (unsigned char)(((x + y) & 0xFF) ^ ((seed >> 16) & 0x3F));
+        }
+    }
+}
+
+/**
+ * Median time of `repeat` runs, in milliseconds. Returns -1 on failure.
+ */
+static double timeRun(EdgeVisionContext *context, EdgeVisionImage *input, EdgeVisionImage *output,
+                      const EdgeVisionOptions *options, int repeat)
+{
+    double times[64];
+    if (repeat > 64)
+        repeat = 64;
+
+    // One untimed run to fault in the buffers
+    if (EdgeVisionProcess(context, input, output, options) != 0)
+        return -1;
+
+    for (int i = 0; i < repeat; i++) {
+        double start = nowMs();
+        EdgeVisionProcess(context, input, output, options);
+        times[i] = nowMs() - start;
+    }
+    qsort(times, repeat, sizeof(double), compareDouble);
+    return times[repeat / 2];
+}
+
+/**
+ * Run a batch of BENCH_BATCH_SMALL small frames followed by one panorama
+ * with each schedule and print the median time and the load balance.
+ * Returns 0 on success, -1 on failure.
+ */
+static int benchBatch(int threads, int repeat)
+{
+    static const char *scheduleNames[] = { "steal", "static" };
+    const int count = BENCH_BATCH_SMALL + 1;
+    EdgeVisionImage inputs[BENCH_BATCH_SMALL + 1], outputs[BENCH_BATCH_SMALL + 1];
+    int status = 0;
+
+    printf("\n%-10s %-8s %8s %10s %8s %8s %8s\n", "batch", "schedule", "threads", "ms", "tasks", "steals", "balance");
+    printf("----------------------------------------------------------------\n");
+
+    for (int schedule = EDGEVISION_SCHEDULE_STEAL; schedule <= EDGEVISION_SCHEDULE_STATIC; schedule++) {
+        EdgeVisionConfig config = { EDGEVISION_BACKEND_CPU, threads, count * 2, (EdgeVisionSchedule)schedule };
+        EdgeVisionContext *context = EdgeVisionCreate(&config);
+        if (!context) {
+            printf("Could not create a %s context\n", scheduleNames[schedule]);
+            return -1;
+        }
+
+        int ready = 0;
+        for (; ready < count; ready++) {
+            int width = ready < BENCH_BATCH_SMALL ? 512 : 8192;
+            int height = ready < BENCH_BATCH_SMALL ? 512 : 1024;
+            if (EdgeVisionImageAlloc(context, width, height, 1, &inputs[ready]) != 0)
+                break;
+            if (EdgeVisionImageAlloc(context, width, height, 1, &outputs[ready]) != 0) {
+                EdgeVisionImageRelease(context, &inputs[ready]);
+                break;
+            }
+            fillFrame(&inputs[ready]);
+        }
+
+        double times[64], balance[64];
+        EdgeVisionStats stats;
+        memset(&stats, 0, sizeof(stats));
+        int runs = repeat > 64 ? 64 : repeat;
+        int failed = ready < count ||
+                     EdgeVisionProcessBatch(context, inputs, outputs, count, NULL, NULL, NULL) != 0;
+        for (int i = 0; i < runs && !failed; i++) {
+            double start = nowMs();
+            failed = EdgeVisionProcessBatch(context, inputs, outputs, count, NULL, NULL, NULL) != 0;
+            times[i] = nowMs() - start;
+            EdgeVisionLastStats(context, &stats);
+            balance[i] = stats.efficiency;
+        }
+
+        if (failed) {
+            printf("%-10s %-8s failed: %s\n", "mixed", scheduleNames[schedule], EdgeVisionLastError(context));
+            status = -1;
+        } else {
+            qsort(times, runs, sizeof(double), compareDouble);
+            qsort(balance, runs, sizeof(double), compareDouble);
+            printf("%-10s %-8s %8d %10.3f %8ld %8ld %7.0f%%\n", "mixed", scheduleNames[schedule], stats.threads,
+                   times[runs / 2], stats.tasks, stats.steals, balance[runs / 2] * 100.0);
+        }
+
+        for (int i = 0; i < ready; i++) {
+            EdgeVisionImageRelease(context, &outputs[i]);
+            EdgeVisionImageRelease(context, &inputs[i]);
+        }
+        EdgeVisionDestroy(context);
+    }
+    printf("Batch   : %d frames of 512x512 and one of 8192x1024, grey; balance = busy / (threads * wall)\n",
+           BENCH_BATCH_SMALL);
+    return status;
+}
+
+static void printUsage(const char *program)
+{
+    printf("Usage: %s [-n REPEAT] [-t THREADS] [WxH ...]\n", program);
+    printf("  Default sizes: 512x512 1920x1080\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int repeat = BENCH_DEFAULT_REPEAT;
+    int threads = 1;
+    BenchSize sizes[BENCH_MAX_SIZES];
+    int sizeCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (sizeCount < BENCH_MAX_SIZES &&
+                   sscanf(argv[i], "%dx%d", &sizes[sizeCount].width, &sizes[sizeCount].height) == 2 &&
+                   sizes[sizeCount].width >= 3 && sizes[sizeCount].height >= 3) {
+            sizeCount++;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1)
+        repeat = 1;
+    if (sizeCount == 0) {
+        sizes[sizeCount++] = (BenchSize){ 512, 512 };
+        sizes[sizeCount++] = (BenchSize){ 1920, 1080 };
+    }
+
+    printf("%-10s %-8s %-8s %-3s %-8s %10s %10s\n", "size", "backend", "operator", "ch", "mode", "ms", "Mpix/s");
+    printf("----------------------------------------------------------------\n");
+
+    int status = 0;
+    for (int backend = EDGEVISION_BACKEND_CPU; backend <= EDGEVISION_BACKEND_CPU_GENERIC; backend++) {
+        EdgeVisionConfig config = { (EdgeVisionBackend)backend, threads, 0, EDGEVISION_SCHEDULE_STEAL };
+        EdgeVisionContext *context = EdgeVisionCreate(&config);
+        if (!context) {
+            printf("Could not create a %s context\n", backendNames[backend]);
+            return 1;
+        }
+
+        for (int s = 0; s < sizeCount; s++) {
+            const int channelCounts[] = { 1, 3, 4 };
+            for (int c = 0; c < 3; c++) {
+                EdgeVisionImage input, output;
+                if (EdgeVisionImageAlloc(context, sizes[s].width, sizes[s].height, channelCounts[c], &input) != 0 ||
+                    EdgeVisionImageAlloc(context, sizes[s].width, sizes[s].height, channelCounts[c], &output) != 0) {
+                    printf("%s\n", EdgeVisionLastError(context));
+                    EdgeVisionDestroy(context);
+                    return 1;
+                }
+                fillFrame(&input);
+
+                char size[32];
+                snprintf(size, sizeof(size), "%dx%d", sizes[s].width, sizes[s].height);
+                const double megapixels = (double)sizes[s].width * sizes[s].height / 1e6;
+
+                for (int mode = EDGEVISION_MODE_GRADIENT; mode <= BENCH_MODE_STATS; mode++) {
+                    // Canny always uses the Sobel weights; statistics are timed for Sobel only
+                    int lastOp = mode == EDGEVISION_MODE_GRADIENT ? EDGEVISION_OP_PREWITT : EDGEVISION_OP_SOBEL;
+                    for (int op = EDGEVISION_OP_SOBEL; op <= lastOp; op++) {
+                        EdgeVisionOptions options;
+                        memset(&options, 0, sizeof(options));
+                        options.op = (EdgeVisionOperator)op;
+                        EdgeVisionEdgeStats edgeStats;
+                        options.mode = mode == BENCH_MODE_STATS ? EDGEVISION_MODE_GRADIENT : (EdgeVisionMode)mode;
+                        if (mode == BENCH_MODE_STATS)
+                            options.stats = &edgeStats;
+
+                        double ms = timeRun(context, &input, &output, &options, repeat);
+                        if (ms < 0) {
+                            printf("%-10s %-8s %-8s %-3d failed: %s\n", size, backendNames[backend],
+                                   operatorNames[op], channelCounts[c], EdgeVisionLastError(context));
+                            status = 1;
+                            continue;
+                        }
+                        printf("%-10s %-8s %-8s %-3d %-8s %10.3f %10.1f\n", size, backendNames[backend],
+                               operatorNames[op], channelCounts[c], modeNames[mode],
+                               ms, ms > 0 ? megapixels / (ms / 1000.0) : 0.0);
+                    }
+                }
+
+                EdgeVisionImageRelease(context, &output);
+                EdgeVisionImageRelease(context, &input);
+            }
+        }
+        EdgeVisionDestroy(context);
+    }
+
+    printf("----------------------------------------------------------------\n");
+    printf("Threads : %d, median of %d runs\n", threads, repeat);
+
+    if (benchBatch(threads, repeat) != 0)
+        status = 1;
+    return status;
+}
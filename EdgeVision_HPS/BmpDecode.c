@@ -0,0 +1,274 @@
+#include "BmpDecode.h"
+#include <stdint.h>
+#include <string.h>
+
+/***********************
+ **
+ ** Row-by-row BMP decoder
+ **
+ ** Decodes every BMP flavour we receive straight into the layout the
+ ** kernels expect: bottom-up rows, no row padding, 1, 3 or 4 bytes per
+ ** pixel. Top-down files are flipped as they are read, 16-bit and
+ ** BI_BITFIELDS pixels are expanded with their channel masks, and RLE8
+ ** is decoded one row at a time, so no conversion pass is needed.
+ **
+ **********************/
+
+static int maskShift(DWORD mask)
+{
+    int shift = 0;
+    while (mask && !(mask & 1)) {
+        mask >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+static int maskBits(DWORD mask)
+{
+    int bits = 0;
+    for (mask >>= maskShift(mask); mask & 1; mask >>= 1)
+        bits++;
+    return bits;
+}
+
+/* Scale one masked channel to 8 bits */
+static unsigned char maskChannel(DWORD pixel, DWORD mask, int shift, int bits)
+{
+    if (bits == 0)
+        return 0;
+    DWORD value = (pixel & mask) >> shift;
+    if (bits == 8)
+        return (unsigned char)value;
+    DWORD max = (1u << bits) - 1;
+    return (unsigned char)((value * 255 + max / 2) / max);
+}
+
+/**
+ * Parse what follows the 40-byte info header (channel masks and palette),
+ * validate the format and rewrite `infoHeader` to describe the decoded
+ * image: positive height, BI_RGB, 8/24/32 bits, biSizeImage = bytes of
+ * unpadded pixel data. `file` must be positioned just after the info
+ * header. Returns 0 on success, -1 for unsupported or corrupt files.
+ */
+int BmpReaderOpen(BmpReader *reader, FILE *file, BITMAPFILEHEADER *fileHeader, BITMAPINFOHEADER *infoHeader)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->file = file;
+    reader->width = infoHeader->biWidth;
+    reader->height = infoHeader->biHeight == INT32_MIN ? 0 :
+                     infoHeader->biHeight < 0 ? -infoHeader->biHeight : infoHeader->biHeight;
+    reader->topDown = infoHeader->biHeight < 0;
+    reader->bitCount = infoHeader->biBitCount;
+    reader->compression = infoHeader->biCompression;
+
+    const int bitCount = reader->bitCount;
+    const DWORD compression = reader->compression;
+    int supported = reader->width > 0 && reader->height > 0 && infoHeader->biSize >= 40;
+    if (compression == BI_RLE8)
+        supported = supported && bitCount == 8 && !reader->topDown;
+    else if (compression == BI_BITFIELDS)
+        supported = supported && (bitCount == 16 || bitCount == 32);
+    else
+        supported = supported && compression == BI_RGB &&
+                    (bitCount == 8 || bitCount == 16 || bitCount == 24 || bitCount == 32);
+    if (!supported) {
+        printf("\nUnsupported BMP format: %d bits per pixel, compression %u\n",
+               bitCount, (unsigned)compression);
+        return -1;
+    }
+    // The stored row and the decoded image must fit an int and biSizeImage
+    const int outBytesPerPixel = bitCount == 16 ? 3 : bitCount / 8;
+    if (((uint64_t)reader->width * bitCount + 31) / 32 * 4 > INT32_MAX ||
+        (uint64_t)reader->width * outBytesPerPixel * reader->height > UINT32_MAX) {
+        printf("\nBMP too large: %dx%d pixels\n", reader->width, reader->height);
+        return -1;
+    }
+
+    // Channel masks: in V4/V5 headers, or right after a 40-byte header
+    DWORD masks[4] = { 0, 0, 0, 0 };
+    long paletteOffset = sizeof(BITMAPFILEHEADER) + infoHeader->biSize;
+    if (compression == BI_BITFIELDS) {
+        int count = infoHeader->biSize >= 56 ? 4 : 3;
+        if (fread(masks, sizeof(DWORD), count, file) != (size_t)count)
+            return -1;
+        if (infoHeader->biSize == 40)
+            paletteOffset += 3 * sizeof(DWORD);
+    } else if (bitCount == 16) {
+        masks[0] = 0x7C00; masks[1] = 0x03E0; masks[2] = 0x001F;   // 5-5-5
+    } else if (bitCount == 32) {
+        masks[0] = 0xFF0000; masks[1] = 0xFF00; masks[2] = 0xFF;
+    }
+    for (int c = 0; c < 4; c++) {
+        reader->masks[c] = masks[c];
+        reader->shifts[c] = maskShift(masks[c]);
+        reader->bits[c] = maskBits(masks[c]);
+    }
+    // 32-bit pixels already in B,G,R,X order are copied as they are
+    reader->passThrough = bitCount != 16 &&
+                          (bitCount != 32 || (masks[0] == 0xFF0000 && masks[1] == 0xFF00 && masks[2] == 0xFF &&
+                                              (masks[3] == 0 || masks[3] == 0xFF000000)));
+
+    // Palette: biClrUsed == 0 means the full 2^bits table for 8-bit images
+    DWORD colours = 0;
+    if (bitCount == 8) {
+        colours = infoHeader->biClrUsed ? infoHeader->biClrUsed : 256;
+        if (colours > 256)
+            colours = 256;
+        fseek(file, paletteOffset, SEEK_SET);
+        if (fread(biColourPalette, 4, colours, file) != colours)
+            return -1;
+    }
+
+    reader->outBytesPerPixel = outBytesPerPixel;
+    reader->fileStride = ((reader->width * bitCount + 31) / 32) * 4;
+    reader->rowBuffer = (unsigned char *)malloc(reader->fileStride);
+    if (!reader->rowBuffer)
+        return -1;
+
+    if (fseek(file, fileHeader->bfOffBits, SEEK_SET) != 0) {
+        BmpReaderClose(reader);
+        return -1;
+    }
+
+    infoHeader->biSize = sizeof(BITMAPINFOHEADER);
+    infoHeader->biHeight = reader->height;
+    infoHeader->biBitCount = reader->outBytesPerPixel * 8;
+    infoHeader->biCompression = BI_RGB;
+    infoHeader->biClrUsed = colours;
+    infoHeader->biClrImportant = 0;
+    infoHeader->biSizeImage = reader->width * reader->outBytesPerPixel * reader->height;
+    return 0;
+}
+
+void BmpReaderClose(BmpReader *reader)
+{
+    free(reader->rowBuffer);
+    reader->rowBuffer = NULL;
+}
+
+/* Decode the next RLE8 row; rows after a delta or the end marker stay blank */
+static int decodeRle8Row(BmpReader *reader, unsigned char *row)
+{
+    FILE *file = reader->file;
+    const int width = reader->width;
+
+    memset(row, 0, width);
+    if (reader->rleEnd)
+        return 0;
+    if (reader->rleSkip > 1) {
+        reader->rleSkip--;
+        return 0;
+    }
+    reader->rleSkip = 0;
+
+    int x = reader->rleX;
+    reader->rleX = 0;
+
+    for (;;) {
+        int count = getc(file);
+        int value = getc(file);
+        if (value == EOF)
+            return -1;
+
+        if (count > 0) {
+            // Encoded run
+            for (int k = 0; k < count; k++, x++)
+                if (x < width)
+                    row[x] = (unsigned char)value;
+            continue;
+        }
+
+        switch (value) {
+            case 0:     // end of line
+                return 0;
+            case 1:     // end of bitmap
+                reader->rleEnd = 1;
+                return 0;
+            case 2: {   // delta
+                int dx = getc(file);
+                int dy = getc(file);
+                if (dy == EOF)
+                    return -1;
+                x += dx;
+                if (dy > 0) {
+                    reader->rleSkip = dy;
+                    reader->rleX = x;
+                    return 0;
+                }
+                break;
+            }
+            default:    // absolute run, padded to a 16-bit boundary
+                for (int k = 0; k < value; k++, x++) {
+                    int pixel = getc(file);
+                    if (pixel == EOF)
+                        return -1;
+                    if (x < width)
+                        row[x] = (unsigned char)pixel;
+                }
+                if (value & 1)
+                    getc(file);
+                break;
+        }
+    }
+}
+
+/**
+ * Bottom-up index of the row the next BmpReadRow() call decodes, or -1
+ * once the whole image has been read.
+ */
+int BmpNextRow(const BmpReader *reader)
+{
+    if (reader->row >= reader->height)
+        return -1;
+    return reader->topDown ? reader->height - 1 - reader->row : reader->row;
+}
+
+/**
+ * Decode the next row stored in the file into `row` (width * bytes per
+ * pixel bytes, no padding). Returns the bottom-up index of that row in the
+ * image, or -1 at the end of the image or on a read error.
+ */
+int BmpReadRow(BmpReader *reader, unsigned char *row)
+{
+    const int width = reader->width;
+    const int y = BmpNextRow(reader);
+    if (y < 0)
+        return -1;
+
+    if (reader->compression == BI_RLE8) {
+        if (decodeRle8Row(reader, row) != 0)
+            return -1;
+        reader->row++;
+        return y;
+    }
+
+    if (fread(reader->rowBuffer, 1, reader->fileStride, reader->file) != (size_t)reader->fileStride) {
+        // Tolerate a short final row, as the old loader did
+        if (reader->row != reader->height - 1)
+            return -1;
+    }
+
+    if (reader->passThrough) {
+        memcpy(row, reader->rowBuffer, width * reader->outBytesPerPixel);
+    } else {
+        const int inBytes = reader->bitCount / 8;
+        const int outBytes = reader->outBytesPerPixel;
+        const unsigned char *src = reader->rowBuffer;
+
+        for (int x = 0; x < width; x++, src += inBytes) {
+            DWORD pixel = (inBytes == 2) ? (DWORD)(src[0] | (src[1] << 8))
+                                         : (DWORD)(src[0] | (src[1] << 8) | (src[2] << 16) | ((DWORD)src[3] << 24));
+            unsigned char *dst = row + x * outBytes;
+            // Masks are R, G, B, A; pixels are stored B, G, R(, A)
+            dst[0] = maskChannel(pixel, reader->masks[2], reader->shifts[2], reader->bits[2]);
+            dst[1] = maskChannel(pixel, reader->masks[1], reader->shifts[1], reader->bits[1]);
+            dst[2] = maskChannel(pixel, reader->masks[0], reader->shifts[0], reader->bits[0]);
+            if (outBytes == 4)
+                dst[3] = maskChannel(pixel, reader->masks[3], reader->shifts[3], reader->bits[3]);
+        }
+    }
+
+    reader->row++;
+    return y;
+}
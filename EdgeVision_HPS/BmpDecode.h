@@ -0,0 +1,72 @@
+#ifndef BMPDECODE_H
+#define BMPDECODE_H
+
+// BMP file structures and the row-by-row decoder (BmpDecode.c). The HPS and
+// FPGA builds share this header and decoder; each EdgeVision.h includes it.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern unsigned char biColourPalette[1024];   // palette of the current 8-bit frame (EdgeVision.c)
+
+typedef int LONG;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+typedef char BYTE;
+
+#pragma pack(push,1)
+typedef struct {
+  WORD  bfType;                       // The type of the image
+ 
+  DWORD bfSize;                       //size of the file
+  WORD  bfReserved;                 // reserved type
+  WORD  bfReserved2;               
+  DWORD bfOffBits;                   //offset bytes from the file header to the image data
+} BITMAPFILEHEADER, *PBITMAPFILEHEADER;
+#pragma pack(pop)
+
+#pragma pack(push,1)
+typedef struct tagBITMAPINFOHEADER {
+  DWORD biSize;                   //the size of the header
+  LONG  biWidth;                 //the width in pixels
+  LONG  biHeight;                //the height in pixels
+  WORD  biPlanes;                //the no. of planes in the bitmap
+  WORD  biBitCount;              //bits per pixel
+  DWORD biCompression;           //compression specifications
+  DWORD biSizeImage;            //size of the bitmap data
+  LONG  biXPelsPerMeter;        //horizontal res(pixels per meter)
+  LONG  biYPelsPerMeter;        //vertical res(pixels per meter) 
+  DWORD biClrUsed;              //colours used in the image
+  DWORD biClrImportant;        //num of important colours used
+} BITMAPINFOHEADER, *PBITMAPINFOHEADER;
+#pragma pack(pop)
+
+
+// biCompression values handled by the loader
+#define BI_RGB        0
+#define BI_RLE8       1
+#define BI_BITFIELDS  3
+
+// State of the row-by-row BMP decoder (BmpDecode.c)
+typedef struct {
+    FILE *file;
+    int width, height;
+    int topDown;                // rows are stored top row first
+    int bitCount;               // bits per pixel in the file
+    DWORD compression;
+    int outBytesPerPixel;       // 1, 3 or 4 after decoding
+    int fileStride;             // padded bytes per stored row
+    DWORD masks[4];             // R, G, B, A channel masks
+    int shifts[4], bits[4];
+    int passThrough;            // rows are copied without conversion
+    unsigned char *rowBuffer;
+    int row;                    // stored rows decoded so far
+    int rleSkip, rleX, rleEnd;  // pending RLE8 delta / end of bitmap
+} BmpReader;
+
+int BmpReaderOpen(BmpReader *reader, FILE *file, BITMAPFILEHEADER *fileHeader, BITMAPINFOHEADER *infoHeader);
+int BmpNextRow(const BmpReader *reader);
+int BmpReadRow(BmpReader *reader, unsigned char *row);
+void BmpReaderClose(BmpReader *reader);
+
+#endif
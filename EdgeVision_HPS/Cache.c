@@ -0,0 +1,354 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Content-addressed result cache
+ **
+ ** Results are stored under a 64-bit key made from the decoded pixels, the
+ ** image header and the processing settings. The index is an open-address
+ ** hash table in a memory-mapped file, so a lookup is a few loads, and the
+ ** stored results are plain files in <dir>/<xx>/<key> that are hard-linked
+ ** into place on a hit (copied if the link fails). The index is locked
+ ** with flock(), so several runs can share one cache.
+ **
+ **********************/
+
+#define CACHE_MAGIC          0x31435645u   // "EVC1"
+#define CACHE_INITIAL_SLOTS  4096
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+    return rotl64(acc + input * PRIME2, 31) * PRIME1;
+}
+
+/**
+ * 64-bit hash of `length` bytes (the xxHash64 construction: four lanes of
+ * 8-byte words, then the tail). Runs at several GB/s, well ahead of the
+ * image decoder.
+ */
+uint64_t CacheHash64(const void *data, size_t length, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = (h ^ round64(0, v1)) * PRIME1 + PRIME4;
+        h = (h ^ round64(0, v2)) * PRIME1 + PRIME4;
+        h = (h ^ round64(0, v3)) * PRIME1 + PRIME4;
+        h = (h ^ round64(0, v4)) * PRIME1 + PRIME4;
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += length;
+    for (; p + 8 <= end; p += 8)
+        h = rotl64(h ^ round64(0, read64(p)), 27) * PRIME1 + PRIME4;
+    for (; p < end; p++)
+        h = rotl64(h ^ (*p * PRIME5), 11) * PRIME1;
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * Cache key of one frame: pixels, the header and palette that end up in
+ * the output, and a string naming everything else that affects it
+ * (operator, mode, backend, output format).
+ */
+uint64_t CacheKey(const unsigned char *pixels, const BITMAPINFOHEADER *info, const char *settings)
+{
+    uint64_t key = CacheHash64(settings, strlen(settings), 0);
+    key = CacheHash64(info, sizeof(*info), key);
+    if (info->biClrUsed > 0)
+        key = CacheHash64(biColourPalette, info->biClrUsed * 4, key);
+    key = CacheHash64(pixels, info->biSizeImage, key);
+    return key ? key : 1;   // 0 marks an empty slot
+}
+
+static size_t indexBytes(uint32_t capacity)
+{
+    return sizeof(CacheIndexHeader) + (size_t)capacity * sizeof(CacheEntry);
+}
+
+static int mapIndex(ResultCache *cache, uint32_t capacity)
+{
+    cache->mapSize = indexBytes(capacity);
+    void *map = mmap(NULL, cache->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    cache->header = (CacheIndexHeader *)map;
+    cache->entries = (CacheEntry *)(cache->header + 1);
+    return 0;
+}
+
+/* Follow another process that grew the index since we mapped it */
+static int remapIfGrown(ResultCache *cache)
+{
+    if (indexBytes(cache->header->capacity) == cache->mapSize)
+        return 0;
+    const uint32_t capacity = cache->header->capacity;
+    munmap(cache->header, cache->mapSize);
+    return mapIndex(cache, capacity);
+}
+
+static CacheEntry *findSlot(ResultCache *cache, uint64_t key)
+{
+    const uint32_t mask = cache->header->capacity - 1;
+    for (uint32_t i = (uint32_t)key & mask; ; i = (i + 1) & mask) {
+        CacheEntry *entry = &cache->entries[i];
+        if (entry->key == key || entry->key == 0)
+            return entry;
+    }
+}
+
+/* Double the table in place: extend the file, then reinsert every entry */
+static int growIndex(ResultCache *cache)
+{
+    const uint32_t oldCapacity = cache->header->capacity;
+    const uint32_t capacity = oldCapacity * 2;
+    CacheEntry *old = (CacheEntry *)malloc((size_t)oldCapacity * sizeof(CacheEntry));
+    if (!old)
+        return -1;
+    memcpy(old, cache->entries, (size_t)oldCapacity * sizeof(CacheEntry));
+
+    munmap(cache->header, cache->mapSize);
+    if (ftruncate(cache->fd, indexBytes(capacity)) != 0 || mapIndex(cache, capacity) != 0) {
+        free(old);
+        return -1;
+    }
+    memset(cache->entries, 0, (size_t)capacity * sizeof(CacheEntry));
+    cache->header->capacity = capacity;
+    for (uint32_t i = 0; i < oldCapacity; i++)
+        if (old[i].key)
+            *findSlot(cache, old[i].key) = old[i];
+    free(old);
+    return 0;
+}
+
+/* Remove an entry, moving later entries of its probe run back into the gap */
+static void removeEntry(ResultCache *cache, CacheEntry *entry)
+{
+    const uint32_t mask = cache->header->capacity - 1;
+    uint32_t hole = (uint32_t)(entry - cache->entries);
+
+    cache->entries[hole].key = 0;
+    cache->header->count--;
+    for (uint32_t i = (hole + 1) & mask; cache->entries[i].key; i = (i + 1) & mask) {
+        uint32_t home = (uint32_t)cache->entries[i].key & mask;
+        // Move it if its home slot is not between the hole and itself
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            cache->entries[hole] = cache->entries[i];
+            cache->entries[i].key = 0;
+            hole = i;
+        }
+    }
+}
+
+static void objectPath(const ResultCache *cache, uint64_t key, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%02x/%016llx", cache->dir, (unsigned)(key >> 56), (unsigned long long)key);
+}
+
+/* Copy a file, for when a hard link is not possible (other file system) */
+static int copyFile(const char *from, const char *to)
+{
+    char buffer[65536];
+    size_t n;
+    int status = 0;
+
+    FILE *in = fopen(from, "rb");
+    if (!in)
+        return -1;
+    FILE *out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return -1;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        if (fwrite(buffer, 1, n, out) != n)
+            status = -1;
+    if (ferror(in))
+        status = -1;
+    fclose(in);
+    if (fclose(out) != 0)
+        status = -1;
+    return status;
+}
+
+/* Make `to` the same content as `from`: hard link if possible, else a copy */
+static int linkOrCopy(const char *from, const char *to)
+{
+    unlink(to);
+    if (link(from, to) == 0)
+        return 0;
+    if (errno == ENOENT)
+        return -1;
+    return copyFile(from, to);
+}
+
+/**
+ * Open (creating if needed) the cache in directory `dir`. Returns 0 on
+ * success, -1 if the directory or index cannot be used.
+ */
+int CacheOpen(ResultCache *cache, const char *dir)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->fd = -1;
+    snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        printf("Cannot create cache directory '%s': %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    char path[sizeof(cache->dir) + 16];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    cache->fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (cache->fd < 0) {
+        printf("Cannot open cache index '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    flock(cache->fd, LOCK_EX);
+    struct stat st;
+    int status = fstat(cache->fd, &st);
+    if (status == 0 && st.st_size < (off_t)sizeof(CacheIndexHeader)) {
+        // New index
+        status = ftruncate(cache->fd, indexBytes(CACHE_INITIAL_SLOTS));
+        if (status == 0 && (status = mapIndex(cache, CACHE_INITIAL_SLOTS)) == 0) {
+            cache->header->magic = CACHE_MAGIC;
+            cache->header->capacity = CACHE_INITIAL_SLOTS;
+        }
+    } else if (status == 0) {
+        CacheIndexHeader header;
+        if (pread(cache->fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != CACHE_MAGIC ||
+            header.capacity == 0 || (header.capacity & (header.capacity - 1)) ||
+            st.st_size < (off_t)indexBytes(header.capacity)) {
+            printf("Cache index '%s' is not valid; delete it to start over\n", path);
+            status = -1;
+        } else {
+            status = mapIndex(cache, header.capacity);
+        }
+    }
+    flock(cache->fd, LOCK_UN);
+
+    if (status != 0) {
+        CacheClose(cache);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Look `key` up; on a hit the stored result is linked (or copied) to
+ * `outputPath`. Returns 0 on a hit, -1 on a miss.
+ */
+int CacheFetch(ResultCache *cache, uint64_t key, const char *outputPath)
+{
+    char path[sizeof(cache->dir) + 32];
+    int status = -1;
+
+    flock(cache->fd, LOCK_EX);
+    if (remapIfGrown(cache) == 0) {
+        CacheEntry *entry = findSlot(cache, key);
+        if (entry->key == key) {
+            objectPath(cache, key, path, sizeof(path));
+            if (linkOrCopy(path, outputPath) == 0) {
+                entry->lastUsed = (uint64_t)time(NULL);
+                status = 0;
+            } else {
+                // The stored file went away; forget it
+                removeEntry(cache, entry);
+            }
+        }
+        if (status == 0)
+            cache->header->hits++;
+        else
+            cache->header->misses++;
+    }
+    flock(cache->fd, LOCK_UN);
+
+    if (status == 0)
+        cache->hits++;
+    else
+        cache->misses++;
+    return status;
+}
+
+/**
+ * Store the finished output file `outputPath` as the result for `key`.
+ * Returns 0 on success.
+ */
+int CacheStore(ResultCache *cache, uint64_t key, const char *outputPath)
+{
+    char path[sizeof(cache->dir) + 32];
+    struct stat st;
+    int status = -1;
+
+    if (stat(outputPath, &st) != 0 || !S_ISREG(st.st_mode))
+        return -1;
+
+    snprintf(path, sizeof(path), "%s/%02x", cache->dir, (unsigned)(key >> 56));
+    mkdir(path, 0777);
+    objectPath(cache, key, path, sizeof(path));
+
+    flock(cache->fd, LOCK_EX);
+    if (remapIfGrown(cache) == 0 &&
+        (cache->header->count + 1 <= cache->header->capacity / 4 * 3 || growIndex(cache) == 0) &&
+        linkOrCopy(outputPath, path) == 0) {
+        CacheEntry *entry = findSlot(cache, key);
+        if (entry->key == 0)
+            cache->header->count++;
+        entry->key = key;
+        entry->size = st.st_size;
+        entry->lastUsed = (uint64_t)time(NULL);
+        status = 0;
+    }
+    flock(cache->fd, LOCK_UN);
+
+    if (status == 0)
+        cache->stores++;
+    return status;
+}
+
+void CacheClose(ResultCache *cache)
+{
+    if (cache->header)
+        munmap(cache->header, cache->mapSize);
+    if (cache->fd >= 0)
+        close(cache->fd);
+    cache->header = NULL;
+    cache->entries = NULL;
+    cache->fd = -1;
+}
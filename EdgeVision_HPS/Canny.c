@@ -0,0 +1,290 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Canny edge detector
+ **
+ ** Gaussian blur, Sobel gradient, non-maximum suppression and hysteresis
+ ** run as one streaming row pipeline. Each stage keeps only the rows its
+ ** window needs in a small ring buffer and pulls rows from the stage
+ ** before it on demand, so the input is read once and no full-size
+ ** intermediate image is allocated. Channels are processed independently,
+ ** like Sobel().
+ **
+ **********************/
+
+#define CANNY_NONE   255
+#define CANNY_WEAK   1
+#define CANNY_STRONG 0
+
+// Gradient direction, quantised to the neighbour pair used by NMS
+enum { DIR_HORIZONTAL, DIR_DIAGONAL_DOWN, DIR_VERTICAL, DIR_DIAGONAL_UP };
+
+typedef struct {
+    const unsigned char *input;
+    int width, height, bpp, rowBytes;
+
+    // Horizontally blurred rows (5-row ring), tags hold the row in each slot
+    unsigned short *hblur[5];
+    int hblurTag[5];
+
+    // Fully blurred rows (3-row ring)
+    unsigned char *blur[3];
+    int blurTag[3];
+
+    // Gradient magnitude and direction rows (3-row ring)
+    unsigned short *mag[3];
+    unsigned char *dir[3];
+    int gradTag[3];
+
+    // Strong pixels waiting to grow into connected weak pixels
+    int *stack;
+    int stackSize, stackCapacity;
+} CannyPipeline;
+
+static int clampRow(int row, int height)
+{
+    return row < 0 ? 0 : (row >= height ? height - 1 : row);
+}
+
+// Stage 1a: horizontal 1-4-6-4-1 pass of one input row, edges replicated
+static const unsigned short *getHBlurRow(CannyPipeline *p, int row)
+{
+    int slot = row % 5;
+    if (p->hblurTag[slot] == row)
+        return p->hblur[slot];
+
+    const unsigned char *src = p->input + row * p->rowBytes;
+    unsigned short *dst = p->hblur[slot];
+    const int bpp = p->bpp;
+    const int lastCol = p->width - 1;
+
+    for (int col = 0; col < p->width; col++) {
+        const int l2 = (col < 2 ? 0 : col - 2) * bpp;
+        const int l1 = (col < 1 ? 0 : col - 1) * bpp;
+        const int r1 = (col + 1 > lastCol ? lastCol : col + 1) * bpp;
+        const int r2 = (col + 2 > lastCol ? lastCol : col + 2) * bpp;
+        const int m = col * bpp;
+
+        for (int channel = 0; channel < bpp; channel++) {
+            dst[m + channel] = src[l2 + channel] + 4 * src[l1 + channel] + 6 * src[m + channel] +
+                               4 * src[r1 + channel] + src[r2 + channel];
+        }
+    }
+
+    p->hblurTag[slot] = row;
+    return dst;
+}
+
+// Stage 1b: vertical 1-4-6-4-1 pass over five horizontally blurred rows
+static const unsigned char *getBlurRow(CannyPipeline *p, int row)
+{
+    int slot = row % 3;
+    if (p->blurTag[slot] == row)
+        return p->blur[slot];
+
+    const unsigned short *r0 = getHBlurRow(p, clampRow(row - 2, p->height));
+    const unsigned short *r1 = getHBlurRow(p, clampRow(row - 1, p->height));
+    const unsigned short *r2 = getHBlurRow(p, row);
+    const unsigned short *r3 = getHBlurRow(p, clampRow(row + 1, p->height));
+    const unsigned short *r4 = getHBlurRow(p, clampRow(row + 2, p->height));
+    unsigned char *dst = p->blur[slot];
+
+    for (int i = 0; i < p->rowBytes; i++)
+        dst[i] = (unsigned char)((r0[i] + 4 * r1[i] + 6 * r2[i] + 4 * r3[i] + r4[i] + 128) >> 8);
+
+    p->blurTag[slot] = row;
+    return dst;
+}
+
+// Stage 2: Sobel gradient of the blurred image, keeping the direction
+static void getGradRow(CannyPipeline *p, int row, const unsigned short **mag, const unsigned char **dir)
+{
+    int slot = row % 3;
+    if (p->gradTag[slot] != row) {
+        const unsigned char *up   = getBlurRow(p, clampRow(row - 1, p->height));
+        const unsigned char *mid  = getBlurRow(p, row);
+        const unsigned char *down = getBlurRow(p, clampRow(row + 1, p->height));
+        unsigned short *m = p->mag[slot];
+        unsigned char *d = p->dir[slot];
+        const int bpp = p->bpp;
+
+        for (int i = 0; i < p->rowBytes; i++) {
+            int l = i - bpp < 0 ? i : i - bpp;
+            int r = i + bpp >= p->rowBytes ? i : i + bpp;
+
+            int sumX = (up[l] - up[r]) + 2 * (mid[l] - mid[r]) + (down[l] - down[r]);
+            int sumY = (up[l] - down[l]) + 2 * (up[i] - down[i]) + (up[r] - down[r]);
+            int ax = abs(sumX), ay = abs(sumY);
+
+            m[i] = (unsigned short)(ax + ay);
+
+            // tan(22.5) ~ 106/256
+            if (ay * 256 <= ax * 106)
+                d[i] = DIR_HORIZONTAL;
+            else if (ax * 256 <= ay * 106)
+                d[i] = DIR_VERTICAL;
+            else
+                d[i] = ((sumX ^ sumY) >= 0) ? DIR_DIAGONAL_DOWN : DIR_DIAGONAL_UP;
+        }
+        p->gradTag[slot] = row;
+    }
+    *mag = p->mag[slot];
+    if (dir)
+        *dir = p->dir[slot];
+}
+
+static int pushStrong(CannyPipeline *p, int index)
+{
+    if (p->stackSize == p->stackCapacity) {
+        int capacity = p->stackCapacity ? p->stackCapacity * 2 : 4096;
+        int *grown = (int *)realloc(p->stack, capacity * sizeof(int));
+        if (!grown)
+            return -1;
+        p->stack = grown;
+        p->stackCapacity = capacity;
+    }
+    p->stack[p->stackSize++] = index;
+    return 0;
+}
+
+// Stage 3: non-maximum suppression and double threshold of one row
+static int suppressRow(CannyPipeline *p, unsigned char *output, int row, int low, int high)
+{
+    const unsigned short *magUp, *magMid, *magDown;
+    const unsigned char *dirMid;
+    getGradRow(p, row - 1, &magUp, NULL);
+    getGradRow(p, row, &magMid, &dirMid);
+    getGradRow(p, row + 1, &magDown, NULL);
+
+    const int bpp = p->bpp;
+    unsigned char *out = output + row * p->rowBytes;
+
+    for (int i = bpp; i < p->rowBytes - bpp; i++) {
+        int m = magMid[i];
+        int a, b;
+
+        if (m < low) {
+            out[i] = CANNY_NONE;
+            continue;
+        }
+
+        switch (dirMid[i]) {
+            case DIR_HORIZONTAL:    a = magMid[i - bpp];  b = magMid[i + bpp];  break;
+            case DIR_VERTICAL:      a = magUp[i];         b = magDown[i];       break;
+            case DIR_DIAGONAL_DOWN: a = magUp[i - bpp];   b = magDown[i + bpp]; break;
+            default:                a = magUp[i + bpp];   b = magDown[i - bpp]; break;
+        }
+
+        if (m <= a || m < b) {
+            out[i] = CANNY_NONE;
+        } else if (m >= high) {
+            out[i] = CANNY_STRONG;
+            if (pushStrong(p, row * p->rowBytes + i) != 0)
+                return -1;
+        } else {
+            out[i] = CANNY_WEAK;
+        }
+    }
+    return 0;
+}
+
+// Stage 4: grow strong edges through 8-connected weak pixels, then drop the rest
+static int hysteresis(CannyPipeline *p, unsigned char *output)
+{
+    const int bpp = p->bpp;
+    const int rowBytes = p->rowBytes;
+    const int offsets[8] = { -rowBytes - bpp, -rowBytes, -rowBytes + bpp, -bpp,
+                             bpp, rowBytes - bpp, rowBytes, rowBytes + bpp };
+
+    while (p->stackSize > 0) {
+        int index = p->stack[--p->stackSize];
+        for (int k = 0; k < 8; k++) {
+            int n = index + offsets[k];
+            // Border pixels are never WEAK, so interior neighbours stay in bounds
+            if (output[n] == CANNY_WEAK) {
+                output[n] = CANNY_STRONG;
+                if (pushStrong(p, n) != 0)
+                    return -1;
+            }
+        }
+    }
+
+    const int total = rowBytes * p->height;
+    for (int i = 0; i < total; i++) {
+        if (output[i] == CANNY_WEAK)
+            output[i] = CANNY_NONE;
+    }
+    return 0;
+}
+
+static void freePipeline(CannyPipeline *p)
+{
+    for (int i = 0; i < 5; i++)
+        free(p->hblur[i]);
+    for (int i = 0; i < 3; i++) {
+        free(p->blur[i]);
+        free(p->mag[i]);
+        free(p->dir[i]);
+    }
+    free(p->stack);
+}
+
+/**
+ * Canny edge detection. Edges are written as 0 on a 255 background, matching
+ * the inverted Sobel output. Thresholds apply to the L1 Sobel magnitude of
+ * the blurred image (0..2040). Returns 0 on success, -1 on failure.
+ */
+int Canny(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel,
+          int lowThreshold, int highThreshold)
+{
+    // Input validation
+    if (!input || !output || width < 3 || height < 3 || bytesPerPixel <= 0) {
+        return -1;
+    }
+
+    CannyPipeline p;
+    memset(&p, 0, sizeof(p));
+    p.input = input;
+    p.width = width;
+    p.height = height;
+    p.bpp = bytesPerPixel;
+    p.rowBytes = width * bytesPerPixel;
+
+    int ok = 1;
+    for (int i = 0; i < 5; i++) {
+        p.hblur[i] = (unsigned short *)malloc(p.rowBytes * sizeof(unsigned short));
+        p.hblurTag[i] = -1;
+        ok = ok && p.hblur[i];
+    }
+    for (int i = 0; i < 3; i++) {
+        p.blur[i] = (unsigned char *)malloc(p.rowBytes);
+        p.mag[i] = (unsigned short *)malloc(p.rowBytes * sizeof(unsigned short));
+        p.dir[i] = (unsigned char *)malloc(p.rowBytes);
+        p.blurTag[i] = -1;
+        p.gradTag[i] = -1;
+        ok = ok && p.blur[i] && p.mag[i] && p.dir[i];
+    }
+    if (!ok) {
+        freePipeline(&p);
+        return -1;
+    }
+
+    // The one pixel frame has no complete NMS neighbourhood
+    memset(output, CANNY_NONE, p.rowBytes);
+    memset(output + (height - 1) * p.rowBytes, CANNY_NONE, p.rowBytes);
+
+    int status = 0;
+    for (int row = 1; row < height - 1 && status == 0; row++) {
+        unsigned char *out = output + row * p.rowBytes;
+        memset(out, CANNY_NONE, bytesPerPixel);
+        memset(out + p.rowBytes - bytesPerPixel, CANNY_NONE, bytesPerPixel);
+        status = suppressRow(&p, output, row, lowThreshold, highThreshold);
+    }
+
+    if (status == 0)
+        status = hysteresis(&p, output);
+
+    freePipeline(&p);
+    return status;
+}
@@ -0,0 +1,741 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Compressed output encoders
+ **
+ ** A small streaming deflate (LZ77 with hash chains, a Huffman block per
+ ** 16K symbols) wrapped as a PNG writer, and a BI_RLE8 row encoder for
+ ** 8-bit BMPs. Both take one row at a time, so the writer thread can
+ ** compress rows as the kernels finish them. The level only sets how many
+ ** match candidates are tried: edge maps are long runs of one value, which
+ ** level 1 already finds.
+ **
+ **********************/
+
+#define DEFLATE_MIN_MATCH      3
+#define DEFLATE_MAX_MATCH      258
+#define DEFLATE_MIN_LOOKAHEAD  (DEFLATE_MAX_MATCH + DEFLATE_MIN_MATCH + 1)
+#define DEFLATE_HASH_SIZE      (1 << DEFLATE_HASH_BITS)
+
+static const unsigned short lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/**
+ * Update a CRC-32 (ISO 3309, as used by PNG) with `length` bytes.
+ * Start with crc = 0.
+ */
+uint32_t Crc32Update(uint32_t crc, const unsigned char *data, size_t length)
+{
+    static uint32_t table[256];
+    static int tableReady = 0;
+
+    if (!tableReady) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = 1;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * Update an Adler-32 checksum (zlib trailer) with `length` bytes.
+ * Start with adler = 1.
+ */
+uint32_t Adler32Update(uint32_t adler, const unsigned char *data, size_t length)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (length > 0) {
+        // 5552 bytes is the most that cannot overflow b before the modulo
+        size_t chunk = length < 5552 ? length : 5552;
+        length -= chunk;
+        while (chunk--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void putByte(DeflateStream *stream, unsigned char value)
+{
+    if (stream->outLen == stream->outCap) {
+        size_t capacity = stream->outCap ? stream->outCap * 2 : 65536;
+        unsigned char *grown = (unsigned char *)realloc(stream->out, capacity);
+        if (!grown) {
+            stream->failed = 1;
+            return;
+        }
+        stream->out = grown;
+        stream->outCap = capacity;
+    }
+    stream->out[stream->outLen++] = value;
+}
+
+/* Append `count` bits, least significant first */
+static void putBits(DeflateStream *stream, uint32_t value, int count)
+{
+    stream->bits |= value << stream->bitCount;
+    stream->bitCount += count;
+    while (stream->bitCount >= 8) {
+        putByte(stream, (unsigned char)stream->bits);
+        stream->bits >>= 8;
+        stream->bitCount -= 8;
+    }
+}
+
+/* Huffman codes are packed most significant bit first */
+static void putCode(DeflateStream *stream, uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++, code >>= 1)
+        reversed = (reversed << 1) | (code & 1);
+    putBits(stream, reversed, length);
+}
+
+static int lengthCode(int length)
+{
+    int code = 28;
+    while (lengthBase[code] > length)
+        code--;
+    return code;
+}
+
+static int distanceCode(int distance)
+{
+    int code = 29;
+    while (distanceBase[code] > distance)
+        code--;
+    return code;
+}
+
+/* Code lengths of the fixed Huffman codes (RFC 1951, 3.2.6) */
+static void fixedLengths(unsigned char *literalLengths, unsigned char *distanceLengths)
+{
+    for (int i = 0; i < DEFLATE_LITERALS; i++)
+        literalLengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    for (int i = 0; i < DEFLATE_DISTANCES; i++)
+        distanceLengths[i] = 5;
+}
+
+/*
+ * Huffman code lengths for `count` symbols, none longer than `limit`.
+ * Frequencies are halved and the tree rebuilt until it fits, which costs a
+ * little ratio on pathological inputs only. At least two symbols always get
+ * a code, so every tree is complete.
+ */
+static void buildLengths(const unsigned *frequencies, int count, int limit, unsigned char *lengths)
+{
+    unsigned weight[2 * DEFLATE_LITERALS];
+    int parent[2 * DEFLATE_LITERALS];
+    unsigned scaled[DEFLATE_LITERALS];
+    int used = 0;
+
+    for (int i = 0; i < count; i++) {
+        scaled[i] = frequencies[i];
+        used += scaled[i] != 0;
+    }
+    for (int i = 0; used < 2 && i < count; i++)
+        if (scaled[i] == 0) {
+            scaled[i] = 1;
+            used++;
+        }
+
+    for (;;) {
+        // Leaves are 0..count-1, internal nodes follow; weight 0 = unused or merged
+        int nodes = count;
+        for (int i = 0; i < count; i++) {
+            weight[i] = scaled[i];
+            parent[i] = -1;
+        }
+        for (int merges = 0; merges < used - 1; merges++) {
+            int first = -1, second = -1;
+            for (int i = 0; i < nodes; i++) {
+                if (weight[i] == 0)
+                    continue;
+                if (first < 0 || weight[i] < weight[first]) {
+                    second = first;
+                    first = i;
+                } else if (second < 0 || weight[i] < weight[second]) {
+                    second = i;
+                }
+            }
+            weight[nodes] = weight[first] + weight[second];
+            parent[nodes] = -1;
+            parent[first] = parent[second] = nodes;
+            weight[first] = weight[second] = 0;
+            nodes++;
+        }
+
+        int longest = 0;
+        for (int i = 0; i < count; i++) {
+            int depth = 0;
+            if (scaled[i])
+                for (int n = i; parent[n] >= 0; n = parent[n])
+                    depth++;
+            lengths[i] = depth;
+            if (depth > longest)
+                longest = depth;
+        }
+        if (longest <= limit)
+            return;
+
+        for (int i = 0; i < count; i++)
+            if (scaled[i])
+                scaled[i] = (scaled[i] + 1) / 2;
+    }
+}
+
+/* Canonical codes from code lengths (RFC 1951, 3.2.2) */
+static void assignCodes(const unsigned char *lengths, int count, unsigned short *codes)
+{
+    unsigned short lengthCount[16] = { 0 }, next[16];
+    for (int i = 0; i < count; i++)
+        lengthCount[lengths[i]]++;
+    lengthCount[0] = 0;
+
+    unsigned short code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = (code + lengthCount[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < count; i++)
+        codes[i] = lengths[i] ? next[lengths[i]]++ : 0;
+}
+
+/*
+ * Run-length code the two length tables as one sequence (RFC 1951, 3.2.7).
+ * Returns the number of symbols; extra bits go to `extra`.
+ */
+static int encodeLengths(const unsigned char *lengths, int count, unsigned char *symbols, unsigned char *extra)
+{
+    int n = 0;
+    for (int i = 0; i < count; ) {
+        int run = 1;
+        while (i + run < count && lengths[i + run] == lengths[i])
+            run++;
+
+        if (lengths[i] == 0 && run >= 3) {
+            run = run > 138 ? 138 : run;
+            symbols[n] = run >= 11 ? 18 : 17;
+            extra[n++] = run >= 11 ? run - 11 : run - 3;
+        } else if (lengths[i] != 0 && run >= 4) {
+            // The value once, then repeats of 3..6
+            run = run > 7 ? 7 : run;
+            symbols[n] = lengths[i];
+            extra[n++] = 0;
+            symbols[n] = 16;
+            extra[n++] = run - 4;
+        } else {
+            run = 1;
+            symbols[n] = lengths[i];
+            extra[n++] = 0;
+        }
+        i += run;
+    }
+    return n;
+}
+
+/* Emit the buffered symbols as one block, dynamic or fixed, whichever is smaller */
+static void flushBlock(DeflateStream *stream, int final)
+{
+    static const unsigned char lengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    static const unsigned char lengthCodeExtra[19] = { [16] = 2, [17] = 3, [18] = 7 };
+    unsigned literalFreq[DEFLATE_LITERALS] = { 0 }, distanceFreq[DEFLATE_DISTANCES] = { 0 };
+    unsigned char literalLengths[DEFLATE_LITERALS], distanceLengths[DEFLATE_DISTANCES];
+    unsigned char fixedLiteral[DEFLATE_LITERALS], fixedDistance[DEFLATE_DISTANCES];
+    unsigned short literalCodes[DEFLATE_LITERALS], distanceCodes[DEFLATE_DISTANCES];
+
+    for (int i = 0; i < stream->symbolCount; i++) {
+        if (stream->symbolLength[i] == 0) {
+            literalFreq[stream->symbolValue[i]]++;
+        } else {
+            literalFreq[257 + lengthCode(stream->symbolLength[i])]++;
+            distanceFreq[distanceCode(stream->symbolValue[i])]++;
+        }
+    }
+    literalFreq[256] = 1;
+
+    buildLengths(literalFreq, DEFLATE_LITERALS, 15, literalLengths);
+    buildLengths(distanceFreq, DEFLATE_DISTANCES, 15, distanceLengths);
+    fixedLengths(fixedLiteral, fixedDistance);
+
+    // Trailing unused codes are not sent
+    int literalCount = DEFLATE_LITERALS, distanceCount = DEFLATE_DISTANCES;
+    while (literalCount > 257 && literalLengths[literalCount - 1] == 0)
+        literalCount--;
+    while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+        distanceCount--;
+
+    unsigned char allLengths[DEFLATE_LITERALS + DEFLATE_DISTANCES];
+    unsigned char symbols[DEFLATE_LITERALS + DEFLATE_DISTANCES], extra[DEFLATE_LITERALS + DEFLATE_DISTANCES];
+    memcpy(allLengths, literalLengths, literalCount);
+    memcpy(allLengths + literalCount, distanceLengths, distanceCount);
+    const int symbolCount = encodeLengths(allLengths, literalCount + distanceCount, symbols, extra);
+
+    unsigned lengthFreq[19] = { 0 };
+    unsigned char lengthLengths[19];
+    unsigned short lengthCodes[19];
+    for (int i = 0; i < symbolCount; i++)
+        lengthFreq[symbols[i]]++;
+    buildLengths(lengthFreq, 19, 7, lengthLengths);
+    int lengthCount = 19;
+    while (lengthCount > 4 && lengthLengths[lengthOrder[lengthCount - 1]] == 0)
+        lengthCount--;
+
+    // Sizes in bits of the two encodings; extra bits are the same for both
+    long dynamicBits = 5 + 5 + 4 + 3 * lengthCount, fixedBits = 0;
+    for (int i = 0; i < symbolCount; i++)
+        dynamicBits += lengthLengths[symbols[i]] + lengthCodeExtra[symbols[i]];
+    for (int i = 0; i < DEFLATE_LITERALS; i++) {
+        dynamicBits += (long)literalFreq[i] * literalLengths[i];
+        fixedBits += (long)literalFreq[i] * fixedLiteral[i];
+    }
+    for (int i = 0; i < DEFLATE_DISTANCES; i++) {
+        dynamicBits += (long)distanceFreq[i] * distanceLengths[i];
+        fixedBits += (long)distanceFreq[i] * fixedDistance[i];
+    }
+
+    putBits(stream, final, 1);
+    if (dynamicBits < fixedBits) {
+        putBits(stream, 2, 2);
+        putBits(stream, literalCount - 257, 5);
+        putBits(stream, distanceCount - 1, 5);
+        putBits(stream, lengthCount - 4, 4);
+        for (int i = 0; i < lengthCount; i++)
+            putBits(stream, lengthLengths[lengthOrder[i]], 3);
+        assignCodes(lengthLengths, 19, lengthCodes);
+        for (int i = 0; i < symbolCount; i++) {
+            putCode(stream, lengthCodes[symbols[i]], lengthLengths[symbols[i]]);
+            putBits(stream, extra[i], lengthCodeExtra[symbols[i]]);
+        }
+    } else {
+        putBits(stream, 1, 2);
+        memcpy(literalLengths, fixedLiteral, sizeof(fixedLiteral));
+        memcpy(distanceLengths, fixedDistance, sizeof(fixedDistance));
+    }
+    assignCodes(literalLengths, DEFLATE_LITERALS, literalCodes);
+    assignCodes(distanceLengths, DEFLATE_DISTANCES, distanceCodes);
+
+    for (int i = 0; i < stream->symbolCount; i++) {
+        const int length = stream->symbolLength[i];
+        const int value = stream->symbolValue[i];
+        if (length == 0) {
+            putCode(stream, literalCodes[value], literalLengths[value]);
+            continue;
+        }
+        int code = lengthCode(length);
+        putCode(stream, literalCodes[257 + code], literalLengths[257 + code]);
+        putBits(stream, length - lengthBase[code], lengthExtra[code]);
+        code = distanceCode(value);
+        putCode(stream, distanceCodes[code], distanceLengths[code]);
+        putBits(stream, value - distanceBase[code], distanceExtra[code]);
+    }
+    putCode(stream, literalCodes[256], literalLengths[256]);
+    stream->symbolCount = 0;
+}
+
+/* Queue a literal (length 0) or a match for the current block */
+static void putSymbol(DeflateStream *stream, int length, int value)
+{
+    stream->symbolLength[stream->symbolCount] = length;
+    stream->symbolValue[stream->symbolCount] = value;
+    if (++stream->symbolCount == DEFLATE_BLOCK_SYMBOLS)
+        flushBlock(stream, 0);
+}
+
+static inline unsigned hash3(const unsigned char *p)
+{
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (DEFLATE_HASH_SIZE - 1);
+}
+
+static inline void insertHash(DeflateStream *stream, int pos)
+{
+    unsigned h = hash3(stream->window + pos);
+    stream->prev[pos & (DEFLATE_WINDOW - 1)] = stream->head[h];
+    stream->head[h] = pos;
+}
+
+/* Encode the window up to `limit`; matches may look ahead to stream->fill */
+static void encodeWindow(DeflateStream *stream, int limit)
+{
+    const unsigned char *window = stream->window;
+
+    while (stream->pos < limit) {
+        const int pos = stream->pos;
+        const int available = stream->fill - pos;
+        int bestLength = 0, bestDistance = 0;
+
+        if (available >= DEFLATE_MIN_MATCH) {
+            const int maxLength = available < DEFLATE_MAX_MATCH ? available : DEFLATE_MAX_MATCH;
+            int candidate = stream->head[hash3(window + pos)];
+
+            for (int chain = stream->maxChain; candidate >= 0 && chain > 0; chain--) {
+                if (pos - candidate > DEFLATE_WINDOW - DEFLATE_MIN_LOOKAHEAD)
+                    break;
+                if (window[candidate + bestLength] == window[pos + bestLength]) {
+                    int length = 0;
+                    while (length < maxLength && window[candidate + length] == window[pos + length])
+                        length++;
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = pos - candidate;
+                        if (length == maxLength)
+                            break;
+                    }
+                }
+                candidate = stream->prev[candidate & (DEFLATE_WINDOW - 1)];
+            }
+        }
+
+        if (bestLength >= DEFLATE_MIN_MATCH) {
+            putSymbol(stream, bestLength, bestDistance);
+            for (int i = 0; i < bestLength; i++)
+                if (stream->fill - (pos + i) >= DEFLATE_MIN_MATCH)
+                    insertHash(stream, pos + i);
+            stream->pos += bestLength;
+        } else {
+            putSymbol(stream, 0, window[pos]);
+            if (available >= DEFLATE_MIN_MATCH)
+                insertHash(stream, pos);
+            stream->pos++;
+        }
+    }
+}
+
+/* Drop the older half of the window once everything before it is encoded */
+static void slideWindow(DeflateStream *stream)
+{
+    memmove(stream->window, stream->window + DEFLATE_WINDOW, DEFLATE_WINDOW);
+    stream->fill -= DEFLATE_WINDOW;
+    stream->pos -= DEFLATE_WINDOW;
+    for (int i = 0; i < DEFLATE_HASH_SIZE; i++)
+        stream->head[i] = stream->head[i] >= DEFLATE_WINDOW ? stream->head[i] - DEFLATE_WINDOW : -1;
+    for (int i = 0; i < DEFLATE_WINDOW; i++)
+        stream->prev[i] = stream->prev[i] >= DEFLATE_WINDOW ? stream->prev[i] - DEFLATE_WINDOW : -1;
+}
+
+/**
+ * Create a zlib stream encoder. `level` 1 (fastest) to 9 sets how far the
+ * match search goes. Returns NULL if out of memory.
+ */
+DeflateStream *DeflateCreate(int level)
+{
+    static const int chainLengths[10] = { 1, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+    DeflateStream *stream = (DeflateStream *)calloc(1, sizeof(DeflateStream));
+    if (!stream)
+        return NULL;
+
+    if (level < 1)
+        level = 1;
+    if (level > 9)
+        level = 9;
+    stream->maxChain = chainLengths[level];
+    stream->adler = 1;
+    for (int i = 0; i < DEFLATE_HASH_SIZE; i++)
+        stream->head[i] = -1;
+
+    // zlib header: deflate, 32K window, level hint
+    putByte(stream, 0x78);
+    putByte(stream, level == 1 ? 0x01 : level < 6 ? 0x5E : level == 6 ? 0x9C : 0xDA);
+    return stream;
+}
+
+/**
+ * Feed uncompressed bytes. Compressed output collects in stream->out;
+ * the caller drains it (DeflateTake) whenever it likes.
+ */
+int DeflateWrite(DeflateStream *stream, const unsigned char *data, size_t length)
+{
+    stream->adler = Adler32Update(stream->adler, data, length);
+
+    while (length > 0) {
+        size_t room = sizeof(stream->window) - stream->fill;
+        size_t chunk = length < room ? length : room;
+        memcpy(stream->window + stream->fill, data, chunk);
+        stream->fill += chunk;
+        data += chunk;
+        length -= chunk;
+
+        if (stream->fill == (int)sizeof(stream->window)) {
+            encodeWindow(stream, stream->fill - DEFLATE_MIN_LOOKAHEAD);
+            slideWindow(stream);
+        }
+    }
+    return stream->failed ? -1 : 0;
+}
+
+/**
+ * Encode everything still buffered and close the zlib stream.
+ */
+int DeflateFinish(DeflateStream *stream)
+{
+    encodeWindow(stream, stream->fill);
+    flushBlock(stream, 1);
+    if (stream->bitCount > 0)
+        putBits(stream, 0, 8 - stream->bitCount);
+
+    for (int shift = 24; shift >= 0; shift -= 8)
+        putByte(stream, (unsigned char)(stream->adler >> shift));
+    return stream->failed ? -1 : 0;
+}
+
+/* Hand over the compressed bytes produced so far */
+size_t DeflateTake(DeflateStream *stream, unsigned char **data)
+{
+    size_t length = stream->outLen;
+    *data = stream->out;
+    stream->outLen = 0;
+    return length;
+}
+
+void DeflateDestroy(DeflateStream *stream)
+{
+    if (stream)
+        free(stream->out);
+    free(stream);
+}
+
+/***********************
+ **
+ ** PNG writer
+ **
+ **********************/
+
+static void putBigEndian(unsigned char *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static int writeChunk(PngWriter *png, const char *type, const unsigned char *data, uint32_t length)
+{
+    unsigned char word[4];
+    putBigEndian(word, length);
+    fwrite(word, 1, 4, png->file);
+    fwrite(type, 1, 4, png->file);
+    if (length > 0)
+        fwrite(data, 1, length, png->file);
+
+    uint32_t crc = Crc32Update(0, (const unsigned char *)type, 4);
+    crc = Crc32Update(crc, data, length);
+    putBigEndian(word, crc);
+    fwrite(word, 1, 4, png->file);
+    png->bytesWritten += length + 12;
+    return ferror(png->file) ? -1 : 0;
+}
+
+/* Emit whatever the encoder has produced once it is worth a chunk */
+static int flushIdat(PngWriter *png, size_t threshold)
+{
+    if (png->deflate->outLen < threshold)
+        return 0;
+    unsigned char *data;
+    size_t length = DeflateTake(png->deflate, &data);
+    return length ? writeChunk(png, "IDAT", data, length) : 0;
+}
+
+/**
+ * Start a PNG: 8 bits per sample, `colourType` 0 (grey), 2 (RGB) or 3
+ * (palette, `paletteRgb` holds `paletteSize` R,G,B triples). Rows then go
+ * in top to bottom with PngWriteRow().
+ */
+int PngWriterBegin(PngWriter *png, FILE *file, int width, int height, int colourType,
+                   const unsigned char *paletteRgb, int paletteSize, int level)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    unsigned char ihdr[13];
+
+    memset(png, 0, sizeof(*png));
+    png->file = file;
+    png->bytesPerPixel = colourType == 2 ? 3 : 1;
+    png->rowBytes = width * png->bytesPerPixel;
+    png->adaptive = level >= 4;
+    png->deflate = DeflateCreate(level);
+    png->previous = (unsigned char *)calloc(png->rowBytes, 1);
+    png->filtered = (unsigned char *)malloc(png->rowBytes + 1);
+    png->trial = (unsigned char *)malloc(png->rowBytes + 1);
+    if (!png->deflate || !png->previous || !png->filtered || !png->trial) {
+        PngWriterFree(png);
+        return -1;
+    }
+
+    putBigEndian(ihdr, width);
+    putBigEndian(ihdr + 4, height);
+    ihdr[8] = 8;            // bit depth
+    ihdr[9] = colourType;
+    ihdr[10] = 0;           // deflate
+    ihdr[11] = 0;           // adaptive filtering
+    ihdr[12] = 0;           // no interlace
+
+    fwrite(signature, 1, 8, file);
+    png->bytesWritten = 8;
+    if (writeChunk(png, "IHDR", ihdr, sizeof(ihdr)) != 0)
+        return -1;
+    if (colourType == 3 && writeChunk(png, "PLTE", paletteRgb, paletteSize * 3) != 0)
+        return -1;
+    return 0;
+}
+
+static inline unsigned char paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+/* Apply PNG filter `type` to `row` into out[0..rowBytes] (out[0] = type) */
+static long filterRow(const PngWriter *png, int type, const unsigned char *row, unsigned char *out)
+{
+    const unsigned char *up = png->previous;
+    const int bpp = png->bytesPerPixel;
+    long cost = 0;
+
+    out[0] = type;
+    for (int i = 0; i < png->rowBytes; i++) {
+        int left = i >= bpp ? row[i - bpp] : 0;
+        int upLeft = i >= bpp ? up[i - bpp] : 0;
+        unsigned char value;
+        switch (type) {
+            case 1:  value = row[i] - left; break;
+            case 2:  value = row[i] - up[i]; break;
+            case 3:  value = row[i] - ((left + up[i]) >> 1); break;
+            case 4:  value = row[i] - paeth(left, up[i], upLeft); break;
+            default: value = row[i]; break;
+        }
+        out[i + 1] = value;
+        cost += (signed char)value < 0 ? -(signed char)value : value;
+    }
+    return cost;
+}
+
+/**
+ * Filter and compress one row of samples in PNG order (R,G,B or index).
+ */
+int PngWriteRow(PngWriter *png, const unsigned char *row)
+{
+    if (!png->adaptive) {
+        // The Up filter turns the uniform background of an edge map into zeros
+        filterRow(png, 2, row, png->filtered);
+    } else {
+        // Smallest sum of absolute differences, the usual libpng heuristic
+        long best = filterRow(png, 0, row, png->filtered);
+        for (int type = 1; type <= 4; type++) {
+            long cost = filterRow(png, type, row, png->trial);
+            if (cost < best) {
+                unsigned char *swap = png->filtered;
+                png->filtered = png->trial;
+                png->trial = swap;
+                best = cost;
+            }
+        }
+    }
+
+    memcpy(png->previous, row, png->rowBytes);
+    if (DeflateWrite(png->deflate, png->filtered, png->rowBytes + 1) != 0)
+        return -1;
+    return flushIdat(png, 65536);
+}
+
+/**
+ * Flush the image data and write IEND. Returns 0 on success.
+ */
+int PngWriterEnd(PngWriter *png)
+{
+    int status = DeflateFinish(png->deflate);
+    if (status == 0)
+        status = flushIdat(png, 1);
+    if (status == 0)
+        status = writeChunk(png, "IEND", NULL, 0);
+    PngWriterFree(png);
+    return status;
+}
+
+void PngWriterFree(PngWriter *png)
+{
+    DeflateDestroy(png->deflate);
+    free(png->previous);
+    free(png->filtered);
+    free(png->trial);
+    png->deflate = NULL;
+    png->previous = png->filtered = png->trial = NULL;
+}
+
+/***********************
+ **
+ ** BI_RLE8 encoder
+ **
+ **********************/
+
+/**
+ * Encode one 8-bit row as BI_RLE8, ending with an end-of-line marker (the
+ * caller replaces the last one with end-of-bitmap). `out` needs room for
+ * RLE8_MAX_ROW_BYTES(width) bytes. Returns the encoded length.
+ */
+int Rle8EncodeRow(const unsigned char *row, int width, unsigned char *out)
+{
+    unsigned char *p = out;
+    int x = 0;
+
+    while (x < width) {
+        int run = 1;
+        while (x + run < width && run < 255 && row[x + run] == row[x])
+            run++;
+
+        if (run >= 3 || x + run == width) {
+            *p++ = run;
+            *p++ = row[x];
+            x += run;
+            continue;
+        }
+
+        // Literal stretch up to the next run of three
+        int end = x;
+        while (end < width && end - x < 255 &&
+               !(end + 2 < width && row[end] == row[end + 1] && row[end] == row[end + 2]))
+            end++;
+        int count = end - x;
+
+        if (count < 3) {
+            // Absolute mode needs at least three pixels; use short runs
+            for (int k = 0; k < count; k++) {
+                *p++ = 1;
+                *p++ = row[x + k];
+            }
+        } else {
+            *p++ = 0;
+            *p++ = count;
+            memcpy(p, row + x, count);
+            p += count;
+            if (count & 1)
+                *p++ = 0;   // pad to a 16-bit boundary
+        }
+        x = end;
+    }
+
+    *p++ = 0;
+    *p++ = 0;   // end of line
+    return (int)(p - out);
+}
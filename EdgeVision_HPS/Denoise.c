@@ -0,0 +1,184 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Denoise pre-stage
+ **
+ ** Sensor noise turns into speckle in the gradient, so a 3x3 Gaussian
+ ** (1-2-1 in both directions) or median can run ahead of the operator. It
+ ** is fused into the gradient pass instead of writing a filtered copy of the
+ ** frame: each output row y needs the filtered rows y-1..y+1, which come
+ ** from the input rows y-2..y+2, and only those three filtered rows are
+ ** kept. They sit in a ring of row buffers that holds every row twice (slot
+ ** k and k+3), so the three rows around any y are contiguous and the
+ ** unchanged gradient kernels run on the ring with a height of three.
+ **
+ ** The interior loops have no branches and work on bytes, so the compiler
+ ** vectorizes them (the median is a min/max sorting network). Outside the
+ ** image the filter reads pixels mapped by the border mode, replicate for
+ ** BORDER_SKIP, like the gradient frame in SobelKernels.c.
+ **
+ **********************/
+
+#define RING_ROWS  3
+
+static const char *denoiseNames[DENOISE_COUNT] = { "none", "gaussian", "median" };
+
+const char *SobelDenoiseName(SobelDenoise denoise)
+{
+    if (denoise < 0 || denoise >= DENOISE_COUNT)
+        return "unknown";
+    return denoiseNames[denoise];
+}
+
+/**
+ * Parse "none", "gaussian" or "median". Returns 0 on success, -1 if the
+ * name is unknown.
+ */
+int ParseSobelDenoise(const char *text, SobelDenoise *denoise)
+{
+    for (int i = 0; i < DENOISE_COUNT; i++) {
+        if (strcmp(text, denoiseNames[i]) == 0) {
+            *denoise = (SobelDenoise)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#define SORT2(a, b) { const unsigned char lo = a < b ? a : b; b = a < b ? b : a; a = lo; }
+
+// Median of nine by the 19 compare-exchange network of Paeth
+static inline __attribute__((always_inline))
+unsigned char median9(unsigned char p0, unsigned char p1, unsigned char p2, unsigned char p3, unsigned char p4,
+                      unsigned char p5, unsigned char p6, unsigned char p7, unsigned char p8)
+{
+    SORT2(p1, p2); SORT2(p4, p5); SORT2(p7, p8);
+    SORT2(p0, p1); SORT2(p3, p4); SORT2(p6, p7);
+    SORT2(p1, p2); SORT2(p4, p5); SORT2(p7, p8);
+    SORT2(p0, p3); SORT2(p5, p8); SORT2(p4, p7);
+    SORT2(p3, p6); SORT2(p1, p4); SORT2(p2, p5);
+    SORT2(p4, p7); SORT2(p4, p2); SORT2(p6, p4);
+    SORT2(p4, p2);
+    return p4;
+}
+
+static inline __attribute__((always_inline))
+unsigned char gaussian9(int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7, int p8)
+{
+    return (unsigned char)((p0 + 2 * p1 + p2 + 2 * (p3 + 2 * p4 + p5) + p6 + 2 * p7 + p8 + 8) >> 4);
+}
+
+// Filtered bytes [m0,m1) of a row whose neighbours are all inside up/mid/down
+static void denoiseSpan(const unsigned char *restrict up, const unsigned char *restrict mid,
+                        const unsigned char *restrict down, unsigned char *restrict out, int m0, int m1,
+                        int bpp, SobelDenoise denoise)
+{
+    if (denoise == DENOISE_MEDIAN) {
+        for (int m = m0; m < m1; m++)
+            out[m] = median9(up[m - bpp], up[m], up[m + bpp], mid[m - bpp], mid[m], mid[m + bpp],
+                             down[m - bpp], down[m], down[m + bpp]);
+    } else {
+        for (int m = m0; m < m1; m++)
+            out[m] = gaussian9(up[m - bpp], up[m], up[m + bpp], mid[m - bpp], mid[m], mid[m + bpp],
+                               down[m - bpp], down[m], down[m + bpp]);
+    }
+}
+
+// Filtered pixel x, with columns outside the row mapped under `border`
+static void denoiseEdgePixel(const unsigned char *rows[3], unsigned char *out, int width, int bpp, int x,
+                             SobelDenoise denoise, SobelBorder border, int value)
+{
+    int columns[3];
+    for (int k = 0; k < 3; k++) {
+        const int column = SobelBorderIndex(x - 1 + k, width, border);
+        columns[k] = column < 0 ? -1 : column * bpp;
+    }
+    for (int channel = 0; channel < bpp; channel++) {
+        unsigned char p[9];
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 3; c++)
+                p[r * 3 + c] = columns[c] >= 0 ? rows[r][columns[c] + channel] : (unsigned char)value;
+        out[x * bpp + channel] = denoise == DENOISE_MEDIAN
+            ? median9(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8])
+            : gaussian9(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+    }
+}
+
+// Filtered row `y` (-1 .. height) of the input into `out`; `constant` is a row of the border value
+static void denoiseRow(const unsigned char *input, int stride, int width, int height, int bpp, int y,
+                       SobelDenoise denoise, SobelBorder border, const unsigned char *constant, unsigned char *out)
+{
+    y = SobelBorderIndex(y, height, border);
+    if (y < 0) {
+        memcpy(out, constant, stride);   // the filter of a constant is the constant
+        return;
+    }
+
+    const unsigned char *rows[3];
+    for (int k = 0; k < 3; k++) {
+        const int row = SobelBorderIndex(y - 1 + k, height, border);
+        rows[k] = row < 0 ? constant : input + (size_t)row * stride;
+    }
+    denoiseSpan(rows[0], rows[1], rows[2], out, bpp, stride - bpp, bpp, denoise);
+    denoiseEdgePixel(rows, out, width, bpp, 0, denoise, border, constant[0]);
+    if (width > 1)
+        denoiseEdgePixel(rows, out, width, bpp, width - 1, denoise, border, constant[0]);
+}
+
+/**
+ * SobelRows() on the input filtered by `denoise`, for rows [y0,y1) of
+ * `output`, which the caller has cleared. Returns 0 on success, -1 if the
+ * row ring cannot be allocated.
+ */
+int SobelDenoisedRows(const unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel,
+                      SobelOperator op, KernelVariant variant, SobelDenoise denoise, int y0, int y1,
+                      SobelBorder border, int borderValue, SobelStats *stats)
+{
+    const int stride = width * bytesPerPixel;
+    const SobelBorder filterBorder = border == BORDER_SKIP ? BORDER_REPLICATE : border;
+    if (y0 >= y1)
+        return 0;
+
+    // Two copies of the ring, then one row of the border value
+    unsigned char *ring = (unsigned char *)malloc((size_t)(2 * RING_ROWS + 1) * stride);
+    if (!ring)
+        return -1;
+    unsigned char *constant = ring + (size_t)2 * RING_ROWS * stride;
+    memset(constant, borderValue, stride);
+
+    SobelKernelFn kernel = NULL;
+    SobelStatsKernelFn statsKernel = NULL;
+    if (stats)
+        statsKernel = variant == VARIANT_GENERIC ? SelectGenericSobelStatsKernel(op)
+                                                 : SelectSobelStatsKernel(op, bytesPerPixel);
+    else
+        kernel = variant == VARIANT_GENERIC ? SelectGenericSobelKernel(op) : SelectSobelKernel(op, bytesPerPixel);
+
+    // Filtered row r lives in slots r mod 3 and r mod 3 + 3
+    for (int r = y0 - 1; r <= y1; r++) {
+        const int slot = (r % RING_ROWS + RING_ROWS) % RING_ROWS;
+        unsigned char *row = ring + (size_t)slot * stride;
+        denoiseRow(input, stride, width, height, bytesPerPixel, r, denoise, filterBorder, constant, row);
+        memcpy(row + (size_t)RING_ROWS * stride, row, stride);
+        if (r < y0 + 1)
+            continue;
+
+        // Rows y-1..y+1 of the filtered frame are now rows 0..2 of `window`
+        const int y = r - 1;
+        if (border == BORDER_SKIP && (y == 0 || y == height - 1))
+            continue;
+        const unsigned char *window = ring + (size_t)((y - 1) % RING_ROWS + RING_ROWS) % RING_ROWS * stride;
+        unsigned char *out = output + (size_t)y * stride - stride;
+        if (stats)
+            statsKernel(window, stride, out, stride, width, RING_ROWS, bytesPerPixel, 0, 1, width, 2, stats);
+        else
+            kernel(window, stride, out, stride, width, RING_ROWS, bytesPerPixel, 0, 1, width, 2);
+        if (border != BORDER_SKIP)
+            SobelBorderPixels(window, stride, out, stride, width, RING_ROWS, bytesPerPixel, op, border,
+                              borderValue, 0, 1, width, 2, stats);
+    }
+
+    free(ring);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Edge statistics
+ **
+ ** The stats kernels fill a SobelStats with a histogram of the clamped
+ ** gradient magnitude as they compute. Everything here works from that
+ ** histogram alone: thresholds (Otsu or a percentile), mean gradient and
+ ** edge density, the JSON sidecar, and the binarized output, which is a
+ ** 256-entry table lookup over the finished edge map.
+ **
+ **********************/
+
+void SobelStatsMerge(SobelStats *into, const SobelStats *from)
+{
+    for (int i = 0; i < STATS_BINS; i++)
+        into->histogram[i] += from->histogram[i];
+    into->samples += from->samples;
+}
+
+/**
+ * Smallest magnitude that at least `percentile` % of the samples do not exceed.
+ */
+int SobelStatsPercentile(const SobelStats *stats, int percentile)
+{
+    const uint64_t target = (stats->samples * (uint64_t)percentile + 99) / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < STATS_BINS; i++) {
+        count += stats->histogram[i];
+        if (count >= target && count > 0)
+            return i;
+    }
+    return STATS_BINS - 1;
+}
+
+/**
+ * Otsu's threshold: the magnitude that splits the histogram into the two
+ * classes with the largest between-class variance. Samples above it are edges.
+ */
+int SobelStatsOtsu(const SobelStats *stats)
+{
+    double sumAll = 0;
+    for (int i = 0; i < STATS_BINS; i++)
+        sumAll += (double)i * stats->histogram[i];
+
+    double weightLow = 0, sumLow = 0, best = -1;
+    int threshold = 0;
+    for (int i = 0; i < STATS_BINS; i++) {
+        weightLow += stats->histogram[i];
+        if (weightLow == 0)
+            continue;
+        const double weightHigh = (double)stats->samples - weightLow;
+        if (weightHigh <= 0)
+            break;
+        sumLow += (double)i * stats->histogram[i];
+
+        const double meanLow = sumLow / weightLow;
+        const double meanHigh = (sumAll - sumLow) / weightHigh;
+        const double between = weightLow * weightHigh * (meanLow - meanHigh) * (meanLow - meanHigh);
+        if (between > best) {
+            best = between;
+            threshold = i;
+        }
+    }
+    return threshold;
+}
+
+/**
+ * Threshold for `mode`. THRESHOLD_NONE gives the Otsu threshold, which is
+ * what the edge density is reported at.
+ */
+int SobelStatsThreshold(const SobelStats *stats, ThresholdMode mode, int percentile)
+{
+    if (mode == THRESHOLD_PERCENTILE)
+        return SobelStatsPercentile(stats, percentile);
+    return SobelStatsOtsu(stats);
+}
+
+// Mean clamped L1 magnitude per sample, i.e. of the inverted edge map
+double SobelStatsMean(const SobelStats *stats)
+{
+    double sum = 0;
+    for (int i = 0; i < STATS_BINS; i++)
+        sum += (double)i * stats->histogram[i];
+    return stats->samples ? sum / stats->samples : 0.0;
+}
+
+// Fraction of samples whose magnitude is above `threshold`
+double SobelStatsDensity(const SobelStats *stats, int threshold)
+{
+    uint64_t edges = 0;
+    for (int i = threshold + 1; i < STATS_BINS; i++)
+        edges += stats->histogram[i];
+    return stats->samples ? (double)edges / stats->samples : 0.0;
+}
+
+/**
+ * Binarize an inverted edge map in place: samples with a magnitude above
+ * `threshold` become 0, everything else 255 (the convention of the Canny
+ * output). A frame left out with BORDER_SKIP is not an edge, so it is 255.
+ */
+void SobelApplyThreshold(unsigned char *output, int stride, int width, int height, int bytesPerPixel,
+                         int threshold, SobelBorder border)
+{
+    unsigned char table[STATS_BINS];
+    for (int value = 0; value < STATS_BINS; value++)
+        table[value] = 255 - value > threshold ? 0 : 255;
+
+    const int skipFrame = border == BORDER_SKIP;
+    const int rowBytes = width * bytesPerPixel;
+    for (int row = 0; row < height; row++) {
+        unsigned char *out = output + (size_t)row * stride;
+        if (skipFrame && (row == 0 || row == height - 1 || width < 3)) {
+            memset(out, 255, rowBytes);
+            continue;
+        }
+        for (int i = 0; i < rowBytes; i++)
+            out[i] = table[out[i]];
+        if (skipFrame) {
+            memset(out, 255, bytesPerPixel);
+            memset(out + rowBytes - bytesPerPixel, 255, bytesPerPixel);
+        }
+    }
+}
+
+/**
+ * Parse "otsu" or "pN" (N = 1..99, the percentile of the magnitude above
+ * which samples are edges). Returns 0 on success, -1 on failure.
+ */
+int ParseThreshold(const char *text, ThresholdMode *mode, int *percentile)
+{
+    char tail;
+    if (strcmp(text, "otsu") == 0) {
+        *mode = THRESHOLD_OTSU;
+        return 0;
+    }
+    if (sscanf(text, "p%d%c", percentile, &tail) == 1 && *percentile >= 1 && *percentile <= 99) {
+        *mode = THRESHOLD_PERCENTILE;
+        return 0;
+    }
+    return -1;
+}
+
+// Control characters are written as \u00XX, so every name keeps its own key
+static void writeJsonString(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text; text++) {
+        if ((unsigned char)*text < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*text);
+            continue;
+        }
+        if (*text == '"' || *text == '\\')
+            fputc('\\', file);
+        fputc(*text, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * Write the statistics of one frame as a JSON object to `path`.
+ * Returns 0 on success, -1 on failure.
+ */
+int SobelStatsWriteJson(const char *path, const char *name, int width, int height, int bytesPerPixel,
+                        SobelOperator op, const SobelStats *stats, ThresholdMode mode, int percentile)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    const int threshold = SobelStatsThreshold(stats, mode, percentile);
+    const char *modeName = mode == THRESHOLD_PERCENTILE ? "percentile" : "otsu";
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"image\": ");
+    writeJsonString(file, name);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n  \"channels\": %d,\n", width, height, bytesPerPixel);
+    fprintf(file, "  \"operator\": \"%s\",\n", SobelOperatorName(op));
+    fprintf(file, "  \"samples\": %llu,\n", (unsigned long long)stats->samples);
+    fprintf(file, "  \"mean_gradient\": %.3f,\n", SobelStatsMean(stats));
+    fprintf(file, "  \"otsu_threshold\": %d,\n", SobelStatsOtsu(stats));
+    fprintf(file, "  \"percentiles\": { \"p50\": %d, \"p90\": %d, \"p99\": %d },\n",
+            SobelStatsPercentile(stats, 50), SobelStatsPercentile(stats, 90), SobelStatsPercentile(stats, 99));
+    if (mode == THRESHOLD_PERCENTILE)
+        fprintf(file, "  \"threshold\": { \"mode\": \"%s\", \"percentile\": %d, \"value\": %d },\n",
+                modeName, percentile, threshold);
+    else
+        fprintf(file, "  \"threshold\": { \"mode\": \"%s\", \"value\": %d },\n", modeName, threshold);
+    fprintf(file, "  \"edge_density\": %.6f,\n", SobelStatsDensity(stats, threshold));
+    fprintf(file, "  \"histogram\": [");
+    for (int i = 0; i < STATS_BINS; i++)
+        fprintf(file, "%s%llu", i == 0 ? "" : (i % 16 == 0 ? ",\n    " : ", "),
+                (unsigned long long)stats->histogram[i]);
+    fprintf(file, "]\n}\n");
+
+    return fclose(file) == 0 ? 0 : -1;
+}
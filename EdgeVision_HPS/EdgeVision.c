@@ -1,63 +1,64 @@
 #include "EdgeVision.h"
 
 /* Global variables */
-unsigned char input_row[SIZE_BUFFER];
-unsigned char output_row;
-unsigned char line_buffer[SIZE_BUFFER][SIZE_BUFFER];
+unsigned char biColourPalette[1024];
 
 
 
 void Sobel(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel) 
+{
+    SobelWithOperator(input, output, width, height, bytesPerPixel, OP_Sobel);
+}
+
+void SobelWithOperator(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel, SobelOperator op)
 {
     // Input validation
     if (!input || !output || width <= 0 || height <= 0 || bytesPerPixel <= 0) {
         return;
     }
 
-    int Gx[3][3] = {{1, 0, -1},
-                    {2, 0, -2},
-                    {1, 0, -1}};
-
-    int Gy[3][3] = {{1, 2, 1},
-                    {0, 0, 0},
-                    {-1, -2, -1}};
-                    
     // Clear output buffer first
     memset(output, 0, width * height * bytesPerPixel);
 
-    for (int row = 1; row < height - 1; row++) 
-    {
-        for (int col = 1; col < width - 1; col++) 
-        {
-            for (int channel = 0; channel < bytesPerPixel; channel++) 
-            {
-                int sumX = 0, sumY = 0;
-                
-                // Calculate index for current pixel's center position
-                const int centerIdx = (row * width * bytesPerPixel) + (col * bytesPerPixel) + channel;
-
-                for (int i = -1; i <= 1; i++) 
-                {
-                    for (int j = -1; j <= 1; j++) 
-                    {
-                        const int idx = ((row + i) * width * bytesPerPixel) + ((col + j) * bytesPerPixel) + channel;
-                        
-                        // Bounds check
-                        if (idx >= 0 && idx < (width * height * bytesPerPixel)) 
-                        {
-                            sumX += input[idx] * Gx[i + 1][j + 1];
-                            sumY += input[idx] * Gy[i + 1][j + 1];
-                        }
-                    }
-                }
-
-                int magnitude = abs(sumX) + abs(sumY);
-                if (magnitude > 255) magnitude = 255;
-                
-                output[centerIdx] = (255 - (unsigned char)magnitude);
-            }
+    SobelKernelFn kernel = SelectSobelKernel(op, bytesPerPixel);
+    kernel(input, width * bytesPerPixel, output, width * bytesPerPixel,
+           width, height, bytesPerPixel, 0, 0, width, height);
+}
+
+/* Rows [y0,y1) of SobelWithOperator(), for output that is written as it is computed,
+   with the frame pixels among them computed under `border`. With `stats` the
+   magnitudes of the rows are also added to it. `denoise` filters the input
+   on the fly before the gradient (Denoise.c). Returns 0 on success, -1 if
+   the filter cannot allocate its rows. */
+int SobelRows(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel,
+              SobelOperator op, KernelVariant variant, SobelDenoise denoise, int y0, int y1, SobelBorder border,
+              int borderValue, SobelStats *stats)
+{
+    const int stride = width * bytesPerPixel;
+    memset(output + (size_t)y0 * stride, 0, (size_t)(y1 - y0) * stride);
+
+    if (denoise != DENOISE_NONE) {
+        if (SobelDenoisedRows(input, output, width, height, bytesPerPixel, op, variant, denoise, y0, y1, border,
+                              borderValue, stats) != 0) {
+            fprintf(stderr, "Out of memory for the %s filter on rows %d-%d\n", SobelDenoiseName(denoise), y0, y1);
+            return -1;
         }
+        return 0;
+    }
+
+    if (stats) {
+        SobelStatsKernelFn kernel = variant == VARIANT_GENERIC ? SelectGenericSobelStatsKernel(op)
+                                                               : SelectSobelStatsKernel(op, bytesPerPixel);
+        kernel(input, stride, output, stride, width, height, bytesPerPixel, 0, y0, width, y1, stats);
+    } else {
+        SobelKernelFn kernel = variant == VARIANT_GENERIC ? SelectGenericSobelKernel(op)
+                                                          : SelectSobelKernel(op, bytesPerPixel);
+        kernel(input, stride, output, stride, width, height, bytesPerPixel, 0, y0, width, y1);
     }
+    if (border != BORDER_SKIP)
+        SobelBorderPixels(input, stride, output, stride, width, height, bytesPerPixel, op, border, borderValue,
+                          0, y0, width, y1, stats);
+    return 0;
 }
 
 /***********************
@@ -67,35 +68,46 @@ void Sobel(unsigned char *input, unsigned char *output, int width, int height, i
  **********************/
 unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader)
 {
-
-   /* Variables declaration */
     FILE *filePtr;               // out file pointer
     unsigned char *bitmapImage;  // store image data
-    size_t bytesRead;
-    
+
     //open filename in read binary mode
     filePtr = fopen(filename,"rb");
     if (filePtr == NULL)
         return NULL;
+
+    bitmapImage = LoadBitmapStream(filePtr, bitmapInfoHeader, bitmapFileHeader);
+    fclose(filePtr);
+    return bitmapImage;
+}
+
+/***********************
+ **
+ ** Load a BMP from an open stream positioned at its first byte; the
+ ** stream must be seekable and the BMP must start at offset 0
+ **
+ **********************/
+unsigned char *LoadBitmapStream(FILE *filePtr, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader)
+{
+
+   /* Variables declaration */
+    unsigned char *bitmapImage;  // store image data
+    BmpReader reader;
    
     //read the bitmap file header
-    bytesRead = fread(bitmapFileHeader, sizeof(BITMAPFILEHEADER),1,filePtr);
+    if (fread(bitmapFileHeader, sizeof(BITMAPFILEHEADER),1,filePtr) != 1)
+        return NULL;
     
     printf("%c bitmap identifies\n",bitmapFileHeader->bfType);
     printf("%d bitmap identifies the size of image\n",bitmapFileHeader->bfSize);
    
     //verify that this is a bmp file by check bitmap id
     if (bitmapFileHeader->bfType !=0x4D42)
-    {
-        fclose(filePtr);
         return NULL;
-    }
 
     //read the bitmap info header
-    bytesRead = fread(bitmapInfoHeader, sizeof(BITMAPINFOHEADER),1,filePtr);
-
-    //read colour palette
-    bytesRead = fread(&biColourPalette,1,bitmapInfoHeader->biClrUsed*4,filePtr);
+    if (fread(bitmapInfoHeader, sizeof(BITMAPINFOHEADER),1,filePtr) != 1)
+        return NULL;
 
     printf("\nIMAGE DETAILS:\n");
     printf("--------------");
@@ -110,8 +122,9 @@ unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader
     printf("\nThe Bit Offset : %d",bitmapFileHeader->bfOffBits);
     printf("\nBytes per pixel : %d ",bitmapInfoHeader->biBitCount/8);
 
-    //move file point to the begging of bitmap data
-    fseek(filePtr, bitmapFileHeader->bfOffBits, SEEK_SET);
+    //read masks and colour palette; the header now describes the decoded image
+    if (BmpReaderOpen(&reader, filePtr, bitmapFileHeader, bitmapInfoHeader) != 0)
+        return NULL;
 
       //allocate enough memory for the bitmap image data
     bitmapImage = (unsigned char*)malloc(bitmapInfoHeader->biSizeImage);
@@ -119,24 +132,26 @@ unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader
       //verify memory allocation
     if (!bitmapImage)
     {
-        free(bitmapImage);
-        fclose(filePtr);
+        BmpReaderClose(&reader);
         return NULL;
     }
 
-    //read in the bitmap image data
-    bytesRead = fread(bitmapImage,1, bitmapInfoHeader->biSizeImage,filePtr);
-    printf("\nLOG: bytesRead :  %d\n", (int)bytesRead);
-
-    //make sure bitmap image data was read
-    if (bitmapImage == NULL)
-	{
-        printf("Data could not be read");
-        fclose(filePtr);
-        return NULL;
-	}
+    //decode rows straight into place: padding stripped, top-down flipped
+    const int stride = reader.width * reader.outBytesPerPixel;
+    for (int row = 0; row < reader.height; row++)
+    {
+        int y = BmpNextRow(&reader);
+        if (BmpReadRow(&reader, bitmapImage + (size_t)y * stride) < 0)
+        {
+            printf("Data could not be read");
+            free(bitmapImage);
+            BmpReaderClose(&reader);
+            return NULL;
+        }
+    }
+    printf("\nLOG: decoded %d rows\n", reader.height);
 
-    fclose(filePtr);
+    BmpReaderClose(&reader);
     return bitmapImage;
 }
 
@@ -146,8 +161,24 @@ void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER
         return;
     }
 
-    FILE *filePtr;
-    
+    // Open the file
+    FILE *filePtr = fopen(filename, "wb");
+    if (!filePtr) {
+        perror("Error opening output BMP file");
+        return;
+    }
+
+    SaveBitmapStream(filePtr, bitmapData, bitmapInfoHeader, bitmapFileHeader);
+    fclose(filePtr);
+}
+
+/***********************
+ **
+ ** Write a BMP (headers, palette, padded rows) to an open stream
+ **
+ **********************/
+int SaveBitmapStream(FILE *filePtr, unsigned char *bitmapData, BITMAPINFOHEADER *bitmapInfoHeader, BITMAPFILEHEADER *bitmapFileHeader)
+{
     // Calculate the correct bytes per line including padding
     int bytesperline = bitmapInfoHeader->biWidth * (bitmapInfoHeader->biBitCount/8);
     if (bytesperline % 4 != 0) {
@@ -169,13 +200,6 @@ void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER
     // Update info header
     bitmapInfoHeader->biSizeImage = imageSize;
 
-    // Open the file
-    filePtr = fopen(filename, "wb");
-    if (!filePtr) {
-        perror("Error opening output BMP file");
-        return;
-    }
-
     // Write headers
     fwrite(bitmapFileHeader, sizeof(BITMAPFILEHEADER), 1, filePtr);
     fwrite(bitmapInfoHeader, sizeof(BITMAPINFOHEADER), 1, filePtr);
@@ -199,8 +223,7 @@ void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER
     // Allocate buffer for a single line including padding
     unsigned char *lineBuffer = (unsigned char *)calloc(bytesperline, 1);
     if (!lineBuffer) {
-        fclose(filePtr);
-        return;
+        return -1;
     }
 
     // Write image data line by line
@@ -223,7 +246,7 @@ void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER
 
     // Clean up
     free(lineBuffer);
-    fclose(filePtr);
+    return ferror(filePtr) ? -1 : 0;
 }
 
 int createDirectory(const char *path) {
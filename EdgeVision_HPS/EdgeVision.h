@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/stat.h>
@@ -12,55 +13,530 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/file.h>
 #include "hps_0.h"  // Include the hps_0.h header
+// Altera hardware library; only the board build (SOBEL_HWLIB) needs it
+#ifdef SOBEL_HWLIB
 #include "hwlib.h"
 #include "socal/socal.h"
 #include "socal/hps.h"
 #include "socal/alt_gpio.h"
+#endif
 
-unsigned char biColourPalette[1024];
-
-typedef int LONG;
-typedef unsigned short WORD;
-typedef unsigned int DWORD;
-typedef char BYTE;
-
-#pragma pack(push,1)
-typedef struct {
-  WORD  bfType;                       // The type of the image
- 
-  DWORD bfSize;                       //size of the file
-  WORD  bfReserved;                 // reserved type
-  WORD  bfReserved2;               
-  DWORD bfOffBits;                   //offset bytes from the file header to the image data
-} BITMAPFILEHEADER, *PBITMAPFILEHEADER;
-#pragma pack(pop)
-
-#pragma pack(push,1)
-typedef struct tagBITMAPINFOHEADER {
-  DWORD biSize;                   //the size of the header
-  LONG  biWidth;                 //the width in pixels
-  LONG  biHeight;                //the height in pixels
-  WORD  biPlanes;                //the no. of planes in the bitmap
-  WORD  biBitCount;              //bits per pixel
-  DWORD biCompression;           //compression specifications
-  DWORD biSizeImage;            //size of the bitmap data
-  LONG  biXPelsPerMeter;        //horizontal res(pixels per meter)
-  LONG  biYPelsPerMeter;        //vertical res(pixels per meter) 
-  DWORD biClrUsed;              //colours used in the image
-  DWORD biClrImportant;        //num of important colours used
-} BITMAPINFOHEADER, *PBITMAPINFOHEADER;
-#pragma pack(pop)
-
+#include "BmpDecode.h"
 
 #define SIZE_BUFFER 3
 
+#define CANNY_DEFAULT_LOW   60
+#define CANNY_DEFAULT_HIGH  160
+
+// Gradient operators available to the kernel generator.
+// Each entry is X(name, corner weight, centre weight): the horizontal kernel
+// is {{A,0,-A},{B,0,-B},{A,0,-A}} and the vertical kernel is its transpose.
+#define SOBEL_OPERATORS(X) \
+    X(Sobel,   1,  2)       \
+    X(Scharr,  3, 10)       \
+    X(Prewitt, 1,  1)
+
+#define SOBEL_OPERATOR_ENUM(name, a, b) OP_##name,
+typedef enum { SOBEL_OPERATORS(SOBEL_OPERATOR_ENUM) OP_COUNT } SobelOperator;
+
+// Kernel variant signature. Processes the interior pixels of the rectangle
+// [x0,x1) x [y0,y1) (clipped to exclude the one pixel frame); strides are in bytes.
+typedef void (*SobelKernelFn)(const unsigned char *input, int inStride,
+                              unsigned char *output, int outStride,
+                              int width, int height, int bytesPerPixel,
+                              int x0, int y0, int x1, int y1);
+
+// How the one pixel frame, which has no full 3x3 neighbourhood, is computed.
+// The FPGA window logic (Sobel_Window.v) implements the same modes.
+typedef enum {
+    BORDER_SKIP,            // not computed, left at 0
+    BORDER_REPLICATE,       // outside pixels repeat the edge pixel:  aa|abcd
+    BORDER_REFLECT101,      // outside pixels mirror about the edge:   b|abcd
+    BORDER_CONSTANT,        // outside pixels have a fixed value
+    BORDER_COUNT
+} SobelBorder;
+
+// Pixel index standing in for `i` (-1 .. n) under `border`; -1 means the constant
+static inline int SobelBorderIndex(int i, int n, SobelBorder border)
+{
+    if (i >= 0 && i < n)
+        return i;
+    if (border == BORDER_CONSTANT)
+        return -1;
+    if (border == BORDER_REFLECT101 && n > 1)
+        return i < 0 ? 1 : n - 2;
+    return i < 0 ? 0 : n - 1;
+}
+
+// Optional 3x3 filter ahead of the gradient (Denoise.c). The FPGA window
+// logic (Sobel_Window.v) has the Gaussian as well.
+typedef enum { DENOISE_NONE, DENOISE_GAUSSIAN, DENOISE_MEDIAN, DENOISE_COUNT } SobelDenoise;
+
+#define STATS_BINS  256
+
+// Gradient statistics gathered by the stats kernels while they compute
+typedef struct {
+    uint64_t histogram[STATS_BINS];  // samples per clamped L1 magnitude (255 - output)
+    uint64_t samples;                // computed samples (the interior, plus the frame unless skipped)
+} SobelStats;
+
+// Same as SobelKernelFn, adding every computed sample to `stats`
+typedef void (*SobelStatsKernelFn)(const unsigned char *input, int inStride,
+                                   unsigned char *output, int outStride,
+                                   int width, int height, int bytesPerPixel,
+                                   int x0, int y0, int x1, int y1, SobelStats *stats);
+
+// Automatic binarization of the gradient (EdgeStats.c)
+typedef enum { THRESHOLD_NONE, THRESHOLD_OTSU, THRESHOLD_PERCENTILE } ThresholdMode;
+
+#define ROI_MAX  64
+
+// Region of interest in image coordinates: x right, y down from the top-left
+typedef struct {
+    int x, y, width, height;
+} SobelRect;
+
+#define DELTA_DEFAULT_TILE  32
+
+// Previous frame and edge map kept by the temporal delta mode
+typedef struct {
+    unsigned char *prevInput;
+    unsigned char *output;
+    int width, height, bytesPerPixel;
+    SobelOperator op;
+    int tileSize;
+    long tilesTotal, tilesSkipped;   // counts for the most recent frame
+} DeltaState;
+
+#define TILED_MAGIC         "EVTILE1"
+#define TILED_DEFAULT_TILE  512
+#define TILED_MIN_TILE      16
+#define TILED_MAX_TILE      8192
+#define TILED_ALIGN         4096   // tile data starts on a page boundary
+
+// Header of the tiled container (Tiled.c), little-endian, followed by the tile index
+typedef struct {
+    char magic[8];                   // TILED_MAGIC
+    uint64_t width, height;
+    uint32_t channels, tileSize;
+    uint32_t tilesX, tilesY;
+    uint64_t fileSize;               // end of the last allocated tile
+    uint64_t reserved[2];
+} TiledHeader;
+
+// An open tiled image; the header and index stay mapped, tiles are mapped on use
+typedef struct {
+    int fd;
+    int writable;
+    TiledHeader *header;
+    uint64_t *index;                 // file offset per tile, row-major, 0 = never written
+    size_t mapSize;
+    size_t tileBytes;
+    pthread_mutex_t lock;            // allocation of new tiles
+} TiledImage;
+
+#define WORK_EMPTY  (-1L)   // WorkDequePop/Steal: no task left
+#define WORK_RETRY  (-2L)   // WorkDequeSteal: lost a race, try again
+
+// Chase-Lev work-stealing deque of task numbers (WorkSteal.c)
+typedef struct {
+    _Atomic long top, bottom;
+    _Atomic long *tasks;
+    long mask;                       // capacity - 1, capacity a power of two
+} WorkDeque;
+
+// Kernel family used for the gradient: one wrapper per channel count, or the
+// wrapper taking the channel count at runtime
+typedef enum { VARIANT_SPECIALIZED, VARIANT_GENERIC, VARIANT_COUNT } KernelVariant;
+
+#define TUNE_DEFAULT_PROFILE  "edgevision.profile"
+#define TUNE_PROFILE_VERSION  1
+#define TUNE_CLASSES          3      // frame size classes, see Autotune.c
+#define TUNE_MAX_THREADS      64
+
+// Setting of the gradient pipeline for one class of frame sizes (Autotune.c)
+typedef struct {
+    size_t maxBytes;            // frames up to this many bytes, 0 = any size
+    KernelVariant variant;
+    int bandRows;               // rows per pipeline band
+    int threads;                // threads sharing each band (and the tiles of --tiled)
+    double mbPerSecond;         // throughput measured by --autotune, 0 = built-in default
+} TuneSetting;
+
+typedef struct {
+    char host[128];             // machine and CPU model it was tuned on
+    int cpus;
+    TuneSetting classes[TUNE_CLASSES];
+} TuneProfile;
+
+// Threads that compute the slices of one band together (BandPool.c)
+typedef struct {
+    pthread_t *threads;
+    int threadCount;            // helpers; the caller computes the first slice itself
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    long generation;            // bumped for every band
+    int nextSlice, pending, stopping;
+    int failed;                 // a slice of the band failed (under lock)
+    SobelStats *sliceStats;     // per slice, merged into the caller's stats
+
+    // The band being computed
+    unsigned char *input, *output;
+    int width, height, bytesPerPixel;
+    SobelOperator op;
+    KernelVariant variant;
+    SobelDenoise denoise;
+    int y0, y1, slices;
+    SobelBorder border;
+    int borderValue;
+    int collect;
+} BandPool;
+
+#define SHARD_MAX_WORKERS   256
+#define SHARD_MAX_ATTEMPTS  2       // runs of a file whose worker died, before it is given up
+
+// Where --workers pins its processes (Shard.c)
+typedef enum { PIN_NONE, PIN_CORE, PIN_NUMA } ShardPin;
+
+// Counters of one worker slot, written only by the worker in it
+typedef struct {
+    atomic_int current;         // file in progress, -1 = none
+    int pid;                    // the slot's latest process
+    int cpu;                    // pinned core or NUMA node, -1 = none
+    int starts, crashes;
+    long files;
+    uint64_t frames, bytes;     // input bytes of the finished files
+    double busySeconds, cpuSeconds;
+} ShardMetrics;
+
+typedef struct {
+    atomic_uchar state;
+    unsigned char attempts;     // runs cut short by a dead worker
+} ShardFile;
+
+// Work queue and metrics shared by the coordinator and its workers
+typedef struct {
+    size_t mapSize;
+    int fileCount, workerCount;
+    ShardPin pin;
+    atomic_int next;            // first file not handed out yet
+    int requeued;
+    double started, finished;
+    ShardMetrics workers[SHARD_MAX_WORKERS];
+    ShardFile files[];
+} ShardQueue;
+
+// Image containers handled by the pipeline reader/writer (ImageIO.c)
+typedef enum { IMAGE_BMP, IMAGE_PNM, IMAGE_RAW, IMAGE_Y4M, IMAGE_PNG } ImageFormat;
+
+// Geometry of headerless raw frames (--raw=WxH[xC][,planar])
+typedef struct {
+    int width, height;
+    int channels;               // 1, 3 (RGB) or 4 (RGBA)
+    int planar;                 // one plane per channel instead of interleaved
+} RawSpec;
+
+typedef struct {
+    FILE *file;
+    int ownsFile;               // 0 for stdin
+    ImageFormat format;
+    RawSpec raw;                // raw geometry, or the Y4M frame size
+    long y4mChroma;             // chroma bytes skipped after each Y4M luma plane
+    char y4mParams[64];         // F/I/A tags passed through to the output
+    long frames;                // frames read so far
+    int mapRows;                // map uncompressed BMP files instead of decoding them
+    unsigned char *map;         // mapping behind the current frame, if any
+    size_t mapSize;
+    int stride;                 // bytes between rows of the current frame
+} ImageReader;
+
+#define IO_DEFAULT_DEPTH   4    // input files read ahead by the I/O engine
+#define IO_MAX_DEPTH       64
+#define IO_CHUNK_BYTES     (1 << 30)   // largest single read/write submitted
+#define IO_POOL_MAX_BYTES  (64 << 20)  // larger inputs get a buffer of their own
+
+// Batch file I/O engine (IoEngine.c)
+typedef enum { IO_BACKEND_AUTO, IO_BACKEND_URING, IO_BACKEND_THREADS } IoBackend;
+
+typedef enum { IO_FREE, IO_QUEUED, IO_RUNNING, IO_DONE, IO_FAILED } IoState;
+
+typedef struct {
+    char path[512];
+    int isWrite;
+    int fd;
+    unsigned char *data;        // file contents (read) or bytes to write
+    size_t size, done;
+    int fixed;                  // registered buffer used by a read, -1 = none
+    IoState state;
+    int error;                  // errno of a failed request
+} IoRequest;
+
+typedef struct {
+    IoBackend backend;          // URING or THREADS once opened
+    int depth;                  // files in flight per direction
+    IoRequest *requests;        // depth read slots, then depth write slots
+    int slots;
+
+    // io_uring rings and the buffers registered with them
+    int ringFd;
+    void *sqRing, *cqRing, *sqes;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    void *cqes;
+    int inFlight;               // submissions without a completion yet
+    unsigned char **fixed;      // one pooled buffer per read slot
+    size_t fixedSize;
+    int registered;             // the pooled buffers are registered with the ring
+
+    // Thread pool fallback
+    pthread_t *threads;
+    int threadCount;
+    pthread_mutex_t lock;
+    pthread_cond_t queued, finished;
+    int stopping;
+
+    long filesRead, filesWritten;
+    long long bytesRead, bytesWritten;
+    int failures;
+} IoEngine;
+
+#define DEFLATE_WINDOW     32768
+#define DEFLATE_HASH_BITS  15
+#define DEFLATE_BLOCK_SYMBOLS 16384
+#define DEFLATE_LITERALS   286   // literal/length alphabet
+#define DEFLATE_DISTANCES  30
+#define PNG_DEFAULT_LEVEL  1
+#define PIPELINE_BAND_ROWS 16   // rows handed to the writer thread at a time, unless tuned
+
+// Worst-case BI_RLE8 encoding of one row, end-of-line marker included
+#define RLE8_MAX_ROW_BYTES(width) (2 * (width) + 4)
+
+// Streaming zlib encoder (Compress.c)
+typedef struct {
+    unsigned char window[2 * DEFLATE_WINDOW];   // history + lookahead
+    int head[1 << DEFLATE_HASH_BITS];           // newest position per hash, -1 = none
+    int prev[DEFLATE_WINDOW];                   // older positions with the same hash
+    int fill, pos;              // bytes in the window / next byte to encode
+    int maxChain;               // match candidates tried per position
+    unsigned short symbolLength[DEFLATE_BLOCK_SYMBOLS];   // 0 = literal
+    unsigned short symbolValue[DEFLATE_BLOCK_SYMBOLS];    // literal byte or distance
+    int symbolCount;            // symbols queued for the current block
+    uint32_t bits, adler;
+    int bitCount;
+    unsigned char *out;         // compressed bytes not yet taken
+    size_t outLen, outCap;
+    int failed;
+} DeflateStream;
+
+typedef struct {
+    FILE *file;
+    DeflateStream *deflate;
+    int rowBytes, bytesPerPixel;
+    int adaptive;               // choose the filter per row instead of always Up
+    unsigned char *previous, *filtered, *trial;
+    long bytesWritten;
+} PngWriter;
+
+typedef struct {
+    FILE *file;
+    ImageFormat format;
+    int isStream;               // stdout: BMP/PNG frames may be concatenated
+    int planar;
+    int width, height;          // Y4M stream geometry, fixed by the first frame
+    char y4mParams[64];
+    long frames;
+
+    // Compressed output, encoded row by row on a writer thread
+    int rle;                    // BI_RLE8 for 8-bit BMP frames
+    int rleWarned;
+    int pngLevel;               // 1 (fastest) .. 9
+    int pipelined;              // current frame goes through the writer thread
+    int topDown;                // order the thread consumes rows in
+    unsigned char *image;
+    BITMAPINFOHEADER *info;
+    BITMAPFILEHEADER *fileHeader;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t rowsChanged;
+    int rowsReady;              // rows final so far, in output order
+    int status;
+    long bytesWritten;
+    PngWriter png;
+    unsigned char *scratch;     // one R,G,B row for PNG
+    unsigned char *encoded;     // BI_RLE8 data of the frame
+    size_t encodedLength, encodedCapacity;
+
+    // File output handed to the I/O engine when the writer is closed
+    IoEngine *io;
+    char *memory;               // open_memstream() buffer behind `file`
+    size_t memorySize;
+    char path[512];
+} ImageWriter;
+
+#define CACHE_DEFAULT_DIR  "cache"
+
+// On-disk layout of the result cache index (Cache.c)
+typedef struct {
+    uint32_t magic;
+    uint32_t capacity;          // slots, a power of two
+    uint32_t count;             // slots in use
+    uint32_t reserved;
+    uint64_t hits, misses;      // lifetime totals over all runs
+} CacheIndexHeader;
+
+typedef struct {
+    uint64_t key;               // 0 = empty slot
+    uint64_t size;              // bytes of the stored result
+    uint64_t lastUsed;          // time of the last store or hit
+} CacheEntry;
+
+typedef struct {
+    char dir[256];
+    int fd;
+    CacheIndexHeader *header;   // mapped index
+    CacheEntry *entries;
+    size_t mapSize;
+    long hits, misses, stores, bypassed;   // this run
+} ResultCache;
+
 unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader);
 void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER *bitmapInfoHeader, BITMAPFILEHEADER *bitmapFileHeader);
+unsigned char *LoadBitmapStream(FILE *filePtr, BITMAPINFOHEADER *bitmapInfoHeader, BITMAPFILEHEADER *bitmapFileHeader);
+int SaveBitmapStream(FILE *filePtr, unsigned char *bitmapData, BITMAPINFOHEADER *bitmapInfoHeader, BITMAPFILEHEADER *bitmapFileHeader);
+void SynthesizeBmpHeaders(BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader, int width, int height, int channels);
+int ImageClaimStdout();
+int ImageFormatFromName(const char *name, ImageFormat *format);
+int ParseRawSpec(const char *text, RawSpec *spec);
+int ImageReaderOpen(ImageReader *reader, const char *path, const RawSpec *raw);
+unsigned char *ImageReadFrame(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader);
+int ImageReaderAtEnd(ImageReader *reader);
+void ImageReleaseFrame(ImageReader *reader, unsigned char *image);
+void ImageReaderClose(ImageReader *reader);
+int ImageReaderOpenMemory(ImageReader *reader, const char *path, unsigned char *data, size_t size, const RawSpec *raw);
+int ImageWriterOpen(ImageWriter *writer, const char *path, ImageFormat format, const ImageReader *source,
+                    IoEngine *io);
+int ImageWriteFrame(ImageWriter *writer, unsigned char *image, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader);
+int ImageWriterBeginFrame(ImageWriter *writer, unsigned char *image, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader);
+void ImageWriterRowsDone(ImageWriter *writer, int rows);
+int ImageWriterEndFrame(ImageWriter *writer);
+int ImageWriterClose(ImageWriter *writer);
+uint32_t Crc32Update(uint32_t crc, const unsigned char *data, size_t length);
+uint32_t Adler32Update(uint32_t adler, const unsigned char *data, size_t length);
+DeflateStream *DeflateCreate(int level);
+int DeflateWrite(DeflateStream *stream, const unsigned char *data, size_t length);
+int DeflateFinish(DeflateStream *stream);
+size_t DeflateTake(DeflateStream *stream, unsigned char **data);
+void DeflateDestroy(DeflateStream *stream);
+int PngWriterBegin(PngWriter *png, FILE *file, int width, int height, int colourType,
+                   const unsigned char *paletteRgb, int paletteSize, int level);
+int PngWriteRow(PngWriter *png, const unsigned char *row);
+int PngWriterEnd(PngWriter *png);
+void PngWriterFree(PngWriter *png);
+int Rle8EncodeRow(const unsigned char *row, int width, unsigned char *out);
+uint64_t CacheHash64(const void *data, size_t length, uint64_t seed);
+uint64_t CacheKey(const unsigned char *pixels, const BITMAPINFOHEADER *info, const char *settings);
+int CacheOpen(ResultCache *cache, const char *dir);
+int CacheFetch(ResultCache *cache, uint64_t key, const char *outputPath);
+int CacheStore(ResultCache *cache, uint64_t key, const char *outputPath);
+void CacheClose(ResultCache *cache);
+int IoEngineOpen(IoEngine *io, IoBackend backend, int depth, size_t bufferSize);
+const char *IoBackendName(IoBackend backend);
+int IoEngineRead(IoEngine *io, const char *path);
+unsigned char *IoEngineWaitRead(IoEngine *io, int id, size_t *size);
+void IoEngineRelease(IoEngine *io, int id);
+int IoEngineWrite(IoEngine *io, const char *path, unsigned char *data, size_t size);
+int IoEngineFlush(IoEngine *io);
+void IoEngineClose(IoEngine *io);
 int createDirectory(const char *path);
 void print_image_header(const char* filename);
 void print_footer();
 void writeOutPutfile();
 void Sobel(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel);
+void SobelWithOperator(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel, SobelOperator op);
+int SobelRows(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel,
+              SobelOperator op, KernelVariant variant, SobelDenoise denoise, int y0, int y1, SobelBorder border,
+              int borderValue, SobelStats *stats);
+int BandPoolInit(BandPool *pool, int threads);
+int BandPoolRows(BandPool *pool, int threads, unsigned char *input, unsigned char *output, int width, int height,
+                 int bytesPerPixel, SobelOperator op, KernelVariant variant, SobelDenoise denoise, int y0, int y1,
+                 SobelBorder border, int borderValue, SobelStats *stats);
+void BandPoolClose(BandPool *pool);
+void TuneProfileDefaults(TuneProfile *profile);
+const TuneSetting *TuneProfileLookup(const TuneProfile *profile, size_t frameBytes);
+int TuneProfileLoad(TuneProfile *profile, const char *path);
+int TuneProfileSave(const TuneProfile *profile, const char *path);
+int Autotune(TuneProfile *profile);
+const char *KernelVariantName(KernelVariant variant);
+SobelKernelFn SelectSobelKernel(SobelOperator op, int bytesPerPixel);
+SobelKernelFn SelectGenericSobelKernel(SobelOperator op);
+SobelStatsKernelFn SelectSobelStatsKernel(SobelOperator op, int bytesPerPixel);
+SobelStatsKernelFn SelectGenericSobelStatsKernel(SobelOperator op);
+void SobelBorderPixels(const unsigned char *input, int inStride, unsigned char *output, int outStride,
+                       int width, int height, int bytesPerPixel, SobelOperator op, SobelBorder border,
+                       int value, int x0, int y0, int x1, int y1, SobelStats *stats);
+const char *SobelBorderName(SobelBorder border);
+int ParseSobelBorder(const char *text, SobelBorder *border, int *value);
+int SobelDenoisedRows(const unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel,
+                      SobelOperator op, KernelVariant variant, SobelDenoise denoise, int y0, int y1,
+                      SobelBorder border, int borderValue, SobelStats *stats);
+const char *SobelDenoiseName(SobelDenoise denoise);
+int ParseSobelDenoise(const char *text, SobelDenoise *denoise);
+void SobelStatsMerge(SobelStats *into, const SobelStats *from);
+int SobelStatsPercentile(const SobelStats *stats, int percentile);
+int SobelStatsOtsu(const SobelStats *stats);
+int SobelStatsThreshold(const SobelStats *stats, ThresholdMode mode, int percentile);
+double SobelStatsMean(const SobelStats *stats);
+double SobelStatsDensity(const SobelStats *stats, int threshold);
+void SobelApplyThreshold(unsigned char *output, int stride, int width, int height, int bytesPerPixel,
+                         int threshold, SobelBorder border);
+int ParseThreshold(const char *text, ThresholdMode *mode, int *percentile);
+int SobelStatsWriteJson(const char *path, const char *name, int width, int height, int bytesPerPixel,
+                        SobelOperator op, const SobelStats *stats, ThresholdMode mode, int percentile);
+const char *SobelOperatorName(SobelOperator op);
+int ParseSobelOperator(const char *name, SobelOperator *op);
+int PyramidLevels(int width, int height, int requested);
+void PyramidLevelSize(int width, int height, int level, int *levelWidth, int *levelHeight);
+int SobelPyramid(unsigned char *input, int width, int height, int bytesPerPixel, SobelOperator op,
+                 int levels, unsigned char **outputs, unsigned char *combined);
+void DeltaInit(DeltaState *state, int tileSize);
+void DeltaFree(DeltaState *state);
+unsigned char *SobelDelta(DeltaState *state, unsigned char *input, int width, int height,
+                          int bytesPerPixel, SobelOperator op);
+int TiledCreate(TiledImage *image, const char *path, uint64_t width, uint64_t height, int channels, int tileSize);
+int TiledOpen(TiledImage *image, const char *path, int writable);
+int TiledMapTile(TiledImage *image, uint32_t tx, uint32_t ty, int writable, unsigned char **tile);
+void TiledUnmapTile(TiledImage *image, unsigned char *tile);
+void TiledClose(TiledImage *image);
+int TiledFromBmp(const char *bmpPath, const char *tiledPath, int tileSize);
+int TiledToBmp(TiledImage *image, const char *bmpPath);
+int SobelTiled(TiledImage *input, TiledImage *output, SobelOperator op, int threads);
+int ParseShardPin(const char *text, ShardPin *pin);
+ShardQueue *ShardCreate(int fileCount, int workers, ShardPin pin);
+void ShardDestroy(ShardQueue *queue);
+int ShardRun(ShardQueue *queue);
+int ShardClaim(ShardQueue *queue);
+void ShardAddFrame(uint64_t bytes);
+void ShardDone(ShardQueue *queue, int index);
+int ShardReport(const ShardQueue *queue, const char *const *inputs);
+int WorkDequeReset(WorkDeque *deque, long capacity);
+void WorkDequeFree(WorkDeque *deque);
+void WorkDequePush(WorkDeque *deque, long task);
+long WorkDequePop(WorkDeque *deque);
+long WorkDequeSteal(WorkDeque *deque);
+int ParseRoi(const char *text, SobelRect *rect);
+int ClipRoi(SobelRect *rect, int width, int height);
+void SobelRegion(const unsigned char *input, int inStride, int width, int height, int bytesPerPixel,
+                 SobelOperator op, const SobelRect *rect, unsigned char *output, int outStride);
+void SobelRegionWithKernel(SobelKernelFn kernel, const unsigned char *input, int inStride, int width, int height,
+                           int bytesPerPixel, const SobelRect *rect, unsigned char *output, int outStride);
+void SobelRegions(const unsigned char *input, int inStride, unsigned char *output, int width, int height,
+                  int bytesPerPixel, SobelOperator op, const SobelRect *rects, int count);
+int Canny(unsigned char *input, unsigned char *output, int width, int height, int bytesPerPixel,
+          int lowThreshold, int highThreshold);
 
 #endif /* EDGEVISION_H */
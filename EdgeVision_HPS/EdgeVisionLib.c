@@ -0,0 +1,766 @@
+#include "EdgeVision.h"
+#include "EdgeVisionLib.h"
+#include <stdarg.h>
+#include <sched.h>
+
+/***********************
+ **
+ ** libedgevision
+ **
+ ** Context-based wrapper around the kernels in SobelKernels.c, Canny.c and
+ ** Roi.c. Every call is planned as a job of tasks: a gradient image is cut
+ ** into bands of about LIB_TILE_BYTES of input each, a Canny image is one
+ ** task. The tasks are dealt to per-worker deques (WorkSteal.c) and a worker
+ ** whose deque runs dry steals from the others, so a batch of mixed sizes
+ ** keeps every thread busy until the last tile. The kernels address their
+ ** output by position, so tiles need no merging. Edge statistics go into
+ ** one histogram per worker and image; the worker that finishes an image's
+ ** last tile merges them and applies the threshold. Nothing here prints or
+ ** touches process-wide state.
+ **
+ **********************/
+
+#define LIB_DEFAULT_POOL_BUFFERS  8
+#define LIB_TILE_BYTES            32768   // input bytes per gradient task
+#define LIB_POOL_HEADER           16      // keeps the pixels 16-byte aligned
+
+// One image of a job; its tasks are numbered firstTask .. firstTask + tasks - 1
+typedef struct {
+    const EdgeVisionImage *input;
+    EdgeVisionImage *output;
+    SobelKernelFn kernel;
+    SobelStatsKernelFn statsKernel; // set when statistics are collected
+    int tileRows;                   // rows per task, 0 = whole image (Canny)
+    long firstTask;
+    int tasks;
+    atomic_int tasksLeft;
+    int finished;                   // under reportLock
+} ImageJob;
+
+struct EdgeVisionContext {
+    EdgeVisionBackend backend;
+    EdgeVisionSchedule schedule;
+    pthread_mutex_t callLock;       // one API call at a time
+
+    // Workers; the calling thread is worker 0 of `threads`
+    pthread_t *workers;
+    int threads, workersStarted, workerIds;
+    pthread_mutex_t lock;
+    pthread_cond_t jobPosted, jobDone;
+    long generation;                // bumped for every posted job
+    int stopping;
+    int workersBusy;                // workers still in the current job
+
+    // Current job
+    ImageJob *images;
+    int imageCount, imageLimit;
+    int *taskImage;                 // image of each task
+    long taskLimit;
+    WorkDeque *deques;              // one per worker
+    atomic_long tasksLeft;
+    atomic_int failed;
+    const EdgeVisionOptions *options;
+    SobelStats *workerStats;        // [image * threads + worker]
+    long workerStatsLimit;
+
+    // Finished images are reported in order
+    pthread_mutex_t reportLock;
+    int nextReport;
+    EdgeVisionDoneFn done;
+    void *user;
+
+    EdgeVisionStats stats;
+
+    // Released buffers, each preceded by its capacity
+    pthread_mutex_t poolLock;
+    unsigned char **pool;
+    int poolCount, poolLimit;
+
+    pthread_mutex_t errorLock;      // Canny tasks may fail on any worker
+    char error[160];
+};
+
+static int processCanny(EdgeVisionContext *context, const EdgeVisionImage *input,
+                        EdgeVisionImage *output, const EdgeVisionOptions *options);
+
+static void setError(EdgeVisionContext *context, const char *format, ...)
+{
+    va_list args;
+    pthread_mutex_lock(&context->errorLock);
+    va_start(args, format);
+    vsnprintf(context->error, sizeof(context->error), format, args);
+    va_end(args);
+    pthread_mutex_unlock(&context->errorLock);
+}
+
+static double secondsNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int rowStride(const EdgeVisionImage *image)
+{
+    return image->stride ? image->stride : image->width * image->channels;
+}
+
+// Report `index` and every finished image after it that was waiting on it
+static void imageFinished(EdgeVisionContext *context, int index)
+{
+    pthread_mutex_lock(&context->reportLock);
+    context->images[index].finished = 1;
+    while (context->nextReport < context->imageCount && context->images[context->nextReport].finished) {
+        if (context->done)
+            context->done(context->user, context->nextReport);
+        context->nextReport++;
+    }
+    pthread_mutex_unlock(&context->reportLock);
+}
+
+// Merge the workers' histograms of a finished image, then threshold it
+static void finishStats(EdgeVisionContext *context, int index)
+{
+    const EdgeVisionOptions *options = context->options;
+    const EdgeVisionImage *output = context->images[index].output;
+    SobelStats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    for (int w = 0; w < context->threads; w++)
+        SobelStatsMerge(&stats, &context->workerStats[(long)index * context->threads + w]);
+
+    const ThresholdMode mode = (ThresholdMode)options->threshold;
+    const int threshold = SobelStatsThreshold(&stats, mode, options->percentile);
+    if (mode != THRESHOLD_NONE)
+        SobelApplyThreshold(output->pixels, rowStride(output), output->width, output->height,
+                            output->channels, threshold, (SobelBorder)options->border);
+
+    if (options->stats) {
+        EdgeVisionEdgeStats *result = &options->stats[index];
+        for (int i = 0; i < STATS_BINS; i++)
+            result->histogram[i] = stats.histogram[i];
+        result->samples = stats.samples;
+        result->meanGradient = SobelStatsMean(&stats);
+        result->otsuThreshold = SobelStatsOtsu(&stats);
+        result->threshold = threshold;
+        result->edgeDensity = SobelStatsDensity(&stats, threshold);
+    }
+}
+
+static void runTask(EdgeVisionContext *context, long task, int self)
+{
+    const int index = context->taskImage[task];
+    ImageJob *image = &context->images[index];
+    const EdgeVisionImage *input = image->input;
+    EdgeVisionImage *output = image->output;
+
+    if (image->tileRows == 0) {
+        if (processCanny(context, input, output, context->options) != 0)
+            atomic_store(&context->failed, 1);
+    } else {
+        const int y0 = (int)(task - image->firstTask) * image->tileRows;
+        int y1 = y0 + image->tileRows;
+        if (y1 > input->height)
+            y1 = input->height;
+
+        const int outStride = rowStride(output);
+        for (int row = y0; row < y1; row++)
+            memset(output->pixels + (size_t)row * outStride, 0, (size_t)input->width * input->channels);
+        if (image->statsKernel)
+            image->statsKernel(input->pixels, rowStride(input), output->pixels, outStride,
+                               input->width, input->height, input->channels, 0, y0, input->width, y1,
+                               &context->workerStats[(long)index * context->threads + self]);
+        else
+            image->kernel(input->pixels, rowStride(input), output->pixels, outStride,
+                          input->width, input->height, input->channels, 0, y0, input->width, y1);
+
+        const EdgeVisionOptions *options = context->options;
+        if (options->border != EDGEVISION_BORDER_SKIP)
+            SobelBorderPixels(input->pixels, rowStride(input), output->pixels, outStride, input->width,
+                              input->height, input->channels, (SobelOperator)options->op,
+                              (SobelBorder)options->border, options->borderValue, 0, y0, input->width, y1,
+                              image->statsKernel ? &context->workerStats[(long)index * context->threads + self]
+                                                 : NULL);
+    }
+
+    // The last tile's worker sees every other worker's histogram for this image
+    if (atomic_fetch_sub(&image->tasksLeft, 1) == 1) {
+        if (image->statsKernel)
+            finishStats(context, index);
+        imageFinished(context, index);
+    }
+}
+
+/**
+ * Run tasks as worker `self` until the job has none left: first from its own
+ * deque, then stolen from the others starting at a random one. Adds the
+ * worker's counters to the context's stats.
+ */
+static void runTasks(EdgeVisionContext *context, int self)
+{
+    WorkDeque *own = &context->deques[self];
+    unsigned int seed = 2654435761u * (unsigned int)(self + 1);
+    long tasks = 0, steals = 0;
+    double busy = 0;
+
+    while (atomic_load(&context->tasksLeft) > 0) {
+        long task = WorkDequePop(own);
+        if (task == WORK_EMPTY) {
+            if (context->schedule == EDGEVISION_SCHEDULE_STATIC)
+                break;
+            seed = seed * 1103515245u + 12345u;
+            const int first = (int)((seed >> 16) % (unsigned int)context->threads);
+            for (int i = 0; i < context->threads && task < 0; i++) {
+                int victim = (first + i) % context->threads;
+                if (victim != self)
+                    task = WorkDequeSteal(&context->deques[victim]);
+            }
+            if (task < 0) {
+                // The last tasks are running elsewhere
+                sched_yield();
+                continue;
+            }
+            steals++;
+        }
+
+        double start = secondsNow();
+        runTask(context, task, self);
+        busy += secondsNow() - start;
+        tasks++;
+        atomic_fetch_sub(&context->tasksLeft, 1);
+    }
+
+    pthread_mutex_lock(&context->lock);
+    context->stats.tasks += tasks;
+    context->stats.steals += steals;
+    context->stats.busySeconds += busy;
+    if (--context->workersBusy == 0)
+        pthread_cond_broadcast(&context->jobDone);
+    pthread_mutex_unlock(&context->lock);
+}
+
+static void *workerMain(void *arg)
+{
+    EdgeVisionContext *context = (EdgeVisionContext *)arg;
+    long seen = 0;
+
+    pthread_mutex_lock(&context->lock);
+    const int self = ++context->workerIds;
+    for (;;) {
+        while (context->generation == seen && !context->stopping)
+            pthread_cond_wait(&context->jobPosted, &context->lock);
+        if (context->stopping)
+            break;
+        seen = context->generation;
+        pthread_mutex_unlock(&context->lock);
+        runTasks(context, self);
+        pthread_mutex_lock(&context->lock);
+    }
+    pthread_mutex_unlock(&context->lock);
+    return NULL;
+}
+
+static SobelKernelFn contextKernel(const EdgeVisionContext *context, SobelOperator op, int bytesPerPixel)
+{
+    if (context->backend == EDGEVISION_BACKEND_CPU_GENERIC)
+        return SelectGenericSobelKernel(op);
+    return SelectSobelKernel(op, bytesPerPixel);
+}
+
+/**
+ * Split `count` checked images into tasks and deal them to the deques. With
+ * at least one image per worker, whole images go round-robin to the workers
+ * (so an image stays in one cache unless its tiles are stolen); fewer images
+ * are split into one contiguous run of tiles per worker.
+ * Returns 0 or -1 if out of memory.
+ */
+static int planJob(EdgeVisionContext *context, const EdgeVisionImage *inputs, EdgeVisionImage *outputs,
+                   int count, const EdgeVisionOptions *options)
+{
+    if (count > context->imageLimit) {
+        ImageJob *images = (ImageJob *)realloc(context->images, count * sizeof(ImageJob));
+        if (!images)
+            return -1;
+        context->images = images;
+        context->imageLimit = count;
+    }
+
+    const int collect = options->mode == EDGEVISION_MODE_GRADIENT &&
+                        (options->stats || options->threshold != EDGEVISION_THRESHOLD_NONE);
+    if (collect) {
+        const long slots = (long)count * context->threads;
+        if (slots > context->workerStatsLimit) {
+            SobelStats *workerStats = (SobelStats *)realloc(context->workerStats, slots * sizeof(SobelStats));
+            if (!workerStats)
+                return -1;
+            context->workerStats = workerStats;
+            context->workerStatsLimit = slots;
+        }
+        memset(context->workerStats, 0, slots * sizeof(SobelStats));
+    }
+
+    long total = 0;
+    for (int i = 0; i < count; i++) {
+        ImageJob *image = &context->images[i];
+        image->input = &inputs[i];
+        image->output = &outputs[i];
+        image->kernel = contextKernel(context, (SobelOperator)options->op, inputs[i].channels);
+        image->statsKernel = !collect ? NULL
+                           : context->backend == EDGEVISION_BACKEND_CPU_GENERIC
+                           ? SelectGenericSobelStatsKernel((SobelOperator)options->op)
+                           : SelectSobelStatsKernel((SobelOperator)options->op, inputs[i].channels);
+        if (options->mode == EDGEVISION_MODE_CANNY) {
+            image->tileRows = 0;
+            image->tasks = 1;
+        } else {
+            image->tileRows = LIB_TILE_BYTES / (inputs[i].width * inputs[i].channels);
+            if (image->tileRows < 1)
+                image->tileRows = 1;
+            image->tasks = (inputs[i].height + image->tileRows - 1) / image->tileRows;
+        }
+        image->firstTask = total;
+        image->finished = 0;
+        atomic_init(&image->tasksLeft, image->tasks);
+        total += image->tasks;
+    }
+
+    if (total > context->taskLimit) {
+        int *taskImage = (int *)realloc(context->taskImage, total * sizeof(int));
+        if (!taskImage)
+            return -1;
+        context->taskImage = taskImage;
+        context->taskLimit = total;
+    }
+    for (int w = 0; w < context->threads; w++)
+        if (WorkDequeReset(&context->deques[w], total) != 0)
+            return -1;
+
+    // Pushed last task first, so each owner pops its tiles top to bottom
+    for (int i = count - 1; i >= 0; i--) {
+        const ImageJob *image = &context->images[i];
+        for (int k = image->tasks - 1; k >= 0; k--) {
+            const long task = image->firstTask + k;
+            int worker = count >= context->threads ? i % context->threads
+                                                   : (int)((long)k * context->threads / image->tasks);
+            context->taskImage[task] = i;
+            WorkDequePush(&context->deques[worker], task);
+        }
+    }
+
+    context->imageCount = count;
+    context->options = options;
+    context->nextReport = 0;
+    atomic_store(&context->tasksLeft, total);
+    atomic_store(&context->failed, 0);
+    return 0;
+}
+
+// Run the planned job on all workers and wait for it. Returns 0 or -1.
+static int runJob(EdgeVisionContext *context)
+{
+    const double start = secondsNow();
+
+    pthread_mutex_lock(&context->lock);
+    memset(&context->stats, 0, sizeof(context->stats));
+    context->stats.threads = context->threads;
+    context->workersBusy = context->threads;
+    context->generation++;
+    pthread_cond_broadcast(&context->jobPosted);
+    pthread_mutex_unlock(&context->lock);
+
+    runTasks(context, 0);
+
+    pthread_mutex_lock(&context->lock);
+    while (context->workersBusy > 0)
+        pthread_cond_wait(&context->jobDone, &context->lock);
+    EdgeVisionStats *stats = &context->stats;
+    stats->wallSeconds = secondsNow() - start;
+    if (stats->wallSeconds > 0)
+        stats->efficiency = stats->busySeconds / (stats->threads * stats->wallSeconds);
+    pthread_mutex_unlock(&context->lock);
+
+    return atomic_load(&context->failed) ? -1 : 0;
+}
+
+EdgeVisionContext *EdgeVisionCreate(const EdgeVisionConfig *config)
+{
+    EdgeVisionConfig defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    if (!config)
+        config = &defaults;
+
+    if (config->backend != EDGEVISION_BACKEND_CPU && config->backend != EDGEVISION_BACKEND_CPU_GENERIC)
+        return NULL;
+
+    EdgeVisionContext *context = (EdgeVisionContext *)calloc(1, sizeof(EdgeVisionContext));
+    if (!context)
+        return NULL;
+
+    context->backend = config->backend;
+    context->schedule = config->schedule;
+    context->threads = config->threads;
+    if (context->threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        context->threads = cpus > 0 ? (int)cpus : 1;
+    }
+    context->poolLimit = config->poolBuffers > 0 ? config->poolBuffers : LIB_DEFAULT_POOL_BUFFERS;
+
+    pthread_mutex_init(&context->callLock, NULL);
+    pthread_mutex_init(&context->lock, NULL);
+    pthread_cond_init(&context->jobPosted, NULL);
+    pthread_cond_init(&context->jobDone, NULL);
+    pthread_mutex_init(&context->reportLock, NULL);
+    pthread_mutex_init(&context->poolLock, NULL);
+    pthread_mutex_init(&context->errorLock, NULL);
+
+    context->pool = (unsigned char **)calloc(context->poolLimit, sizeof(unsigned char *));
+    context->workers = (pthread_t *)calloc(context->threads, sizeof(pthread_t));
+    context->deques = (WorkDeque *)calloc(context->threads, sizeof(WorkDeque));
+    if (!context->pool || !context->workers || !context->deques) {
+        EdgeVisionDestroy(context);
+        return NULL;
+    }
+
+    for (int i = 1; i < context->threads; i++) {
+        if (pthread_create(&context->workers[i], NULL, workerMain, context) != 0) {
+            EdgeVisionDestroy(context);
+            return NULL;
+        }
+        context->workersStarted++;
+    }
+    return context;
+}
+
+void EdgeVisionDestroy(EdgeVisionContext *context)
+{
+    if (!context)
+        return;
+
+    pthread_mutex_lock(&context->lock);
+    context->stopping = 1;
+    pthread_cond_broadcast(&context->jobPosted);
+    pthread_mutex_unlock(&context->lock);
+    for (int i = 1; i <= context->workersStarted; i++)
+        pthread_join(context->workers[i], NULL);
+
+    for (int i = 0; i < context->poolCount; i++)
+        free(context->pool[i]);
+    for (int i = 0; context->deques && i < context->threads; i++)
+        WorkDequeFree(&context->deques[i]);
+
+    pthread_mutex_destroy(&context->errorLock);
+    pthread_mutex_destroy(&context->poolLock);
+    pthread_mutex_destroy(&context->reportLock);
+    pthread_cond_destroy(&context->jobDone);
+    pthread_cond_destroy(&context->jobPosted);
+    pthread_mutex_destroy(&context->lock);
+    pthread_mutex_destroy(&context->callLock);
+    free(context->deques);
+    free(context->workerStats);
+    free(context->taskImage);
+    free(context->images);
+    free(context->pool);
+    free(context->workers);
+    free(context);
+}
+
+static int checkImage(EdgeVisionContext *context, const EdgeVisionImage *image, const char *name)
+{
+    if (!image || !image->pixels || image->width <= 0 || image->height <= 0) {
+        setError(context, "%s image is empty", name);
+        return -1;
+    }
+    if (image->channels != 1 && image->channels != 3 && image->channels != 4) {
+        setError(context, "%s image has %d channels (1, 3 or 4 supported)", name, image->channels);
+        return -1;
+    }
+    if (image->stride != 0 && image->stride < image->width * image->channels) {
+        setError(context, "%s stride %d is shorter than a row", name, image->stride);
+        return -1;
+    }
+    return 0;
+}
+
+// Takes a pool buffer of at least `size` bytes
+static unsigned char *poolTake(EdgeVisionContext *context, size_t size)
+{
+    pthread_mutex_lock(&context->poolLock);
+    int best = -1;
+    for (int i = 0; i < context->poolCount; i++) {
+        size_t capacity = *(size_t *)context->pool[i];
+        if (capacity >= size && (best < 0 || capacity < *(size_t *)context->pool[best]))
+            best = i;
+    }
+
+    unsigned char *block;
+    if (best >= 0) {
+        block = context->pool[best];
+        context->pool[best] = context->pool[--context->poolCount];
+        pthread_mutex_unlock(&context->poolLock);
+    } else {
+        pthread_mutex_unlock(&context->poolLock);
+        block = (unsigned char *)malloc(LIB_POOL_HEADER + size);
+        if (!block)
+            return NULL;
+        *(size_t *)block = size;
+    }
+    return block + LIB_POOL_HEADER;
+}
+
+static void poolGive(EdgeVisionContext *context, unsigned char *pixels)
+{
+    unsigned char *block = pixels - LIB_POOL_HEADER;
+    pthread_mutex_lock(&context->poolLock);
+    if (context->poolCount < context->poolLimit) {
+        context->pool[context->poolCount++] = block;
+        pthread_mutex_unlock(&context->poolLock);
+        return;
+    }
+
+    // Full: keep the larger buffers, they satisfy more requests
+    int smallest = 0;
+    for (int i = 1; i < context->poolCount; i++)
+        if (*(size_t *)context->pool[i] < *(size_t *)context->pool[smallest])
+            smallest = i;
+    if (*(size_t *)context->pool[smallest] < *(size_t *)block) {
+        unsigned char *evicted = context->pool[smallest];
+        context->pool[smallest] = block;
+        block = evicted;
+    }
+    pthread_mutex_unlock(&context->poolLock);
+    free(block);
+}
+
+int EdgeVisionImageAlloc(EdgeVisionContext *context, int width, int height, int channels,
+                         EdgeVisionImage *image)
+{
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4)) {
+        setError(context, "cannot allocate a %dx%dx%d image", width, height, channels);
+        return -1;
+    }
+
+    unsigned char *pixels = poolTake(context, (size_t)width * height * channels);
+    if (!pixels) {
+        setError(context, "out of memory for a %dx%dx%d image", width, height, channels);
+        return -1;
+    }
+
+    image->pixels = pixels;
+    image->width = width;
+    image->height = height;
+    image->channels = channels;
+    image->stride = width * channels;
+    return 0;
+}
+
+void EdgeVisionImageRelease(EdgeVisionContext *context, EdgeVisionImage *image)
+{
+    if (!image || !image->pixels)
+        return;
+
+    poolGive(context, image->pixels);
+    image->pixels = NULL;
+}
+
+static int processRegions(EdgeVisionContext *context, const EdgeVisionImage *input,
+                          EdgeVisionImage *output, SobelOperator op, const EdgeVisionOptions *options)
+{
+    const int width = input->width, height = input->height, bpp = input->channels;
+    const int outStride = rowStride(output);
+
+    for (int row = 0; row < height; row++)
+        memset(output->pixels + (size_t)row * outStride, 0, (size_t)width * bpp);
+
+    for (int i = 0; i < options->regionCount; i++) {
+        const EdgeVisionRect *region = &options->regions[i];
+        SobelRect rect = { region->x, region->y, region->width, region->height };
+        if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0) {
+            setError(context, "region %d (%d,%d,%d,%d) is invalid", i, rect.x, rect.y, rect.width, rect.height);
+            return -1;
+        }
+        if (ClipRoi(&rect, width, height) != 0)
+            continue;
+
+        unsigned char *corner = output->pixels + (size_t)rect.y * outStride + (size_t)rect.x * bpp;
+
+        // Rows are top-down here; SobelRegion() counts rect.y from the far end
+        rect.y = height - (rect.y + rect.height);
+        SobelRegionWithKernel(contextKernel(context, op, bpp), input->pixels, rowStride(input),
+                              width, height, bpp, &rect, corner, outStride);
+    }
+    return 0;
+}
+
+static int processCanny(EdgeVisionContext *context, const EdgeVisionImage *input,
+                        EdgeVisionImage *output, const EdgeVisionOptions *options)
+{
+    const int width = input->width, height = input->height, bpp = input->channels;
+    const size_t rowBytes = (size_t)width * bpp;
+    int low = options->cannyLow, high = options->cannyHigh;
+    if (low == 0 && high == 0) {
+        low = CANNY_DEFAULT_LOW;
+        high = CANNY_DEFAULT_HIGH;
+    }
+
+    // Canny() takes packed rows, bottom row first like the loaded BMPs.
+    // Ties in non-maximum suppression depend on the row order, so the rows
+    // are flipped into pool buffers to give the same edges as SOBEL_HPS.
+    unsigned char *in = poolTake(context, rowBytes * height);
+    unsigned char *out = in ? poolTake(context, rowBytes * height) : NULL;
+    if (!out) {
+        if (in)
+            poolGive(context, in);
+        setError(context, "out of memory");
+        return -1;
+    }
+    for (int row = 0; row < height; row++)
+        memcpy(in + (height - 1 - row) * rowBytes, input->pixels + (size_t)row * rowStride(input), rowBytes);
+
+    int status = Canny(in, out, width, height, bpp, low, high);
+    if (status != 0)
+        setError(context, "Canny needs at least a 3x3 image and memory for its row buffers");
+    else
+        for (int row = 0; row < height; row++)
+            memcpy(output->pixels + (size_t)row * rowStride(output), out + (height - 1 - row) * rowBytes, rowBytes);
+
+    poolGive(context, out);
+    poolGive(context, in);
+    return status;
+}
+
+static int checkPair(EdgeVisionContext *context, const EdgeVisionImage *input, const EdgeVisionImage *output)
+{
+    if (checkImage(context, input, "input") != 0 || checkImage(context, output, "output") != 0)
+        return -1;
+    if (output->width != input->width || output->height != input->height || output->channels != input->channels) {
+        setError(context, "output is %dx%dx%d, input is %dx%dx%d", output->width, output->height,
+                 output->channels, input->width, input->height, input->channels);
+        return -1;
+    }
+    return 0;
+}
+
+static int checkOptions(EdgeVisionContext *context, const EdgeVisionOptions *options)
+{
+    if ((int)options->op < 0 || (int)options->op >= OP_COUNT) {
+        setError(context, "unknown operator %d", (int)options->op);
+        return -1;
+    }
+    if (options->mode != EDGEVISION_MODE_GRADIENT && options->mode != EDGEVISION_MODE_CANNY) {
+        setError(context, "unknown mode %d", (int)options->mode);
+        return -1;
+    }
+    if (options->mode == EDGEVISION_MODE_CANNY && options->regions && options->regionCount > 0) {
+        setError(context, "regions are only supported in gradient mode");
+        return -1;
+    }
+    if (options->border < EDGEVISION_BORDER_SKIP || options->border > EDGEVISION_BORDER_CONSTANT ||
+        options->borderValue < 0 || options->borderValue > 255) {
+        setError(context, "unknown border mode %d or value %d", (int)options->border, options->borderValue);
+        return -1;
+    }
+    if (options->border != EDGEVISION_BORDER_SKIP &&
+        (options->mode != EDGEVISION_MODE_GRADIENT || (options->regions && options->regionCount > 0))) {
+        setError(context, "border modes need the gradient of the whole image");
+        return -1;
+    }
+    if (options->stats || options->threshold != EDGEVISION_THRESHOLD_NONE) {
+        if (options->mode != EDGEVISION_MODE_GRADIENT || (options->regions && options->regionCount > 0)) {
+            setError(context, "statistics and thresholds need the gradient of the whole image");
+            return -1;
+        }
+        if (options->threshold < EDGEVISION_THRESHOLD_NONE || options->threshold > EDGEVISION_THRESHOLD_PERCENTILE) {
+            setError(context, "unknown threshold mode %d", (int)options->threshold);
+            return -1;
+        }
+        if (options->threshold == EDGEVISION_THRESHOLD_PERCENTILE && (options->percentile < 1 || options->percentile > 99)) {
+            setError(context, "percentile %d is not in 1..99", options->percentile);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Plan and run a job over checked images. Called with callLock held.
+static int processBatch(EdgeVisionContext *context, const EdgeVisionImage *inputs, EdgeVisionImage *outputs,
+                        int count, const EdgeVisionOptions *options, EdgeVisionDoneFn done, void *user)
+{
+    if (planJob(context, inputs, outputs, count, options) != 0) {
+        setError(context, "out of memory for %d images", count);
+        return -1;
+    }
+    context->done = done;
+    context->user = user;
+    return runJob(context);
+}
+
+int EdgeVisionProcess(EdgeVisionContext *context, const EdgeVisionImage *input,
+                      EdgeVisionImage *output, const EdgeVisionOptions *options)
+{
+    EdgeVisionOptions defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    if (!options)
+        options = &defaults;
+
+    pthread_mutex_lock(&context->callLock);
+    int status = -1;
+    if (checkPair(context, input, output) == 0 && checkOptions(context, options) == 0) {
+        if (options->regions && options->regionCount > 0)
+            status = processRegions(context, input, output, (SobelOperator)options->op, options);
+        else
+            status = processBatch(context, input, output, 1, options, NULL, NULL);
+    }
+    pthread_mutex_unlock(&context->callLock);
+    return status;
+}
+
+int EdgeVisionProcessBatch(EdgeVisionContext *context, const EdgeVisionImage *inputs,
+                           EdgeVisionImage *outputs, int count, const EdgeVisionOptions *options,
+                           EdgeVisionDoneFn done, void *user)
+{
+    EdgeVisionOptions defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    if (!options)
+        options = &defaults;
+
+    pthread_mutex_lock(&context->callLock);
+    int status = -1;
+    if (count <= 0 || !inputs || !outputs) {
+        setError(context, "batch of %d images is empty", count);
+        goto done;
+    }
+    if (checkOptions(context, options) != 0)
+        goto done;
+    if (options->regions && options->regionCount > 0) {
+        setError(context, "regions are not supported in batches");
+        goto done;
+    }
+    for (int i = 0; i < count; i++) {
+        if (checkPair(context, &inputs[i], &outputs[i]) != 0) {
+            char reason[sizeof(context->error)];
+            memcpy(reason, context->error, sizeof(reason));
+            setError(context, "image %d: %s", i, reason);
+            goto done;
+        }
+    }
+    status = processBatch(context, inputs, outputs, count, options, done, user);
+
+done:
+    pthread_mutex_unlock(&context->callLock);
+    return status;
+}
+
+const char *EdgeVisionLastError(const EdgeVisionContext *context)
+{
+    return context->error;
+}
+
+int EdgeVisionThreads(const EdgeVisionContext *context)
+{
+    return context->threads;
+}
+
+void EdgeVisionLastStats(const EdgeVisionContext *context, EdgeVisionStats *stats)
+{
+    *stats = context->stats;
+}
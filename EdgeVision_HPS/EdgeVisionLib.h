@@ -0,0 +1,195 @@
+#ifndef EDGEVISION_LIB_H
+#define EDGEVISION_LIB_H
+
+/***********************
+ **
+ ** libedgevision public API
+ **
+ ** The edge kernels of the HPS build as a library that can be embedded in
+ ** another process. All state lives in an EdgeVisionContext: its worker
+ ** threads, its pool of image buffers and the message of the last error.
+ ** There are no globals, so any number of contexts can be used at the same
+ ** time from different threads. Calls on one context are serialized.
+ **
+ ** This header only depends on the C library; link with -ledgevision
+ ** -lpthread (static) or against libedgevision.so.
+ **
+ **********************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EDGEVISION_API_VERSION  4
+
+#if defined(__GNUC__)
+#define EDGEVISION_API __attribute__((visibility("default")))
+#else
+#define EDGEVISION_API
+#endif
+
+typedef struct EdgeVisionContext EdgeVisionContext;
+
+// Kernel implementation used by a context
+typedef enum {
+    EDGEVISION_BACKEND_CPU = 0,         // variant specialized per operator and channel count
+    EDGEVISION_BACKEND_CPU_GENERIC      // one loop with the channel count at runtime (reference)
+} EdgeVisionBackend;
+
+// Same order as the operators of the command line build (--op)
+typedef enum {
+    EDGEVISION_OP_SOBEL = 0,
+    EDGEVISION_OP_SCHARR,
+    EDGEVISION_OP_PREWITT
+} EdgeVisionOperator;
+
+typedef enum {
+    EDGEVISION_MODE_GRADIENT = 0,       // inverted gradient magnitude, like the SOBEL_HPS output
+    EDGEVISION_MODE_CANNY               // 0 on edges, 255 elsewhere
+} EdgeVisionMode;
+
+// Binarize the gradient at a threshold taken from its own histogram
+typedef enum {
+    EDGEVISION_THRESHOLD_NONE = 0,      // keep the gradient
+    EDGEVISION_THRESHOLD_OTSU,          // Otsu's threshold
+    EDGEVISION_THRESHOLD_PERCENTILE     // edges are the samples above this percentile
+} EdgeVisionThreshold;
+
+// How the one pixel frame of the gradient is computed (--border)
+typedef enum {
+    EDGEVISION_BORDER_SKIP = 0,         // not computed, 0
+    EDGEVISION_BORDER_REPLICATE,        // pixels outside repeat the edge pixel
+    EDGEVISION_BORDER_REFLECT101,       // pixels outside mirror about the edge pixel
+    EDGEVISION_BORDER_CONSTANT          // pixels outside are borderValue
+} EdgeVisionBorder;
+
+// Gradient statistics of one image, gathered while the kernel computes it
+typedef struct {
+    unsigned long long histogram[256];  // samples per clamped L1 magnitude (255 - gradient output)
+    unsigned long long samples;         // computed samples, all channels
+    double meanGradient;                // mean clamped L1 magnitude (0..255)
+    int otsuThreshold;
+    int threshold;                      // the one applied, Otsu's without a threshold mode
+    double edgeDensity;                 // fraction of samples above `threshold`
+} EdgeVisionEdgeStats;
+
+// 8-bit image with 1, 3 or 4 interleaved channels, top row first.
+// stride is the distance between rows in bytes; 0 means width * channels.
+typedef struct {
+    unsigned char *pixels;
+    int width, height;
+    int channels;
+    int stride;
+} EdgeVisionImage;
+
+// Rectangle in pixels from the top-left corner
+typedef struct {
+    int x, y, width, height;
+} EdgeVisionRect;
+
+// How tiles are spread over the workers
+typedef enum {
+    EDGEVISION_SCHEDULE_STEAL = 0,      // idle workers take tiles from busy ones
+    EDGEVISION_SCHEDULE_STATIC          // each worker runs only the tiles it was dealt
+} EdgeVisionSchedule;
+
+typedef struct {
+    EdgeVisionBackend backend;
+    int threads;                // workers, 0 = one per online CPU
+    int poolBuffers;            // released buffers kept for reuse, 0 = default
+    EdgeVisionSchedule schedule;
+} EdgeVisionConfig;
+
+typedef struct {
+    EdgeVisionOperator op;
+    EdgeVisionMode mode;
+    int cannyLow, cannyHigh;    // L1 magnitude thresholds, 0,0 = 60,160
+    const EdgeVisionRect *regions;   // compute only these (gradient mode), NULL = whole image
+    int regionCount;
+    EdgeVisionThreshold threshold;   // gradient mode: output 0 on edges, 255 elsewhere
+    int percentile;                  // 1..99 for EDGEVISION_THRESHOLD_PERCENTILE
+    EdgeVisionEdgeStats *stats;      // filled per image (gradient mode), NULL = not needed
+    EdgeVisionBorder border;         // gradient mode of the whole image
+    int borderValue;                 // 0..255 for EDGEVISION_BORDER_CONSTANT
+} EdgeVisionOptions;
+
+// Scheduling counters of the last EdgeVisionProcess/ProcessBatch call
+typedef struct {
+    int threads;
+    long tasks;                 // tiles run
+    long steals;                // tiles run by a worker they were not dealt to
+    double busySeconds;         // summed over the workers
+    double wallSeconds;
+    double efficiency;          // busySeconds / (threads * wallSeconds), 1 = no idle time
+} EdgeVisionStats;
+
+// Called once per finished image of a batch, in input order
+typedef void (*EdgeVisionDoneFn)(void *user, int index);
+
+/**
+ * Create a context. `config` may be NULL for the defaults.
+ * Returns NULL if the threads or memory cannot be set up.
+ */
+EDGEVISION_API EdgeVisionContext *EdgeVisionCreate(const EdgeVisionConfig *config);
+
+/**
+ * Stop the workers and free the context and every pooled buffer.
+ * Images still allocated from the pool must be released first.
+ */
+EDGEVISION_API void EdgeVisionDestroy(EdgeVisionContext *context);
+
+/**
+ * Run the edge filter on `input` and write the result to `output`, which
+ * must have the same size and channel count and must not overlap it.
+ * `options` may be NULL for the Sobel gradient of the whole image.
+ * Returns 0 on success, -1 on failure (see EdgeVisionLastError()).
+ */
+EDGEVISION_API int EdgeVisionProcess(EdgeVisionContext *context, const EdgeVisionImage *input,
+                                     EdgeVisionImage *output, const EdgeVisionOptions *options);
+
+/**
+ * Run the filter on `count` images at once. Every image is cut into tiles of
+ * about the same cost and the tiles of all images are shared by the workers,
+ * so a large image does not hold up the batch behind it. `done` (may be
+ * NULL) is called for image 0, 1, 2, ... as soon as it and all images before
+ * it are finished; it runs on a worker thread and must not call back into
+ * the context. Regions are not supported here.
+ * Returns 0 on success, -1 on failure (see EdgeVisionLastError()).
+ */
+EDGEVISION_API int EdgeVisionProcessBatch(EdgeVisionContext *context, const EdgeVisionImage *inputs,
+                                          EdgeVisionImage *outputs, int count, const EdgeVisionOptions *options,
+                                          EdgeVisionDoneFn done, void *user);
+
+/**
+ * Take a packed width x height x channels image from the context's buffer
+ * pool, reusing a released buffer when one is large enough.
+ * Returns 0 on success, -1 on failure.
+ */
+EDGEVISION_API int EdgeVisionImageAlloc(EdgeVisionContext *context, int width, int height, int channels,
+                                        EdgeVisionImage *image);
+
+/**
+ * Give an image from EdgeVisionImageAlloc() back to the pool.
+ */
+EDGEVISION_API void EdgeVisionImageRelease(EdgeVisionContext *context, EdgeVisionImage *image);
+
+/**
+ * Message describing the last failure on `context`.
+ */
+EDGEVISION_API const char *EdgeVisionLastError(const EdgeVisionContext *context);
+
+/**
+ * Worker threads of `context`.
+ */
+EDGEVISION_API int EdgeVisionThreads(const EdgeVisionContext *context);
+
+/**
+ * Scheduling counters of the last processing call on `context`.
+ */
+EDGEVISION_API void EdgeVisionLastStats(const EdgeVisionContext *context, EdgeVisionStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EDGEVISION_LIB_H */
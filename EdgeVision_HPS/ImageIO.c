@@ -0,0 +1,939 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Pipeline image I/O
+ **
+ ** Readers and writers for BMP, PGM/PPM (P5/P6), headerless raw (packed or
+ ** planar, dimensions from the command line) and Y4M frame sequences, plus
+ ** PNG and BI_RLE8 BMP output encoded on a writer thread. Every
+ ** reader fills the same BMP info header and returns the decoded layout the
+ ** kernels use (bottom-up, unpadded rows, B,G,R order), so the rest of the
+ ** program does not care where a frame came from. "-" is stdin / stdout,
+ ** and streams may carry any number of frames.
+ **
+ **********************/
+
+static int stdoutFd = -1;   // real stdout once ImageClaimStdout() has run
+
+/**
+ * Reserve stdout for image data: diagnostics printed with printf() go to
+ * stderr from now on, and a writer opened on "-" gets the original stdout.
+ */
+int ImageClaimStdout()
+{
+    if (stdoutFd != -1)
+        return 0;
+    fflush(stdout);
+    stdoutFd = dup(STDOUT_FILENO);
+    if (stdoutFd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+        perror("Error redirecting stdout");
+        return -1;
+    }
+    return 0;
+}
+
+static const char *fileExtension(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    return (dot && (!slash || dot > slash)) ? dot + 1 : "";
+}
+
+/**
+ * Map a format name or file extension to an ImageFormat. Returns -1 if
+ * the name is not recognised.
+ */
+int ImageFormatFromName(const char *name, ImageFormat *format)
+{
+    if (strcasecmp(name, "bmp") == 0 || strcasecmp(name, "dib") == 0)
+        *format = IMAGE_BMP;
+    else if (strcasecmp(name, "pgm") == 0 || strcasecmp(name, "ppm") == 0 || strcasecmp(name, "pnm") == 0)
+        *format = IMAGE_PNM;
+    else if (strcasecmp(name, "raw") == 0 || strcasecmp(name, "y8") == 0 || strcasecmp(name, "gray") == 0)
+        *format = IMAGE_RAW;
+    else if (strcasecmp(name, "y4m") == 0)
+        *format = IMAGE_Y4M;
+    else if (strcasecmp(name, "png") == 0)
+        *format = IMAGE_PNG;
+    else
+        return -1;
+    return 0;
+}
+
+/**
+ * Parse a raw frame description, "WIDTHxHEIGHT[xCHANNELS][,planar]".
+ */
+int ParseRawSpec(const char *text, RawSpec *spec)
+{
+    char layout[8] = "";
+    memset(spec, 0, sizeof(*spec));
+    spec->channels = 1;
+
+    int fields = sscanf(text, "%dx%dx%d,%7s", &spec->width, &spec->height, &spec->channels, layout);
+    if (fields < 3)
+        fields = sscanf(text, "%dx%d,%7s", &spec->width, &spec->height, layout) + (fields == 3);
+    if (fields < 2 || spec->width <= 0 || spec->height <= 0 ||
+        (spec->channels != 1 && spec->channels != 3 && spec->channels != 4))
+        return -1;
+    if (layout[0] != '\0') {
+        if (strcmp(layout, "planar") != 0)
+            return -1;
+        spec->planar = 1;
+    }
+    return 0;
+}
+
+/* Describe a decoded frame with the BMP headers the rest of the program uses */
+void SynthesizeBmpHeaders(BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader,
+                          int width, int height, int channels)
+{
+    memset(info, 0, sizeof(*info));
+    info->biSize = sizeof(BITMAPINFOHEADER);
+    info->biWidth = width;
+    info->biHeight = height;
+    info->biPlanes = 1;
+    info->biBitCount = channels * 8;
+    info->biCompression = BI_RGB;
+    info->biSizeImage = width * height * channels;
+    info->biXPelsPerMeter = 2835;
+    info->biYPelsPerMeter = 2835;
+
+    // Grey ramp, so 8-bit frames can still be written as BMP
+    if (channels == 1) {
+        info->biClrUsed = 256;
+        for (int i = 0; i < 256; i++) {
+            biColourPalette[i * 4 + 0] = i;
+            biColourPalette[i * 4 + 1] = i;
+            biColourPalette[i * 4 + 2] = i;
+            biColourPalette[i * 4 + 3] = 0;
+        }
+    }
+
+    memset(fileHeader, 0, sizeof(*fileHeader));
+    fileHeader->bfType = 0x4D42;
+    fileHeader->bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + info->biClrUsed * 4;
+    fileHeader->bfSize = fileHeader->bfOffBits + info->biSizeImage;
+}
+
+/* Skip whitespace and '#' comments in a PNM or Y4M header */
+static int skipSpace(FILE *file)
+{
+    int c;
+    while ((c = getc(file)) != EOF) {
+        if (c == '#') {
+            while ((c = getc(file)) != EOF && c != '\n')
+                ;
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            ungetc(c, file);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int readHeaderInt(FILE *file, int *value)
+{
+    if (skipSpace(file) != 0 || fscanf(file, "%d", value) != 1)
+        return -1;
+    return 0;
+}
+
+/**
+ * Read one top-down row (width * channels samples in file order) into the
+ * bottom-up B,G,R layout.
+ */
+static void storeRow(unsigned char *image, const unsigned char *row, int width, int height,
+                     int channels, int y, int swapRedBlue)
+{
+    unsigned char *dst = image + (size_t)(height - 1 - y) * width * channels;
+    if (!swapRedBlue || channels == 1) {
+        memcpy(dst, row, width * channels);
+        return;
+    }
+    for (int x = 0; x < width; x++, dst += channels, row += channels) {
+        dst[0] = row[2];
+        dst[1] = row[1];
+        dst[2] = row[0];
+        if (channels == 4)
+            dst[3] = row[3];
+    }
+}
+
+/* Read a top-down image of `channels` interleaved samples per pixel */
+static unsigned char *readPackedImage(FILE *file, int width, int height, int channels, int swapRedBlue)
+{
+    const size_t rowBytes = (size_t)width * channels;
+    unsigned char *image = (unsigned char *)malloc(rowBytes * height);
+    unsigned char *row = (unsigned char *)malloc(rowBytes);
+    if (!image || !row) {
+        free(image);
+        free(row);
+        return NULL;
+    }
+
+    for (int y = 0; y < height; y++) {
+        if (fread(row, 1, rowBytes, file) != rowBytes) {
+            free(image);
+            free(row);
+            return NULL;
+        }
+        storeRow(image, row, width, height, channels, y, swapRedBlue);
+    }
+    free(row);
+    return image;
+}
+
+static unsigned char *readPnm(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    FILE *file = reader->file;
+    int width, height, maxval;
+    char magic[2];
+
+    if (skipSpace(file) != 0 || fread(magic, 1, 2, file) != 2)
+        return NULL;   // end of stream
+    if (magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6') ||
+        readHeaderInt(file, &width) != 0 || readHeaderInt(file, &height) != 0 ||
+        readHeaderInt(file, &maxval) != 0 || width <= 0 || height <= 0 || maxval < 1 || maxval > 255) {
+        printf("Unsupported or corrupt PNM header (8-bit P5/P6 only)\n");
+        return NULL;
+    }
+    getc(file);   // the single whitespace before the samples
+
+    const int channels = (magic[1] == '5') ? 1 : 3;
+    unsigned char *image = readPackedImage(file, width, height, channels, 1);
+    if (!image)
+        return NULL;
+
+    // Stretch reduced sample ranges to the 0..255 the kernels assume
+    if (maxval != 255) {
+        const size_t size = (size_t)width * height * channels;
+        for (size_t i = 0; i < size; i++)
+            image[i] = (unsigned char)((image[i] * 255 + maxval / 2) / maxval);
+    }
+
+    SynthesizeBmpHeaders(info, fileHeader, width, height, channels);
+    return image;
+}
+
+static unsigned char *readRaw(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    const RawSpec *spec = &reader->raw;
+    unsigned char *image;
+
+    if (!spec->planar) {
+        image = readPackedImage(reader->file, spec->width, spec->height, spec->channels, 1);
+    } else {
+        // One top-down plane per channel, R,G,B(,A) like the packed layout
+        const size_t planeSize = (size_t)spec->width * spec->height;
+        unsigned char *planes = (unsigned char *)malloc(planeSize * spec->channels);
+        image = (unsigned char *)malloc(planeSize * spec->channels);
+        if (!planes || !image || fread(planes, 1, planeSize * spec->channels, reader->file) != planeSize * spec->channels) {
+            free(planes);
+            free(image);
+            return NULL;
+        }
+        for (int y = 0; y < spec->height; y++) {
+            unsigned char *dst = image + (size_t)(spec->height - 1 - y) * spec->width * spec->channels;
+            for (int x = 0; x < spec->width; x++) {
+                for (int c = 0; c < spec->channels; c++) {
+                    int plane = (spec->channels >= 3 && c < 3) ? 2 - c : c;   // B,G,R from R,G,B
+                    dst[x * spec->channels + c] = planes[plane * planeSize + (size_t)y * spec->width + x];
+                }
+            }
+        }
+        free(planes);
+    }
+
+    if (image)
+        SynthesizeBmpHeaders(info, fileHeader, spec->width, spec->height, spec->channels);
+    return image;
+}
+
+/* Parse the YUV4MPEG2 stream header; only 8-bit colour spaces are accepted */
+static int readY4mHeader(ImageReader *reader)
+{
+    char line[256];
+    if (!fgets(line, sizeof(line), reader->file) || strncmp(line, "YUV4MPEG2", 9) != 0)
+        return -1;
+
+    const char *colourSpace = "420";
+    char colour[32] = "";
+    reader->y4mParams[0] = '\0';
+
+    for (char *token = strtok(line + 9, " \n"); token; token = strtok(NULL, " \n")) {
+        switch (token[0]) {
+            case 'W': reader->raw.width = atoi(token + 1); break;
+            case 'H': reader->raw.height = atoi(token + 1); break;
+            case 'C': snprintf(colour, sizeof(colour), "%s", token + 1); colourSpace = colour; break;
+            case 'F': case 'I': case 'A':
+                // Kept so the output stream plays back at the same rate
+                strncat(reader->y4mParams, " ", sizeof(reader->y4mParams) - strlen(reader->y4mParams) - 1);
+                strncat(reader->y4mParams, token, sizeof(reader->y4mParams) - strlen(reader->y4mParams) - 1);
+                break;
+        }
+    }
+
+    const long w = reader->raw.width, h = reader->raw.height;
+    const long cw = (w + 1) / 2, ch = (h + 1) / 2;
+    if (strncmp(colourSpace, "420", 3) == 0 && !strstr(colourSpace, "p1"))   // not 420p10 / p12
+        reader->y4mChroma = 2 * cw * ch;
+    else if (strcmp(colourSpace, "422") == 0)
+        reader->y4mChroma = 2 * cw * h;
+    else if (strcmp(colourSpace, "444") == 0)
+        reader->y4mChroma = 2 * w * h;
+    else if (strcmp(colourSpace, "mono") == 0)
+        reader->y4mChroma = 0;
+    else {
+        printf("Unsupported Y4M colour space: %s\n", colourSpace);
+        return -1;
+    }
+
+    reader->raw.channels = 1;
+    return (w > 0 && h > 0) ? 0 : -1;
+}
+
+static unsigned char *readY4mFrame(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    char line[256];
+    if (!fgets(line, sizeof(line), reader->file) || strncmp(line, "FRAME", 5) != 0)
+        return NULL;
+
+    // The luma plane is the image; chroma is skipped
+    unsigned char *image = readPackedImage(reader->file, reader->raw.width, reader->raw.height, 1, 0);
+    if (!image)
+        return NULL;
+    for (long skipped = 0; skipped < reader->y4mChroma; skipped++)
+        getc(reader->file);
+
+    SynthesizeBmpHeaders(info, fileHeader, reader->raw.width, reader->raw.height, 1);
+    return image;
+}
+
+/* BMPs are parsed in memory, so they can come from a pipe and be concatenated */
+static unsigned char *readBmpFrame(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    BITMAPFILEHEADER header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1)
+        return NULL;
+    if (header.bfType != 0x4D42 || header.bfSize < sizeof(header) + sizeof(BITMAPINFOHEADER)) {
+        printf("Corrupt BMP header\n");
+        return NULL;
+    }
+
+    unsigned char *bytes = (unsigned char *)malloc(header.bfSize);
+    if (!bytes)
+        return NULL;
+    memcpy(bytes, &header, sizeof(header));
+    if (fread(bytes + sizeof(header), 1, header.bfSize - sizeof(header), reader->file) != header.bfSize - sizeof(header)) {
+        free(bytes);
+        return NULL;
+    }
+
+    unsigned char *image = NULL;
+    FILE *memory = fmemopen(bytes, header.bfSize, "rb");
+    if (memory) {
+        image = LoadBitmapStream(memory, info, fileHeader);
+        fclose(memory);
+    }
+    free(bytes);
+    return image;
+}
+
+/*
+ * Map an uncompressed bottom-up BMP and return its pixels in place, so only
+ * the rows the kernels touch are ever read from disk. Rows keep their file
+ * padding (reader->stride). Returns NULL if the file needs decoding.
+ */
+static unsigned char *mapBitmap(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    struct stat st;
+    const int fd = fileno(reader->file);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < (off_t)(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)))
+        return NULL;
+    if (pread(fd, fileHeader, sizeof(BITMAPFILEHEADER), 0) != sizeof(BITMAPFILEHEADER) ||
+        pread(fd, info, sizeof(BITMAPINFOHEADER), sizeof(BITMAPFILEHEADER)) != sizeof(BITMAPINFOHEADER))
+        return NULL;
+
+    // Sizes in 64 bits: on the 32-bit HPS a crafted header would wrap them
+    const int bitCount = info->biBitCount;
+    const uint64_t stride = ((uint64_t)info->biWidth * bitCount + 31) / 32 * 4;
+    const uint64_t pixelBytes = (uint64_t)info->biWidth * (bitCount / 8) * info->biHeight;
+    const DWORD colours = bitCount != 8 ? 0 : (info->biClrUsed && info->biClrUsed < 256) ? info->biClrUsed : 256;
+    const uint64_t paletteOffset = sizeof(BITMAPFILEHEADER) + (uint64_t)info->biSize;
+    if (fileHeader->bfType != 0x4D42 || info->biSize < 40 || info->biCompression != BI_RGB ||
+        info->biWidth <= 0 || info->biHeight <= 0 || (bitCount != 8 && bitCount != 24 && bitCount != 32) ||
+        (uint64_t)st.st_size > SIZE_MAX || pixelBytes > UINT32_MAX || stride > INT32_MAX ||
+        fileHeader->bfOffBits + stride * info->biHeight > (uint64_t)st.st_size ||
+        paletteOffset + colours * 4 > fileHeader->bfOffBits)
+        return NULL;
+
+    unsigned char *map = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    memcpy(biColourPalette, map + paletteOffset, colours * 4);
+    madvise(map, st.st_size, MADV_RANDOM);   // no read-ahead past the touched rows
+
+    // Describe the frame the way the decoder would
+    info->biSize = sizeof(BITMAPINFOHEADER);
+    info->biClrUsed = colours;
+    info->biClrImportant = 0;
+    info->biSizeImage = (DWORD)pixelBytes;
+
+    reader->map = map;
+    reader->mapSize = st.st_size;
+    reader->stride = (int)stride;
+    printf("\nLOG: mapped %dx%d pixels in place, rows %d bytes apart\n", info->biWidth, info->biHeight, reader->stride);
+    return map + fileHeader->bfOffBits;
+}
+
+static int identifyInput(ImageReader *reader, const char *path, const RawSpec *raw);
+
+/**
+ * Open an input for reading frames. `path` may be "-" for stdin. A
+ * non-NULL `raw` forces headerless raw input of that geometry; otherwise
+ * the format comes from the extension, or from the first byte of the
+ * stream. Returns 0 on success, -1 on failure.
+ */
+int ImageReaderOpen(ImageReader *reader, const char *path, const RawSpec *raw)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    if (strcmp(path, "-") == 0) {
+        reader->file = stdin;
+    } else {
+        reader->file = fopen(path, "rb");
+        if (!reader->file)
+            return -1;
+        reader->ownsFile = 1;
+    }
+    return identifyInput(reader, path, raw);
+}
+
+/**
+ * Open the contents of `path` already read into memory (by the I/O engine).
+ * `data` must stay valid until ImageReaderClose().
+ */
+int ImageReaderOpenMemory(ImageReader *reader, const char *path, unsigned char *data, size_t size, const RawSpec *raw)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    // fmemopen() rejects an empty buffer; an empty file simply has no frames
+    reader->file = size ? fmemopen(data, size, "rb") : fopen("/dev/null", "rb");
+    if (!reader->file)
+        return -1;
+    reader->ownsFile = 1;
+    return identifyInput(reader, path, raw);
+}
+
+/*
+ * Work out the format of a freshly opened input and read its stream header
+ */
+static int identifyInput(ImageReader *reader, const char *path, const RawSpec *raw)
+{
+    if (raw) {
+        reader->format = IMAGE_RAW;
+        reader->raw = *raw;
+    } else if (ImageFormatFromName(fileExtension(path), &reader->format) != 0 || reader->format == IMAGE_RAW) {
+        // Sniff the magic: "BM", "P5"/"P6" or "YUV4MPEG2"
+        int c = getc(reader->file);
+        ungetc(c, reader->file);
+        if (c == 'B')
+            reader->format = IMAGE_BMP;
+        else if (c == 'P')
+            reader->format = IMAGE_PNM;
+        else if (c == 'Y')
+            reader->format = IMAGE_Y4M;
+        else {
+            printf("Cannot tell the format of %s; raw input needs --raw=WxH[xC]\n", path);
+            ImageReaderClose(reader);
+            return -1;
+        }
+    }
+
+    if (reader->format == IMAGE_PNG) {
+        printf("PNG is an output format only: %s\n", path);
+        ImageReaderClose(reader);
+        return -1;
+    }
+    if (reader->format == IMAGE_Y4M && readY4mHeader(reader) != 0) {
+        printf("Corrupt Y4M header in %s\n", path);
+        ImageReaderClose(reader);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Read the next frame of the input. Returns the decoded image (free() it)
+ * with `info` / `fileHeader` describing it, or NULL at the end of the
+ * stream or on error.
+ */
+unsigned char *ImageReadFrame(ImageReader *reader, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    unsigned char *image = NULL;
+
+    // A file-backed BMP is decoded (or mapped) in place; anything else can be a stream
+    if (reader->format == IMAGE_BMP && reader->ownsFile) {
+        if (reader->frames == 0 && reader->mapRows)
+            image = mapBitmap(reader, info, fileHeader);
+        if (reader->frames == 0 && !image)
+            image = LoadBitmapStream(reader->file, info, fileHeader);
+    } else {
+        int c = getc(reader->file);
+        if (c == EOF)
+            return NULL;
+        ungetc(c, reader->file);
+
+        switch (reader->format) {
+            case IMAGE_BMP: image = readBmpFrame(reader, info, fileHeader); break;
+            case IMAGE_PNM: image = readPnm(reader, info, fileHeader); break;
+            case IMAGE_RAW: image = readRaw(reader, info, fileHeader); break;
+            case IMAGE_Y4M: image = readY4mFrame(reader, info, fileHeader); break;
+            default: break;
+        }
+    }
+
+    if (image) {
+        if (!reader->map)
+            reader->stride = info->biWidth * (info->biBitCount / 8);
+        reader->frames++;
+    }
+    return image;
+}
+
+/**
+ * Release a frame returned by ImageReadFrame().
+ */
+void ImageReleaseFrame(ImageReader *reader, unsigned char *image)
+{
+    if (reader->map && image >= reader->map && image < reader->map + reader->mapSize) {
+        munmap(reader->map, reader->mapSize);
+        reader->map = NULL;
+    } else {
+        free(image);
+    }
+}
+
+/**
+ * Non-zero if no frame follows the ones read so far (may block on a pipe).
+ */
+int ImageReaderAtEnd(ImageReader *reader)
+{
+    if (reader->format == IMAGE_BMP && reader->ownsFile)
+        return reader->frames > 0;
+
+    int c = getc(reader->file);
+    if (c == EOF)
+        return 1;
+    ungetc(c, reader->file);
+    return 0;
+}
+
+void ImageReaderClose(ImageReader *reader)
+{
+    if (reader->map)
+        munmap(reader->map, reader->mapSize);
+    reader->map = NULL;
+    if (reader->ownsFile && reader->file)
+        fclose(reader->file);
+    reader->file = NULL;
+    reader->ownsFile = 0;
+}
+
+/**
+ * Open an output for writing frames. `path` may be "-" for stdout (call
+ * ImageClaimStdout() first). `source`, if not NULL, supplies the raw layout
+ * and Y4M frame rate of the input being processed. With an I/O engine, a
+ * file is built in memory and queued for writing when the writer closes.
+ */
+int ImageWriterOpen(ImageWriter *writer, const char *path, ImageFormat format, const ImageReader *source,
+                    IoEngine *io)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->format = format;
+    writer->pngLevel = PNG_DEFAULT_LEVEL;
+    if (source) {
+        writer->planar = source->format == IMAGE_RAW && source->raw.planar;
+        snprintf(writer->y4mParams, sizeof(writer->y4mParams), "%s", source->y4mParams);
+    }
+
+    if (strcmp(path, "-") == 0) {
+        if (ImageClaimStdout() != 0)
+            return -1;
+        writer->file = fdopen(dup(stdoutFd), "wb");
+        writer->isStream = 1;
+    } else {
+        // A file hard-linked from the result cache must not be rewritten in place
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1)
+            unlink(path);
+        if (io) {
+            writer->io = io;
+            snprintf(writer->path, sizeof(writer->path), "%s", path);
+            writer->file = open_memstream(&writer->memory, &writer->memorySize);
+        } else {
+            writer->file = fopen(path, "wb");
+        }
+    }
+    if (!writer->file) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Write one bottom-up frame as top-down rows in file order */
+static int writePacked(FILE *file, const unsigned char *image, int width, int height,
+                       int channels, int outChannels)
+{
+    unsigned char *row = (unsigned char *)malloc((size_t)width * outChannels);
+    if (!row)
+        return -1;
+
+    for (int y = height - 1; y >= 0; y--) {
+        const unsigned char *src = image + (size_t)y * width * channels;
+        for (int x = 0; x < width; x++, src += channels) {
+            unsigned char *dst = row + x * outChannels;
+            if (outChannels == 1) {
+                // Colour frames into a grey format: BT.601 luma
+                dst[0] = (channels == 1) ? src[0] : (unsigned char)((29 * src[0] + 150 * src[1] + 77 * src[2] + 128) >> 8);
+            } else {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                if (outChannels == 4)
+                    dst[3] = src[3];
+            }
+        }
+        fwrite(row, 1, (size_t)width * outChannels, file);
+    }
+    free(row);
+    return ferror(file) ? -1 : 0;
+}
+
+static int writePlanar(FILE *file, const unsigned char *image, int width, int height, int channels)
+{
+    unsigned char *row = (unsigned char *)malloc(width);
+    if (!row)
+        return -1;
+
+    for (int plane = 0; plane < channels; plane++) {
+        int c = (channels >= 3 && plane < 3) ? 2 - plane : plane;
+        for (int y = height - 1; y >= 0; y--) {
+            const unsigned char *src = image + (size_t)y * width * channels + c;
+            for (int x = 0; x < width; x++)
+                row[x] = src[x * channels];
+            fwrite(row, 1, width, file);
+        }
+    }
+    free(row);
+    return ferror(file) ? -1 : 0;
+}
+
+/* Write a whole frame in one of the uncompressed formats */
+static int writeFrame(ImageWriter *writer, unsigned char *image, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    const int width = info->biWidth;
+    const int height = info->biHeight;
+    const int channels = info->biBitCount / 8;
+    int status = 0;
+
+    switch (writer->format) {
+        case IMAGE_BMP:
+            status = SaveBitmapStream(writer->file, image, info, fileHeader);
+            break;
+
+        case IMAGE_PNM: {
+            // Alpha has no place in P6 and is dropped
+            const int outChannels = (channels == 1) ? 1 : 3;
+            fprintf(writer->file, "P%c\n%d %d\n255\n", outChannels == 1 ? '5' : '6', width, height);
+            status = writePacked(writer->file, image, width, height, channels, outChannels);
+            break;
+        }
+
+        case IMAGE_RAW:
+            status = writer->planar ? writePlanar(writer->file, image, width, height, channels)
+                                    : writePacked(writer->file, image, width, height, channels, channels);
+            break;
+
+        case IMAGE_Y4M:
+            if (writer->frames == 0) {
+                writer->width = width;
+                writer->height = height;
+                fprintf(writer->file, "YUV4MPEG2 W%d H%d%s Cmono\n", width, height, writer->y4mParams);
+            } else if (width != writer->width || height != writer->height) {
+                printf("Y4M frames must all be %dx%d\n", writer->width, writer->height);
+                return -1;
+            }
+            fprintf(writer->file, "FRAME\n");
+            status = writePacked(writer->file, image, width, height, channels, 1);
+            break;
+
+        case IMAGE_PNG:
+            break;   // always written by the row pipeline
+    }
+    return status;
+}
+
+/* Encode one row of a pipelined frame; `row` counts in output order */
+static int encodeRow(ImageWriter *writer, int row)
+{
+    const BITMAPINFOHEADER *info = writer->info;
+    const int width = info->biWidth;
+    const int channels = info->biBitCount / 8;
+
+    if (writer->format == IMAGE_PNG) {
+        const unsigned char *src = writer->image + (size_t)(info->biHeight - 1 - row) * width * channels;
+        if (channels == 1)
+            return PngWriteRow(&writer->png, src);
+        // B,G,R(,X) to R,G,B; a fourth channel is dropped as for P6
+        for (int x = 0; x < width; x++, src += channels) {
+            writer->scratch[x * 3 + 0] = src[2];
+            writer->scratch[x * 3 + 1] = src[1];
+            writer->scratch[x * 3 + 2] = src[0];
+        }
+        return PngWriteRow(&writer->png, writer->scratch);
+    }
+
+    // BI_RLE8 rows are stored bottom-up, the order the kernels finish them
+    const size_t worstCase = RLE8_MAX_ROW_BYTES(width);
+    if (writer->encodedLength + worstCase > writer->encodedCapacity) {
+        size_t capacity = writer->encodedCapacity * 2 + worstCase;
+        unsigned char *grown = (unsigned char *)realloc(writer->encoded, capacity);
+        if (!grown)
+            return -1;
+        writer->encoded = grown;
+        writer->encodedCapacity = capacity;
+    }
+    writer->encodedLength += Rle8EncodeRow(writer->image + (size_t)row * width, width,
+                                           writer->encoded + writer->encodedLength);
+    return 0;
+}
+
+/* Write the BI_RLE8 file once every row is encoded, or a plain one if that is smaller */
+static int writeRle8Bitmap(ImageWriter *writer)
+{
+    BITMAPINFOHEADER info = *writer->info;
+    BITMAPFILEHEADER fileHeader = *writer->fileHeader;
+
+    // Dense edge maps have few runs and grow under RLE
+    const size_t stride = ((size_t)info.biWidth + 3) & ~(size_t)3;
+    if (writer->encodedLength >= stride * info.biHeight) {
+        info.biCompression = BI_RGB;
+        const int status = SaveBitmapStream(writer->file, writer->image, &info, &fileHeader);
+        writer->bytesWritten = fileHeader.bfSize;
+        return status;
+    }
+
+    // The last end-of-line marker becomes end-of-bitmap
+    writer->encoded[writer->encodedLength - 1] = 1;
+
+    info.biCompression = BI_RLE8;
+    info.biSizeImage = writer->encodedLength;
+    if (info.biClrUsed == 0)
+        info.biClrUsed = 256;
+    fileHeader.bfType = 0x4D42;
+    fileHeader.bfReserved = 0;
+    fileHeader.bfReserved2 = 0;
+    fileHeader.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + info.biClrUsed * 4;
+    fileHeader.bfSize = fileHeader.bfOffBits + info.biSizeImage;
+
+    fwrite(&fileHeader, sizeof(fileHeader), 1, writer->file);
+    fwrite(&info, sizeof(info), 1, writer->file);
+    fwrite(biColourPalette, 4, info.biClrUsed, writer->file);
+    fwrite(writer->encoded, 1, writer->encodedLength, writer->file);
+    writer->bytesWritten = fileHeader.bfSize;
+    return ferror(writer->file) ? -1 : 0;
+}
+
+/* Start a PNG: grey for grey-ramp palettes, indexed for any other palette */
+static int beginPng(ImageWriter *writer)
+{
+    const BITMAPINFOHEADER *info = writer->info;
+    unsigned char palette[256 * 3];
+    int colourType = info->biBitCount == 8 ? 0 : 2;
+    int colours = info->biClrUsed > 256 ? 256 : (int)info->biClrUsed;
+
+    for (int i = 0; i < colours; i++) {
+        palette[i * 3 + 0] = biColourPalette[i * 4 + 2];
+        palette[i * 3 + 1] = biColourPalette[i * 4 + 1];
+        palette[i * 3 + 2] = biColourPalette[i * 4 + 0];
+        if (colourType == 0 && (palette[i * 3] != i || palette[i * 3 + 1] != i || palette[i * 3 + 2] != i))
+            colourType = 3;
+    }
+    return PngWriterBegin(&writer->png, writer->file, info->biWidth, info->biHeight,
+                          colourType, palette, colours, writer->pngLevel);
+}
+
+static void *writerThread(void *arg)
+{
+    ImageWriter *writer = (ImageWriter *)arg;
+    const int height = writer->info->biHeight;
+    int done = 0;
+
+    if (writer->format == IMAGE_PNG)
+        writer->status = beginPng(writer);
+
+    while (done < height && writer->status == 0) {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->rowsReady == done)
+            pthread_cond_wait(&writer->rowsChanged, &writer->lock);
+        const int ready = writer->rowsReady;
+        pthread_mutex_unlock(&writer->lock);
+
+        for (; done < ready && writer->status == 0; done++)
+            writer->status = encodeRow(writer, done);
+    }
+
+    if (writer->format == IMAGE_PNG) {
+        if (writer->status == 0) {
+            writer->status = PngWriterEnd(&writer->png);
+            writer->bytesWritten = writer->png.bytesWritten;
+        } else {
+            PngWriterFree(&writer->png);
+        }
+    } else if (writer->status == 0) {
+        writer->status = writeRle8Bitmap(writer);
+    }
+    return NULL;
+}
+
+/**
+ * Start writing a frame. `image` must stay valid until ImageWriterEndFrame().
+ * For compressed output a writer thread encodes rows as ImageWriterRowsDone()
+ * reports them, in the order given by writer->topDown; other formats are
+ * written in one go when the frame ends. Returns 0 on success.
+ */
+int ImageWriterBeginFrame(ImageWriter *writer, unsigned char *image, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    // BMPs and PNGs can be concatenated on a pipe, but a file holds one
+    if ((writer->format == IMAGE_BMP || writer->format == IMAGE_PNG) && writer->frames > 0 && !writer->isStream) {
+        printf("A %s file holds one frame; use a stream format for sequences\n",
+               writer->format == IMAGE_BMP ? "BMP" : "PNG");
+        return -1;
+    }
+
+    writer->image = image;
+    writer->info = info;
+    writer->fileHeader = fileHeader;
+    writer->rowsReady = 0;
+    writer->status = 0;
+    writer->bytesWritten = 0;
+    writer->encodedLength = 0;
+
+    const int rle = writer->format == IMAGE_BMP && writer->rle;
+    if (rle && info->biBitCount != 8 && !writer->rleWarned) {
+        printf("BI_RLE8 needs 8-bit frames; writing %d-bit output uncompressed\n", info->biBitCount);
+        writer->rleWarned = 1;
+    }
+    writer->pipelined = writer->format == IMAGE_PNG || (rle && info->biBitCount == 8);
+    writer->topDown = writer->format == IMAGE_PNG;
+    if (!writer->pipelined)
+        return 0;
+
+    if (writer->format == IMAGE_PNG && info->biBitCount != 8) {
+        unsigned char *scratch = (unsigned char *)realloc(writer->scratch, (size_t)info->biWidth * 3);
+        if (!scratch)
+            return -1;
+        writer->scratch = scratch;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->rowsChanged, NULL);
+    if (pthread_create(&writer->thread, NULL, writerThread, writer) != 0) {
+        printf("Could not start the writer thread\n");
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->rowsChanged);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Report that the first `rows` rows (in output order) of the frame are final.
+ */
+void ImageWriterRowsDone(ImageWriter *writer, int rows)
+{
+    if (!writer->pipelined)
+        return;
+    pthread_mutex_lock(&writer->lock);
+    if (rows > writer->rowsReady) {
+        writer->rowsReady = rows;
+        pthread_cond_signal(&writer->rowsChanged);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Finish the frame: wait for the writer thread, or write the whole frame
+ * for uncompressed formats. Returns 0 on success, -1 on failure.
+ */
+int ImageWriterEndFrame(ImageWriter *writer)
+{
+    int status;
+
+    if (writer->pipelined) {
+        ImageWriterRowsDone(writer, writer->info->biHeight);
+        pthread_join(writer->thread, NULL);
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->rowsChanged);
+        status = writer->status;
+
+        if (status == 0) {
+            const BITMAPINFOHEADER *info = writer->info;
+            const long stride = ((info->biWidth * info->biBitCount + 31) / 32) * 4;
+            const long plain = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + info->biClrUsed * 4 +
+                               stride * info->biHeight;
+            if (writer->format == IMAGE_BMP && writer->bytesWritten >= plain)
+                printf("Compressed output : BI_RLE8 would not be smaller, wrote a plain BMP\n");
+            else
+                printf("Compressed output : %ld bytes, %.1fx smaller than a plain BMP\n",
+                       writer->bytesWritten, (double)plain / writer->bytesWritten);
+        }
+    } else {
+        status = writeFrame(writer, writer->image, writer->info, writer->fileHeader);
+    }
+
+    // Downstream stages should see each frame as soon as it is done
+    fflush(writer->file);
+    if (status == 0)
+        writer->frames++;
+    return status;
+}
+
+/**
+ * Append one frame to the output. Returns 0 on success, -1 on failure.
+ */
+int ImageWriteFrame(ImageWriter *writer, unsigned char *image, BITMAPINFOHEADER *info, BITMAPFILEHEADER *fileHeader)
+{
+    if (ImageWriterBeginFrame(writer, image, info, fileHeader) != 0)
+        return -1;
+    return ImageWriterEndFrame(writer);
+}
+
+/**
+ * Close the output. Returns 0 on success, -1 if data could not be written
+ * (a file queued on the I/O engine reports errors from IoEngineFlush()).
+ */
+int ImageWriterClose(ImageWriter *writer)
+{
+    int status = 0;
+    if (writer->file && fclose(writer->file) != 0)
+        status = -1;
+    writer->file = NULL;
+    if (writer->io && writer->memory) {
+        if (status == 0)
+            status = IoEngineWrite(writer->io, writer->path, (unsigned char *)writer->memory, writer->memorySize);
+        else
+            free(writer->memory);
+    }
+    writer->memory = NULL;
+    writer->io = NULL;
+    free(writer->encoded);
+    free(writer->scratch);
+    writer->encoded = writer->scratch = NULL;
+    return status;
+}
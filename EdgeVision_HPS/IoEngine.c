@@ -0,0 +1,564 @@
+#include "EdgeVision.h"
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/***********************
+ **
+ ** Batch file I/O engine
+ **
+ ** Reads whole input files ahead of the kernels and writes finished outputs
+ ** behind them, so the processing thread never blocks on a read or write
+ ** syscall. Up to `depth` reads and `depth` writes are in flight at once.
+ ** With io_uring (Linux 5.1+) the requests are queued on a submission ring
+ ** and reads land in buffers registered with the ring once, at start-up.
+ ** Where io_uring is missing (older kernels, e.g. the DE1-SoC image) a pool
+ ** of `depth` threads runs the same requests with pread()/pwrite().
+ ** Opening and closing files stays synchronous; it is the data transfer
+ ** that scales with the file size.
+ **
+ **********************/
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define IO_HAVE_URING 1
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup     425
+#define __NR_io_uring_enter     426
+#define __NR_io_uring_register  427
+#endif
+#endif
+#endif
+
+static const char *backendNames[] = { "auto", "io_uring", "threads" };
+
+const char *IoBackendName(IoBackend backend)
+{
+    return backendNames[backend];
+}
+
+#ifdef IO_HAVE_URING
+
+static int setupRing(IoEngine *io)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // Every slot has at most one request on the ring
+    io->ringFd = (int)syscall(__NR_io_uring_setup, io->slots, &params);
+    if (io->ringFd < 0)
+        return -1;
+
+    io->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cqRingSize > io->sqRingSize)
+            io->sqRingSize = io->cqRingSize;
+        io->cqRingSize = 0;
+    }
+    io->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    io->sqRing = mmap(NULL, io->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      io->ringFd, IORING_OFF_SQ_RING);
+    if (io->sqRing == MAP_FAILED) {
+        io->sqRing = NULL;
+        return -1;
+    }
+    io->cqRing = io->sqRing;
+    if (io->cqRingSize) {
+        io->cqRing = mmap(NULL, io->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          io->ringFd, IORING_OFF_CQ_RING);
+        if (io->cqRing == MAP_FAILED) {
+            io->cqRing = NULL;
+            return -1;
+        }
+    }
+    io->sqes = mmap(NULL, io->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    io->ringFd, IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED) {
+        io->sqes = NULL;
+        return -1;
+    }
+
+    unsigned char *sq = (unsigned char *)io->sqRing, *cq = (unsigned char *)io->cqRing;
+    io->sqHead = (unsigned *)(sq + params.sq_off.head);
+    io->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    io->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    io->sqArray = (unsigned *)(sq + params.sq_off.array);
+    io->cqHead = (unsigned *)(cq + params.cq_off.head);
+    io->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    io->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    io->cqes = cq + params.cq_off.cqes;
+
+    // Register the read buffers so the kernel pins them once, not per read.
+    // This can fail under a low RLIMIT_MEMLOCK; plain reads still work.
+    if (io->fixed) {
+        struct iovec iov[IO_MAX_DEPTH];
+        for (int i = 0; i < io->depth; i++) {
+            iov[i].iov_base = io->fixed[i];
+            iov[i].iov_len = io->fixedSize;
+        }
+        io->registered = syscall(__NR_io_uring_register, io->ringFd, IORING_REGISTER_BUFFERS, iov, io->depth) == 0;
+    }
+    return 0;
+}
+
+static void closeRing(IoEngine *io)
+{
+    if (io->sqes)
+        munmap(io->sqes, io->sqesSize);
+    if (io->cqRing && io->cqRing != io->sqRing)
+        munmap(io->cqRing, io->cqRingSize);
+    if (io->sqRing)
+        munmap(io->sqRing, io->sqRingSize);
+    if (io->ringFd >= 0)
+        close(io->ringFd);
+    io->sqes = io->cqRing = io->sqRing = NULL;
+    io->ringFd = -1;
+}
+
+// Queue the next chunk of a request
+static int submitRing(IoEngine *io, int id)
+{
+    IoRequest *request = &io->requests[id];
+    size_t length = request->size - request->done;
+    if (length > IO_CHUNK_BYTES)
+        length = IO_CHUNK_BYTES;
+
+    unsigned tail = *io->sqTail;
+    unsigned index = tail & *io->sqMask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe *)io->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = request->fd;
+    sqe->off = request->done;
+    sqe->addr = (unsigned long)(request->data + request->done);
+    sqe->len = (unsigned)length;
+    sqe->user_data = (unsigned)id;
+    if (request->isWrite) {
+        sqe->opcode = IORING_OP_WRITE;
+    } else if (request->fixed >= 0 && io->registered) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = (unsigned short)request->fixed;
+    } else {
+        sqe->opcode = IORING_OP_READ;
+    }
+    io->sqArray[index] = index;
+    __atomic_store_n(io->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, io->ringFd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            __atomic_store_n(io->sqTail, tail, __ATOMIC_RELEASE);   // not consumed; take it back
+            return -1;
+        }
+    }
+    io->inFlight++;
+    return 0;
+}
+
+#endif /* IO_HAVE_URING */
+
+// Called once a request has moved all its bytes or failed
+static void finishRequest(IoEngine *io, IoRequest *request, int error)
+{
+    close(request->fd);
+    request->fd = -1;
+    request->error = error;
+
+    if (request->isWrite) {
+        if (error) {
+            printf("Error writing %s: %s\n", request->path, strerror(error));
+            io->failures++;
+        } else {
+            io->filesWritten++;
+            io->bytesWritten += request->size;
+        }
+        free(request->data);
+        request->data = NULL;
+        request->state = IO_FREE;
+    } else if (error) {
+        request->state = IO_FAILED;
+    } else {
+        io->filesRead++;
+        io->bytesRead += request->size;
+        request->state = IO_DONE;
+    }
+}
+
+#ifdef IO_HAVE_URING
+
+// Handle completions, blocking for at least one if `wait` is set
+static void reapRing(IoEngine *io, int wait)
+{
+    if (io->inFlight == 0)
+        return;
+    if (wait)
+        syscall(__NR_io_uring_enter, io->ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+    unsigned head = *io->cqHead;
+    const unsigned tail = __atomic_load_n(io->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &((const struct io_uring_cqe *)io->cqes)[head & *io->cqMask];
+        IoRequest *request = &io->requests[cqe->user_data];
+        const int result = cqe->res;
+        io->inFlight--;
+
+        if (result == -EINTR || result == -EAGAIN) {
+            if (submitRing(io, (int)cqe->user_data) != 0)
+                finishRequest(io, request, errno);
+        } else if (result < 0) {
+            finishRequest(io, request, -result);
+        } else if (result == 0 && request->done < request->size) {
+            finishRequest(io, request, request->isWrite ? ENOSPC : EIO);   // file changed under us
+        } else {
+            request->done += result;
+            if (request->done < request->size) {
+                if (submitRing(io, (int)cqe->user_data) != 0)
+                    finishRequest(io, request, errno);
+            } else
+                finishRequest(io, request, 0);
+        }
+    }
+    __atomic_store_n(io->cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif /* IO_HAVE_URING */
+
+// Thread pool fallback: run queued requests to completion
+static void *ioThread(void *arg)
+{
+    IoEngine *io = (IoEngine *)arg;
+
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        IoRequest *request = NULL;
+        for (int i = 0; i < io->slots && !request; i++)
+            if (io->requests[i].state == IO_QUEUED)
+                request = &io->requests[i];
+        if (!request) {
+            if (io->stopping)
+                break;
+            pthread_cond_wait(&io->queued, &io->lock);
+            continue;
+        }
+        request->state = IO_RUNNING;
+        pthread_mutex_unlock(&io->lock);
+
+        int error = 0;
+        while (request->done < request->size && !error) {
+            size_t length = request->size - request->done;
+            if (length > IO_CHUNK_BYTES)
+                length = IO_CHUNK_BYTES;
+            ssize_t n = request->isWrite
+                ? pwrite(request->fd, request->data + request->done, length, request->done)
+                : pread(request->fd, request->data + request->done, length, request->done);
+            if (n > 0)
+                request->done += n;
+            else if (n == 0)
+                error = request->isWrite ? ENOSPC : EIO;
+            else if (errno != EINTR)
+                error = errno;
+        }
+
+        pthread_mutex_lock(&io->lock);
+        finishRequest(io, request, error);
+        pthread_cond_broadcast(&io->finished);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+static int submit(IoEngine *io, int id)
+{
+#ifdef IO_HAVE_URING
+    if (io->backend == IO_BACKEND_URING) {
+        io->requests[id].state = IO_QUEUED;
+        if (submitRing(io, id) != 0) {
+            finishRequest(io, &io->requests[id], errno);
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    io->requests[id].state = IO_QUEUED;
+    pthread_cond_signal(&io->queued);
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+}
+
+// Block until some request completes
+static void waitForCompletion(IoEngine *io)
+{
+#ifdef IO_HAVE_URING
+    if (io->backend == IO_BACKEND_URING) {
+        reapRing(io, 1);
+        return;
+    }
+#endif
+    pthread_cond_wait(&io->finished, &io->lock);
+}
+
+static void lockEngine(IoEngine *io)
+{
+    if (io->backend == IO_BACKEND_THREADS)
+        pthread_mutex_lock(&io->lock);
+}
+
+static void unlockEngine(IoEngine *io)
+{
+    if (io->backend == IO_BACKEND_THREADS)
+        pthread_mutex_unlock(&io->lock);
+}
+
+/**
+ * Start an engine with `depth` reads and `depth` writes in flight. Each read
+ * slot gets a pooled buffer of `bufferSize` bytes (0 for none); larger
+ * files get a buffer of their own. IO_BACKEND_AUTO and IO_BACKEND_URING
+ * fall back to threads where io_uring is not available.
+ * Returns 0 on success, -1 on failure.
+ */
+int IoEngineOpen(IoEngine *io, IoBackend backend, int depth, size_t bufferSize)
+{
+    memset(io, 0, sizeof(*io));
+    io->ringFd = -1;
+    io->depth = depth < 1 ? 1 : depth > IO_MAX_DEPTH ? IO_MAX_DEPTH : depth;
+    io->slots = 2 * io->depth;
+    io->requests = (IoRequest *)calloc(io->slots, sizeof(IoRequest));
+    if (!io->requests)
+        return -1;
+    for (int i = 0; i < io->slots; i++)
+        io->requests[i].fd = -1;
+
+    if (bufferSize > 0) {
+        io->fixedSize = (bufferSize + 4095) & ~(size_t)4095;
+        io->fixed = (unsigned char **)calloc(io->depth, sizeof(unsigned char *));
+        for (int i = 0; io->fixed && i < io->depth; i++) {
+            io->fixed[i] = (unsigned char *)mmap(NULL, io->fixedSize, PROT_READ | PROT_WRITE,
+                                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (io->fixed[i] == MAP_FAILED) {
+                io->fixed[i] = NULL;
+                IoEngineClose(io);
+                return -1;
+            }
+        }
+    }
+
+    if (backend != IO_BACKEND_THREADS) {
+#ifdef IO_HAVE_URING
+        if (setupRing(io) == 0) {
+            io->backend = IO_BACKEND_URING;
+            return 0;
+        }
+        closeRing(io);
+        printf("io_uring unavailable (%s), using %d I/O threads\n", strerror(errno), io->depth);
+#else
+        printf("io_uring not supported by this build, using %d I/O threads\n", io->depth);
+#endif
+    }
+
+    io->backend = IO_BACKEND_THREADS;
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->queued, NULL);
+    pthread_cond_init(&io->finished, NULL);
+    io->threads = (pthread_t *)calloc(io->depth, sizeof(pthread_t));
+    if (!io->threads) {
+        IoEngineClose(io);
+        return -1;
+    }
+    for (int i = 0; i < io->depth; i++) {
+        if (pthread_create(&io->threads[i], NULL, ioThread, io) != 0)
+            break;
+        io->threadCount++;
+    }
+    if (io->threadCount == 0) {
+        IoEngineClose(io);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Start reading all of `path`. Returns the request id for IoEngineWaitRead(),
+ * or -1 if the file cannot be opened or all read slots are busy.
+ */
+int IoEngineRead(IoEngine *io, const char *path)
+{
+    int id = -1;
+    lockEngine(io);
+    for (int i = 0; i < io->depth && id < 0; i++)
+        if (io->requests[i].state == IO_FREE)
+            id = i;
+    unlockEngine(io);
+    if (id < 0)
+        return -1;
+
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    IoRequest *request = &io->requests[id];
+    snprintf(request->path, sizeof(request->path), "%s", path);
+    request->isWrite = 0;
+    request->fd = fd;
+    request->size = st.st_size;
+    request->done = 0;
+    request->error = 0;
+    request->fixed = request->size <= io->fixedSize && io->fixed ? id : -1;
+    request->data = request->fixed >= 0 ? io->fixed[id] : (unsigned char *)malloc(request->size ? request->size : 1);
+    if (!request->data) {
+        close(fd);
+        request->fd = -1;
+        return -1;
+    }
+
+    if (request->size == 0) {
+        lockEngine(io);
+        finishRequest(io, request, 0);
+        unlockEngine(io);
+        return id;
+    }
+    if (submit(io, id) != 0) {
+        IoEngineRelease(io, id);
+        return -1;
+    }
+    return id;
+}
+
+/**
+ * Wait for a read to finish. Returns the file contents, valid until
+ * IoEngineRelease(), with their length in `size`; NULL if the read failed.
+ */
+unsigned char *IoEngineWaitRead(IoEngine *io, int id, size_t *size)
+{
+    IoRequest *request = &io->requests[id];
+
+    lockEngine(io);
+    while (request->state != IO_DONE && request->state != IO_FAILED)
+        waitForCompletion(io);
+    unlockEngine(io);
+
+    if (request->state == IO_FAILED) {
+        printf("Error reading %s: %s\n", request->path, strerror(request->error));
+        return NULL;
+    }
+    *size = request->size;
+    return request->data;
+}
+
+/**
+ * Return a finished read's buffer to the pool.
+ */
+void IoEngineRelease(IoEngine *io, int id)
+{
+    IoRequest *request = &io->requests[id];
+    if (request->fixed < 0)
+        free(request->data);
+    request->data = NULL;
+    lockEngine(io);
+    request->state = IO_FREE;
+    unlockEngine(io);
+}
+
+/**
+ * Write `size` bytes of `data` (malloc()ed; the engine frees it) to `path`
+ * in the background, replacing the file. Waits for a free write slot if
+ * `depth` writes are already in flight. Returns 0 if the write was queued.
+ */
+int IoEngineWrite(IoEngine *io, const char *path, unsigned char *data, size_t size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(path);
+        free(data);
+        io->failures++;
+        return -1;
+    }
+
+    int id = -1;
+    lockEngine(io);
+    for (;;) {
+        for (int i = io->depth; i < io->slots && id < 0; i++)
+            if (io->requests[i].state == IO_FREE)
+                id = i;
+        if (id >= 0)
+            break;
+        waitForCompletion(io);
+    }
+
+    IoRequest *request = &io->requests[id];
+    snprintf(request->path, sizeof(request->path), "%s", path);
+    request->isWrite = 1;
+    request->fd = fd;
+    request->data = data;
+    request->size = size;
+    request->done = 0;
+    request->fixed = -1;
+    request->state = IO_RUNNING;    // claimed; submit() queues it
+    if (size == 0)
+        finishRequest(io, request, 0);
+    unlockEngine(io);
+
+    if (size == 0)
+        return 0;
+    return submit(io, id);
+}
+
+/**
+ * Wait for every queued write. Returns -1 if any write so far has failed.
+ */
+int IoEngineFlush(IoEngine *io)
+{
+    lockEngine(io);
+    for (int i = io->depth; i < io->slots; i++)
+        while (io->requests[i].state != IO_FREE)
+            waitForCompletion(io);
+    unlockEngine(io);
+    return io->failures ? -1 : 0;
+}
+
+void IoEngineClose(IoEngine *io)
+{
+    if (!io->requests)
+        return;
+
+    if (io->backend != IO_BACKEND_AUTO)
+        IoEngineFlush(io);
+
+    // Reads nobody waited for
+    for (int i = 0; io->backend != IO_BACKEND_AUTO && i < io->depth; i++) {
+        size_t size;
+        if (io->requests[i].state != IO_FREE) {
+            IoEngineWaitRead(io, i, &size);
+            IoEngineRelease(io, i);
+        }
+    }
+
+    if (io->backend == IO_BACKEND_THREADS) {
+        pthread_mutex_lock(&io->lock);
+        io->stopping = 1;
+        pthread_cond_broadcast(&io->queued);
+        pthread_mutex_unlock(&io->lock);
+        for (int i = 0; i < io->threadCount; i++)
+            pthread_join(io->threads[i], NULL);
+        pthread_cond_destroy(&io->finished);
+        pthread_cond_destroy(&io->queued);
+        pthread_mutex_destroy(&io->lock);
+        free(io->threads);
+    }
+#ifdef IO_HAVE_URING
+    closeRing(io);
+#endif
+
+    for (int i = 0; io->fixed && i < io->depth; i++)
+        if (io->fixed[i])
+            munmap(io->fixed[i], io->fixedSize);
+    free(io->fixed);
+    free(io->requests);
+    io->fixed = NULL;
+    io->requests = NULL;
+}
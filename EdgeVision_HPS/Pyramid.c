@@ -0,0 +1,150 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Multi-scale pyramid edge detection
+ **
+ ** Rows of the input are pushed through the levels in a single sweep: each
+ ** new row completes one Sobel row at its level, and every second row is
+ ** 2x2-averaged into the next level, which recurses. All levels are therefore
+ ** built and filtered while their source rows are still in cache, for about
+ ** 1.33x the work of a single-level run.
+ **
+ **********************/
+
+typedef struct {
+    const unsigned char *src;   // level image (level 0 is the caller's input)
+    unsigned char *image;       // owned storage for levels above 0
+    unsigned char *output;
+    int width, height, rowBytes;
+} PyramidLevel;
+
+void PyramidLevelSize(int width, int height, int level, int *levelWidth, int *levelHeight)
+{
+    *levelWidth = width >> level;
+    *levelHeight = height >> level;
+}
+
+/**
+ * Clamp the requested level count so every level keeps a 3x3 interior.
+ */
+int PyramidLevels(int width, int height, int requested)
+{
+    int levels = 0;
+    while (levels < requested && (width >> levels) >= 3 && (height >> levels) >= 3)
+        levels++;
+    return levels;
+}
+
+static void pushRow(PyramidLevel *levels, int count, int level, int row,
+                    SobelKernelFn kernel, int bytesPerPixel)
+{
+    PyramidLevel *L = &levels[level];
+
+    // The row above this one now has its full 3x3 neighbourhood
+    if (row >= 2)
+        kernel(L->src, L->rowBytes, L->output, L->rowBytes, L->width, L->height,
+               bytesPerPixel, 0, row - 1, L->width, row);
+
+    if (level + 1 >= count || !(row & 1))
+        return;
+
+    PyramidLevel *next = &levels[level + 1];
+    int nextRow = row >> 1;
+    if (nextRow >= next->height)
+        return;
+
+    // 2x2 box decimation of rows (row - 1, row) into the next level
+    const unsigned char *a = L->src + (row - 1) * L->rowBytes;
+    const unsigned char *b = a + L->rowBytes;
+    unsigned char *dst = next->image + nextRow * next->rowBytes;
+
+    for (int col = 0; col < next->width; col++) {
+        const int s = 2 * col * bytesPerPixel;
+        for (int channel = 0; channel < bytesPerPixel; channel++) {
+            const int i = s + channel;
+            const int j = i + bytesPerPixel;
+            dst[col * bytesPerPixel + channel] = (unsigned char)((a[i] + a[j] + b[i] + b[j] + 2) >> 2);
+        }
+    }
+
+    pushRow(levels, count, level + 1, nextRow, kernel, bytesPerPixel);
+}
+
+/**
+ * Sobel edge maps for `levels` 2x-decimated levels from one pass over the input.
+ * outputs[k] must hold PyramidLevelSize(k) pixels; level counts beyond
+ * PyramidLevels() are rejected. If `combined` is not NULL it receives the
+ * strongest edge over all levels at full resolution.
+ * Returns 0 on success, -1 on failure.
+ */
+int SobelPyramid(unsigned char *input, int width, int height, int bytesPerPixel, SobelOperator op,
+                 int levels, unsigned char **outputs, unsigned char *combined)
+{
+    // Input validation
+    if (!input || !outputs || bytesPerPixel <= 0 || levels < 1 ||
+        levels > PyramidLevels(width, height, levels)) {
+        return -1;
+    }
+
+    PyramidLevel level[levels];
+    memset(level, 0, sizeof(level));
+
+    for (int k = 0; k < levels; k++) {
+        PyramidLevelSize(width, height, k, &level[k].width, &level[k].height);
+        level[k].rowBytes = level[k].width * bytesPerPixel;
+        level[k].output = outputs[k];
+        memset(outputs[k], 0, level[k].rowBytes * level[k].height);
+
+        if (k == 0) {
+            level[k].src = input;
+        } else {
+            level[k].image = (unsigned char *)malloc(level[k].rowBytes * level[k].height);
+            if (!level[k].image) {
+                for (int j = 1; j < k; j++)
+                    free(level[j].image);
+                return -1;
+            }
+            level[k].src = level[k].image;
+        }
+    }
+
+    SobelKernelFn kernel = SelectSobelKernel(op, bytesPerPixel);
+    for (int row = 0; row < height; row++)
+        pushRow(level, levels, 0, row, kernel, bytesPerPixel);
+
+    for (int k = 1; k < levels; k++)
+        free(level[k].image);
+
+    if (!combined)
+        return 0;
+
+    // Darker is stronger in the inverted map, so combine with min. Coarse
+    // levels only contribute their interior, not the unfiltered frame.
+    const int rowBytes = width * bytesPerPixel;
+    memcpy(combined, outputs[0], rowBytes * height);
+
+    for (int k = 1; k < levels; k++) {
+        for (int y = 0; y < height; y++) {
+            int ly = y >> k;
+            if (ly < 1 || ly >= level[k].height - 1)
+                continue;
+
+            const unsigned char *src = outputs[k] + ly * level[k].rowBytes;
+            unsigned char *dst = combined + y * rowBytes;
+
+            for (int x = 0; x < width; x++) {
+                int lx = x >> k;
+                if (lx < 1 || lx >= level[k].width - 1)
+                    continue;
+                for (int channel = 0; channel < bytesPerPixel; channel++) {
+                    unsigned char v = src[lx * bytesPerPixel + channel];
+                    if (v < dst[x * bytesPerPixel + channel])
+                        dst[x * bytesPerPixel + channel] = v;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
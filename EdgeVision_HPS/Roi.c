@@ -0,0 +1,87 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Region-of-interest processing
+ **
+ ** Runs the gradient kernel inside rectangles only. A region reads its
+ ** pixels plus a one-pixel halo and writes nothing else, so the cost
+ ** follows the region area. Regions use image coordinates (x right, y down
+ ** from the top-left corner, as detectors report boxes); buffers stay in
+ ** the bottom-up row order of the rest of the program.
+ **
+ **********************/
+
+/**
+ * Parse "x,y,w,h". Returns 0 on success, -1 if malformed.
+ */
+int ParseRoi(const char *text, SobelRect *rect)
+{
+    char tail;
+    if (sscanf(text, "%d,%d,%d,%d%c", &rect->x, &rect->y, &rect->width, &rect->height, &tail) != 4 ||
+        rect->x < 0 || rect->y < 0 || rect->width <= 0 || rect->height <= 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * Clip `rect` to a width x height image. Returns 0 if anything is left.
+ */
+int ClipRoi(SobelRect *rect, int width, int height)
+{
+    if (rect->x >= width || rect->y >= height)
+        return -1;
+    if (rect->x + rect->width > width)
+        rect->width = width - rect->x;
+    if (rect->y + rect->height > height)
+        rect->height = height - rect->y;
+    return 0;
+}
+
+/**
+ * Gradient of one (clipped) region into `output`, a rect->width x
+ * rect->height buffer with rows `outStride` bytes apart, bottom row first.
+ * Region pixels on the outer frame of the image have no full neighbourhood
+ * and are set to 0, as Sobel() leaves them. `inStride` is the distance
+ * between input rows, so padded or mapped images can be used in place.
+ */
+void SobelRegion(const unsigned char *input, int inStride, int width, int height, int bytesPerPixel,
+                 SobelOperator op, const SobelRect *rect, unsigned char *output, int outStride)
+{
+    SobelRegionWithKernel(SelectSobelKernel(op, bytesPerPixel), input, inStride, width, height,
+                          bytesPerPixel, rect, output, outStride);
+}
+
+/* SobelRegion() with an explicit kernel variant */
+void SobelRegionWithKernel(SobelKernelFn kernel, const unsigned char *input, int inStride, int width, int height,
+                           int bytesPerPixel, const SobelRect *rect, unsigned char *output, int outStride)
+{
+    const int x0 = rect->x, x1 = rect->x + rect->width;
+    const int y0 = height - (rect->y + rect->height), y1 = height - rect->y;   // bottom-up rows
+
+    for (int row = 0; row < rect->height; row++)
+        memset(output + (size_t)row * outStride, 0, (size_t)rect->width * bytesPerPixel);
+
+    // The kernel addresses output by image position; shift the base so the
+    // region's corner lands on output[0]
+    kernel(input, inStride, output - (long)y0 * outStride - (long)x0 * bytesPerPixel, outStride,
+           width, height, bytesPerPixel, x0, y0, x1, y1);
+}
+
+/**
+ * Full-frame output with only the regions computed; everything else is 0.
+ * Overlapping regions are simply computed twice. Regions must be clipped.
+ */
+void SobelRegions(const unsigned char *input, int inStride, unsigned char *output, int width, int height,
+                  int bytesPerPixel, SobelOperator op, const SobelRect *rects, int count)
+{
+    const int outStride = width * bytesPerPixel;
+    memset(output, 0, (size_t)outStride * height);
+
+    for (int i = 0; i < count; i++) {
+        const SobelRect *rect = &rects[i];
+        const int bottom = height - (rect->y + rect->height);
+        SobelRegion(input, inStride, width, height, bytesPerPixel, op, rect,
+                    output + (size_t)bottom * outStride + (size_t)rect->x * bytesPerPixel, outStride);
+    }
+}
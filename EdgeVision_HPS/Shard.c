@@ -0,0 +1,340 @@
+#define _GNU_SOURCE     // sched_setaffinity() and the CPU_* macros
+#include "EdgeVision.h"
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+/***********************
+ **
+ ** Sharded runner
+ **
+ ** On hosts with many cores one process runs into allocator and stdio
+ ** contention long before the cores are busy, so --workers=N forks N
+ ** worker processes that each run the normal pipeline on whole files. The
+ ** queue lives in an anonymous shared mapping: workers take the next file
+ ** index with an atomic add, and a file whose worker died is put back as
+ ** REQUEUED and taken with a compare-and-swap. Each worker slot has its
+ ** own counters in the mapping, written only by that worker, which the
+ ** coordinator merges into one report once every file is done.
+ **
+ ** The coordinator only waits for its workers. When one dies (a signal or
+ ** a failed exit), the file it was on goes back into the queue, up to
+ ** SHARD_MAX_ATTEMPTS runs, and a fresh worker takes over the slot while
+ ** work is left. Workers are pinned to one core each, or to the CPUs of
+ ** one NUMA node, round robin, and log to output/HPS_worker<k>.txt.
+ **
+ **********************/
+
+enum { FILE_PENDING, FILE_RUNNING, FILE_REQUEUED, FILE_DONE, FILE_FAILED };
+
+// Worker-local progress on the current file, committed by ShardDone()
+static int workerSlot = -1;
+static long fileFrames;
+static uint64_t fileBytes;
+static double fileStart;
+static clock_t fileClock;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *pinNames[] = { "none", "core", "numa" };
+
+/**
+ * Parse "none", "core" or "numa". Returns 0 on success, -1 if unknown.
+ */
+int ParseShardPin(const char *text, ShardPin *pin)
+{
+    for (int i = 0; i <= PIN_NUMA; i++) {
+        if (strcmp(text, pinNames[i]) == 0) {
+            *pin = (ShardPin)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Shared queue for `fileCount` files and `workers` worker slots.
+ * Returns NULL if it cannot be mapped.
+ */
+ShardQueue *ShardCreate(int fileCount, int workers, ShardPin pin)
+{
+    const size_t size = sizeof(ShardQueue) + (size_t)fileCount * sizeof(ShardFile);
+    ShardQueue *queue = (ShardQueue *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (queue == MAP_FAILED)
+        return NULL;
+
+    // The mapping starts zeroed: every file pending, every counter 0
+    queue->mapSize = size;
+    queue->fileCount = fileCount;
+    queue->workerCount = workers;
+    queue->pin = pin;
+    atomic_init(&queue->next, 0);
+    for (int w = 0; w < workers; w++)
+        atomic_init(&queue->workers[w].current, -1);
+    return queue;
+}
+
+void ShardDestroy(ShardQueue *queue)
+{
+    munmap(queue, queue->mapSize);
+}
+
+// CPUs of NUMA node `node` from sysfs ("0-3,8-11"), or 0 if there is no such node
+static int numaNodeCpus(int node, cpu_set_t *set)
+{
+    char path[64], list[1024];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+    const int read = fgets(list, sizeof(list), file) != NULL;
+    fclose(file);
+    if (!read)
+        return 0;
+
+    int cpus = 0;
+    CPU_ZERO(set);
+    for (char *range = strtok(list, ",\n"); range; range = strtok(NULL, ",\n")) {
+        int first, last;
+        const int fields = sscanf(range, "%d-%d", &first, &last);
+        if (fields < 1)
+            continue;
+        if (fields == 1)
+            last = first;
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++, cpus++)
+            CPU_SET(cpu, set);
+    }
+    return cpus;
+}
+
+// Pin the calling worker; the slot's `cpu` records the core or node, -1 if unpinned
+static void pinWorker(ShardQueue *queue, int slot)
+{
+    ShardMetrics *metrics = &queue->workers[slot];
+    cpu_set_t set;
+    metrics->cpu = -1;
+
+    if (queue->pin == PIN_CORE) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        const int cpu = (int)(slot % (cpus > 0 ? cpus : 1));
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == 0)
+            metrics->cpu = cpu;
+    }
+    else if (queue->pin == PIN_NUMA) {
+        int nodes = 0;
+        while (numaNodeCpus(nodes, &set) > 0)
+            nodes++;
+        if (nodes > 0 && numaNodeCpus(slot % nodes, &set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0)
+            metrics->cpu = slot % nodes;
+    }
+}
+
+// Fork the worker of `slot`. Returns 0 in the worker, 1 in the coordinator, -1 on failure.
+static int spawnWorker(ShardQueue *queue, int slot)
+{
+    fflush(NULL);   // nothing buffered may be written twice
+    const pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid > 0) {
+        queue->workers[slot].pid = pid;
+        queue->workers[slot].starts++;
+        return 1;
+    }
+
+    workerSlot = slot;
+    pinWorker(queue, slot);
+    char logName[48];
+    snprintf(logName, sizeof(logName), "output/HPS_worker%d.txt", slot);
+    if (!freopen(logName, "a", stdout))
+        perror(logName);
+    return 0;
+}
+
+// A file is left to run: never handed out, requeued, or on a live worker
+static int workLeft(ShardQueue *queue)
+{
+    if (atomic_load(&queue->next) < queue->fileCount)
+        return 1;
+    for (int i = 0; i < queue->fileCount; i++) {
+        if (atomic_load(&queue->files[i].state) == FILE_REQUEUED)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Fork the workers and, in the coordinator, wait until every file is done
+ * or given up, replacing workers that die. Returns the worker's slot in a
+ * worker process, which then runs the pipeline on ShardClaim()ed files;
+ * returns -1 in the coordinator once the run is over, or -2 if no worker
+ * could be started.
+ */
+int ShardRun(ShardQueue *queue)
+{
+    int live = 0;
+    queue->started = nowSeconds();
+    for (int slot = 0; slot < queue->workerCount; slot++) {
+        const int spawned = spawnWorker(queue, slot);
+        if (spawned == 0)
+            return slot;
+        if (spawned < 0) {
+            printf("Could not start worker %d: %s\n", slot, strerror(errno));
+            break;
+        }
+        live++;
+    }
+    if (live == 0)
+        return -2;
+
+    while (live > 0) {
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        int slot = 0;
+        while (slot < queue->workerCount && queue->workers[slot].pid != pid)
+            slot++;
+        if (slot == queue->workerCount)
+            continue;
+        live--;
+
+        ShardMetrics *metrics = &queue->workers[slot];
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            continue;
+
+        // The file it was on goes back into the queue, or is given up
+        metrics->crashes++;
+        const int current = atomic_exchange(&metrics->current, -1);
+        if (current >= 0) {
+            ShardFile *file = &queue->files[current];
+            file->attempts++;
+            const int retry = file->attempts < SHARD_MAX_ATTEMPTS;
+            atomic_store(&file->state, retry ? FILE_REQUEUED : FILE_FAILED);
+            queue->requeued += retry;
+            printf("Worker %d (pid %d) %s %d on file %d, %s\n", slot, (int)pid,
+                   WIFSIGNALED(status) ? "died of signal" : "exited with status",
+                   WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status), current,
+                   retry ? "requeued" : "given up");
+        }
+        else
+            printf("Worker %d (pid %d) died between files\n", slot, (int)pid);
+
+        if (workLeft(queue)) {
+            const int spawned = spawnWorker(queue, slot);
+            if (spawned == 0)
+                return slot;
+            if (spawned > 0)
+                live++;
+            else
+                printf("Could not restart worker %d: %s\n", slot, strerror(errno));
+        }
+    }
+    queue->finished = nowSeconds();
+    return -1;
+}
+
+/**
+ * Next file for this worker: a fresh index, else a requeued one. Returns
+ * -1 when the queue is empty.
+ */
+int ShardClaim(ShardQueue *queue)
+{
+    ShardMetrics *metrics = &queue->workers[workerSlot];
+    int index = atomic_fetch_add(&queue->next, 1);
+    if (index >= queue->fileCount) {
+        atomic_store(&queue->next, queue->fileCount);   // keep the counter from wrapping
+        for (index = 0; index < queue->fileCount; index++) {
+            unsigned char expected = FILE_REQUEUED;
+            if (atomic_compare_exchange_strong(&queue->files[index].state, &expected, FILE_RUNNING))
+                break;
+        }
+        if (index == queue->fileCount)
+            return -1;
+    }
+    else
+        atomic_store(&queue->files[index].state, FILE_RUNNING);
+
+    atomic_store(&metrics->current, index);
+    fileFrames = 0;
+    fileBytes = 0;
+    fileStart = nowSeconds();
+    fileClock = clock();
+    return index;
+}
+
+/**
+ * Count one frame of `bytes` input bytes towards the current file.
+ */
+void ShardAddFrame(uint64_t bytes)
+{
+    fileFrames++;
+    fileBytes += bytes;
+}
+
+/**
+ * The current file is complete: add it to this worker's counters.
+ */
+void ShardDone(ShardQueue *queue, int index)
+{
+    ShardMetrics *metrics = &queue->workers[workerSlot];
+    metrics->files++;
+    metrics->frames += fileFrames;
+    metrics->bytes += fileBytes;
+    metrics->busySeconds += nowSeconds() - fileStart;
+    metrics->cpuSeconds += (double)(clock() - fileClock) / CLOCKS_PER_SEC;
+    atomic_store(&queue->files[index].state, FILE_DONE);
+    atomic_store(&metrics->current, -1);
+}
+
+/**
+ * Print the per-worker counters and their merged throughput. Returns the
+ * number of files that were given up.
+ */
+int ShardReport(const ShardQueue *queue, const char *const *inputs)
+{
+    const double wall = queue->finished - queue->started;
+    uint64_t frames = 0, bytes = 0;
+    long files = 0;
+    double busy = 0;
+    int failed = 0;
+
+    printf("Workers : %d, pinned to %s\n", queue->workerCount, pinNames[queue->pin]);
+    for (int w = 0; w < queue->workerCount; w++) {
+        const ShardMetrics *m = &queue->workers[w];
+        char pin[16] = "-";
+        if (m->cpu >= 0)
+            snprintf(pin, sizeof(pin), "%s %d", queue->pin == PIN_NUMA ? "node" : "cpu", m->cpu);
+        printf("Worker %-3d : %-8s %5ld files, %6llu frames, %9.1f MB, busy %7.3f s, cpu %7.3f s, %8.1f MB/s%s\n",
+               w, pin, m->files, (unsigned long long)m->frames, m->bytes / 1e6, m->busySeconds, m->cpuSeconds,
+               m->busySeconds > 0 ? m->bytes / m->busySeconds / 1e6 : 0.0,
+               m->crashes ? " (restarted)" : "");
+        files += m->files;
+        frames += m->frames;
+        bytes += m->bytes;
+        busy += m->busySeconds;
+    }
+    for (int i = 0; i < queue->fileCount; i++) {
+        if (atomic_load(&queue->files[i].state) != FILE_DONE) {
+            printf("Not processed : %s\n", inputs[i]);
+            failed++;
+        }
+    }
+
+    printf("Total : %ld of %d files, %llu frames, %.1f MB in %.3f s, %.1f MB/s, %.1f frames/s\n", files,
+           queue->fileCount, (unsigned long long)frames, bytes / 1e6, wall, wall > 0 ? bytes / wall / 1e6 : 0.0,
+           wall > 0 ? frames / wall : 0.0);
+    printf("Parallelism : %.2f workers busy on average, %d file(s) requeued, %d given up\n",
+           wall > 0 ? busy / wall : 0.0, queue->requeued, failed);
+    return failed;
+}
@@ -0,0 +1,313 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Specialized gradient kernels
+ **
+ ** SobelKernelBody() is force-inlined into one wrapper per (operator, channel
+ ** count) pair, so the channel loop is unrolled and the stencil weights are
+ ** folded into the arithmetic at compile time. The "N" variant keeps the
+ ** channel count as a runtime value for unusual formats. A second family of
+ ** wrappers also fills a SobelStats histogram while it computes, so edge
+ ** statistics and thresholds need no further pass over the input.
+ **
+ ** The one pixel frame is left to SobelBorderPixels(), which maps the
+ ** indices that fall outside the image instead of padding a copy of it.
+ **
+ **********************/
+
+static inline __attribute__((always_inline))
+void SobelKernelBody(const unsigned char *input, int inStride,
+                     unsigned char *output, int outStride,
+                     int width, int height, const int bpp,
+                     int x0, int y0, int x1, int y1,
+                     const int A, const int B, SobelStats *stats)
+{
+    // The outermost frame has no full 3x3 neighbourhood
+    if (x0 < 1) x0 = 1;
+    if (y0 < 1) y0 = 1;
+    if (x1 > width - 1) x1 = width - 1;
+    if (y1 > height - 1) y1 = height - 1;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    uint32_t counts[4][STATS_BINS];   // interleaved so repeated bins do not serialize
+    if (stats)
+        memset(counts, 0, sizeof(counts));
+
+    for (int row = y0; row < y1; row++)
+    {
+        const unsigned char *up   = input + (row - 1) * inStride;
+        const unsigned char *mid  = up + inStride;
+        const unsigned char *down = mid + inStride;
+        unsigned char *out = output + row * outStride;
+
+        for (int col = x0; col < x1; col++)
+        {
+            for (int channel = 0; channel < bpp; channel++)
+            {
+                const int m = col * bpp + channel;
+                const int l = m - bpp;
+                const int r = m + bpp;
+
+                int sumX = A * (up[l] - up[r]) + B * (mid[l] - mid[r]) + A * (down[l] - down[r]);
+                int sumY = A * (up[l] - down[l]) + B * (up[m] - down[m]) + A * (up[r] - down[r]);
+
+                int magnitude = abs(sumX) + abs(sumY);
+                if (magnitude > 255) magnitude = 255;
+
+                out[m] = (255 - (unsigned char)magnitude);
+            }
+        }
+
+        // Counted from the finished row, which is still in cache, so the
+        // loop above stays vectorized
+        if (stats) {
+            const unsigned char *begin = out + x0 * bpp, *end = out + x1 * bpp;
+            const unsigned char *p = begin;
+            for (; p + 4 <= end; p += 4) {
+                counts[0][255 - p[0]]++;
+                counts[1][255 - p[1]]++;
+                counts[2][255 - p[2]]++;
+                counts[3][255 - p[3]]++;
+            }
+            for (; p < end; p++)
+                counts[0][255 - *p]++;
+        }
+    }
+
+    if (stats) {
+        for (int i = 0; i < STATS_BINS; i++)
+            stats->histogram[i] += (uint64_t)counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+        stats->samples += (uint64_t)(x1 - x0) * (y1 - y0) * bpp;
+    }
+}
+
+#define SOBEL_KERNEL_ARGS \
+    const unsigned char *input, int inStride, unsigned char *output, int outStride, \
+    int width, int height, int bytesPerPixel, int x0, int y0, int x1, int y1
+
+#define DEFINE_SOBEL_KERNEL(name, suffix, channels, a, b)                         \
+    static void Kernel_##name##_##suffix(SOBEL_KERNEL_ARGS)                       \
+    {                                                                             \
+        (void)bytesPerPixel;                                                      \
+        SobelKernelBody(input, inStride, output, outStride, width, height,       \
+                        channels, x0, y0, x1, y1, a, b, NULL);                    \
+    }                                                                             \
+    static void StatsKernel_##name##_##suffix(SOBEL_KERNEL_ARGS, SobelStats *stats) \
+    {                                                                             \
+        (void)bytesPerPixel;                                                      \
+        SobelKernelBody(input, inStride, output, outStride, width, height,       \
+                        channels, x0, y0, x1, y1, a, b, stats);                   \
+    }
+
+#define DEFINE_SOBEL_OPERATOR(name, a, b)                     \
+    DEFINE_SOBEL_KERNEL(name, 1, 1, a, b)                     \
+    DEFINE_SOBEL_KERNEL(name, 3, 3, a, b)                     \
+    DEFINE_SOBEL_KERNEL(name, 4, 4, a, b)                     \
+    DEFINE_SOBEL_KERNEL(name, N, bytesPerPixel, a, b)
+
+SOBEL_OPERATORS(DEFINE_SOBEL_OPERATOR)
+
+#define SOBEL_KERNEL_ROW(name, a, b) \
+    { Kernel_##name##_1, Kernel_##name##_3, Kernel_##name##_4, Kernel_##name##_N },
+
+#define SOBEL_STATS_KERNEL_ROW(name, a, b) \
+    { StatsKernel_##name##_1, StatsKernel_##name##_3, StatsKernel_##name##_4, StatsKernel_##name##_N },
+
+// Indexed by [operator][variant], variant 0..2 = 1/3/4 channels, 3 = generic
+static const SobelKernelFn kernelTable[OP_COUNT][4] = {
+    SOBEL_OPERATORS(SOBEL_KERNEL_ROW)
+};
+static const SobelStatsKernelFn statsKernelTable[OP_COUNT][4] = {
+    SOBEL_OPERATORS(SOBEL_STATS_KERNEL_ROW)
+};
+
+static int kernelVariant(int bytesPerPixel)
+{
+    switch (bytesPerPixel) {
+        case 1:  return 0;
+        case 3:  return 1;
+        case 4:  return 2;
+        default: return 3;
+    }
+}
+
+/***********************
+ **
+ ** Border pixels
+ **
+ ** Only the 2 * (width + height) - 4 pixels of the frame need a neighbour
+ ** outside the image, so they get a scalar loop of their own that maps each
+ ** of those neighbours to a pixel inside (or to the constant), and the
+ ** interior loops above stay free of any bounds test.
+ **
+ **********************/
+
+#define SOBEL_OPERATOR_WEIGHTS(name, a, b) { a, b },
+static const int operatorWeights[OP_COUNT][2] = {
+    SOBEL_OPERATORS(SOBEL_OPERATOR_WEIGHTS)
+};
+
+static void borderPixel(const unsigned char *input, int inStride, unsigned char *out, int width, int height,
+                        int bpp, int x, int y, int A, int B, SobelBorder border, int value, SobelStats *stats)
+{
+    const unsigned char *rows[3];
+    int columns[3];
+    for (int k = 0; k < 3; k++) {
+        const int row = SobelBorderIndex(y - 1 + k, height, border);
+        const int column = SobelBorderIndex(x - 1 + k, width, border);
+        rows[k] = row < 0 ? NULL : input + (size_t)row * inStride;
+        columns[k] = column < 0 ? -1 : column * bpp;
+    }
+
+    for (int channel = 0; channel < bpp; channel++) {
+        int p[3][3];
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 3; c++)
+                p[r][c] = rows[r] && columns[c] >= 0 ? rows[r][columns[c] + channel] : value;
+
+        const int sumX = A * (p[0][0] - p[0][2]) + B * (p[1][0] - p[1][2]) + A * (p[2][0] - p[2][2]);
+        const int sumY = A * (p[0][0] - p[2][0]) + B * (p[0][1] - p[2][1]) + A * (p[0][2] - p[2][2]);
+        int magnitude = abs(sumX) + abs(sumY);
+        if (magnitude > 255) magnitude = 255;
+
+        out[x * bpp + channel] = 255 - (unsigned char)magnitude;
+        if (stats)
+            stats->histogram[magnitude]++;
+    }
+    if (stats)
+        stats->samples += bpp;
+}
+
+/**
+ * Compute the frame pixels inside [x0,x1) x [y0,y1), the part the kernels
+ * skip, under `border`; `value` is the outside pixel of BORDER_CONSTANT.
+ * BORDER_SKIP writes 0. With `stats`, the computed samples are added to it.
+ */
+void SobelBorderPixels(const unsigned char *input, int inStride, unsigned char *output, int outStride,
+                       int width, int height, int bytesPerPixel, SobelOperator op, SobelBorder border,
+                       int value, int x0, int y0, int x1, int y1, SobelStats *stats)
+{
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > width) x1 = width;
+    if (y1 > height) y1 = height;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    if (op < 0 || op >= OP_COUNT)
+        op = OP_Sobel;
+    const int A = operatorWeights[op][0], B = operatorWeights[op][1];
+
+    for (int y = y0; y < y1; y++) {
+        unsigned char *out = output + (size_t)y * outStride;
+        const int wholeRow = y == 0 || y == height - 1;
+        // Interior rows only have their first and last pixel in the frame
+        const int step = wholeRow ? 1 : (width > 1 ? width - 1 : 1);
+        for (int x = wholeRow ? x0 : (x0 > 0 ? width - 1 : 0); x < x1; x += step) {
+            if (border == BORDER_SKIP)
+                memset(out + x * bytesPerPixel, 0, bytesPerPixel);
+            else
+                borderPixel(input, inStride, out, width, height, bytesPerPixel, x, y, A, B, border, value, stats);
+        }
+    }
+}
+
+#define SOBEL_OPERATOR_NAME(name, a, b) #name,
+static const char *operatorNames[OP_COUNT] = {
+    SOBEL_OPERATORS(SOBEL_OPERATOR_NAME)
+};
+
+/**
+ * Pick the kernel variant matching the operator and the channel count
+ * taken from the BMP header (biBitCount / 8).
+ */
+SobelKernelFn SelectSobelKernel(SobelOperator op, int bytesPerPixel)
+{
+    if (op < 0 || op >= OP_COUNT)
+        op = OP_Sobel;
+    return kernelTable[op][kernelVariant(bytesPerPixel)];
+}
+
+/**
+ * Kernel variant that also adds its samples to a SobelStats.
+ */
+SobelStatsKernelFn SelectSobelStatsKernel(SobelOperator op, int bytesPerPixel)
+{
+    if (op < 0 || op >= OP_COUNT)
+        op = OP_Sobel;
+    return statsKernelTable[op][kernelVariant(bytesPerPixel)];
+}
+
+/**
+ * The variant that takes the channel count at runtime, for checking the
+ * specialized ones against.
+ */
+SobelKernelFn SelectGenericSobelKernel(SobelOperator op)
+{
+    if (op < 0 || op >= OP_COUNT)
+        op = OP_Sobel;
+    return kernelTable[op][3];
+}
+
+SobelStatsKernelFn SelectGenericSobelStatsKernel(SobelOperator op)
+{
+    if (op < 0 || op >= OP_COUNT)
+        op = OP_Sobel;
+    return statsKernelTable[op][3];
+}
+
+const char *SobelOperatorName(SobelOperator op)
+{
+    if (op < 0 || op >= OP_COUNT)
+        return "unknown";
+    return operatorNames[op];
+}
+
+/**
+ * Look up an operator by (case-insensitive) name.
+ * Returns 0 on success, -1 if the name is unknown.
+ */
+int ParseSobelOperator(const char *name, SobelOperator *op)
+{
+    for (int i = 0; i < OP_COUNT; i++) {
+        if (strcasecmp(name, operatorNames[i]) == 0) {
+            *op = (SobelOperator)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const char *borderNames[BORDER_COUNT] = { "skip", "replicate", "reflect101", "constant" };
+
+const char *SobelBorderName(SobelBorder border)
+{
+    if (border < 0 || border >= BORDER_COUNT)
+        return "unknown";
+    return borderNames[border];
+}
+
+/**
+ * Parse "skip", "replicate", "reflect101" (or "reflect") or "constant[:V]"
+ * (V = 0..255, default 0). Returns 0 on success, -1 on failure.
+ */
+int ParseSobelBorder(const char *text, SobelBorder *border, int *value)
+{
+    char tail;
+    *value = 0;
+    if (strcmp(text, "reflect") == 0) {
+        *border = BORDER_REFLECT101;
+        return 0;
+    }
+    if (strncmp(text, "constant:", 9) == 0) {
+        *border = BORDER_CONSTANT;
+        return sscanf(text + 9, "%d%c", value, &tail) == 1 && *value >= 0 && *value <= 255 ? 0 : -1;
+    }
+    for (int i = 0; i < BORDER_COUNT; i++) {
+        if (strcmp(text, borderNames[i]) == 0) {
+            *border = (SobelBorder)i;
+            return 0;
+        }
+    }
+    return -1;
+}
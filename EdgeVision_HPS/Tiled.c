@@ -0,0 +1,467 @@
+// Tile offsets pass 4 GB on the 32-bit board as well
+#define _FILE_OFFSET_BITS 64
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Tiled image container
+ **
+ ** Images larger than memory, or than the 32-bit size fields of BMP, are
+ ** stored as square tiles in one file:
+ **
+ **   header  TiledHeader (64 bytes, little-endian)
+ **   index   tilesX * tilesY uint64 file offsets, row-major; 0 = the tile
+ **           was never written and reads as zeros
+ **   tiles   tileSize x tileSize x channels bytes each, rows top-down,
+ **           page-aligned, in the order they were first written
+ **
+ ** The header and index stay memory-mapped while the image is open. Tiles
+ ** are mapped only while they are used, so the memory and address space a
+ ** process needs depend on the tile size, not on the image size.
+ **
+ **********************/
+
+static size_t alignUp(uint64_t size)
+{
+    return (size_t)((size + TILED_ALIGN - 1) / TILED_ALIGN * TILED_ALIGN);
+}
+
+static int mapIndex(TiledImage *image, uint64_t tiles)
+{
+    const uint64_t bytes = sizeof(TiledHeader) + tiles * sizeof(uint64_t);
+    if (bytes > (uint64_t)(SIZE_MAX / 2))
+        return -1;
+
+    image->mapSize = alignUp(bytes);
+    void *map = mmap(NULL, image->mapSize, PROT_READ | (image->writable ? PROT_WRITE : 0), MAP_SHARED, image->fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    image->header = (TiledHeader *)map;
+    image->index = (uint64_t *)((unsigned char *)map + sizeof(TiledHeader));
+    image->tileBytes = (size_t)image->header->tileSize * image->header->tileSize * image->header->channels;
+    pthread_mutex_init(&image->lock, NULL);
+    return 0;
+}
+
+/**
+ * Create an empty tiled image; every tile reads as zeros until it is
+ * written. Returns 0 on success, -1 on failure, in which case no file is
+ * left at `path`.
+ */
+int TiledCreate(TiledImage *image, const char *path, uint64_t width, uint64_t height, int channels, int tileSize)
+{
+    memset(image, 0, sizeof(*image));
+    if (width == 0 || height == 0 || (channels != 1 && channels != 3 && channels != 4) ||
+        tileSize < TILED_MIN_TILE || tileSize > TILED_MAX_TILE) {
+        printf("Invalid tiled image: %llux%llux%d, tiles of %d\n", (unsigned long long)width,
+               (unsigned long long)height, channels, tileSize);
+        return -1;
+    }
+
+    const uint64_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint64_t tilesY = (height + tileSize - 1) / tileSize;
+    if (tilesX > UINT32_MAX || tilesY > UINT32_MAX)
+        return -1;
+
+    image->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (image->fd < 0) {
+        printf("Could not create %s\n", path);
+        return -1;
+    }
+    image->writable = 1;
+
+    const uint64_t indexBytes = sizeof(TiledHeader) + tilesX * tilesY * sizeof(uint64_t);
+    if (ftruncate(image->fd, (off_t)alignUp(indexBytes)) != 0) {
+        close(image->fd);
+        unlink(path);
+        return -1;
+    }
+
+    TiledHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC));
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.tileSize = tileSize;
+    header.tilesX = (uint32_t)tilesX;
+    header.tilesY = (uint32_t)tilesY;
+    header.fileSize = alignUp(indexBytes);
+    if (pwrite(image->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        mapIndex(image, tilesX * tilesY) != 0) {
+        close(image->fd);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Open an existing tiled image. Returns 0 on success, -1 on failure.
+ */
+int TiledOpen(TiledImage *image, const char *path, int writable)
+{
+    TiledHeader header;
+    memset(image, 0, sizeof(*image));
+    image->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (image->fd < 0) {
+        printf("Could not open %s\n", path);
+        return -1;
+    }
+    image->writable = writable;
+
+    if (pread(image->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC)) != 0 ||
+        header.tileSize < TILED_MIN_TILE || header.tileSize > TILED_MAX_TILE ||
+        (header.channels != 1 && header.channels != 3 && header.channels != 4) ||
+        header.tilesX != (header.width + header.tileSize - 1) / header.tileSize ||
+        header.tilesY != (header.height + header.tileSize - 1) / header.tileSize ||
+        mapIndex(image, (uint64_t)header.tilesX * header.tilesY) != 0) {
+        printf("%s is not a valid tiled image\n", path);
+        close(image->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Map tile (tx, ty). Without `writable`, a tile that was never written
+ * gives *tile = NULL. With it, such a tile is allocated at the end of the
+ * file (zero-filled). Returns 0 on success, -1 on failure.
+ */
+int TiledMapTile(TiledImage *image, uint32_t tx, uint32_t ty, int writable, unsigned char **tile)
+{
+    const uint64_t slot = (uint64_t)ty * image->header->tilesX + tx;
+    uint64_t offset = image->index[slot];
+    *tile = NULL;
+
+    if (offset == 0) {
+        if (!writable)
+            return 0;
+        pthread_mutex_lock(&image->lock);
+        offset = image->index[slot];
+        if (offset == 0) {
+            offset = image->header->fileSize;
+            if (ftruncate(image->fd, (off_t)(offset + alignUp(image->tileBytes))) != 0) {
+                pthread_mutex_unlock(&image->lock);
+                return -1;
+            }
+            image->header->fileSize = offset + alignUp(image->tileBytes);
+            image->index[slot] = offset;
+        }
+        pthread_mutex_unlock(&image->lock);
+    }
+
+    void *map = mmap(NULL, image->tileBytes, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED,
+                     image->fd, (off_t)offset);
+    if (map == MAP_FAILED)
+        return -1;
+    *tile = (unsigned char *)map;
+    return 0;
+}
+
+void TiledUnmapTile(TiledImage *image, unsigned char *tile)
+{
+    if (tile)
+        munmap(tile, image->tileBytes);
+}
+
+void TiledClose(TiledImage *image)
+{
+    if (image->header) {
+        munmap(image->header, image->mapSize);
+        pthread_mutex_destroy(&image->lock);
+    }
+    if (image->fd >= 0)
+        close(image->fd);
+    memset(image, 0, sizeof(*image));
+    image->fd = -1;
+}
+
+static void unmapBand(TiledImage *image, unsigned char **band)
+{
+    for (uint32_t tx = 0; tx < image->header->tilesX; tx++) {
+        TiledUnmapTile(image, band[tx]);
+        band[tx] = NULL;
+    }
+}
+
+/**
+ * Convert a BMP into a tiled image one row at a time: only one band of
+ * tiles is mapped at a time. Returns 0 on success, -1 on failure.
+ */
+int TiledFromBmp(const char *bmpPath, const char *tiledPath, int tileSize)
+{
+    BITMAPFILEHEADER fileHeader;
+    BITMAPINFOHEADER infoHeader;
+    BmpReader reader;
+    TiledImage image;
+    int status = -1;
+
+    FILE *file = fopen(bmpPath, "rb");
+    if (!file)
+        return -1;
+    if (fread(&fileHeader, sizeof(fileHeader), 1, file) != 1 || fileHeader.bfType != 0x4D42 ||
+        fread(&infoHeader, sizeof(infoHeader), 1, file) != 1 ||
+        BmpReaderOpen(&reader, file, &fileHeader, &infoHeader) != 0) {
+        printf("%s is not a readable BMP\n", bmpPath);
+        fclose(file);
+        return -1;
+    }
+
+    const int width = reader.width, height = reader.height, channels = reader.outBytesPerPixel;
+    unsigned char *row = (unsigned char *)malloc((size_t)width * channels);
+    unsigned char **band = NULL;
+    if (!row || TiledCreate(&image, tiledPath, width, height, channels, tileSize) != 0)
+        goto done;
+    band = (unsigned char **)calloc(image.header->tilesX, sizeof(unsigned char *));
+    if (!band)
+        goto closeImage;
+
+    int bandRow = -1;
+    for (int y; (y = BmpReadRow(&reader, row)) >= 0; ) {
+        const int top = height - 1 - y;    // tiles are top-down
+        if (top / tileSize != bandRow) {
+            unmapBand(&image, band);
+            bandRow = top / tileSize;
+            for (uint32_t tx = 0; tx < image.header->tilesX; tx++)
+                if (TiledMapTile(&image, tx, bandRow, 1, &band[tx]) != 0)
+                    goto closeImage;
+        }
+        const size_t tileRow = (size_t)(top % tileSize) * tileSize * channels;
+        for (uint32_t tx = 0; tx < image.header->tilesX; tx++) {
+            const int x0 = tx * tileSize;
+            const int columns = width - x0 < tileSize ? width - x0 : tileSize;
+            memcpy(band[tx] + tileRow, row + (size_t)x0 * channels, (size_t)columns * channels);
+        }
+    }
+    status = reader.row == height ? 0 : -1;
+    printf("Converted %s to %s : %dx%dx%d in %ux%u tiles of %d\n", bmpPath, tiledPath, width, height, channels,
+           image.header->tilesX, image.header->tilesY, tileSize);
+
+closeImage:
+    if (band)
+        unmapBand(&image, band);
+    TiledClose(&image);
+    if (status != 0)
+        unlink(tiledPath);      // a partly converted container is no use
+done:
+    free(band);
+    free(row);
+    BmpReaderClose(&reader);
+    fclose(file);
+    return status;
+}
+
+/**
+ * Write a tiled image as an uncompressed bottom-up BMP, one row at a time.
+ * Fails if it does not fit in BMP's 32-bit fields. Returns 0 or -1.
+ */
+int TiledToBmp(TiledImage *image, const char *bmpPath)
+{
+    const TiledHeader *header = image->header;
+    const int tileSize = header->tileSize, channels = header->channels;
+    const uint64_t stride = (header->width * channels + 3) & ~(uint64_t)3;
+    if (header->width > INT32_MAX || header->height > INT32_MAX ||
+        stride * header->height + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + 1024 > UINT32_MAX) {
+        printf("%llux%llu is too large for a BMP\n", (unsigned long long)header->width,
+               (unsigned long long)header->height);
+        return -1;
+    }
+
+    BITMAPINFOHEADER info;
+    BITMAPFILEHEADER fileHeader;
+    SynthesizeBmpHeaders(&info, &fileHeader, (int)header->width, (int)header->height, channels);
+    info.biSizeImage = (DWORD)(stride * header->height);
+    fileHeader.bfSize = fileHeader.bfOffBits + info.biSizeImage;
+
+    FILE *file = fopen(bmpPath, "wb");
+    unsigned char *row = (unsigned char *)calloc(stride, 1);
+    unsigned char **band = (unsigned char **)calloc(header->tilesX, sizeof(unsigned char *));
+    int status = -1;
+    if (!file || !row || !band)
+        goto done;
+    if (fwrite(&fileHeader, sizeof(fileHeader), 1, file) != 1 || fwrite(&info, sizeof(info), 1, file) != 1 ||
+        fwrite(biColourPalette, 4, info.biClrUsed, file) != info.biClrUsed)
+        goto done;
+
+    int bandRow = -1;
+    for (int64_t top = (int64_t)header->height - 1; top >= 0; top--) {
+        if (top / tileSize != bandRow) {
+            unmapBand(image, band);
+            bandRow = (int)(top / tileSize);
+            for (uint32_t tx = 0; tx < header->tilesX; tx++)
+                if (TiledMapTile(image, tx, bandRow, 0, &band[tx]) != 0)
+                    goto done;
+        }
+        const size_t tileRow = (size_t)(top % tileSize) * tileSize * channels;
+        for (uint32_t tx = 0; tx < header->tilesX; tx++) {
+            const uint64_t x0 = (uint64_t)tx * tileSize;
+            const size_t bytes = (size_t)((header->width - x0 < (uint64_t)tileSize ? header->width - x0 : tileSize) * channels);
+            if (band[tx])
+                memcpy(row + x0 * channels, band[tx] + tileRow, bytes);
+            else
+                memset(row + x0 * channels, 0, bytes);
+        }
+        if (fwrite(row, 1, stride, file) != stride)
+            goto done;
+    }
+    status = 0;
+
+done:
+    if (band)
+        unmapBand(image, band);
+    if (file && fclose(file) != 0)
+        status = -1;
+    if (file && status != 0)
+        unlink(bmpPath);
+    free(band);
+    free(row);
+    return status;
+}
+
+/***********************
+ **
+ ** Tile-by-tile gradient
+ **
+ ** Each output tile is computed from a (tile + 2) square window: the input
+ ** tile plus a one pixel halo copied from its eight neighbours. Workers take
+ ** tiles in row-major order from a shared counter, so the neighbours a tile
+ ** needs were usually just read by another worker and are still cached.
+ **
+ **********************/
+
+typedef struct {
+    TiledImage *input, *output;
+    SobelKernelFn kernel;
+    uint64_t tiles;
+    atomic_ullong nextTile;
+    atomic_int failed;
+} TiledJob;
+
+// Copy tile (tx, ty) and its halo into `window`; missing neighbours read as zeros
+static int loadWindow(TiledImage *image, uint32_t tx, uint32_t ty, unsigned char *window)
+{
+    const TiledHeader *header = image->header;
+    const int tileSize = header->tileSize, channels = header->channels;
+    const size_t windowStride = (size_t)(tileSize + 2) * channels;
+    const size_t tileStride = (size_t)tileSize * channels;
+
+    memset(window, 0, windowStride * (tileSize + 2));
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (((int64_t)tx + dx) < 0 || ((int64_t)ty + dy) < 0 ||
+                (int64_t)tx + dx >= header->tilesX || (int64_t)ty + dy >= header->tilesY)
+                continue;
+
+            unsigned char *tile;
+            if (TiledMapTile(image, tx + dx, ty + dy, 0, &tile) != 0)
+                return -1;
+            if (!tile)
+                continue;
+
+            // Last row/column of the neighbour above/left, first of the one below/right
+            const int r0 = dy < 0 ? tileSize - 1 : 0, r1 = dy > 0 ? 1 : tileSize;
+            const int c0 = dx < 0 ? tileSize - 1 : 0, c1 = dx > 0 ? 1 : tileSize;
+            const int toRow = dy < 0 ? 0 : dy == 0 ? 1 : tileSize + 1;
+            const int toColumn = dx < 0 ? 0 : dx == 0 ? 1 : tileSize + 1;
+            for (int r = r0; r < r1; r++)
+                memcpy(window + (toRow + r - r0) * windowStride + (size_t)toColumn * channels,
+                       tile + r * tileStride + (size_t)c0 * channels, (size_t)(c1 - c0) * channels);
+            TiledUnmapTile(image, tile);
+        }
+    }
+    return 0;
+}
+
+static void *tiledWorker(void *arg)
+{
+    TiledJob *job = (TiledJob *)arg;
+    const TiledHeader *header = job->input->header;
+    const int tileSize = header->tileSize, channels = header->channels;
+    const int windowSize = tileSize + 2;
+    const size_t windowStride = (size_t)windowSize * channels;
+    const size_t tileStride = (size_t)tileSize * channels;
+
+    unsigned char *window = (unsigned char *)malloc(windowStride * windowSize);
+    unsigned char *result = (unsigned char *)malloc(windowStride * windowSize);
+    if (!window || !result) {
+        atomic_store(&job->failed, 1);
+        goto done;
+    }
+
+    for (;;) {
+        const uint64_t t = atomic_fetch_add(&job->nextTile, 1);
+        if (t >= job->tiles || atomic_load(&job->failed))
+            break;
+        const uint32_t tx = (uint32_t)(t % header->tilesX), ty = (uint32_t)(t / header->tilesX);
+
+        unsigned char *out;
+        if (loadWindow(job->input, tx, ty, window) != 0 || TiledMapTile(job->output, tx, ty, 1, &out) != 0) {
+            atomic_store(&job->failed, 1);
+            break;
+        }
+        job->kernel(window, (int)windowStride, result, (int)windowStride, windowSize, windowSize, channels,
+                    1, 1, windowSize - 1, windowSize - 1);
+
+        // The image's outer frame and the padding past its edge stay 0, as in Sobel()
+        const uint64_t x0 = (uint64_t)tx * tileSize, y0 = (uint64_t)ty * tileSize;
+        const int64_t columnEnd = (int64_t)header->width - 1 - (int64_t)x0;
+        const int firstColumn = x0 == 0 ? 1 : 0;
+        const int lastColumn = columnEnd < tileSize ? (int)columnEnd : tileSize;
+        for (int r = 0; r < tileSize; r++) {
+            unsigned char *outRow = out + r * tileStride;
+            const uint64_t y = y0 + r;
+            if (y == 0 || y + 1 >= header->height || lastColumn <= firstColumn) {
+                memset(outRow, 0, tileStride);
+                continue;
+            }
+            memset(outRow, 0, (size_t)firstColumn * channels);
+            memcpy(outRow + (size_t)firstColumn * channels, result + (r + 1) * windowStride + (size_t)(firstColumn + 1) * channels,
+                   (size_t)(lastColumn - firstColumn) * channels);
+            memset(outRow + (size_t)lastColumn * channels, 0, (size_t)(tileSize - lastColumn) * channels);
+        }
+        TiledUnmapTile(job->output, out);
+    }
+
+done:
+    free(result);
+    free(window);
+    return NULL;
+}
+
+/**
+ * Gradient of a tiled image into `output`, created with the same geometry.
+ * Each of `threads` workers holds two windows of (tile + 2)^2 pixels.
+ * Returns 0 on success, -1 on failure.
+ */
+int SobelTiled(TiledImage *input, TiledImage *output, SobelOperator op, int threads)
+{
+    const TiledHeader *in = input->header, *out = output->header;
+    if (in->width != out->width || in->height != out->height || in->channels != out->channels ||
+        in->tileSize != out->tileSize)
+        return -1;
+
+    TiledJob job;
+    job.input = input;
+    job.output = output;
+    job.kernel = SelectSobelKernel(op, in->channels);
+    job.tiles = (uint64_t)in->tilesX * in->tilesY;
+    atomic_init(&job.nextTile, 0);
+    atomic_init(&job.failed, 0);
+
+    if (threads < 1)
+        threads = 1;
+    if ((uint64_t)threads > job.tiles)
+        threads = (int)job.tiles;
+    pthread_t workers[threads];
+    int started = 1;
+    for (; started < threads; started++)
+        if (pthread_create(&workers[started], NULL, tiledWorker, &job) != 0)
+            break;
+    tiledWorker(&job);
+    for (int i = 1; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    return atomic_load(&job.failed) ? -1 : 0;
+}
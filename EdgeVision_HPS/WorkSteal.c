@@ -0,0 +1,97 @@
+#include "EdgeVision.h"
+
+/***********************
+ **
+ ** Work-stealing deque
+ **
+ ** Chase-Lev deque of task numbers (Chase and Lev, "Dynamic circular
+ ** work-stealing deque", SPAA 2005, with the C11 memory orders of Le et al.,
+ ** PPoPP 2013). The owning worker pushes and pops at the bottom without
+ ** locks; other workers steal from the top with one compare-and-swap. The
+ ** capacity is fixed per job because every task is known before it starts.
+ **
+ **********************/
+
+/**
+ * Make `deque` empty with room for at least `capacity` tasks.
+ * Must not run while other threads use the deque. Returns 0 or -1.
+ */
+int WorkDequeReset(WorkDeque *deque, long capacity)
+{
+    long size = 16;
+    while (size < capacity)
+        size *= 2;
+
+    if (size > deque->mask + 1) {
+        _Atomic long *tasks = (_Atomic long *)realloc((void *)deque->tasks, size * sizeof(_Atomic long));
+        if (!tasks)
+            return -1;
+        deque->tasks = tasks;
+        deque->mask = size - 1;
+    }
+    atomic_store_explicit(&deque->top, 0, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, 0, memory_order_relaxed);
+    return 0;
+}
+
+void WorkDequeFree(WorkDeque *deque)
+{
+    free((void *)deque->tasks);
+    deque->tasks = NULL;
+    deque->mask = 0;
+}
+
+/* Owner only */
+void WorkDequePush(WorkDeque *deque, long task)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->tasks[bottom & deque->mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/**
+ * Owner only: take the newest task. Returns WORK_EMPTY if there is none.
+ */
+long WorkDequePop(WorkDeque *deque)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return WORK_EMPTY;
+    }
+
+    long task = atomic_load_explicit(&deque->tasks[bottom & deque->mask], memory_order_relaxed);
+    if (top == bottom) {
+        // Last task: race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            task = WORK_EMPTY;
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/**
+ * Any thread: take the oldest task. Returns WORK_EMPTY if there is none, or
+ * WORK_RETRY if another thread took it first.
+ */
+long WorkDequeSteal(WorkDeque *deque)
+{
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+        return WORK_EMPTY;
+
+    long task = atomic_load_explicit(&deque->tasks[top & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return WORK_RETRY;
+    return task;
+}
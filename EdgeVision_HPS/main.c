@@ -9,8 +9,6 @@
 
 #include "EdgeVision.h"
 
-extern unsigned char input_row[];
-extern unsigned char output_row;
 /**************************
 **************************
 **
@@ -19,97 +17,952 @@ extern unsigned char output_row;
 *************************
 ************************/
 
+/**
+ * Pyramid mode: level 0 goes to `output`, coarser levels (and optionally the
+ * max-combined map) are saved next to it with _L<k> / _pyramid suffixes.
+ */
+static int runPyramid(unsigned char *input, unsigned char *output, BITMAPINFOHEADER *infoHeader,
+                      BITMAPFILEHEADER *fileHeader, SobelOperator op, int requestedLevels,
+                      int saveCombined, const char *baseName, int baseNameLen)
+{
+  const int bpp = infoHeader->biBitCount / 8;
+  const int width = infoHeader->biWidth;
+  const int height = infoHeader->biHeight;
+  const int levels = PyramidLevels(width, height, requestedLevels);
+  unsigned char *outputs[levels > 0 ? levels : 1];
+  unsigned char *combined = NULL;
+  int status = -1;
+
+  if (levels < 1)
+    return -1;
+
+  memset(outputs, 0, sizeof(outputs));
+  outputs[0] = output;
+  for (int k = 1; k < levels; k++)
+  {
+    int w, h;
+    PyramidLevelSize(width, height, k, &w, &h);
+    outputs[k] = (unsigned char *)malloc(w * h * bpp);
+    if (!outputs[k])
+      goto done;
+  }
+  if (saveCombined && !(combined = (unsigned char *)malloc(width * height * bpp)))
+    goto done;
+
+  printf("Pyramid levels : %d\n", levels);
+  if (SobelPyramid(input, width, height, bpp, op, levels, outputs, combined) != 0)
+    goto done;
+
+  for (int k = 1; k < levels; k++)
+  {
+    char levelFileName[baseNameLen + 40];
+    BITMAPINFOHEADER levelInfo = *infoHeader;
+    BITMAPFILEHEADER levelFile = *fileHeader;
+
+    PyramidLevelSize(width, height, k, &levelInfo.biWidth, &levelInfo.biHeight);
+    snprintf(levelFileName, sizeof(levelFileName), "output/%.*s_L%d_HPSoutput.bmp", baseNameLen, baseName, k);
+    SaveBitmapFile(levelFileName, outputs[k], &levelInfo, &levelFile);
+  }
+
+  if (combined)
+  {
+    char combinedFileName[baseNameLen + 40];
+    BITMAPINFOHEADER combinedInfo = *infoHeader;
+    BITMAPFILEHEADER combinedFile = *fileHeader;
+
+    snprintf(combinedFileName, sizeof(combinedFileName), "output/%.*s_pyramid_HPSoutput.bmp", baseNameLen, baseName);
+    SaveBitmapFile(combinedFileName, combined, &combinedInfo, &combinedFile);
+  }
+  status = 0;
+
+done:
+  for (int k = 1; k < levels; k++)
+    free(outputs[k]);
+  free(combined);
+  return status;
+}
+
+/**
+ * ROI crop mode: each region is computed into a tile of its own size and
+ * saved as <name>_roi<k>_HPSoutput.<ext>; nothing outside them is touched.
+ */
+static int saveRegionTiles(const unsigned char *input, int inStride, BITMAPINFOHEADER *infoHeader,
+                           BITMAPFILEHEADER *fileHeader, SobelOperator op, const SobelRect *regions, int count,
+                           const char *frameName, ImageFormat format, const char *extension,
+                           const ImageReader *source, int compressRle, int pngLevel)
+{
+  const int bpp = infoHeader->biBitCount / 8;
+
+  for (int k = 0; k < count; k++)
+  {
+    const SobelRect *rect = &regions[k];
+    unsigned char *tile = (unsigned char *)malloc((size_t)rect->width * rect->height * bpp);
+    if (!tile)
+      return -1;
+    SobelRegion(input, inStride, infoHeader->biWidth, infoHeader->biHeight, bpp, op, rect, tile, rect->width * bpp);
+
+    BITMAPINFOHEADER tileInfo = *infoHeader;
+    BITMAPFILEHEADER tileFile = *fileHeader;
+    tileInfo.biWidth = rect->width;
+    tileInfo.biHeight = rect->height;
+    tileInfo.biSizeImage = rect->width * rect->height * bpp;
+
+    char tileFileName[512];
+    ImageWriter writer;
+    snprintf(tileFileName, sizeof(tileFileName), "output/%.400s_roi%d_HPSoutput.%.15s", frameName, k, extension);
+    int status = ImageWriterOpen(&writer, tileFileName, format, source, NULL);
+    if (status == 0)
+    {
+      writer.rle = compressRle;
+      writer.pngLevel = pngLevel;
+      status = ImageWriteFrame(&writer, tile, &tileInfo, &tileFile);
+      ImageWriterClose(&writer);
+    }
+    free(tile);
+    if (status != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/**
+ * Tiled mode: the input (a .evt container, or any BMP, which is converted
+ * to output/<name>.evt first) is processed tile by tile into
+ * output/<name>_HPSoutput.evt, and exported to BMP as well when asked.
+ * Memory use depends on the tile size, not on the image size.
+ */
+static int runTiled(const char *inputName, SobelOperator op, int tileSize, int threads, int exportBmp)
+{
+  const char *baseName = strrchr(inputName, '/') ? strrchr(inputName, '/') + 1 : inputName;
+  const char *dot = strrchr(baseName, '.');
+  const int baseNameLen = (dot && dot != baseName) ? (int)(dot - baseName) : (int)strlen(baseName);
+  char path[strlen(baseName) + 48];
+  struct timespec start, end;
+  TiledImage input, output;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (dot && strcmp(dot, ".evt") == 0)
+  {
+    if (TiledOpen(&input, inputName, 0) != 0)
+      return -1;
+  }
+  else
+  {
+    snprintf(path, sizeof(path), "output/%.*s.evt", baseNameLen, baseName);
+    if (TiledFromBmp(inputName, path, tileSize) != 0 || TiledOpen(&input, path, 0) != 0)
+    {
+      printf("Could not convert %s to a tiled image\n", inputName);
+      return -1;
+    }
+  }
+
+  const TiledHeader *header = input.header;
+  snprintf(path, sizeof(path), "output/%.*s_HPSoutput.evt", baseNameLen, baseName);
+  if (TiledCreate(&output, path, header->width, header->height, header->channels, header->tileSize) != 0)
+  {
+    TiledClose(&input);
+    return -1;
+  }
+  printf("Tiled image : %llux%llux%u, %ux%u tiles of %u, %d thread(s)\n", (unsigned long long)header->width,
+         (unsigned long long)header->height, header->channels, header->tilesX, header->tilesY, header->tileSize,
+         threads);
+
+  int status = SobelTiled(&input, &output, op, threads);
+  if (status != 0)
+    unlink(path);   // leave no partly computed container behind
+  if (status == 0 && exportBmp)
+  {
+    snprintf(path, sizeof(path), "output/%.*s_HPSoutput.bmp", baseNameLen, baseName);
+    status = TiledToBmp(&output, path);
+  }
+  // Per thread: two (tile + 2)^2 windows, one mapped input and one mapped output tile
+  const double workingSet = (double)threads * (2.0 * (header->tileSize + 2) * (header->tileSize + 2) *
+                            header->channels + 2.0 * input.tileBytes);
+  TiledClose(&output);
+  TiledClose(&input);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("Tiled working set : %.1f MB\n", workingSet / 1e6);
+  printf("Runtime: %f seconds for %.*s\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+         baseNameLen, baseName);
+  return status;
+}
+
+// Batch I/O engine (--io); closed at exit so queued outputs reach the disk
+// even when a later input fails
+static IoEngine io;
+
+static void closeIoEngine(void)
+{
+  IoEngineClose(&io);
+}
+
+// Output file extensions when the input has none, indexed by ImageFormat
+static const char *formatExtensions[] = { "bmp", "pnm", "raw", "y4m", "png" };
+
+static void print_usage(const char *prog)
+{
+    print_footer();
+    printf("Error: Program accepts minimum 1 and maximum 3 input files (any number with --io or --workers)\n");
+    printf("Usage: %s -o/-w [--op=sobel|scharr|prewitt] [--canny[=LOW,HIGH]] [--pyramid=N[,max]] [--delta[=TILE]]\n"
+           "       [--raw=WxH[xC][,planar]] [--out-format=bmp|pgm|ppm|raw|y4m|png] [--output=PATH|-]\n"
+           "       [--compress=rle] [--png-level=1-9] [--cache[=DIR]] [--roi=x,y,w,h ...] [--roi-output=frame|crop]\n"
+           "       [--io[=uring|threads]] [--io-depth=N] [--stats] [--threshold=otsu|pN] [--tiled[=TILE]]\n"
+           "       [--border=skip|replicate|reflect101|constant[:V]] [--denoise=gaussian|median]\n"
+           "       [--autotune] [--profile=PATH] [--workers=N] [--pin=core|numa|none]\n"
+           "       input1 [input2 input3]\n", prog);
+    printf("Inputs may be BMP, PGM/PPM, raw or Y4M; \"-\" reads stdin and writes stdout in the same format\n");
+    printf("Example: %s -o/-w image.bmp\n", prog);
+    printf("Example: %s -o/-w image1.bmp image2.bmp image3.bmp\n", prog);
+    printf("Example: %s -o/-w --workers=8 frames/*.bmp\n", prog);
+    printf("Example: ffmpeg -i in.mp4 -f yuv4mpegpipe - | %s -w - | ffplay -\n", prog);
+    print_footer();
+}
+
 int main(int argc, char* argv[])
 {
-  if (argc > 5 || argc < 3 ||
+  if (argc < 3 ||
   (strcmp("-o",argv[1]) != 0 &&
   strcmp("-w",argv[1]) != 0))
   {
-    print_footer();
-    printf("Error: Program accepts minimum 1 and maximum 3 input files\n");
-    printf("Usage: %s -o/-w input1.bmp [input2.bmp input3.bmp]\n", argv[0]);
-    printf("Example: %s -o/-w image.bmp\n", argv[0]);
-    printf("Example: %s -o/-w image1.bmp image2.bmp image3.bmp\n", argv[0]);
-    print_footer();
+    print_usage(argv[0]);
     return 1;
   }
 
+  // Options may appear anywhere after -o/-w; everything else is an input file
+  SobelOperator op = OP_Sobel;
+  int canny = 0;
+  int cannyLow = CANNY_DEFAULT_LOW, cannyHigh = CANNY_DEFAULT_HIGH;
+  int pyramidLevels = 0, pyramidMax = 0;
+  int delta = 0, deltaTile = DELTA_DEFAULT_TILE;
+  long deltaTiles = 0, deltaSkipped = 0;
+  DeltaState deltaState;
+  RawSpec rawSpec;
+  int raw = 0;
+  const char *outputPath = NULL;
+  ImageFormat outFormat = IMAGE_BMP;
+  const char *outFormatName = NULL;
+  int compressRle = 0, pngLevel = PNG_DEFAULT_LEVEL;
+  const char *cacheDir = NULL;
+  SobelRect rois[ROI_MAX];
+  int roiCount = 0, roiCrop = 0;
+  ResultCache cache;
+  int useIo = 0, ioDepth = IO_DEFAULT_DEPTH;
+  IoBackend ioBackend = IO_BACKEND_AUTO;
+  int statsJson = 0;
+  ThresholdMode thresholdMode = THRESHOLD_NONE;
+  int thresholdPercentile = 0;
+  int tiled = 0, tiledTile = TILED_DEFAULT_TILE;
+  SobelBorder border = BORDER_SKIP;
+  int borderValue = 0;
+  SobelDenoise denoise = DENOISE_NONE;
+  int autotune = 0;
+  const char *profilePath = NULL;
+  int workers = 0;
+  ShardPin pin = PIN_CORE;
+  int stdinInput = 0;
+  int fileCount = 0;
+  for (int a = 2; a < argc; a++)
+  {
+    if (strncmp(argv[a], "--op=", 5) == 0)
+    {
+      if (ParseSobelOperator(argv[a] + 5, &op) != 0)
+      {
+        printf("Unknown operator: %s\n", argv[a] + 5);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[a], "--canny") == 0)
+      canny = 1;
+    else if (strncmp(argv[a], "--canny=", 8) == 0)
+    {
+      canny = 1;
+      if (sscanf(argv[a] + 8, "%d,%d", &cannyLow, &cannyHigh) != 2 || cannyLow > cannyHigh)
+      {
+        printf("Invalid Canny thresholds: %s\n", argv[a] + 8);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--pyramid=", 10) == 0)
+    {
+      char mode[8] = "";
+      int fields = sscanf(argv[a] + 10, "%d,%7s", &pyramidLevels, mode);
+      if (fields < 1 || pyramidLevels < 1 || (fields == 2 && strcmp(mode, "max") != 0))
+      {
+        printf("Invalid pyramid option: %s\n", argv[a] + 10);
+        return 1;
+      }
+      pyramidMax = (fields == 2);
+    }
+    else if (strcmp(argv[a], "--delta") == 0)
+      delta = 1;
+    else if (strncmp(argv[a], "--delta=", 8) == 0)
+    {
+      delta = 1;
+      deltaTile = atoi(argv[a] + 8);
+      if (deltaTile < 1)
+      {
+        printf("Invalid delta tile size: %s\n", argv[a] + 8);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--raw=", 6) == 0)
+    {
+      if (ParseRawSpec(argv[a] + 6, &rawSpec) != 0)
+      {
+        printf("Invalid raw geometry: %s\n", argv[a] + 6);
+        return 1;
+      }
+      raw = 1;
+    }
+    else if (strncmp(argv[a], "--output=", 9) == 0)
+      outputPath = argv[a] + 9;
+    else if (strncmp(argv[a], "--out-format=", 13) == 0)
+    {
+      outFormatName = argv[a] + 13;
+      if (ImageFormatFromName(outFormatName, &outFormat) != 0)
+      {
+        printf("Unknown output format: %s\n", outFormatName);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--roi=", 6) == 0)
+    {
+      if (roiCount == ROI_MAX || ParseRoi(argv[a] + 6, &rois[roiCount]) != 0)
+      {
+        printf("Invalid region (x,y,w,h, at most %d): %s\n", ROI_MAX, argv[a] + 6);
+        return 1;
+      }
+      roiCount++;
+    }
+    else if (strncmp(argv[a], "--roi-output=", 13) == 0)
+    {
+      if (strcmp(argv[a] + 13, "crop") != 0 && strcmp(argv[a] + 13, "frame") != 0)
+      {
+        printf("Invalid region output: %s\n", argv[a] + 13);
+        return 1;
+      }
+      roiCrop = strcmp(argv[a] + 13, "crop") == 0;
+    }
+    else if (strcmp(argv[a], "--cache") == 0)
+      cacheDir = CACHE_DEFAULT_DIR;
+    else if (strncmp(argv[a], "--cache=", 8) == 0)
+      cacheDir = argv[a] + 8;
+    else if (strcmp(argv[a], "--io") == 0)
+      useIo = 1;
+    else if (strncmp(argv[a], "--io=", 5) == 0)
+    {
+      useIo = 1;
+      if (strcmp(argv[a] + 5, "uring") == 0)
+        ioBackend = IO_BACKEND_URING;
+      else if (strcmp(argv[a] + 5, "threads") == 0)
+        ioBackend = IO_BACKEND_THREADS;
+      else if (strcmp(argv[a] + 5, "auto") != 0)
+      {
+        printf("Unknown I/O backend: %s\n", argv[a] + 5);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--io-depth=", 11) == 0)
+    {
+      useIo = 1;
+      ioDepth = atoi(argv[a] + 11);
+      if (ioDepth < 1 || ioDepth > IO_MAX_DEPTH)
+      {
+        printf("Invalid I/O depth (1-%d): %s\n", IO_MAX_DEPTH, argv[a] + 11);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[a], "--stats") == 0)
+      statsJson = 1;
+    else if (strncmp(argv[a], "--threshold=", 12) == 0)
+    {
+      if (ParseThreshold(argv[a] + 12, &thresholdMode, &thresholdPercentile) != 0)
+      {
+        printf("Invalid threshold (otsu or p1-p99): %s\n", argv[a] + 12);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--border=", 9) == 0)
+    {
+      if (ParseSobelBorder(argv[a] + 9, &border, &borderValue) != 0)
+      {
+        printf("Invalid border (skip, replicate, reflect101 or constant[:V]): %s\n", argv[a] + 9);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--denoise=", 10) == 0)
+    {
+      if (ParseSobelDenoise(argv[a] + 10, &denoise) != 0)
+      {
+        printf("Invalid denoise filter (none, gaussian or median): %s\n", argv[a] + 10);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[a], "--autotune") == 0)
+      autotune = 1;
+    else if (strncmp(argv[a], "--profile=", 10) == 0)
+      profilePath = argv[a] + 10;
+    else if (strncmp(argv[a], "--workers=", 10) == 0)
+    {
+      workers = atoi(argv[a] + 10);
+      if (workers < 1 || workers > SHARD_MAX_WORKERS)
+      {
+        printf("Invalid worker count (1-%d): %s\n", SHARD_MAX_WORKERS, argv[a] + 10);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--pin=", 6) == 0)
+    {
+      if (ParseShardPin(argv[a] + 6, &pin) != 0)
+      {
+        printf("Unknown pinning: %s\n", argv[a] + 6);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[a], "--tiled") == 0)
+      tiled = 1;
+    else if (strncmp(argv[a], "--tiled=", 8) == 0)
+    {
+      tiled = 1;
+      tiledTile = atoi(argv[a] + 8);
+      if (tiledTile < TILED_MIN_TILE || tiledTile > TILED_MAX_TILE)
+      {
+        printf("Invalid tile size (%d-%d): %s\n", TILED_MIN_TILE, TILED_MAX_TILE, argv[a] + 8);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[a], "--compress=rle") == 0)
+      compressRle = 1;
+    else if (strncmp(argv[a], "--png-level=", 12) == 0)
+    {
+      pngLevel = atoi(argv[a] + 12);
+      if (pngLevel < 1 || pngLevel > 9)
+      {
+        printf("Invalid PNG level: %s\n", argv[a] + 12);
+        return 1;
+      }
+    }
+    else if (strncmp(argv[a], "--", 2) == 0)
+    {
+      printf("Unknown option: %s\n", argv[a]);
+      print_usage(argv[0]);
+      return 1;
+    }
+    else
+    {
+      stdinInput |= strcmp(argv[a], "-") == 0;
+      fileCount++;
+    }
+  }
+
+  if ((fileCount < 1 && !autotune) || (!workers && !useIo && fileCount > 3))
+  {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (delta && (canny || pyramidLevels > 0))
+  {
+    printf("--delta works with the plain gradient only\n");
+    return 1;
+  }
+  if (roiCount > 0 && (canny || pyramidLevels > 0 || delta))
+  {
+    printf("--roi works with the plain gradient only\n");
+    return 1;
+  }
+  if ((statsJson || thresholdMode != THRESHOLD_NONE) && (canny || pyramidLevels > 0 || delta || roiCount > 0))
+  {
+    printf("--stats and --threshold work with the plain gradient only\n");
+    return 1;
+  }
+  if ((border != BORDER_SKIP || denoise != DENOISE_NONE) && (canny || pyramidLevels > 0 || delta || roiCount > 0 || tiled))
+  {
+    printf("--border and --denoise work with the plain gradient only\n");
+    return 1;
+  }
+  if (tiled && (canny || pyramidLevels > 0 || delta || roiCount > 0 || statsJson || thresholdMode != THRESHOLD_NONE ||
+                raw || useIo || cacheDir || stdinInput || outputPath || (outFormatName && outFormat != IMAGE_BMP)))
+  {
+    printf("--tiled works with the plain gradient on files, with BMP as the only other output\n");
+    return 1;
+  }
+  if (workers && (stdinInput || outputPath || delta || useIo || tiled))
+  {
+    printf("--workers runs whole files: not with stdin, --output, --delta, --io or --tiled\n");
+    return 1;
+  }
+  if (outputPath && fileCount > 1)
+  {
+    printf("--output takes a single input\n");
+    return 1;
+  }
+  if (outputPath && roiCrop)
+  {
+    printf("--roi-output=crop writes one file per region under output/, not to --output\n");
+    return 1;
+  }
+
+  // Image data on stdout: keep the log off it (before -o redirects the log)
+  if (outputPath ? strcmp(outputPath, "-") == 0 : stdinInput)
+    ImageClaimStdout();
+
   if(strcmp("-o",argv[1]) == 0)
     writeOutPutfile();
 
+  // Kernel variant, band height and threads per frame size: measured now, or
+  // taken from the profile of an earlier --autotune on this host
+  TuneProfile profile;
+  const char *profileFile = profilePath ? profilePath : TUNE_DEFAULT_PROFILE;
+  int profileLoaded = 0;
+  if (autotune)
+  {
+    if (Autotune(&profile) != 0 || TuneProfileSave(&profile, profileFile) != 0)
+    {
+      printf("Could not tune this host or write %s\n", profileFile);
+      return 1;
+    }
+    printf("Profile written to %s\n", profileFile);
+    profileLoaded = 1;
+    if (fileCount == 0)
+      return 0;
+  }
+  else
+  {
+    int status = TuneProfileLoad(&profile, profileFile);
+    if (status == 0)
+    {
+      printf("Profile : %s\n", profileFile);
+      profileLoaded = 1;
+    }
+    else if (status > 0)
+      printf("Ignoring %s, it was tuned on another host (run --autotune)\n", profileFile);
+    else if (profilePath || access(profileFile, F_OK) == 0)
+    {
+      printf("Could not read the profile %s\n", profileFile);
+      if (profilePath)
+        return 1;
+    }
+  }
+  // Without a profile, tiles are spread over every CPU as before
+  const int tiledThreads = profileLoaded ? TuneProfileLookup(&profile, SIZE_MAX)->threads
+                                         : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int poolThreads = 1;
+  for (int c = 0; c < TUNE_CLASSES; c++)
+    poolThreads = profile.classes[c].threads > poolThreads ? profile.classes[c].threads : poolThreads;
   createDirectory("output");
 
+  // Inputs in order; with the I/O engine, files are read ahead `ioDepth` at a time
+  const char *inputs[fileCount];
+  int readIds[fileCount];
+  int nextRead = 0;
+  size_t largestInput = 0;
+  fileCount = 0;
+  for (int a = 2; a < argc; a++)
+  {
+    struct stat st;
+    if (strncmp(argv[a], "--", 2) == 0)
+      continue;
+    if (strcmp(argv[a], "-") != 0 && stat(argv[a], &st) == 0 && (size_t)st.st_size > largestInput)
+      largestInput = st.st_size;
+    readIds[fileCount] = -1;
+    inputs[fileCount++] = argv[a];
+  }
+
+  // With --workers this process only hands out files and merges the workers'
+  // counters; the workers run the rest of main() on the files they claim.
+  // Nothing that holds threads or descriptors is set up before the fork.
+  ShardQueue *shard = NULL;
+  if (workers)
+  {
+    shard = ShardCreate(fileCount, workers < fileCount ? workers : fileCount, pin);
+    if (!shard)
+    {
+      printf("Could not map the work queue\n");
+      return 1;
+    }
+    const int slot = ShardRun(shard);
+    if (slot < 0)
+    {
+      if (slot == -2)
+      {
+        printf("No worker could be started\n");
+        ShardDestroy(shard);
+        return 1;
+      }
+      const int failed = ShardReport(shard, inputs);
+      ShardDestroy(shard);
+      return failed ? 1 : 0;
+    }
+    // A worker pinned to one core gets one band thread
+    if (pin == PIN_CORE)
+      poolThreads = 1;
+  }
+
+  BandPool bandPool;
+  if (BandPoolInit(&bandPool, poolThreads) != 0)
+    return 1;
+
+  DeltaInit(&deltaState, deltaTile);
+  if (cacheDir && CacheOpen(&cache, cacheDir) != 0)
+    return 1;
+  if (useIo)
+  {
+    if (IoEngineOpen(&io, ioBackend, ioDepth, largestInput < IO_POOL_MAX_BYTES ? largestInput : IO_POOL_MAX_BYTES) != 0)
+    {
+      printf("Could not start the I/O engine\n");
+      return 1;
+    }
+    atexit(closeIoEngine);
+    printf("I/O engine : %s, %d files in flight, %s buffers of %zu bytes\n", IoBackendName(io.backend), io.depth,
+           io.registered ? "registered" : "pooled", io.fixedSize);
+  }
+
   int totalImg;
-  totalImg = 2;
+  totalImg = 0;
   double total_cpu_time_used = 0;
-  while(totalImg < argc)
+  while(shard ? (totalImg = ShardClaim(shard)) >= 0 : totalImg < fileCount)
   {
-      print_image_header(argv[totalImg]);
+      const char *inputName = inputs[totalImg];
+      const int fromStdin = strcmp(inputName, "-") == 0;
 
-      int COLS, ROWS, BYTES_PER_PIXEL;
-      clock_t start, end;
-      double cpu_time_used;
-      start = clock();
+      // Keep the read-ahead window full (stdin is read as a stream)
+      for (; useIo && nextRead < fileCount && nextRead < totalImg + io.depth; nextRead++)
+        if (strcmp(inputs[nextRead], "-") != 0)
+          readIds[nextRead] = IoEngineRead(&io, inputs[nextRead]);
 
+      print_image_header(inputName);
 
-      size_t inputLen = strlen(argv[totalImg]);
-      if (inputLen < 4) 
+      if (tiled)
       {
-        printf("Invalid input filename\n");
-        return 1;
+        if (runTiled(inputName, op, tiledTile, tiledThreads, outFormatName != NULL) != 0)
+        {
+          printf("Tiled processing of %s failed\n", inputName);
+          return 1;
+        }
+        printf("\n%s\n", "----------------------------------------------------------------");
+        totalImg++;
+        continue;
       }
-      // Get the base filename
-      char *baseFileName = argv[totalImg];
-      char *lastSlash = strrchr(baseFileName, '/');
-      if (lastSlash != NULL) {
-          baseFileName = lastSlash + 1;  // Skip the last slash to get just the filename
+
+      ImageReader reader;
+      int opened;
+      if (readIds[totalImg] >= 0)
+      {
+        size_t inputSize;
+        unsigned char *inputData = IoEngineWaitRead(&io, readIds[totalImg], &inputSize);
+        opened = inputData ? ImageReaderOpenMemory(&reader, inputName, inputData, inputSize, raw ? &rawSpec : NULL) : -1;
       }
-      size_t baseNameLen = strlen(baseFileName);
-      char outputFileName[baseNameLen + 30];
-      if (snprintf(outputFileName, sizeof(outputFileName), "output/%.*s_HPSoutput.bmp",
-        (int)(baseNameLen - 4), baseFileName) >= sizeof(outputFileName))
+      else
+        opened = ImageReaderOpen(&reader, inputName, raw ? &rawSpec : NULL);
+      if (opened != 0)
       {
-        printf("Output filename too long\n");
+        printf("No image found!\n");
         return 1;
       }
+      const ImageFormat format = outFormatName ? outFormat : reader.format;
+      reader.mapRows = roiCount > 0;   // regions read only the rows they cover
+
+      // Get the base filename, without directory or extension
+      const char *baseFileName = fromStdin ? "stdin" : inputName;
+      const char *lastSlash = strrchr(baseFileName, '/');
+      if (lastSlash != NULL) {
+          baseFileName = lastSlash + 1;  // Skip the last slash to get just the filename
+      }
+      const char *dot = strrchr(baseFileName, '.');
+      const int baseNameLen = (dot && dot != baseFileName) ? (int)(dot - baseFileName) : (int)strlen(baseFileName);
+      const char *extension = outFormatName ? outFormatName
+                            : (dot && dot != baseFileName) ? dot + 1 : formatExtensions[format];
+
+      // Everything besides the pixels and header that shapes the output
+      char cacheSettings[256];
+      snprintf(cacheSettings, sizeof(cacheSettings), "backend=hps op=%s canny=%d:%d,%d format=%d rle=%d png=%d planar=%d y4m=%s threshold=%d:%d border=%d:%d denoise=%d",
+               SobelOperatorName(op), canny, cannyLow, cannyHigh, (int)format, compressRle, pngLevel,
+               reader.raw.planar, reader.y4mParams, (int)thresholdMode, thresholdPercentile, (int)border, borderValue,
+               (int)denoise);
+
+      ImageWriter writer;
+      int writerOpen = 0;
+      long frame = 0;
+      unsigned char *bitmapData;
       BITMAPINFOHEADER bitmapInfoHeader;
       BITMAPFILEHEADER bitmapFileHeader; //our bitmap file header
-      unsigned char *bitmapData;
-      unsigned char *bitmapFinalImage;
-      bitmapData = LoadBitmapFile(argv[totalImg],&bitmapInfoHeader, &bitmapFileHeader);
 
-      if(NULL == bitmapData)
+      // Every frame of the input goes through the same pipeline
+      while ((bitmapData = ImageReadFrame(&reader, &bitmapInfoHeader, &bitmapFileHeader)) != NULL)
       {
-        printf("No image found!\n");
-        return 1;
-      }
+        int COLS, ROWS, BYTES_PER_PIXEL;
+        clock_t start, end;
+        double cpu_time_used;
+        start = clock();
 
+        // Frames after the first are named <base>_f<k> where they get files of their own
+        char frameName[baseNameLen + 24];
+        if (frame == 0)
+          snprintf(frameName, sizeof(frameName), "%.*s", baseNameLen, baseFileName);
+        else
+          snprintf(frameName, sizeof(frameName), "%.*s_f%ld", baseNameLen, baseFileName, frame);
 
-      BYTES_PER_PIXEL = bitmapInfoHeader.biBitCount / 8;
-      COLS = bitmapInfoHeader.biWidth;
-      ROWS = bitmapInfoHeader.biHeight;
+        unsigned char *bitmapFinalImage = NULL;
+        unsigned char *outputImage;
 
-      bitmapFinalImage = (unsigned char*)malloc(ROWS * COLS * BYTES_PER_PIXEL);
-      if (!bitmapFinalImage) {
-          // Handle allocation failure
-          return 0;
-      }
-      Sobel(bitmapData, bitmapFinalImage, COLS, ROWS, BYTES_PER_PIXEL);
-   
-      SaveBitmapFile(outputFileName, bitmapFinalImage, &bitmapInfoHeader, &bitmapFileHeader);
+        BYTES_PER_PIXEL = bitmapInfoHeader.biBitCount / 8;
+        COLS = bitmapInfoHeader.biWidth;
+        ROWS = bitmapInfoHeader.biHeight;
+
+        char outputFileName[sizeof(frameName) + (outputPath ? strlen(outputPath) : 0) + 48];
+        if (outputPath || fromStdin)
+          snprintf(outputFileName, sizeof(outputFileName), "%s", outputPath ? outputPath : "-");
+        else
+          snprintf(outputFileName, sizeof(outputFileName), "output/%s_HPSoutput.%.15s", frameName, extension);
+
+        // BMP and PNG files hold one frame, so each frame of a sequence gets its own
+        if (writerOpen && (format == IMAGE_BMP || format == IMAGE_PNG) && !outputPath && !fromStdin)
+        {
+          ImageWriterClose(&writer);
+          writerOpen = 0;
+        }
 
-      // Clean up
-      free(bitmapData);
-      free(bitmapFinalImage);
+        // Cache only frames that end up as a file of their own
+        uint64_t cacheKey = 0;
+        if (cacheDir)
+        {
+          const int ownFile = strcmp(outputFileName, "-") != 0 && !writerOpen &&
+                              (format == IMAGE_BMP || format == IMAGE_PNG || (frame == 0 && ImageReaderAtEnd(&reader)));
+          if (!ownFile || delta || pyramidLevels > 0 || roiCount > 0 || statsJson)
+            cache.bypassed++;
+          else
+          {
+            cacheKey = CacheKey(bitmapData, &bitmapInfoHeader, cacheSettings);
+            if (CacheFetch(&cache, cacheKey, outputFileName) == 0)
+            {
+              printf("Cache hit : %016llx -> %s\n", (unsigned long long)cacheKey, outputFileName);
+              ImageReleaseFrame(&reader, bitmapData);
+              goto frame_done;
+            }
+          }
+        }
 
-      end = clock();
-      cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-      total_cpu_time_used += cpu_time_used;
+        if (!writerOpen && !roiCrop)
+        {
+          if (ImageWriterOpen(&writer, outputFileName, format, &reader, useIo ? &io : NULL) != 0)
+            return 1;
+          writer.rle = compressRle;
+          writer.pngLevel = pngLevel;
+          writerOpen = 1;
+        }
+        if (!delta && !roiCrop && !(bitmapFinalImage = (unsigned char*)malloc(ROWS * COLS * BYTES_PER_PIXEL)))
+        {
+            // Handle allocation failure
+            return 0;
+        }
+        outputImage = bitmapFinalImage;
+        int frameStarted = 0;
+
+        if (delta)
+        {
+          // Input frames are consecutive; the edge map is owned by deltaState
+          outputImage = SobelDelta(&deltaState, bitmapData, COLS, ROWS, BYTES_PER_PIXEL, op);
+          if (!outputImage)
+          {
+            printf("Delta processing failed\n");
+            return 1;
+          }
+          deltaTiles += deltaState.tilesTotal;
+          deltaSkipped += deltaState.tilesSkipped;
+          printf("Tiles skipped : %ld of %ld (%.1f%%)\n", deltaState.tilesSkipped, deltaState.tilesTotal,
+                 100.0 * deltaState.tilesSkipped / deltaState.tilesTotal);
+        }
+        else if (canny)
+        {
+          printf("Canny thresholds : %d, %d\n", cannyLow, cannyHigh);
+          if (Canny(bitmapData, bitmapFinalImage, COLS, ROWS, BYTES_PER_PIXEL, cannyLow, cannyHigh) != 0)
+          {
+            printf("Canny processing failed\n");
+            return 1;
+          }
+        }
+        else if (pyramidLevels > 0)
+        {
+          if (runPyramid(bitmapData, bitmapFinalImage, &bitmapInfoHeader, &bitmapFileHeader, op,
+                         pyramidLevels, pyramidMax, frameName, (int)strlen(frameName)) != 0)
+          {
+            printf("Pyramid processing failed\n");
+            return 1;
+          }
+        }
+        else if (roiCount > 0)
+        {
+          SobelRect regions[ROI_MAX];
+          int regionCount = 0;
+          long regionPixels = 0;
+          for (int k = 0; k < roiCount; k++)
+          {
+            regions[regionCount] = rois[k];
+            if (ClipRoi(&regions[regionCount], COLS, ROWS) != 0)
+            {
+              printf("Region %d is outside the %dx%d frame\n", k, COLS, ROWS);
+              continue;
+            }
+            regionPixels += (long)regions[regionCount].width * regions[regionCount].height;
+            regionCount++;
+          }
+          printf("Regions : %d, %ld of %ld pixels (%.1f%%)\n", regionCount, regionPixels, (long)COLS * ROWS,
+                 100.0 * regionPixels / ((long)COLS * ROWS));
+
+          if (roiCrop)
+          {
+            if (saveRegionTiles(bitmapData, reader.stride, &bitmapInfoHeader, &bitmapFileHeader, op, regions,
+                                regionCount, frameName, format, extension, &reader, compressRle, pngLevel) != 0)
+            {
+              printf("Could not write the region tiles of %s\n", frameName);
+              return 1;
+            }
+            ImageReleaseFrame(&reader, bitmapData);
+            goto frame_done;
+          }
+          SobelRegions(bitmapData, reader.stride, bitmapFinalImage, COLS, ROWS, BYTES_PER_PIXEL, op,
+                       regions, regionCount);
+        }
+        else
+        {
+          // Kernel variant is dispatched on the channel count from the image header
+          const TuneSetting *tuning = TuneProfileLookup(&profile, (size_t)COLS * ROWS * BYTES_PER_PIXEL);
+          printf("Kernel variant : %s, %d channel(s), border %s, denoise %s\n", SobelOperatorName(op),
+                 BYTES_PER_PIXEL, SobelBorderName(border), SobelDenoiseName(denoise));
+          printf("Tuning : %s kernel, %d-row bands, %d thread(s)\n", KernelVariantName(tuning->variant),
+                 tuning->bandRows, tuning->threads);
+          SobelStats stats;
+          const int collect = statsJson || thresholdMode != THRESHOLD_NONE;
+          if (collect)
+            memset(&stats, 0, sizeof(stats));
+
+          // A thresholded frame is only known once its histogram is complete
+          if (thresholdMode == THRESHOLD_NONE)
+          {
+            if (ImageWriterBeginFrame(&writer, outputImage, &bitmapInfoHeader, &bitmapFileHeader) != 0)
+              return 1;
+            frameStarted = 1;
+          }
+          // Bands go out in the writer's row order, so compression overlaps the kernels
+          for (int done = 0; done < ROWS; )
+          {
+            int rows = ROWS - done < tuning->bandRows ? ROWS - done : tuning->bandRows;
+            int y0 = writer.topDown ? ROWS - done - rows : done;
+            if (BandPoolRows(&bandPool, tuning->threads, bitmapData, bitmapFinalImage, COLS, ROWS, BYTES_PER_PIXEL,
+                             op, tuning->variant, denoise, y0, y0 + rows, border, borderValue,
+                             collect ? &stats : NULL) != 0)
+            {
+              printf("Gradient processing failed\n");
+              return 1;
+            }
+            done += rows;
+            if (frameStarted)
+              ImageWriterRowsDone(&writer, done);
+          }
+
+          if (collect)
+          {
+            const int threshold = SobelStatsThreshold(&stats, thresholdMode, thresholdPercentile);
+            printf("Edge stats : mean gradient %.2f, edge density %.2f%% above %d (%s)\n", SobelStatsMean(&stats),
+                   100.0 * SobelStatsDensity(&stats, threshold), threshold,
+                   thresholdMode == THRESHOLD_PERCENTILE ? "percentile" : "otsu");
+            if (thresholdMode != THRESHOLD_NONE)
+              SobelApplyThreshold(bitmapFinalImage, COLS * BYTES_PER_PIXEL, COLS, ROWS, BYTES_PER_PIXEL, threshold,
+                                  border);
+          }
+          if (statsJson)
+          {
+            char statsFileName[sizeof(frameName) + 32];
+            snprintf(statsFileName, sizeof(statsFileName), "output/%s_HPSstats.json", frameName);
+            if (SobelStatsWriteJson(statsFileName, frameName, COLS, ROWS, BYTES_PER_PIXEL, op, &stats,
+                                    thresholdMode, thresholdPercentile) != 0)
+              printf("Could not write %s\n", statsFileName);
+          }
+        }
+
+        if (!frameStarted && ImageWriterBeginFrame(&writer, outputImage, &bitmapInfoHeader, &bitmapFileHeader) != 0)
+          return 1;
+
+        if (ImageWriterEndFrame(&writer) != 0)
+        {
+          printf("Could not write frame %ld of %s\n", frame, inputName);
+          return 1;
+        }
+
+        if (cacheKey)
+        {
+          // The result must be complete on disk before it is linked into the cache
+          ImageWriterClose(&writer);
+          writerOpen = 0;
+          if (useIo)
+            IoEngineFlush(&io);
+          if (CacheStore(&cache, cacheKey, outputFileName) != 0)
+            printf("Could not store %s in the cache\n", outputFileName);
+        }
+
+        // Clean up
+        ImageReleaseFrame(&reader, bitmapData);
+        free(bitmapFinalImage);
+
+frame_done:
+        frame++;
+        if (shard)
+          ShardAddFrame((uint64_t)COLS * ROWS * BYTES_PER_PIXEL);
+
+        end = clock();
+        cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+        total_cpu_time_used += cpu_time_used;
+        printf("Runtime: %f seconds for %s\n", cpu_time_used, frameName);
+        printf("Total Runtime: %f seconds", total_cpu_time_used);
+        printf("\n%s\n", "----------------------------------------------------------------");
+      }
+
+      if (writerOpen)
+        ImageWriterClose(&writer);
+      ImageReaderClose(&reader);
+      if (readIds[totalImg] >= 0)
+        IoEngineRelease(&io, readIds[totalImg]);
+      if (frame == 0)
+      {
+        printf("No image found!\n");
+        return 1;
+      }
+      if (shard)
+        ShardDone(shard, totalImg);
       totalImg++;
-      printf("Runtime: %f seconds for %s\n", cpu_time_used, baseFileName);
-      printf("Total Runtime: %f seconds", total_cpu_time_used);
-      printf("\n%s\n", "----------------------------------------------------------------");
   }
+
+  if (useIo)
+  {
+    int ioStatus = IoEngineFlush(&io);
+    printf("I/O engine : %ld files read (%.1f MB), %ld written (%.1f MB)\n", io.filesRead, io.bytesRead / 1e6,
+           io.filesWritten, io.bytesWritten / 1e6);
+    IoEngineClose(&io);
+    if (ioStatus != 0)
+    {
+      printf("Some outputs could not be written\n");
+      return 1;
+    }
+  }
+
+  if (cacheDir)
+  {
+    printf("Cache: %ld hits, %ld misses, %ld stored, %ld frames not cacheable\n",
+           cache.hits, cache.misses, cache.stores, cache.bypassed);
+    printf("Cache lifetime: %llu hits, %llu misses, %u results in %s\n",
+           (unsigned long long)cache.header->hits, (unsigned long long)cache.header->misses,
+           cache.header->count, cacheDir);
+    CacheClose(&cache);
+  }
+
+  if (delta)
+  {
+    printf("Delta mode: %ld of %ld tiles skipped (%.1f%%)\n", deltaSkipped, deltaTiles,
+           deltaTiles ? 100.0 * deltaSkipped / deltaTiles : 0.0);
+    DeltaFree(&deltaState);
+  }
+  BandPoolClose(&bandPool);
   return 0;
 }
 
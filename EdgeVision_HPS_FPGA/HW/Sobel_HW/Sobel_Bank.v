@@ -0,0 +1,134 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_Bank
+// Description:
+// NUM_CORES independent filter lanes behind one Avalon-MM slave on the
+// lightweight bridge. Each lane has its own 3x3 window and Sobel_Core,
+// and all lanes share the kernel loaded in Sobel_CSR. The host hands
+// one column to each lane, e.g. the B, G and R planes of a pixel or
+// the same column of several horizontal bands. The write to the last
+// active lane steps every lane at once, and one read returns four
+// results, so a colour pixel costs one read instead of three.
+//
+// Register map (32-bit words, byte offsets):
+// - 0x00..0x1C LANE[i] : write {6'b0, border row, 1'b0, row y-1, row y,
+//                        row y+1}, same packing as pixel_in_pio. Writing
+//                        the last active lane steps all lanes.
+// - 0x20 RESULT0       : read lanes 0..3, [7:0] = lane 0
+// - 0x24 RESULT1       : read lanes 4..7
+// - 0x28 CONFIG        : [3:0] active lanes (write), [11:8] NUM_CORES (read)
+//
+// Each lane is a Sobel_Window with the PIO timing: a step returns the
+// result of the column before it, and one extra step after the last
+// column returns the last pixels. Reads have a fixed latency of one
+// clock.
+//======================================================================
+
+module Sobel_Bank #(
+		parameter NUM_CORES = 4             // 1..8
+)(
+		input              clk,
+		input              rst,
+
+		///////// AVALON-MM SLAVE /////////
+		input       [3:0]  address,
+		input              write,
+		input       [31:0] writedata,
+		input              read,
+		output reg  [31:0] readdata,
+
+		///////// KERNEL (from Sobel_CSR) /////////
+		input       [71:0] kx,
+		input       [71:0] ky,
+		input       [3:0]  shift_x,
+		input       [3:0]  shift_y,
+		input       [1:0]  mode,
+
+		///////// GEOMETRY AND BORDER (from Sobel_CSR) /////////
+		input       [31:0] row_length,      // pixels per row of each lane
+		input       [1:0]  border_mode,
+		input       [7:0]  border_value,
+		input              frame_clear,
+
+		///////// EVENTS (to Sobel_CSR counters) /////////
+		output             pixel_in,        // one pulse per sweep step
+		output             pixel_out
+);
+
+localparam [3:0] CORE_COUNT = NUM_CORES;
+
+reg  [3:0]  active_lanes;
+reg  [25:0] pending [0:NUM_CORES-1];        // columns written since the last step
+wire [7:0]  result  [0:7];
+wire [NUM_CORES-1:0] lane_valid;
+
+wire [3:0] last_lane = (active_lanes == 0) ? 4'd0 : active_lanes - 1'b1;
+wire       do_step   = write && (address < CORE_COUNT) && (address == last_lane);
+
+assign pixel_in  = do_step;
+assign pixel_out = lane_valid[0];
+
+genvar g;
+generate
+    for (g = 0; g < 8; g = g + 1) begin : lane
+        if (g < NUM_CORES) begin : core
+            // The last lane's column comes straight from the bus
+            wire [25:0] word = (g == address) ? writedata[25:0] : pending[g];
+
+            Sobel_Window window (
+                .clk          (clk),
+                .rst          (rst),
+                .clear        (frame_clear),
+                .step         (do_step),
+                .first        (1'b0),
+                .column       ({word[7:0], word[15:8], word[23:16]}),
+                .border_row   (word[25]),
+                .row_bytes    (row_length),
+                .channels     (3'd1),
+                .border_mode  (border_mode),
+                .border_value (border_value),
+                .kx           (kx),
+                .ky           (ky),
+                .shift_x      (shift_x),
+                .shift_y      (shift_y),
+                .mode         (mode),
+                .column_pos   (),
+                .out_valid    (lane_valid[g]),
+                .out_pixel    (result[g])
+            );
+        end
+        else begin : idle
+            assign result[g] = 8'h00;
+        end
+    end
+endgenerate
+
+integer i;
+
+always @(posedge clk) begin
+    if (!rst) begin
+        active_lanes <= CORE_COUNT;
+        readdata     <= 0;
+        for (i = 0; i < NUM_CORES; i = i + 1)
+            pending[i] <= 0;
+    end
+    else begin
+        if (write) begin
+            if (address < CORE_COUNT)
+                pending[address] <= writedata[25:0];
+            else if (address == 4'd10)
+                active_lanes <= (writedata[3:0] > CORE_COUNT) ? CORE_COUNT : writedata[3:0];
+        end
+
+        if (read) begin
+            case (address)
+                4'd8:    readdata <= {result[3], result[2], result[1], result[0]};
+                4'd9:    readdata <= {result[7], result[6], result[5], result[4]};
+                4'd10:   readdata <= {20'b0, CORE_COUNT, active_lanes};
+                default: readdata <= 32'h0;
+            endcase
+        end
+    end
+end
+
+endmodule
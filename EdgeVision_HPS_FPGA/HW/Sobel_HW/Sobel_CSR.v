@@ -0,0 +1,221 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_CSR
+// Description:
+// Avalon-MM register block on the lightweight HPS-to-FPGA bridge that
+// holds the convolution coefficients used by the filter datapath. The
+// HPS loads two signed 3x3 kernels, per-kernel shift amounts and an
+// output mode at runtime, so one bitstream can run Sobel, Scharr,
+// Prewitt, Laplacian or a blur without reconfiguring the FPGA.
+//
+// Register map (32-bit words, byte offsets):
+// - 0x00 CTRL    : [1:0] output mode
+//                    0 = 255 - sat(|X| + |Y|)   (inverted gradient, default)
+//                    1 = sat(|X| + |Y|)         (gradient)
+//                    2 = sat(|X|)               (single kernel, magnitude)
+//                    3 = clamp(X, 0, 255)       (single kernel, signed)
+// - 0x04 SHIFT   : [3:0] right shift of X, [11:8] right shift of Y
+// - 0x08..0x10   : KX rows 0..2, [7:0] col 0, [15:8] col 1, [23:16] col 2
+// - 0x14..0x1C   : KY rows 0..2, same packing as KX
+// - 0x20 ID      : read-only core identifier
+// - 0x24 STATUS  : [0] idle (every pixel in has produced a pixel out)
+//                  [1] row done, [2] frame done (sticky, write 1 to clear)
+// - 0x28 IRQ_EN  : [1] row-done interrupt, [2] frame-done interrupt
+// - 0x2C ROW_LEN : output pixels per row, for row/frame completion
+// - 0x30 ROWS    : rows per frame
+// - 0x34 CYCLES  : free-running clock counter
+// - 0x38 PIX_IN  : pixels accepted by the datapath
+// - 0x3C PIX_OUT : results produced by the datapath
+// - 0x40 STALLS  : cycles spent waiting for the host inside a frame
+// - 0x44 CLEAR   : write 1 to zero the counters and the row/frame state,
+//                  and restart the PIO and lane windows at column 0
+// - 0x48 BORDER  : [1:0] border mode (see Sobel_Window)
+//                    0 = skip, frame pixels are 0 (reset value)
+//                    1 = replicate, 2 = reflect-101, 3 = constant
+//                  [15:8] outside sample value for the constant mode
+// - 0x4C LINE_MAX: read-only, bytes per row (width * channels) that the
+//                  streaming line buffers hold (the MAX_LINE parameter)
+//
+// CTRL[6:4] holds the bytes per pixel of the streamed image (0 = 1).
+// CTRL[9:8] selects the denoise filter ahead of the streamed gradient
+// (see Sobel_Denoise): 0 = off, 1 = Gaussian, 2 = median.
+// CTRL[2] selects strobed mode: the window only advances when the host
+// toggles bit 24 of the pixel word, which is what makes the pixel
+// counters and the completion interrupt meaningful.
+//
+// Reads have a fixed latency of one clock. Coefficients are signed
+// 8-bit. Reset values load the Sobel kernels so the core behaves as
+// before until the HPS writes new ones.
+//======================================================================
+
+module Sobel_CSR #(
+		parameter MAX_LINE = 8192           // Sobel_Stream line buffer depth, reported in LINE_MAX
+)(
+		input              clk,
+		input              rst,
+
+		///////// AVALON-MM SLAVE /////////
+		input       [4:0]  address,
+		input              write,
+		input       [31:0] writedata,
+		input              read,
+		output reg  [31:0] readdata,
+
+		///////// TO DATAPATH /////////
+		output      [71:0] kx,          // 9 x signed 8-bit, row-major, [7:0] = (0,0)
+		output      [71:0] ky,
+		output      [3:0]  shift_x,
+		output      [3:0]  shift_y,
+		output      [1:0]  mode,
+		output             strobed,
+		output      [2:0]  channels,
+		output      [31:0] row_len,
+		output      [1:0]  border_mode,
+		output      [7:0]  border_value,
+		output      [1:0]  denoise,
+		output             frame_clear,  // one-cycle pulse on a CLEAR write
+
+		///////// FROM DATAPATH /////////
+		input              pixel_in,     // one-cycle pulse per accepted pixel
+		input              pixel_out,    // one-cycle pulse per produced result
+
+		///////// INTERRUPT /////////
+		output             irq
+);
+
+localparam CORE_ID = 32'h534F4231;      // "SOB1"
+
+reg [23:0] kx_row [0:2];
+reg [23:0] ky_row [0:2];
+reg [31:0] ctrl;
+reg [31:0] shift;
+reg [15:0] border;
+
+reg [2:1]  status_sticky;
+reg [2:1]  irq_enable;
+reg [31:0] row_length;
+reg [31:0] frame_rows;
+reg [31:0] cycle_count;
+reg [31:0] pixel_in_count;
+reg [31:0] pixel_out_count;
+reg [31:0] stall_count;
+reg [31:0] column;
+reg [31:0] row;
+wire       clear = write && (address == 5'd17) && writedata[0];
+wire       idle = (pixel_in_count == pixel_out_count);
+wire       in_frame = (pixel_in_count != 0) && !status_sticky[2];
+
+assign kx = {kx_row[2], kx_row[1], kx_row[0]};
+assign ky = {ky_row[2], ky_row[1], ky_row[0]};
+assign shift_x = shift[3:0];
+assign shift_y = shift[11:8];
+assign mode    = ctrl[1:0];
+assign strobed = ctrl[2];
+assign channels = (ctrl[6:4] == 3'd0) ? 3'd1 : ctrl[6:4];
+assign row_len  = row_length;
+assign border_mode  = border[1:0];
+assign border_value = border[15:8];
+assign denoise      = ctrl[9:8];
+assign frame_clear  = clear;
+assign irq     = |(status_sticky & irq_enable);
+
+always @(posedge clk) begin
+    if (!rst) begin
+        ctrl  <= 0;
+        shift <= 0;
+        irq_enable <= 0;
+        border <= 0;
+        row_length <= 0;
+        frame_rows <= 0;
+        // Sobel: Gx = {{1,0,-1},{2,0,-2},{1,0,-1}}, Gy = {{1,2,1},{0,0,0},{-1,-2,-1}}
+        kx_row[0] <= {8'hFF, 8'h00, 8'h01};
+        kx_row[1] <= {8'hFE, 8'h00, 8'h02};
+        kx_row[2] <= {8'hFF, 8'h00, 8'h01};
+        ky_row[0] <= {8'h01, 8'h02, 8'h01};
+        ky_row[1] <= {8'h00, 8'h00, 8'h00};
+        ky_row[2] <= {8'hFF, 8'hFE, 8'hFF};
+    end
+    else if (write) begin
+        case (address)
+            5'd0:  ctrl       <= writedata;
+            5'd1:  shift      <= writedata;
+            5'd2:  kx_row[0]  <= writedata[23:0];
+            5'd3:  kx_row[1]  <= writedata[23:0];
+            5'd4:  kx_row[2]  <= writedata[23:0];
+            5'd5:  ky_row[0]  <= writedata[23:0];
+            5'd6:  ky_row[1]  <= writedata[23:0];
+            5'd7:  ky_row[2]  <= writedata[23:0];
+            5'd10: irq_enable <= writedata[2:1];
+            5'd11: row_length <= writedata;
+            5'd12: frame_rows <= writedata;
+            5'd18: border     <= writedata[15:0];
+            default: ;
+        endcase
+    end
+end
+
+// Performance counters and row/frame completion tracking
+always @(posedge clk) begin
+    if (!rst || clear) begin
+        cycle_count     <= 0;
+        pixel_in_count  <= 0;
+        pixel_out_count <= 0;
+        stall_count     <= 0;
+        column          <= 0;
+        row             <= 0;
+        status_sticky   <= 0;
+    end
+    else begin
+        cycle_count <= cycle_count + 1;
+        if (pixel_in)
+            pixel_in_count <= pixel_in_count + 1;
+        else if (in_frame)
+            stall_count <= stall_count + 1;
+
+        if (pixel_out) begin
+            pixel_out_count <= pixel_out_count + 1;
+            if (row_length != 0 && column == row_length - 1) begin
+                column <= 0;
+                row <= row + 1;
+                status_sticky[1] <= 1'b1;
+                if (frame_rows != 0 && row == frame_rows - 1)
+                    status_sticky[2] <= 1'b1;
+            end
+            else
+                column <= column + 1;
+        end
+
+        // Write-one-to-clear of the sticky bits
+        if (write && address == 5'd9)
+            status_sticky <= status_sticky & ~writedata[2:1];
+    end
+end
+
+always @(posedge clk) begin
+    if (read) begin
+        case (address)
+            5'd0:  readdata <= ctrl;
+            5'd1:  readdata <= shift;
+            5'd2:  readdata <= {8'h00, kx_row[0]};
+            5'd3:  readdata <= {8'h00, kx_row[1]};
+            5'd4:  readdata <= {8'h00, kx_row[2]};
+            5'd5:  readdata <= {8'h00, ky_row[0]};
+            5'd6:  readdata <= {8'h00, ky_row[1]};
+            5'd7:  readdata <= {8'h00, ky_row[2]};
+            5'd8:  readdata <= CORE_ID;
+            5'd9:  readdata <= {29'h0, status_sticky, idle};
+            5'd10: readdata <= {29'h0, irq_enable, 1'b0};
+            5'd11: readdata <= row_length;
+            5'd12: readdata <= frame_rows;
+            5'd13: readdata <= cycle_count;
+            5'd14: readdata <= pixel_in_count;
+            5'd15: readdata <= pixel_out_count;
+            5'd16: readdata <= stall_count;
+            5'd18: readdata <= {16'h0, border};
+            5'd19: readdata <= MAX_LINE;
+            default: readdata <= 32'h0;
+        endcase
+    end
+end
+
+endmodule
@@ -0,0 +1,91 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_Core
+// Description:
+// 3x3 convolution datapath shared by the PIO and streaming front ends.
+// Takes a complete window and the runtime coefficients from Sobel_CSR
+// and produces one output pixel per accepted window, registered, one
+// clock after in_valid.
+//
+// Inputs:
+// - window: 9 x 8-bit pixels, row-major, [7:0] = top-left, [71:64] =
+//   bottom-right. Row 0 is the previous image row, column 2 the newest.
+// - kx, ky, shift_x, shift_y, mode: see Sobel_CSR
+// - in_blank: output 0 for this window (a frame pixel in SKIP border mode)
+//
+// Outputs:
+// - out_pixel / out_valid: result and its one-cycle valid pulse
+//======================================================================
+
+module Sobel_Core(
+		input              clk,
+		input              rst,
+
+		input              in_valid,
+		input              in_blank,
+		input       [71:0] window,
+
+		input       [71:0] kx,
+		input       [71:0] ky,
+		input       [3:0]  shift_x,
+		input       [3:0]  shift_y,
+		input       [1:0]  mode,
+
+		output reg         out_valid,
+		output reg  [7:0]  out_pixel
+);
+
+reg signed [19:0] sumX, sumY;
+reg signed [19:0] shiftedX, shiftedY;
+reg [19:0] absX, absY;
+reg [20:0] magnitude;
+reg [7:0] result;
+
+integer k;
+
+initial begin
+    out_valid = 0;
+    out_pixel = 0;
+end
+
+always @(posedge clk) begin
+    if (!rst) begin
+        out_valid <= 0;
+        out_pixel <= 0;
+    end
+    else begin
+        out_valid <= in_valid;
+
+        if (in_valid) begin
+//////////////////////// Apply and Compute gradients using the loaded kernels/////////////////////////////////////////////
+            sumX = 0;
+            sumY = 0;
+
+            for (k = 0; k < 9; k = k + 1) begin
+                sumX = sumX + $signed({1'b0, window[k*8 +: 8]}) * $signed(kx[k*8 +: 8]);
+                sumY = sumY + $signed({1'b0, window[k*8 +: 8]}) * $signed(ky[k*8 +: 8]);
+            end
+
+            // Normalise, then calculate magnitude of edge gradient
+            shiftedX = sumX >>> shift_x;
+            shiftedY = sumY >>> shift_y;
+            absX = (shiftedX < 0) ? -shiftedX : shiftedX;
+            absY = (shiftedY < 0) ? -shiftedY : shiftedY;
+
+            case (mode)
+                2'd0, 2'd1: magnitude = absX + absY;
+                2'd2:       magnitude = absX;
+                default:    magnitude = (shiftedX < 0) ? 21'd0 : shiftedX;
+            endcase
+
+            // Saturate, and invert the result for the default edge-map mode
+            result = (magnitude > 21'd255) ? 8'hFF : magnitude[7:0];
+            if (in_blank)
+                out_pixel <= 8'h00;
+            else
+                out_pixel <= (mode == 2'd0) ? (8'hFF - result) : result;
+        end
+    end
+end
+
+endmodule
@@ -0,0 +1,174 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_Denoise
+// Description:
+// Optional 3x3 pre-filter of the streaming path, run ahead of the
+// gradient so sensor noise does not turn into speckle in the edge map.
+// It has line buffers of its own and rebuilds the 3x3 window of each
+// byte the same way as Sobel_Stream, through a Sobel_Window whose core
+// is left unused; the window taps go to a Gaussian (1-2-1 in both
+// directions, rounded) or to a median made of a 19 compare-exchange
+// sorting network. Together with the two line buffers of the gradient
+// stage, five image rows are held on chip.
+//
+//   filter 0 : off (the stream bypasses this stage)
+//          1 : Gaussian
+//          2 : median
+//
+// The filtered byte leaves in the same beat, combinationally, and is
+// centred one row and one pixel behind the arriving byte, like the
+// gradient; out_valid is low for the first row_bytes + channels beats
+// of a packet, and out_first marks filtered byte 0. Samples outside
+// the image follow the border mode, with SKIP filtered as REPLICATE
+// (the CPU build does the same).
+//
+// The line buffers are read one clock ahead, at the column of the next
+// step, as in Sobel_Stream.
+//
+// Inputs:
+// - step / first / data: the beat of Sobel_Stream, startofpacket
+// - flushing: the beat is past the last byte of the frame
+//======================================================================
+
+module Sobel_Denoise #(
+		parameter MAX_LINE = 8192           // bytes per row (width * channels)
+)(
+		input              clk,
+		input              rst,
+
+		input              step,
+		input              first,
+		input       [7:0]  data,
+		input              flushing,
+
+		///////// GEOMETRY AND BORDER (from Sobel_CSR) /////////
+		input       [31:0] row_bytes,       // samples per row (width * channels)
+		input       [2:0]  channels,        // 1..4
+		input       [1:0]  border_mode,
+		input       [7:0]  border_value,
+		input       [1:0]  filter,
+
+		output             out_valid,
+		output             out_first,
+		output reg  [7:0]  out_data
+);
+
+localparam [1:0] BORDER_SKIP       = 2'd0;
+localparam [1:0] BORDER_REPLICATE  = 2'd1;
+localparam [1:0] BORDER_REFLECT101 = 2'd2;
+localparam [1:0] BORDER_CONSTANT   = 2'd3;
+localparam [1:0] FILTER_MEDIAN     = 2'd2;
+
+// Median network, one compare-exchange per byte from [7:0]: the smaller
+// sample goes to index [3:0], the larger to index [7:4]
+localparam [151:0] MEDIAN_NETWORK = {8'h24, 8'h46, 8'h24, 8'h74, 8'h52, 8'h41, 8'h63, 8'h74, 8'h85, 8'h30,
+                                     8'h87, 8'h54, 8'h21, 8'h76, 8'h43, 8'h10, 8'h87, 8'h54, 8'h21};
+
+// Previous two image rows, indexed by byte position in the row
+reg [7:0] line_prev1 [0:MAX_LINE-1];
+reg [7:0] line_prev2 [0:MAX_LINE-1];
+
+reg [7:0]  prev1_q, prev2_q;    // line buffer samples at read_pos, one clock later
+reg [1:0]  rows_seen;           // rows of the packet started before this one, saturating at 2
+reg [31:0] lead;                // beats since startofpacket, saturating past the latency
+
+wire [31:0] column_pos;
+wire [71:0] taps;
+wire [1:0]  row_now = first ? 2'd0 : rows_seen;
+wire [1:0]  edge_mode = (border_mode == BORDER_SKIP) ? BORDER_REPLICATE : border_mode;
+wire [31:0] latency = row_bytes + channels;
+wire [31:0] lead_now = first ? 32'd0 : lead;
+wire        row_wraps = (column_pos + 1 == row_bytes);
+wire [31:0] read_pos  = !step    ? column_pos :
+                        row_wraps ? 32'd0 : column_pos + 1;
+
+assign out_valid = (lead_now >= latency);
+assign out_first = (lead_now == latency);
+
+// Rows outside the image, as in Sobel_Stream
+wire       top_outside    = !flushing && (row_now == 2'd1);
+wire       bottom_outside = flushing;
+wire [7:0] top_raw    = prev2_q;
+wire [7:0] middle     = prev1_q;
+wire [7:0] top    = !top_outside                     ? top_raw :
+                    (edge_mode == BORDER_REPLICATE)  ? middle :
+                    (edge_mode == BORDER_REFLECT101) ? data : border_value;
+wire [7:0] bottom = !bottom_outside                  ? data :
+                    (edge_mode == BORDER_REPLICATE)  ? middle :
+                    (edge_mode == BORDER_REFLECT101) ? top_raw : border_value;
+
+Sobel_Window window (
+    .clk          (clk),
+    .rst          (rst),
+    .clear        (1'b0),
+    .step         (step),
+    .first        (first),
+    .column       ({bottom, middle, top}),
+    .border_row   (1'b0),
+    .row_bytes    (row_bytes),
+    .channels     (channels),
+    .border_mode  (edge_mode),
+    .border_value (border_value),
+    .kx           (72'd0),
+    .ky           (72'd0),
+    .shift_x      (4'd0),
+    .shift_y      (4'd0),
+    .mode         (2'd0),
+    .column_pos   (column_pos),
+    .taps         (taps),
+    .out_valid    (),
+    .out_pixel    ()
+);
+
+reg [7:0]  p [0:8];
+reg [7:0]  swap;
+reg [11:0] weighted;
+reg [3:0]  lo, hi;
+integer k;
+
+always @(*) begin
+    for (k = 0; k < 9; k = k + 1)
+        p[k] = taps[k*8 +: 8];
+
+    if (filter == FILTER_MEDIAN) begin
+        for (k = 0; k < 19; k = k + 1) begin
+            lo = MEDIAN_NETWORK[k*8 +: 4];
+            hi = MEDIAN_NETWORK[k*8 + 4 +: 4];
+            if (p[lo] > p[hi]) begin
+                swap  = p[lo];
+                p[lo] = p[hi];
+                p[hi] = swap;
+            end
+        end
+        out_data = p[4];
+    end
+    else begin
+        weighted = p[0] + 2 * p[1] + p[2] + 2 * p[3] + 4 * p[4] + 2 * p[5] + p[6] + 2 * p[7] + p[8] + 8;
+        out_data = weighted[11:4];
+    end
+end
+
+always @(posedge clk) begin
+    prev1_q <= line_prev1[read_pos];
+    prev2_q <= line_prev2[read_pos];
+end
+
+always @(posedge clk) begin
+    if (!rst) begin
+        rows_seen <= 0;
+        lead      <= 0;
+    end
+    else if (step) begin
+        line_prev2[column_pos] <= middle;
+        line_prev1[column_pos] <= data;
+
+        if (row_wraps)
+            rows_seen <= (row_now == 2'd2) ? 2'd2 : row_now + 1'b1;
+        else
+            rows_seen <= row_now;
+
+        lead <= (lead_now > latency) ? lead_now : lead_now + 1;
+    end
+end
+
+endmodule
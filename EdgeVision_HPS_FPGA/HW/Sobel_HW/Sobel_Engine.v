@@ -0,0 +1,210 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_Engine
+// Description:
+// The filter datapath behind the HPS bridges: kernel CSR block, PIO
+// window, mSGDMA streaming path and parallel lane bank. Sobel_Filter
+// connects it to soc_system; the Verilator harness in sim/ drives the
+// same ports directly, so the simulated engine is the synthesised one.
+//
+// Inputs:
+// - input_row: PIO word {[25] border row, [24] strobe, row y-1, row y,
+//   row y+1}
+// - csr_* and bank_*: Avalon-MM slaves on the lightweight bridge
+// - sink_*: Avalon-ST from the mSGDMA read master
+//
+// Outputs:
+// - output_row: PIO result pixel
+// - source_*: Avalon-ST to the mSGDMA write master
+// - irq: row/frame completion interrupt
+// - pixel_in/pixel_out: one-cycle pixel events of any path, as counted
+//   by the CSR block (used by the harness for latency)
+//======================================================================
+
+module Sobel_Engine #(
+		parameter NUM_CORES = 4,            // parallel lanes in Sobel_Bank, 1..8
+		parameter MAX_LINE  = 8192          // bytes per row of the streaming line buffers
+)(
+		input              clk,
+		input              rst,             // active low
+
+		///////// PIO /////////
+		input       [31:0] input_row,
+		output      [7:0]  output_row,
+
+		///////// KERNEL CSR /////////
+		input       [4:0]  csr_address,
+		input              csr_write,
+		input       [31:0] csr_writedata,
+		input              csr_read,
+		output      [31:0] csr_readdata,
+
+		///////// LANE BANK /////////
+		input       [3:0]  bank_address,
+		input              bank_write,
+		input       [31:0] bank_writedata,
+		input              bank_read,
+		output      [31:0] bank_readdata,
+
+		///////// mSGDMA STREAMS /////////
+		input       [7:0]  sink_data,
+		input              sink_valid,
+		input              sink_startofpacket,
+		input              sink_endofpacket,
+		output             sink_ready,
+		output      [7:0]  source_data,
+		output             source_valid,
+		output             source_startofpacket,
+		output             source_endofpacket,
+		input              source_ready,
+
+		output             irq,
+		output             pixel_in,
+		output             pixel_out
+);
+
+// Convolution kernels, loaded at runtime through the CSR block
+wire [71:0] kx_flat, ky_flat;
+wire [3:0] shift_x, shift_y;
+wire [1:0] out_mode;
+wire [2:0] channels;
+wire [31:0] row_length;
+wire [1:0] border_mode;
+wire [7:0] border_value;
+wire [1:0] denoise;
+wire frame_clear;
+wire strobed_mode;
+
+// Pixel handshake: in strobed mode the host toggles input_row[24] per pixel
+reg  strobe_toggle;
+wire pixel_strobe = (input_row[24] != strobe_toggle);
+wire advance = strobed_mode ? pixel_strobe : 1'b1;
+wire pio_valid;
+
+// Per-path pixel events, merged into the CSR counters
+wire        stream_pixel_in;
+wire        stream_pixel_out;
+wire        bank_pixel_in;
+wire        bank_pixel_out;
+
+assign pixel_in  = (strobed_mode & pixel_strobe) | stream_pixel_in | bank_pixel_in;
+assign pixel_out = (strobed_mode & pio_valid) | stream_pixel_out | bank_pixel_out;
+
+Sobel_CSR #(
+    .MAX_LINE (MAX_LINE)
+) kernel_csr (
+    .clk        (clk),
+    .rst        (rst),
+    .address    (csr_address),
+    .write      (csr_write),
+    .writedata  (csr_writedata),
+    .read       (csr_read),
+    .readdata   (csr_readdata),
+    .kx         (kx_flat),
+    .ky         (ky_flat),
+    .shift_x    (shift_x),
+    .shift_y    (shift_y),
+    .mode       (out_mode),
+    .strobed    (strobed_mode),
+    .channels   (channels),
+    .row_len    (row_length),
+    .border_mode  (border_mode),
+    .border_value (border_value),
+    .denoise      (denoise),
+    .frame_clear  (frame_clear),
+    .pixel_in   (pixel_in),
+    .pixel_out  (pixel_out),
+    .irq        (irq)
+);
+
+////////// PIO path: the host sends one 3-pixel column per write //////////
+// The result read after column x is pixel x-1 of the same plane; one more
+// column after the last one returns the last pixel.
+Sobel_Window pio_window (
+    .clk          (clk),
+    .rst          (rst),
+    .clear        (frame_clear),
+    .step         (rst && advance),
+    .first        (1'b0),
+    .column       ({input_row[7:0], input_row[15:8], input_row[23:16]}),
+    .border_row   (input_row[25]),
+    .row_bytes    (row_length),
+    .channels     (3'd1),
+    .border_mode  (border_mode),
+    .border_value (border_value),
+    .kx           (kx_flat),
+    .ky           (ky_flat),
+    .shift_x      (shift_x),
+    .shift_y      (shift_y),
+    .mode         (out_mode),
+    .column_pos   (),
+    .out_valid    (pio_valid),
+    .out_pixel    (output_row)
+);
+
+initial begin
+    strobe_toggle = 0;
+end
+
+always @(posedge clk) begin
+    if (!rst)
+        strobe_toggle <= 0;
+    else
+        strobe_toggle <= input_row[24];
+end
+
+////////// Streaming path: mSGDMA read -> [denoise] -> line buffers -> core -> mSGDMA write //////////
+Sobel_Stream #(
+    .MAX_LINE (MAX_LINE)
+) stream (
+    .clk                  (clk),
+    .rst                  (rst),
+    .row_length           (row_length),
+    .channels             (channels),
+    .kx                   (kx_flat),
+    .ky                   (ky_flat),
+    .shift_x              (shift_x),
+    .shift_y              (shift_y),
+    .mode                 (out_mode),
+    .border_mode          (border_mode),
+    .border_value         (border_value),
+    .denoise              (denoise),
+    .sink_data            (sink_data),
+    .sink_valid           (sink_valid),
+    .sink_startofpacket   (sink_startofpacket),
+    .sink_endofpacket     (sink_endofpacket),
+    .sink_ready           (sink_ready),
+    .source_data          (source_data),
+    .source_valid         (source_valid),
+    .source_startofpacket (source_startofpacket),
+    .source_endofpacket   (source_endofpacket),
+    .source_ready         (source_ready),
+    .pixel_in             (stream_pixel_in),
+    .pixel_out            (stream_pixel_out)
+);
+
+////////// Lane bank: one column per lane per write, all lanes step together //////////
+Sobel_Bank #(
+    .NUM_CORES (NUM_CORES)
+) bank (
+    .clk        (clk),
+    .rst        (rst),
+    .address    (bank_address),
+    .write      (bank_write),
+    .writedata  (bank_writedata),
+    .read       (bank_read),
+    .readdata   (bank_readdata),
+    .kx         (kx_flat),
+    .ky         (ky_flat),
+    .shift_x    (shift_x),
+    .shift_y    (shift_y),
+    .mode       (out_mode),
+    .row_length   (row_length),
+    .border_mode  (border_mode),
+    .border_value (border_value),
+    .frame_clear  (frame_clear),
+    .pixel_in   (bank_pixel_in),
+    .pixel_out  (bank_pixel_out)
+);
+
+endmodule
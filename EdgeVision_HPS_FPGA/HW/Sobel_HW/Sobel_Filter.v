@@ -11,13 +11,28 @@
 // - Sobel Filter Operation:
 //     - Computes horizontal (Gx) and vertical (Gy) gradients
 //     - Combines gradients to calculate edge magnitude
+// - Runtime-loaded 3x3 coefficients, shifts and output mode (Sobel_CSR),
+//   so other operators run on the same bitstream
+// - Strobed pixel handshake (bit 24 of input_row toggles per pixel),
+//   row/frame completion interrupt and cycle/pixel/stall counters
+// - Border modes (skip, replicate, reflect-101, constant) applied in the
+//   window logic (Sobel_Window), so frames are never padded
+// - mSGDMA streaming path (Sobel_Stream): frames are read from and
+//   written back to HPS DDR3 by descriptor, without CPU pixel writes
+// - NUM_CORES parallel filter lanes (Sobel_Bank) so the channels or
+//   horizontal bands of an image are filtered in a single sweep
 // - Interfaces with external DDR3 memory via HPS for storing and retrieving data
 // - Uses internal line buffers for pixel storage and convolution operations
 //
+// The datapath itself is Sobel_Engine; this top level only connects it to
+// soc_system, so the engine can be simulated on its own (see sim/).
+//
 // Inputs:
 // - rst (Reset): System reset signal
 // - CLOCK_50: Clock signal at 50 MHz
 // - input_row: 32-bit input containing three 8-bit pixel values
+//   {row y-1, row y, row y+1}, [24] strobe, [25] row y is the first or
+//   last image row
 //
 // Outputs:
 // - output_row: 8-bit pixel value after Sobel processing
@@ -27,13 +42,16 @@
 // Date: 12/11/2024
 //======================================================================
 
-module Sobel_Filter(
+module Sobel_Filter #(
+		parameter NUM_CORES = 4,            // parallel lanes in Sobel_Bank, 1..8
+		parameter MAX_LINE  = 8192          // widest streamed row in bytes (width * channels)
+)(
 
 		//////////RESET//////////
 		input 				 rst,
 		
 		/////////OUTPUT//////////
-		output reg [7:0] output_row,
+		output     [7:0] output_row,
 		
       ///////// CLOCK /////////
       input              CLOCK_50,
@@ -88,81 +106,67 @@ wire hps_warm_reset;
 wire hps_debug_reset;
 wire [27:0] stm_hw_events;
 
-// Line buffer memory (3x3 window)
-reg [7:0] line_buffer [0:2][0:2];  
-
-// Sobel filter kernels (fixed 3x3 matrices)
-wire signed [3:0] Gx [0:2][0:2];
-wire signed [3:0] Gy [0:2][0:2];
+wire sobel_irq;
 
-// Internal signals for processing the Sobel filter
+////////// Kernel CSR (lightweight bridge) //////////
+wire [4:0]  kernel_csr_address;
+wire        kernel_csr_write;
+wire [31:0] kernel_csr_writedata;
+wire        kernel_csr_read;
+wire [31:0] kernel_csr_readdata;
 
-reg signed [15:0] sumX, sumY;
-reg [7:0] absX, absY;
-reg [8:0] magnitude;
+////////// mSGDMA streams (HPS DDR3 <-> core) //////////
+wire [7:0]  dma_rd_data;
+wire        dma_rd_valid;
+wire        dma_rd_ready;
+wire        dma_rd_startofpacket;
+wire        dma_rd_endofpacket;
+wire [7:0]  dma_wr_data;
+wire        dma_wr_valid;
+wire        dma_wr_ready;
+wire        dma_wr_startofpacket;
+wire        dma_wr_endofpacket;
 
-integer i, j;
+////////// Parallel lane bank (lightweight bridge) //////////
+wire [3:0]  core_bank_address;
+wire        core_bank_write;
+wire [31:0] core_bank_writedata;
+wire        core_bank_read;
+wire [31:0] core_bank_readdata;
 
-// Initialize Sobel kernels using assign statements (direct initialization)
-    // Assign Sobel kernels
-    assign Gx[0][0] = 1;  assign Gx[0][1] = 0;  assign Gx[0][2] = -1;
-    assign Gx[1][0] = 2;  assign Gx[1][1] = 0;  assign Gx[1][2] = -2;
-    assign Gx[2][0] = 1;  assign Gx[2][1] = 0;  assign Gx[2][2] = -1;
-    
-    assign Gy[0][0] = 1;  assign Gy[0][1] = 2;  assign Gy[0][2] = 1;
-    assign Gy[1][0] = 0;  assign Gy[1][1] = 0;  assign Gy[1][2] = 0;
-    assign Gy[2][0] = -1; assign Gy[2][1] = -2; assign Gy[2][2] = -1;
-	 
-initial begin
-    output_row = 0;
-    // Initialize line buffer
-    for (i = 0; i < 3; i = i + 1)
-        for (j = 0; j < 3; j = j + 1)
-            line_buffer[i][j] = 0;
-end
-
-always @(posedge CLOCK_50) begin
- // Reset line buffer and output
-    if (!rst) begin
-        output_row <= 0;
-        for (i = 0; i < 3; i = i + 1)
-            for (j = 0; j < 3; j = j + 1)
-                line_buffer[i][j] <= 0;
-    end 
-    else begin
-///////////////////////// Shift pixels in line buffer horizontally/////////////////////////////////////////////////
-        for (i = 0; i < 3; i = i + 1) begin
-            line_buffer[i][0] <= line_buffer[i][1];
-            line_buffer[i][1] <= line_buffer[i][2];
-        end
-        
-///////////////////////// Load new pixel values in the line buffer////////////////////////////////////////////////
-        line_buffer[0][2] <= input_row[23:16];
-        line_buffer[1][2] <= input_row[15:8];
-        line_buffer[2][2] <= input_row[7:0];
-
-        
-//////////////////////// Apply and Compute gradients using sobel filter/////////////////////////////////////////////////////
-
-        sumX = 0;
-        sumY = 0;
-		  
-		  for (i = 0; i < 3; i = i + 1) begin
-            for (j = 0; j < 3; j = j + 1) begin
-                sumX = sumX + $signed({1'b0, line_buffer[i][j]}) * Gx[i][j];
-                sumY = sumY + $signed({1'b0, line_buffer[i][j]}) * Gy[i][j];
-            end
-        end
-
-        // Calculate magnitude of edge gradient
-        absX = (sumX < 0) ? -sumX[7:0] : sumX[7:0];
-        absY = (sumY < 0) ? -sumY[7:0] : sumY[7:0];
-        magnitude = absX + absY;
-
-        // Threshold and invert the result
-        output_row <= (8'hFF - magnitude[7:0]);
-    end
-end
+////////// Filter datapath: PIO, CSR, stream and lane bank //////////
+Sobel_Engine #(
+    .NUM_CORES (NUM_CORES),
+    .MAX_LINE  (MAX_LINE)
+) engine (
+    .clk                  (CLOCK_50),
+    .rst                  (rst),
+    .input_row            (input_row),
+    .output_row           (output_row),
+    .csr_address          (kernel_csr_address),
+    .csr_write            (kernel_csr_write),
+    .csr_writedata        (kernel_csr_writedata),
+    .csr_read             (kernel_csr_read),
+    .csr_readdata         (kernel_csr_readdata),
+    .bank_address         (core_bank_address),
+    .bank_write           (core_bank_write),
+    .bank_writedata       (core_bank_writedata),
+    .bank_read            (core_bank_read),
+    .bank_readdata        (core_bank_readdata),
+    .sink_data            (dma_rd_data),
+    .sink_valid           (dma_rd_valid),
+    .sink_startofpacket   (dma_rd_startofpacket),
+    .sink_endofpacket     (dma_rd_endofpacket),
+    .sink_ready           (dma_rd_ready),
+    .source_data          (dma_wr_data),
+    .source_valid         (dma_wr_valid),
+    .source_startofpacket (dma_wr_startofpacket),
+    .source_endofpacket   (dma_wr_endofpacket),
+    .source_ready         (dma_wr_ready),
+    .irq                  (sobel_irq),
+    .pixel_in             (),
+    .pixel_out            ()
+);
 
 // External system instantiation (HPS and DDR3 memory interface)
     soc_system u0 (
@@ -189,7 +193,28 @@ end
         .hps_0_f2h_debug_reset_req_reset_n     (~hps_debug_reset),     						//      		hps_0_f2h_debug_reset_req.reset_n
         .hps_0_f2h_cold_reset_req_reset_n      (~hps_cold_reset),       					//       	hps_0_f2h_cold_reset_req.reset_n
 		  .pixel_in_pio_external_connection_export  (input_row),  								//  			pixel_in_pio_external_connection.export
-        .pixel_out_pio_external_connection_export (output_row)  								// 			pixel_out_pio_external_connection.export
+        .pixel_out_pio_external_connection_export (output_row),  								// 			pixel_out_pio_external_connection.export
+        .kernel_csr_external_address           (kernel_csr_address),                   //          kernel_csr_external.address
+        .kernel_csr_external_write             (kernel_csr_write),                     //          .write
+        .kernel_csr_external_writedata         (kernel_csr_writedata),                 //          .writedata
+        .kernel_csr_external_read              (kernel_csr_read),                      //          .read
+        .kernel_csr_external_readdata          (kernel_csr_readdata),                  //          .readdata
+        .hps_0_f2h_irq0_irq                    ({31'b0, sobel_irq}),                   //          hps_0_f2h_irq0.irq
+        .msgdma_rd_st_data                     (dma_rd_data),                          //          msgdma_rd_st.data
+        .msgdma_rd_st_valid                    (dma_rd_valid),                         //          .valid
+        .msgdma_rd_st_ready                    (dma_rd_ready),                         //          .ready
+        .msgdma_rd_st_startofpacket            (dma_rd_startofpacket),                 //          .startofpacket
+        .msgdma_rd_st_endofpacket              (dma_rd_endofpacket),                   //          .endofpacket
+        .msgdma_wr_st_data                     (dma_wr_data),                          //          msgdma_wr_st.data
+        .msgdma_wr_st_valid                    (dma_wr_valid),                         //          .valid
+        .msgdma_wr_st_ready                    (dma_wr_ready),                         //          .ready
+        .msgdma_wr_st_startofpacket            (dma_wr_startofpacket),                 //          .startofpacket
+        .msgdma_wr_st_endofpacket              (dma_wr_endofpacket),                   //          .endofpacket
+        .core_bank_external_address            (core_bank_address),                    //          core_bank_external.address
+        .core_bank_external_write              (core_bank_write),                      //          .write
+        .core_bank_external_writedata          (core_bank_writedata),                  //          .writedata
+        .core_bank_external_read               (core_bank_read),                       //          .read
+        .core_bank_external_readdata           (core_bank_readdata)                    //          .readdata
     );
 	 
 //////////////////////////// Reset management for HPS system/////////////////////////////////////////////////
@@ -0,0 +1,221 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_Stream
+// Description:
+// Streaming front end for the Sobel core, fed by the mSGDMA read
+// dispatcher straight from HPS DDR3 and drained by the write
+// dispatcher. Raw image bytes arrive one per beat in memory order
+// (pixel-interleaved channels); two line buffers and a short column
+// history rebuild the 3x3 window of each channel, so the CPU only
+// posts descriptors.
+//
+// Output byte k is the filter response centred on input byte
+// k - row_length*channels - channels, i.e. one row and one pixel
+// behind; the driver offsets the write descriptor to compensate.
+// After the endofpacket beat the stream runs row_length*channels +
+// channels flush beats of its own, which complete the last row, so a
+// frame of N bytes produces N + guard output bytes. startofpacket
+// restarts the row position, so every descriptor chain can carry a new
+// frame.
+//
+// With a denoise filter selected (CTRL[9:8]) the bytes first pass
+// Sobel_Denoise, and the gradient stage below steps on its filtered
+// bytes instead. The filter is one row and one pixel behind as well, so
+// the stream runs twice the flush beats, but the gradient stage still
+// emits N + guard bytes with the same alignment and the driver does not
+// change. pixel_in then counts the beats of the gradient stage.
+//
+// Rows outside the image are resolved here, as each column is built
+// from the line buffers; columns outside it in Sobel_Window. Frames
+// need at least two rows and two pixels per row, and at most MAX_LINE
+// bytes per row (reported in the CSR LINE_MAX register).
+//
+// The line buffers are M10K blocks with a registered read. The address
+// of the next step's column is presented in the cycle of the current
+// step (or held while the stream waits), so its samples are ready when
+// that step arrives and the window timing is the same as a
+// combinational read. Only the startofpacket step sees samples of the
+// wrong column; they belong to rows outside the new frame and are
+// never used.
+//======================================================================
+
+module Sobel_Stream #(
+		parameter MAX_LINE = 8192           // bytes per row (width * channels)
+)(
+		input              clk,
+		input              rst,
+
+		///////// GEOMETRY (from Sobel_CSR) /////////
+		input       [31:0] row_length,      // pixels per row
+		input       [2:0]  channels,        // bytes per pixel, 1..4
+
+		///////// KERNEL (from Sobel_CSR) /////////
+		input       [71:0] kx,
+		input       [71:0] ky,
+		input       [3:0]  shift_x,
+		input       [3:0]  shift_y,
+		input       [1:0]  mode,
+		input       [1:0]  border_mode,
+		input       [7:0]  border_value,
+		input       [1:0]  denoise,         // 0 = off, 1 = Gaussian, 2 = median
+
+		///////// AVALON-ST SINK (mSGDMA MM-to-ST) /////////
+		input       [7:0]  sink_data,
+		input              sink_valid,
+		input              sink_startofpacket,
+		input              sink_endofpacket,
+		output             sink_ready,
+
+		///////// AVALON-ST SOURCE (mSGDMA ST-to-MM) /////////
+		output      [7:0]  source_data,
+		output reg         source_valid,
+		output reg         source_startofpacket,
+		output reg         source_endofpacket,
+		input              source_ready,
+
+		///////// EVENTS (to Sobel_CSR counters) /////////
+		output             pixel_in,
+		output             pixel_out
+);
+
+// Previous two image rows, indexed by byte position in the row
+reg [7:0] line_prev1 [0:MAX_LINE-1];
+reg [7:0] line_prev2 [0:MAX_LINE-1];
+
+localparam [1:0] BORDER_REPLICATE  = 2'd1;
+localparam [1:0] BORDER_REFLECT101 = 2'd2;
+localparam [1:0] BORDER_CONSTANT   = 2'd3;
+
+reg [7:0]  prev1_q, prev2_q;    // line buffer samples at read_pos, one clock later
+reg [1:0]  rows_seen;           // rows of the packet started before this one, saturating at 2
+reg        flushing;            // after endofpacket: beats without input
+reg [31:0] flush_left;
+
+wire        fire       = sink_valid && sink_ready;
+wire        flush_step = flushing && (source_ready || !source_valid);
+wire        beat       = fire || flush_step;
+wire [7:0]  beat_data  = flushing ? 8'h00 : sink_data;
+wire [31:0] row_bytes  = row_length * channels;
+wire [31:0] guard      = row_bytes + channels;
+wire        denoising  = (denoise == 2'd1) || (denoise == 2'd2);
+
+// Optional pre-filter; the gradient stage steps on its output
+wire        filtered_valid;
+wire        filtered_first;
+wire [7:0]  filtered;
+
+Sobel_Denoise #(
+    .MAX_LINE (MAX_LINE)
+) pre_filter (
+    .clk          (clk),
+    .rst          (rst),
+    .step         (beat && denoising),
+    .first        (fire && sink_startofpacket),
+    .data         (beat_data),
+    .flushing     (flushing),
+    .row_bytes    (row_bytes),
+    .channels     (channels),
+    .border_mode  (border_mode),
+    .border_value (border_value),
+    .filter       (denoise),
+    .out_valid    (filtered_valid),
+    .out_first    (filtered_first),
+    .out_data     (filtered)
+);
+
+wire        step       = denoising ? beat && filtered_valid : beat;
+wire        first      = denoising ? beat && filtered_first : fire && sink_startofpacket;
+wire [7:0]  data       = denoising ? filtered : beat_data;
+wire        past_frame = denoising ? flushing && (flush_left <= guard) : flushing;
+wire [31:0] column_pos;
+wire        row_wraps  = (column_pos + 1 == row_bytes);
+wire [1:0]  row_now    = first ? 2'd0 : rows_seen;
+wire [31:0] read_pos   = !step    ? column_pos :
+                         row_wraps ? 32'd0 : column_pos + 1;
+
+// The middle sample of the column is in image row 0 (its top is outside)
+// or, after the last byte of the frame, in the last row (its bottom is outside)
+wire       top_outside    = !past_frame && (row_now == 2'd1);
+wire       bottom_outside = past_frame;
+wire [7:0] top_raw    = prev2_q;
+wire [7:0] middle     = prev1_q;
+wire [7:0] top    = !top_outside                       ? top_raw :
+                    (border_mode == BORDER_REPLICATE)  ? middle :
+                    (border_mode == BORDER_REFLECT101) ? data :
+                    (border_mode == BORDER_CONSTANT)   ? border_value : top_raw;
+wire [7:0] bottom = !bottom_outside                    ? data :
+                    (border_mode == BORDER_REPLICATE)  ? middle :
+                    (border_mode == BORDER_REFLECT101) ? top_raw :
+                    (border_mode == BORDER_CONSTANT)   ? border_value : data;
+
+assign sink_ready = (source_ready || !source_valid) && !flushing;
+assign pixel_in   = step;
+assign pixel_out  = source_valid && source_ready;
+
+Sobel_Window window (
+    .clk          (clk),
+    .rst          (rst),
+    .clear        (1'b0),
+    .step         (step),
+    .first        (first),
+    .column       ({bottom, middle, top}),
+    .border_row   (top_outside || bottom_outside),
+    .row_bytes    (row_bytes),
+    .channels     (channels),
+    .border_mode  (border_mode),
+    .border_value (border_value),
+    .kx           (kx),
+    .ky           (ky),
+    .shift_x      (shift_x),
+    .shift_y      (shift_y),
+    .mode         (mode),
+    .column_pos   (column_pos),
+    .out_valid    (),
+    .out_pixel    (source_data)
+);
+
+always @(posedge clk) begin
+    prev1_q <= line_prev1[read_pos];
+    prev2_q <= line_prev2[read_pos];
+end
+
+always @(posedge clk) begin
+    if (!rst) begin
+        rows_seen            <= 0;
+        flushing             <= 0;
+        flush_left           <= 0;
+        source_valid         <= 0;
+        source_startofpacket <= 0;
+        source_endofpacket   <= 0;
+    end
+    else begin
+        if (step) begin
+            line_prev2[column_pos] <= middle;
+            line_prev1[column_pos] <= data;
+
+            if (row_wraps)
+                rows_seen <= (row_now == 2'd2) ? 2'd2 : row_now + 1'b1;
+            else
+                rows_seen <= row_now;
+
+            source_valid         <= 1'b1;
+            source_startofpacket <= first;
+            source_endofpacket   <= flush_step && (flush_left == 1);
+        end
+        else if (source_ready)
+            source_valid <= 1'b0;
+
+        // One row and one pixel of flush beats per stage close the frame
+        if (fire && sink_endofpacket) begin
+            flushing   <= 1'b1;
+            flush_left <= denoising ? {guard[30:0], 1'b0} : guard;
+        end
+        else if (flush_step) begin
+            flush_left <= flush_left - 1;
+            if (flush_left == 1)
+                flushing <= 1'b0;
+        end
+    end
+end
+
+endmodule
@@ -0,0 +1,141 @@
+//======================================================================
+// Project Name: Sobel Filter Implementation on FPGA
+// Module Name: Sobel_Window
+// Description:
+// Horizontal half of the 3x3 window shared by the PIO, lane bank and
+// streaming front ends. Columns of three vertically adjacent samples
+// arrive in row order (pixel-interleaved when channels > 1); the
+// producer has already resolved rows outside the image. A short column
+// history and the position in the row give each window its left,
+// centre and right columns, and the columns outside the image are
+// substituted here according to the border mode, so the image never
+// has to be padded:
+//
+//   0 SKIP       : frame pixels are output as 0
+//   1 REPLICATE  : the outside column repeats the edge column
+//   2 REFLECT101 : the outside column mirrors about the edge column
+//   3 CONSTANT   : the outside column is border_value
+//
+// The window of each step is centred one pixel behind the column that
+// arrives: on column x it is pixel x-1, and on column 0 of a row it is
+// the last pixel of the row before. A frame of N pixels therefore
+// takes N + 1 steps, and out_valid is held low for the first one
+// after `clear`. Rows need at least two pixels.
+//
+// Inputs:
+// - column: {bottom, middle, top} samples, top row in [7:0]
+// - border_row: the middle sample lies in the first or last image row
+//   (only used by SKIP)
+// - first: with step, this column is column 0 (start of packet)
+//
+// Outputs:
+// - taps: the current window, combinational, for Sobel_Denoise
+//======================================================================
+
+module Sobel_Window(
+		input              clk,
+		input              rst,
+		input              clear,           // restart at column 0, e.g. CSR CLEAR
+
+		input              step,
+		input              first,
+		input       [23:0] column,
+		input              border_row,
+
+		///////// GEOMETRY AND BORDER (from Sobel_CSR) /////////
+		input       [31:0] row_bytes,       // samples per row (width * channels)
+		input       [2:0]  channels,        // 1..4
+		input       [1:0]  border_mode,
+		input       [7:0]  border_value,
+
+		///////// KERNEL (from Sobel_CSR) /////////
+		input       [71:0] kx,
+		input       [71:0] ky,
+		input       [3:0]  shift_x,
+		input       [3:0]  shift_y,
+		input       [1:0]  mode,
+
+		output      [31:0] column_pos,      // position of the arriving column in its row
+		output      [71:0] taps,            // the window itself, for filters other than the core
+		output             out_valid,
+		output      [7:0]  out_pixel
+);
+
+localparam [1:0] BORDER_SKIP       = 2'd0;
+localparam [1:0] BORDER_REPLICATE  = 2'd1;
+localparam [1:0] BORDER_REFLECT101 = 2'd2;
+
+// Last 8 columns {border_row, column}, [0] = most recent
+reg [24:0] history [0:7];
+reg [31:0] position;
+reg        primed;      // a column arrived since `clear`, so the next window has a centre
+reg        emit;        // the core's result belongs to a pixel
+wire       core_valid;
+
+assign column_pos = first ? 32'd0 : position;
+
+// Arriving column 0: the centre is the last pixel of a row, its right column is outside.
+// Arriving column 1: the centre is the first pixel of a row, its left column is outside.
+wire at_row_end   = (column_pos < channels);
+wire at_row_start = !at_row_end && (column_pos < {channels, 1'b0});
+
+wire [24:0] left_h   = history[2*channels - 1];
+wire [24:0] centre_h = history[channels - 1];
+wire [23:0] constant_column = {3{border_value}};
+
+wire [23:0] left   = !at_row_start                      ? left_h[23:0] :
+                     (border_mode == BORDER_REPLICATE)  ? centre_h[23:0] :
+                     (border_mode == BORDER_REFLECT101) ? column :
+                                                          constant_column;
+wire [23:0] right  = !at_row_end                        ? column :
+                     (border_mode == BORDER_REPLICATE)  ? centre_h[23:0] :
+                     (border_mode == BORDER_REFLECT101) ? left_h[23:0] :
+                                                          constant_column;
+wire [23:0] centre = centre_h[23:0];
+wire        blank  = (border_mode == BORDER_SKIP) && (at_row_end || at_row_start || centre_h[24]);
+
+// Window rows are top to bottom; columns left to right, [7:0] = top-left
+wire [71:0] window = {right[23:16], centre[23:16], left[23:16],
+                      right[15:8],  centre[15:8],  left[15:8],
+                      right[7:0],   centre[7:0],   left[7:0]};
+assign taps = window;
+
+Sobel_Core core (
+    .clk       (clk),
+    .rst       (rst),
+    .in_valid  (step),
+    .in_blank  (blank),
+    .window    (window),
+    .kx        (kx),
+    .ky        (ky),
+    .shift_x   (shift_x),
+    .shift_y   (shift_y),
+    .mode      (mode),
+    .out_valid (core_valid),
+    .out_pixel (out_pixel)
+);
+
+assign out_valid = core_valid && emit;
+
+integer h;
+
+always @(posedge clk) begin
+    if (!rst || clear) begin
+        position <= 0;
+        primed   <= 0;
+        emit     <= 0;
+        for (h = 0; h < 8; h = h + 1)
+            history[h] <= 0;
+    end
+    else if (step) begin
+        for (h = 7; h > 0; h = h - 1)
+            history[h] <= history[h - 1];
+        history[0] <= {border_row, column};
+
+        position <= (column_pos + 1 == row_bytes) ? 32'd0 : column_pos + 1;
+        primed   <= 1'b1;
+        emit     <= primed;
+    end
+end
+
+endmodule
@@ -0,0 +1,649 @@
+/***********************
+ **
+ ** Sobel_Engine testbench (Verilator)
+ **
+ ** Cycle-accurate run of the filter datapath without soc_system or DDR3.
+ ** A BMP is pushed through one of the three host paths with the same
+ ** protocol as SW/main.c and the drivers: CSR setup, strobed PIO columns
+ ** with a lagged read and a final flush column, the lane bank with
+ ** planes and bands spread over the lanes, or the mSGDMA stream with
+ ** its guard bytes. The harness stands in for the HPS side: every
+ ** bridge access costs --bridge cycles, and the stream can be throttled
+ ** with random backpressure or run through the denoise pre-filter. The
+ ** result is checked against a C reference of the 3x3 window and the
+ ** run reports cycles per pixel, first-result latency and the projected
+ ** rate at the target clock.
+ **
+ ** Exit status is 0 when the frame matches the reference.
+ **
+ **********************/
+
+#include <algorithm>
+#include <vector>
+#include "VSobel_Engine.h"
+#include "verilated.h"
+
+extern "C" {
+#include "EdgeVision.h"
+}
+
+#define DEFAULT_BRIDGE_CYCLES  10        // lightweight bridge access, in 50 MHz cycles
+#define DEFAULT_CLOCK_MHZ      50.0
+#define DMA_TIMEOUT_CYCLES     64        // per expected beat, before the stream is declared stuck
+
+enum SimPath { PATH_PIO, PATH_BANK, PATH_DMA };
+
+static VSobel_Engine *top;
+static uint64_t cycle;
+static int bridge_cycles = DEFAULT_BRIDGE_CYCLES;
+static int stall_percent = 0;
+static uint32_t pio_strobe = 0;
+
+// Cycle of every pixel_in / pixel_out event, for the latency report
+static std::vector<uint64_t> in_events, out_events;
+
+/* One clock: settle the inputs, record the events of this cycle, then the rising edge */
+static void tick()
+{
+    top->clk = 0;
+    top->eval();
+    if (top->pixel_in)
+        in_events.push_back(cycle);
+    if (top->pixel_out)
+        out_events.push_back(cycle);
+    top->clk = 1;
+    top->eval();
+    cycle++;
+}
+
+static void idle(int cycles)
+{
+    for (int c = 0; c < cycles; c++)
+        tick();
+}
+
+/* Avalon-MM accesses, as a bridge transaction of bridge_cycles cycles */
+static void csr_write(int address, uint32_t data)
+{
+    top->csr_address = address;
+    top->csr_writedata = data;
+    top->csr_write = 1;
+    tick();
+    top->csr_write = 0;
+    idle(bridge_cycles - 1);
+}
+
+static uint32_t csr_read(int address)
+{
+    top->csr_address = address;
+    top->csr_read = 1;
+    tick();
+    top->csr_read = 0;
+    const uint32_t data = top->csr_readdata;
+    idle(bridge_cycles - 1);
+    return data;
+}
+
+static void bank_write(int address, uint32_t data)
+{
+    top->bank_address = address;
+    top->bank_writedata = data;
+    top->bank_write = 1;
+    tick();
+    top->bank_write = 0;
+    idle(bridge_cycles - 1);
+}
+
+static uint32_t bank_read(int address)
+{
+    top->bank_address = address;
+    top->bank_read = 1;
+    tick();
+    top->bank_read = 0;
+    const uint32_t data = top->bank_readdata;
+    idle(bridge_cycles - 1);
+    return data;
+}
+
+/* pixel_in_pio / pixel_out_pio: the PIO registers hold their value between accesses */
+static void pio_write(uint32_t data)
+{
+    pio_strobe ^= PIXEL_STROBE_BIT;
+    top->input_row = (data & ~PIXEL_STROBE_BIT) | pio_strobe;
+    idle(bridge_cycles);
+}
+
+static uint8_t pio_read()
+{
+    idle(bridge_cycles);
+    return top->output_row;
+}
+
+/* Same packing as border_column() in SW/main.c */
+static uint8_t outside_row(SobelBorder border, uint8_t value, uint8_t edge, uint8_t mirror)
+{
+    switch (border)
+    {
+        case BORDER_REPLICATE: return edge;
+        case BORDER_REFLECT101: return mirror;
+        case BORDER_CONSTANT: return value;
+        default: return 0;
+    }
+}
+
+static uint32_t border_column(const unsigned char *sample, int cols, int row, int height,
+                              SobelBorder border, uint8_t value)
+{
+    uint8_t column[SIZE_BUFFER];
+    const uint8_t middle = sample[row * cols];
+
+    column[0] = (row > 0) ? sample[(row - 1) * cols]
+                          : outside_row(border, value, middle, sample[(row + 1) * cols]);
+    column[1] = middle;
+    column[2] = (row < height - 1) ? sample[(row + 1) * cols]
+                                   : outside_row(border, value, middle, sample[(row - 1) * cols]);
+
+    uint32_t packed = prepareDataforTx(column, SIZE_BUFFER);
+    if (row == 0 || row == height - 1)
+        packed |= PIXEL_BORDER_ROW_BIT;
+    return packed;
+}
+
+/**
+ * Reference: the Sobel kernels at their reset values, the default
+ * inverted-gradient output and the border rules of Sobel_Window.
+ */
+static void reference_frame(const unsigned char *image, unsigned char *expected, int width, int height,
+                            int channels, SobelBorder border, uint8_t value)
+{
+    static const int kx[3][3] = {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}};
+    static const int ky[3][3] = {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}};
+    const int cols = width * channels;
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                unsigned char *out = &expected[(size_t)y * cols + x * channels + c];
+                if (border == BORDER_SKIP && (x == 0 || y == 0 || x == width - 1 || y == height - 1))
+                {
+                    *out = 0;
+                    continue;
+                }
+
+                int sumX = 0, sumY = 0;
+                for (int r = 0; r < 3; r++)
+                {
+                    for (int k = 0; k < 3; k++)
+                    {
+                        int yy = y + r - 1, xx = x + k - 1, sample;
+                        if (border == BORDER_REPLICATE)
+                        {
+                            yy = yy < 0 ? 0 : (yy >= height ? height - 1 : yy);
+                            xx = xx < 0 ? 0 : (xx >= width ? width - 1 : xx);
+                        }
+                        else if (border == BORDER_REFLECT101)
+                        {
+                            yy = yy < 0 ? 1 : (yy >= height ? height - 2 : yy);
+                            xx = xx < 0 ? 1 : (xx >= width ? width - 2 : xx);
+                        }
+                        if (yy < 0 || yy >= height || xx < 0 || xx >= width)
+                            sample = value;
+                        else
+                            sample = image[(size_t)yy * cols + xx * channels + c];
+                        sumX += sample * kx[r][k];
+                        sumY += sample * ky[r][k];
+                    }
+                }
+                int magnitude = abs(sumX) + abs(sumY);
+                *out = (uint8_t)(255 - (magnitude > 255 ? 255 : magnitude));
+            }
+        }
+    }
+}
+
+/**
+ * Reference of Sobel_Denoise: the Gaussian or median of each 3x3
+ * neighbourhood, with SKIP filtered as REPLICATE.
+ */
+static void reference_denoise(const unsigned char *image, unsigned char *filtered, int width, int height,
+                              int channels, SobelDenoise denoise, SobelBorder border, uint8_t value)
+{
+    static const int weights[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+    const int cols = width * channels;
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                int p[9], n = 0;
+                for (int r = -1; r <= 1; r++)
+                {
+                    for (int k = -1; k <= 1; k++)
+                    {
+                        int yy = y + r, xx = x + k;
+                        if (border == BORDER_REFLECT101)
+                        {
+                            yy = yy < 0 ? 1 : (yy >= height ? height - 2 : yy);
+                            xx = xx < 0 ? 1 : (xx >= width ? width - 2 : xx);
+                        }
+                        else if (border != BORDER_CONSTANT)
+                        {
+                            yy = yy < 0 ? 0 : (yy >= height ? height - 1 : yy);
+                            xx = xx < 0 ? 0 : (xx >= width ? width - 1 : xx);
+                        }
+                        p[n++] = (yy < 0 || yy >= height || xx < 0 || xx >= width)
+                                 ? value : image[(size_t)yy * cols + xx * channels + c];
+                    }
+                }
+
+                int out = 8;
+                if (denoise == DENOISE_MEDIAN)
+                {
+                    std::sort(p, p + 9);
+                    out = p[4];
+                }
+                else
+                {
+                    for (int k = 0; k < 9; k++)
+                        out += weights[k] * p[k];
+                    out >>= 4;
+                }
+                filtered[(size_t)y * cols + x * channels + c] = (uint8_t)out;
+            }
+        }
+    }
+}
+
+/* Host side of fpga_begin_frame() */
+static void begin_frame(uint32_t row_length, uint32_t rows)
+{
+    csr_write(KERNEL_CSR_ROW_LEN, row_length);
+    csr_write(KERNEL_CSR_ROWS, rows);
+    csr_write(KERNEL_CSR_CLEAR, 1);
+    csr_write(KERNEL_CSR_IRQ_EN, STATUS_FRAME_DONE);
+}
+
+/* The PIO loop of SW/main.c: planes back to back, one lagged read per column */
+static void run_pio(const unsigned char *image, unsigned char *result, int width, int height, int channels,
+                    SobelBorder border, uint8_t value)
+{
+    const int cols = width * channels;
+
+    pio_strobe = 0;
+    top->input_row = 0;
+    csr_write(KERNEL_CSR_CTRL, KERNEL_CTRL_STROBED);
+    begin_frame(width, height * channels);
+
+    long previous = -1;
+    for (int k = 0; k < channels; k++)
+    {
+        for (int i = 0; i < height; i++)
+        {
+            for (int j = k; j < cols; j += channels)
+            {
+                pio_write(border_column(image + j, cols, i, height, border, value));
+                const uint8_t pixel = pio_read();
+                if (previous >= 0)
+                    result[previous] = pixel;
+                previous = (long)i * cols + j;
+            }
+        }
+    }
+    pio_write(0);
+    result[previous] = pio_read();
+}
+
+/* runCoreBank() of SW/main.c: planes, then bands, spread over the lanes */
+static int run_bank(const unsigned char *image, unsigned char *result, int width, int height, int channels,
+                    SobelBorder border, uint8_t value, int lanes_requested)
+{
+    const int cols = width * channels;
+    int lanes = (bank_read(CORE_BANK_CONFIG) >> 8) & 0xF;
+    if (lanes > lanes_requested)
+        lanes = lanes_requested;
+    if (lanes < 1)
+        return -1;
+
+    int bands = lanes / channels;
+    if (bands < 1)
+        bands = 1;
+    if (bands > height)
+        bands = height;
+
+    const int task_count = channels * bands;
+    std::vector<int> task_channel(task_count), task_start(task_count), task_end(task_count);
+    for (int t = 0; t < task_count; t++)
+    {
+        const int band = t % bands;
+        task_channel[t] = t / bands;
+        task_start[t] = (int)((long)height * band / bands);
+        task_end[t] = (int)((long)height * (band + 1) / bands);
+    }
+
+    const int band_rows = (height + bands - 1) / bands;
+    const int groups = (task_count + lanes - 1) / lanes;
+    csr_write(KERNEL_CSR_CTRL, KERNEL_CTRL_STROBED);
+    begin_frame(width, groups * band_rows);
+
+    uint8_t results[CORE_BANK_MAX_LANES];
+    long previous[CORE_BANK_MAX_LANES];
+    int group_size = 0;
+    for (int l = 0; l < lanes; l++)
+        previous[l] = -1;
+
+    for (int first = 0; first < task_count; first += lanes)
+    {
+        group_size = (task_count - first < lanes) ? task_count - first : lanes;
+        bank_write(CORE_BANK_CONFIG, group_size);
+
+        for (int row = 0; row < band_rows; row++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                for (int l = 0; l < group_size; l++)
+                {
+                    const int t = first + l;
+                    const int i = task_start[t] + row;
+                    const int j = x * channels + task_channel[t];
+                    bank_write(CORE_BANK_LANE0 + l,
+                               i < task_end[t] ? border_column(image + j, cols, i, height, border, value) : 0);
+                }
+
+                for (int group = 0; group * 4 < lanes; group++)
+                {
+                    const uint32_t packed = bank_read(CORE_BANK_RESULT0 + group);
+                    for (int k = 0; k < 4 && group * 4 + k < lanes; k++)
+                        results[group * 4 + k] = (uint8_t)(packed >> (8 * k));
+                }
+                for (int l = 0; l < lanes; l++)
+                {
+                    const int t = first + l;
+                    const int i = (l < group_size) ? task_start[t] + row : height;
+                    if (previous[l] >= 0)
+                        result[previous[l]] = results[l];
+                    previous[l] = (l < group_size && i < task_end[t])
+                                  ? (long)i * cols + x * channels + task_channel[t] : -1;
+                }
+            }
+        }
+    }
+
+    bank_write(CORE_BANK_LANE0 + group_size - 1, 0);
+    for (int group = 0; group * 4 < lanes; group++)
+    {
+        const uint32_t packed = bank_read(CORE_BANK_RESULT0 + group);
+        for (int k = 0; k < 4 && group * 4 + k < lanes; k++)
+            results[group * 4 + k] = (uint8_t)(packed >> (8 * k));
+    }
+    for (int l = 0; l < lanes; l++)
+    {
+        if (previous[l] >= 0)
+            result[previous[l]] = results[l];
+    }
+    return lanes;
+}
+
+/**
+ * dma_sobel_batch() with the mSGDMA dispatchers replaced by the harness:
+ * `frames` copies of the image, one packet each, one byte per beat into
+ * the sink, and frames * (total + guard) beats out of the source. With
+ * --stall, each cycle the read side withholds data and the write side
+ * deasserts ready with that probability. The first frame goes to
+ * `result`, and every later one must match it.
+ */
+static int run_dma(const unsigned char *image, unsigned char *result, int width, int height, int channels,
+                   int frames, SobelDenoise denoise)
+{
+    const uint32_t row_bytes = (uint32_t)width * channels;
+    const uint32_t total = row_bytes * height;
+    const uint32_t guard = DMA_OUTPUT_GUARD(row_bytes, channels);
+    const uint64_t stride = total + guard;
+    const uint64_t beats_in = (uint64_t)total * frames, beats_out = stride * frames;
+    std::vector<unsigned char> written(beats_out);
+
+    csr_write(KERNEL_CSR_CTRL, KERNEL_CTRL_STROBED | ((uint32_t)channels << KERNEL_CTRL_CHANNELS_SHIFT) |
+                               ((uint32_t)denoise << KERNEL_CTRL_DENOISE_SHIFT));
+    begin_frame(width, height * channels * frames);
+
+    uint64_t sent = 0, received = 0;
+    const uint64_t deadline = cycle + beats_out * DMA_TIMEOUT_CYCLES;
+    while (received < beats_out)
+    {
+        if (cycle > deadline)
+        {
+            printf("Error: stream stopped after %llu of %llu beats\n", (unsigned long long)received,
+                   (unsigned long long)beats_out);
+            return -1;
+        }
+
+        const int hold = stall_percent > 0 && rand() % 100 < stall_percent;
+        const int block = stall_percent > 0 && rand() % 100 < stall_percent;
+        top->sink_valid = sent < beats_in && !hold;
+        top->sink_data = sent < beats_in ? image[sent % total] : 0;
+        top->sink_startofpacket = sent % total == 0;
+        top->sink_endofpacket = sent % total == total - 1;
+        top->source_ready = !block;
+
+        top->clk = 0;
+        top->eval();
+        const int accepted = top->sink_valid && top->sink_ready;
+        const int delivered = top->source_valid && top->source_ready;
+        if (delivered)
+        {
+            written[received] = top->source_data;
+            if (top->source_endofpacket && received % stride != stride - 1)
+                printf("Warning: endofpacket on beat %llu of %llu\n", (unsigned long long)received + 1,
+                       (unsigned long long)beats_out);
+            received++;
+        }
+        tick();
+        if (accepted)
+            sent++;
+    }
+    top->sink_valid = 0;
+    top->source_ready = 1;
+
+    memcpy(result, written.data() + guard, total);
+    for (int f = 1; f < frames; f++)
+    {
+        if (memcmp(result, written.data() + f * stride + guard, total) != 0)
+        {
+            printf("Error: frame %d of the batch differs from frame 0\n", f);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [--path=pio|bank|dma] [--lanes=N] [--border=skip|replicate|reflect101|constant[:V]]\n"
+           "       [--bridge=CYCLES] [--stall=PERCENT] [--frames=N] [--denoise=gaussian|median]\n"
+           "       [--clock-mhz=F] input.bmp\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    Verilated::commandArgs(argc, argv);
+
+    SimPath path = PATH_PIO;
+    SobelBorder border = BORDER_SKIP;
+    uint8_t border_value = 0;
+    int lanes_requested = CORE_BANK_MAX_LANES;
+    double clock_mhz = DEFAULT_CLOCK_MHZ;
+    int frames = 1;                 // DMA path: copies of the image sent as one batch
+    SobelDenoise denoise = DENOISE_NONE;
+    char *filename = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--path=pio") == 0)
+            path = PATH_PIO;
+        else if (strcmp(argv[a], "--path=bank") == 0)
+            path = PATH_BANK;
+        else if (strcmp(argv[a], "--path=dma") == 0)
+            path = PATH_DMA;
+        else if (strncmp(argv[a], "--lanes=", 8) == 0)
+            lanes_requested = atoi(argv[a] + 8);
+        else if (strncmp(argv[a], "--border=", 9) == 0)
+        {
+            if (parse_border(argv[a] + 9, &border, &border_value) != 0)
+            {
+                printf("Invalid border: %s\n", argv[a] + 9);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[a], "--bridge=", 9) == 0)
+            bridge_cycles = atoi(argv[a] + 9);
+        else if (strncmp(argv[a], "--stall=", 8) == 0)
+            stall_percent = atoi(argv[a] + 8);
+        else if (strncmp(argv[a], "--frames=", 9) == 0)
+            frames = atoi(argv[a] + 9);
+        else if (strncmp(argv[a], "--denoise=", 10) == 0)
+        {
+            if (parse_denoise(argv[a] + 10, &denoise) != 0)
+            {
+                printf("Invalid denoise filter: %s\n", argv[a] + 10);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[a], "--clock-mhz=", 12) == 0)
+            clock_mhz = atof(argv[a] + 12);
+        else if (argv[a][0] == '+')
+            continue;       // Verilator plusargs
+        else if (strncmp(argv[a], "--", 2) == 0 || filename != NULL)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+            filename = argv[a];
+    }
+
+    // A PIO result is ready one clock after its column, so one cycle per access is the floor
+    if (filename == NULL || bridge_cycles < 1 || stall_percent < 0 || stall_percent > 99 ||
+        lanes_requested < 1 || frames < 1 || ((frames > 1 || denoise != DENOISE_NONE) && path != PATH_DMA) ||
+        clock_mhz <= 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    BITMAPINFOHEADER info;
+    BITMAPFILEHEADER header;
+    unsigned char *image = LoadBitmapFile(filename, &info, &header);
+    if (image == NULL)
+    {
+        printf("No image found!\n");
+        return 1;
+    }
+    const int width = info.biWidth, height = info.biHeight, channels = info.biBitCount / 8;
+    if (width < 2 || height < 2)
+    {
+        printf("Image too small: at least 2x2 pixels needed\n");
+        free(image);
+        return 1;
+    }
+    const size_t bytes = (size_t)width * height * channels;
+    std::vector<unsigned char> result(bytes), expected(bytes);
+
+    top = new VSobel_Engine;
+    srand(1);
+
+    // Reset (active low), with every bus idle
+    top->rst = 0;
+    top->source_ready = 1;
+    idle(4);
+    top->rst = 1;
+    idle(2);
+
+    if (csr_read(KERNEL_CSR_ID) != 0x534F4231)
+        printf("Warning: unexpected core ID 0x%08X\n", csr_read(KERNEL_CSR_ID));
+    csr_write(KERNEL_CSR_BORDER, (border & 3) | ((uint32_t)border_value << 8));
+
+    const char *path_name = path == PATH_PIO ? "pio" : (path == PATH_BANK ? "bank" : "dma");
+    in_events.clear();
+    out_events.clear();
+    const uint64_t start = cycle;
+    int lanes = 1, status = 0;
+
+    if (path == PATH_PIO)
+        run_pio(image, result.data(), width, height, channels, border, border_value);
+    else if (path == PATH_BANK)
+        status = lanes = run_bank(image, result.data(), width, height, channels, border, border_value,
+                                  lanes_requested);
+    else
+        status = run_dma(image, result.data(), width, height, channels, frames, denoise);
+    const uint64_t elapsed = cycle - start;
+
+    if (status < 0)
+    {
+        printf("Simulation failed on the %s path\n", path_name);
+        delete top;
+        free(image);
+        return 1;
+    }
+
+    // Let the frame-done status settle, then read it and the counters as main.c does
+    idle(4);
+    const uint32_t frame_status = csr_read(KERNEL_CSR_STATUS);
+    const uint32_t hw_cycles = csr_read(KERNEL_CSR_CYCLES);
+    const uint32_t hw_in = csr_read(KERNEL_CSR_PIX_IN);
+    const uint32_t hw_out = csr_read(KERNEL_CSR_PIX_OUT);
+    const uint32_t hw_stalls = csr_read(KERNEL_CSR_STALLS);
+
+    if (denoise != DENOISE_NONE)
+    {
+        std::vector<unsigned char> filtered(bytes);
+        reference_denoise(image, filtered.data(), width, height, channels, denoise, border, border_value);
+        reference_frame(filtered.data(), expected.data(), width, height, channels, border, border_value);
+    }
+    else
+        reference_frame(image, expected.data(), width, height, channels, border, border_value);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        if (result[i] != expected[i])
+        {
+            if (mismatches < 8)
+                printf("Mismatch at byte %zu (row %zu, column %zu): got %u, expected %u\n", i,
+                       i / ((size_t)width * channels), i % ((size_t)width * channels), result[i], expected[i]);
+            mismatches++;
+        }
+    }
+
+    // First result: pixel 0 needs the column of pixel 1 (PIO, lanes), or the
+    // byte `guard` further on (stream, whose output is offset by the guard).
+    // With a denoise filter the stream counts the beats of its gradient stage.
+    const size_t first_in = path == PATH_DMA ? DMA_OUTPUT_GUARD((size_t)width * channels, channels) : 1;
+    const size_t first_out = path == PATH_DMA ? first_in : 0;
+    const long latency = (in_events.size() > first_in && out_events.size() > first_out)
+                         ? (long)(out_events[first_out] - in_events[first_in]) : -1;
+
+    const double pixels = (double)width * height * frames;
+    const double cycles_per_pixel = elapsed / pixels;
+    printf("Image : %s, %dx%d, %d byte(s) per pixel\n", filename, width, height, channels);
+    printf("Path : %s, border %d, %d bridge cycles per access", path_name, border, bridge_cycles);
+    if (path == PATH_BANK)
+        printf(", %d lanes", lanes);
+    if (path == PATH_DMA)
+        printf(", %d frame(s), %d%% stall, denoise %d", frames, stall_percent, denoise);
+    printf("\n");
+    printf("Cycles : %llu, %.3f cycles/pixel, first result latency %ld cycles\n",
+           (unsigned long long)elapsed, cycles_per_pixel, latency);
+    printf("Projected : %.2f Mpix/s, %.2f ms per frame at %.1f MHz\n", clock_mhz / cycles_per_pixel,
+           elapsed / (clock_mhz * 1e3), clock_mhz);
+    printf("HW counters : cycles %u, pixels in %u, pixels out %u, stalls %u, frame done %s\n", hw_cycles, hw_in,
+           hw_out, hw_stalls, (frame_status & STATUS_FRAME_DONE) ? "yes" : "no");
+    printf("Check : %zu of %zu bytes differ from the reference\n", mismatches, bytes);
+
+    top->final();
+    delete top;
+    free(image);
+    return mismatches == 0 ? 0 : 1;
+}
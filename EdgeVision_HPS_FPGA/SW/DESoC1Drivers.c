@@ -3,14 +3,27 @@
 // Global variables for memory-mapped addresses
 volatile uint32_t *pixel_in_pio = NULL;
 volatile uint8_t *pixel_out_pio = NULL;
+volatile uint32_t *kernel_csr = NULL;
+volatile uint32_t *core_bank = NULL;
 void *lw_bridge_base = NULL;
 int fd = -1;
+int uio_fd = -1;
+uint32_t ctrl_shadow = 0;      // last value written to KERNEL_CSR_CTRL
+uint32_t strobe_state = 0;     // current level of PIXEL_STROBE_BIT
 
 /**
  * Configure the Lightweight HPS-to-FPGA bridge and map PIOs.
  * Returns 0 on success, -1 on failure.
  */
 int configure_fpga() {
+#ifdef SOBEL_DMA_MODEL
+    // Off-board: registers live in plain memory and DMA runs in software
+    lw_bridge_base = dma_model_map_bridge();
+    if (lw_bridge_base == NULL) {
+        perror("Error allocating model bridge");
+        return -1;
+    }
+#else
     // Open memory-mapped device
     fd = open("/dev/mem", O_RDWR | O_SYNC);
     if (fd == -1) {
@@ -25,10 +38,13 @@ int configure_fpga() {
         close(fd);
         return -1;
     }
+#endif
 
     // Calculate PIO addresses
     pixel_in_pio = (uint32_t *)((uintptr_t)lw_bridge_base + PIXEL_IN_PIO_BASE);
     pixel_out_pio = (uint8_t *)((uintptr_t)lw_bridge_base + PIXEL_OUT_PIO_BASE);
+    kernel_csr = (uint32_t *)((uintptr_t)lw_bridge_base + KERNEL_CSR_BASE);
+    core_bank = (uint32_t *)((uintptr_t)lw_bridge_base + CORE_BANK_BASE);
 
     return 0;
 }
@@ -38,6 +54,11 @@ int configure_fpga() {
  */
 void write_to_fpga(uint32_t data) {
     if (pixel_in_pio != NULL) {
+        // In strobed mode every write toggles bit 24 so the core sees a new pixel
+        if (ctrl_shadow & KERNEL_CTRL_STROBED) {
+            strobe_state ^= PIXEL_STROBE_BIT;
+            data = (data & ~PIXEL_STROBE_BIT) | strobe_state;
+        }
         *pixel_in_pio = data;
         //printf("HPS -> FPGA: Sent 0x%X\n", data);
     } else {
@@ -59,16 +80,508 @@ uint8_t read_from_fpga() {
     }
 }
 
+/* Operators the configurable stencil can run without a new bitstream */
+static const FpgaKernel kernel_presets[] = {
+    { "sobel",     {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}},     {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}},     0, 0, KERNEL_MODE_GRADIENT_INV },
+    { "scharr",    {{3, 0, -3}, {10, 0, -10}, {3, 0, -3}},   {{3, 10, 3}, {0, 0, 0}, {-3, -10, -3}},   0, 0, KERNEL_MODE_GRADIENT_INV },
+    { "prewitt",   {{1, 0, -1}, {1, 0, -1}, {1, 0, -1}},     {{1, 1, 1}, {0, 0, 0}, {-1, -1, -1}},     0, 0, KERNEL_MODE_GRADIENT_INV },
+    { "laplacian", {{0, 1, 0}, {1, -4, 1}, {0, 1, 0}},       {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}},        0, 0, KERNEL_MODE_SINGLE_ABS },
+    { "blur",      {{1, 2, 1}, {2, 4, 2}, {1, 2, 1}},        {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}},        4, 0, KERNEL_MODE_SINGLE },
+};
+
+/**
+ * Look up a kernel preset by name. Returns NULL if there is none.
+ */
+const FpgaKernel *find_kernel_preset(const char *name) {
+    for (size_t i = 0; i < sizeof(kernel_presets) / sizeof(kernel_presets[0]); i++) {
+        if (strcasecmp(name, kernel_presets[i].name) == 0)
+            return &kernel_presets[i];
+    }
+    return NULL;
+}
+
+/**
+ * Parse a border mode: skip, replicate, reflect101 (or reflect) or
+ * constant[:V] with V = 0..255. Returns 0 on success, -1 on failure.
+ */
+int parse_border(const char *text, SobelBorder *border, uint8_t *value) {
+    static const char *names[BORDER_COUNT] = { "skip", "replicate", "reflect101", "constant" };
+    int parsed;
+    char tail;
+
+    *value = 0;
+    if (strcasecmp(text, "reflect") == 0) {
+        *border = BORDER_REFLECT101;
+        return 0;
+    }
+    if (strncasecmp(text, "constant:", 9) == 0) {
+        if (sscanf(text + 9, "%d%c", &parsed, &tail) != 1 || parsed < 0 || parsed > 255)
+            return -1;
+        *border = BORDER_CONSTANT;
+        *value = (uint8_t)parsed;
+        return 0;
+    }
+    for (int i = 0; i < BORDER_COUNT; i++) {
+        if (strcasecmp(text, names[i]) == 0) {
+            *border = (SobelBorder)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Pack one kernel row as three signed bytes, column 0 in the low byte */
+static uint32_t pack_kernel_row(const int8_t row[3]) {
+    return (uint32_t)(uint8_t)row[0] |
+           ((uint32_t)(uint8_t)row[1] << 8) |
+           ((uint32_t)(uint8_t)row[2] << 16);
+}
+
+/**
+ * Load a coefficient set, shift amounts and output mode into the kernel CSR.
+ * Takes effect from the next pixel; no reconfiguration needed.
+ * Returns 0 on success, -1 if the bridge is not mapped.
+ */
+int set_kernel(const FpgaKernel *kernel) {
+    if (kernel_csr == NULL || kernel == NULL) {
+        fprintf(stderr, "Error: Kernel CSR not configured. Call configure_fpga() first.\n");
+        return -1;
+    }
+
+    for (int row = 0; row < 3; row++) {
+        kernel_csr[KERNEL_CSR_KX0 + row] = pack_kernel_row(kernel->kx[row]);
+        kernel_csr[KERNEL_CSR_KY0 + row] = pack_kernel_row(kernel->ky[row]);
+    }
+    kernel_csr[KERNEL_CSR_SHIFT] = (kernel->shift_x & 0xF) | ((uint32_t)(kernel->shift_y & 0xF) << 8);
+    ctrl_shadow = (ctrl_shadow & ~0x3u) | (kernel->mode & 0x3);
+    kernel_csr[KERNEL_CSR_CTRL] = ctrl_shadow;
+
+    return 0;
+}
+
+/**
+ * Select how the window treats samples outside the image (and the value
+ * used by BORDER_CONSTANT). Applies to the PIO, lane and DMA paths alike.
+ * Returns 0 on success, -1 if the bridge is not mapped.
+ */
+int set_border(SobelBorder border, uint8_t value) {
+    if (kernel_csr == NULL) {
+        fprintf(stderr, "Error: Kernel CSR not configured. Call configure_fpga() first.\n");
+        return -1;
+    }
+    kernel_csr[KERNEL_CSR_BORDER] = (border & 3) | ((uint32_t)value << 8);
+    return 0;
+}
+
+/**
+ * Parse a denoise filter: none, gaussian or median. Returns 0 on success,
+ * -1 if the name is unknown.
+ */
+int parse_denoise(const char *text, SobelDenoise *denoise) {
+    static const char *names[DENOISE_COUNT] = { "none", "gaussian", "median" };
+
+    for (int i = 0; i < DENOISE_COUNT; i++) {
+        if (strcasecmp(text, names[i]) == 0) {
+            *denoise = (SobelDenoise)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Select the 3x3 filter that Sobel_Denoise runs ahead of the gradient.
+ * Only the DMA path has it; the PIO and lane paths ignore the setting.
+ * Returns 0 on success, -1 if the bridge is not mapped.
+ */
+int set_denoise(SobelDenoise denoise) {
+    if (kernel_csr == NULL) {
+        fprintf(stderr, "Error: Kernel CSR not configured. Call configure_fpga() first.\n");
+        return -1;
+    }
+    ctrl_shadow = (ctrl_shadow & ~(3u << KERNEL_CTRL_DENOISE_SHIFT)) |
+                  ((uint32_t)(denoise & 3) << KERNEL_CTRL_DENOISE_SHIFT);
+    kernel_csr[KERNEL_CSR_CTRL] = ctrl_shadow;
+    return 0;
+}
+
+/**
+ * Switch the datapath to the strobed handshake, so it advances once per
+ * write_to_fpga() and the pixel counters and completion status are exact.
+ */
+int enable_strobed_mode() {
+    if (kernel_csr == NULL) {
+        fprintf(stderr, "Error: Kernel CSR not configured. Call configure_fpga() first.\n");
+        return -1;
+    }
+    // Output-only PIOs read back undefined, so park the strobe at a known level
+    strobe_state = 0;
+    *pixel_in_pio = 0;
+    ctrl_shadow |= KERNEL_CTRL_STROBED;
+    kernel_csr[KERNEL_CSR_CTRL] = ctrl_shadow;
+    return 0;
+}
+
+/**
+ * Open the UIO node carrying the Sobel completion interrupt.
+ * Without it fpga_wait_frame() falls back to polling the status register.
+ */
+int open_fpga_irq(const char *uio_device) {
+    uio_fd = open(uio_device, O_RDWR);
+    if (uio_fd == -1) {
+        perror("Warning: cannot open UIO device, polling for completion");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Arm row/frame tracking for the next frame and zero the counters.
+ */
+int fpga_begin_frame(uint32_t row_length, uint32_t rows) {
+    if (kernel_csr == NULL) {
+        fprintf(stderr, "Error: Kernel CSR not configured. Call configure_fpga() first.\n");
+        return -1;
+    }
+    kernel_csr[KERNEL_CSR_ROW_LEN] = row_length;
+    kernel_csr[KERNEL_CSR_ROWS] = rows;
+    kernel_csr[KERNEL_CSR_CLEAR] = 1;
+    kernel_csr[KERNEL_CSR_IRQ_EN] = STATUS_FRAME_DONE;
+    return 0;
+}
+
+/**
+ * Sleep until the frame-done interrupt fires (or poll when no UIO node is
+ * open), then acknowledge it. Returns 0 on completion, -1 on timeout/error.
+ */
+int fpga_wait_frame(int timeout_ms) {
+    if (kernel_csr == NULL)
+        return -1;
+
+    if (uio_fd != -1) {
+        uint32_t unmask = 1, count;
+        struct pollfd pfd = { .fd = uio_fd, .events = POLLIN };
+
+        // Always unmask and consume an event, even if the frame is already
+        // done: a level interrupt that is still asserted fires again at
+        // once, and skipping the read would leave this frame's event to
+        // wake the next wait early
+        do {
+            if (write(uio_fd, &unmask, sizeof(unmask)) != sizeof(unmask))
+                return -1;
+            if (poll(&pfd, 1, timeout_ms) <= 0)
+                return -1;
+            if (read(uio_fd, &count, sizeof(count)) != sizeof(count))
+                return -1;
+        } while (!(kernel_csr[KERNEL_CSR_STATUS] & STATUS_FRAME_DONE));
+    } else {
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (!(kernel_csr[KERNEL_CSR_STATUS] & STATUS_FRAME_DONE)) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 > timeout_ms)
+                return -1;
+            sched_yield();
+        }
+    }
+
+    kernel_csr[KERNEL_CSR_IRQ_EN] = 0;
+    kernel_csr[KERNEL_CSR_STATUS] = STATUS_ROW_DONE | STATUS_FRAME_DONE;
+    return 0;
+}
+
+/**
+ * Snapshot the free-running hardware counters.
+ */
+int read_fpga_counters(FpgaCounters *counters) {
+    if (kernel_csr == NULL || counters == NULL)
+        return -1;
+    counters->cycles = kernel_csr[KERNEL_CSR_CYCLES];
+    counters->pixels_in = kernel_csr[KERNEL_CSR_PIX_IN];
+    counters->pixels_out = kernel_csr[KERNEL_CSR_PIX_OUT];
+    counters->stalls = kernel_csr[KERNEL_CSR_STALLS];
+    return 0;
+}
+
+/**
+ * Number of parallel filter lanes built into the bitstream (0 if the
+ * bank is absent, e.g. an older .sof).
+ */
+int fpga_core_count() {
+    if (core_bank == NULL)
+        return 0;
+    int lanes = (core_bank[CORE_BANK_CONFIG] >> 8) & 0xF;
+    return lanes > CORE_BANK_MAX_LANES ? 0 : lanes;
+}
+
+/**
+ * Select how many lanes take part in a sweep; the write to the last of
+ * them steps the whole bank. Returns the number enabled, or -1.
+ */
+int set_active_lanes(int lanes) {
+    int available = fpga_core_count();
+    if (lanes < 1 || available == 0)
+        return -1;
+    if (lanes > available)
+        lanes = available;
+    core_bank[CORE_BANK_CONFIG] = lanes;
+    return lanes;
+}
+
+/**
+ * Hand one 3-pixel column (packed as by prepareDataforTx) to a lane.
+ */
+void write_lane(int lane, uint32_t column) {
+    core_bank[CORE_BANK_LANE0 + lane] = column;
+}
+
+/**
+ * Fetch the latest result of the first `lanes` lanes, four per read.
+ */
+void read_lane_results(uint8_t *results, int lanes) {
+    for (int group = 0; group * 4 < lanes; group++) {
+        uint32_t packed = core_bank[CORE_BANK_RESULT0 + group];
+        for (int k = 0; k < 4 && group * 4 + k < lanes; k++)
+            results[group * 4 + k] = (uint8_t)(packed >> (8 * k));
+    }
+}
+
+#ifndef SOBEL_DMA_MODEL
+/* Read one numeric u-dma-buf sysfs attribute (hex or decimal) */
+static int read_udmabuf_attr(const char *name, const char *attr, unsigned long *value) {
+    char path[128], text[32];
+    snprintf(path, sizeof(path), "/sys/class/u-dma-buf/%s/%s", name, attr);
+
+    FILE *attrFile = fopen(path, "r");
+    if (attrFile == NULL) {
+        perror(path);
+        return -1;
+    }
+    char *line = fgets(text, sizeof(text), attrFile);
+    fclose(attrFile);
+    if (line == NULL)
+        return -1;
+    *value = strtoul(text, NULL, 0);
+    return 0;
+}
+#endif
+
+/**
+ * Map a physically contiguous u-dma-buf (CMA) buffer so the loader can place
+ * the image straight into memory the DMA engine reads from.
+ * Returns 0 on success, -1 on failure.
+ */
+int dma_alloc(DmaBuffer *buffer, const char *name) {
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->fd = -1;
+
+#ifdef SOBEL_DMA_MODEL
+    (void)name;
+    return dma_model_alloc(buffer, 16 * 1024 * 1024);
+#else
+    unsigned long phys, size;
+    char path[64];
+
+    if (read_udmabuf_attr(name, "phys_addr", &phys) != 0 ||
+        read_udmabuf_attr(name, "size", &size) != 0)
+        return -1;
+
+    snprintf(path, sizeof(path), "/dev/%s", name);
+    buffer->fd = open(path, O_RDWR | O_SYNC);
+    if (buffer->fd == -1) {
+        perror(path);
+        return -1;
+    }
+
+    buffer->virt = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+    if (buffer->virt == MAP_FAILED) {
+        perror("Error mapping DMA buffer");
+        close(buffer->fd);
+        buffer->fd = -1;
+        buffer->virt = NULL;
+        return -1;
+    }
+    buffer->phys = (uint32_t)phys;
+    buffer->size = size;
+    return 0;
+#endif
+}
+
+void dma_free(DmaBuffer *buffer) {
+#ifdef SOBEL_DMA_MODEL
+    dma_model_free(buffer);
+#else
+    if (buffer->virt != NULL)
+        munmap(buffer->virt, buffer->size);
+    if (buffer->fd != -1)
+        close(buffer->fd);
+#endif
+    buffer->virt = NULL;
+    buffer->fd = -1;
+}
+
+/* Queue one descriptor on an mSGDMA dispatcher, waiting for FIFO space */
+static void post_descriptor(volatile uint32_t *csr, volatile uint32_t *slave, uint32_t read_addr,
+                            uint32_t write_addr, uint32_t length, uint32_t control) {
+#ifdef SOBEL_DMA_MODEL
+    (void)csr;
+    dma_model_post(slave, read_addr, write_addr, length, control | MSGDMA_DESC_GO);
+#else
+    while (csr[MSGDMA_CSR_STATUS] & MSGDMA_STATUS_FULL)
+        sched_yield();
+    slave[MSGDMA_DESC_READ_ADDR] = read_addr;
+    slave[MSGDMA_DESC_WRITE_ADDR] = write_addr;
+    slave[MSGDMA_DESC_LENGTH] = length;
+    slave[MSGDMA_DESC_CONTROL] = control | MSGDMA_DESC_GO;
+#endif
+}
+
+/**
+ * Widest row, in bytes (width * channels), that the stream's line buffers
+ * hold, as built into the bitstream. 0 if the CSR block is not mapped.
+ */
+uint32_t dma_max_row_bytes() {
+    return kernel_csr == NULL ? 0 : kernel_csr[KERNEL_CSR_LINE_MAX];
+}
+
+/* Rows wider than the line buffers would wrap around them */
+static int dma_row_fits(uint32_t rowBytes) {
+    const uint32_t limit = dma_max_row_bytes();
+    if (rowBytes <= limit)
+        return 1;
+    fprintf(stderr, "Error: rows of %u bytes exceed the %u-byte DMA line buffers\n", rowBytes, limit);
+    return 0;
+}
+
+/**
+ * Filter one frame entirely by DMA: the read dispatcher streams the source
+ * rows (one descriptor per row when they are padded, i.e. a gather list)
+ * into Sobel_Stream, and the write dispatcher stores the results so the
+ * edge map starts DMA_OUTPUT_GUARD bytes into dst. The core flushes the
+ * last row itself after endofpacket, so frames need two rows and two
+ * pixels per row; rows may be at most dma_max_row_bytes() long. The CPU
+ * only posts descriptors and then sleeps on the frame-done interrupt.
+ * Returns 0 on success, -1 on failure or timeout.
+ */
+int dma_sobel_frame(const DmaBuffer *src, int srcStride, DmaBuffer *dst,
+                    int width, int height, int channels, int timeout_ms) {
+    const uint32_t rowBytes = (uint32_t)width * channels;
+    const uint32_t total = rowBytes * height;
+    const uint32_t guard = DMA_OUTPUT_GUARD(rowBytes, channels);
+
+    if (kernel_csr == NULL || channels < 1 || channels > 4 || width < 2 || height < 2 ||
+        (size_t)srcStride * height > src->size || (size_t)total + guard > dst->size) {
+        fprintf(stderr, "Error: DMA frame does not fit the configured buffers\n");
+        return -1;
+    }
+    if (!dma_row_fits(rowBytes))
+        return -1;
+
+    volatile uint32_t *rd_csr  = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_RD_CSR_BASE);
+    volatile uint32_t *rd_desc = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_RD_DESCRIPTOR_SLAVE_BASE);
+    volatile uint32_t *wr_csr  = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_WR_CSR_BASE);
+    volatile uint32_t *wr_desc = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_WR_DESCRIPTOR_SLAVE_BASE);
+
+    // Stream geometry; every byte is one sample, so a frame is height*channels rows
+    ctrl_shadow = (ctrl_shadow & ~(7u << KERNEL_CTRL_CHANNELS_SHIFT)) |
+                  ((uint32_t)channels << KERNEL_CTRL_CHANNELS_SHIFT);
+    kernel_csr[KERNEL_CSR_CTRL] = ctrl_shadow;
+    if (fpga_begin_frame(width, height * channels) != 0)
+        return -1;
+
+    // The sink first, so the core never backs up
+    post_descriptor(wr_csr, wr_desc, 0, dst->phys, total + guard, 0);
+
+    if ((uint32_t)srcStride == rowBytes) {
+        post_descriptor(rd_csr, rd_desc, src->phys, 0, total, MSGDMA_DESC_GEN_SOP | MSGDMA_DESC_GEN_EOP);
+    } else {
+        // Padded BMP rows: gather the payload of each row
+        for (int row = 0; row < height; row++) {
+            uint32_t control = (row == 0 ? MSGDMA_DESC_GEN_SOP : 0) |
+                               (row == height - 1 ? MSGDMA_DESC_GEN_EOP : 0);
+            post_descriptor(rd_csr, rd_desc, src->phys + (uint32_t)row * srcStride, 0, rowBytes, control);
+        }
+    }
+
+    if (fpga_wait_frame(timeout_ms) != 0)
+        return -1;
+    while (wr_csr[MSGDMA_CSR_STATUS] & MSGDMA_STATUS_BUSY)
+        sched_yield();
+    return 0;
+}
+
+/**
+ * Filter `frames` frames of one geometry in a single DMA run. The frames
+ * lie back to back and unpadded in src. Each one is posted as its own
+ * packet, and its startofpacket resets the window in-band, so the core
+ * needs no CSR access, flush or interrupt between frames. The results
+ * are written as one continuous stream. Frame f's edge map starts
+ * f * DMA_OUTPUT_FRAME(rowBytes, height, channels) + DMA_OUTPUT_GUARD
+ * bytes into dst.
+ * Returns 0 on success, -1 on failure or timeout.
+ */
+int dma_sobel_batch(const DmaBuffer *src, DmaBuffer *dst, int frames,
+                    int width, int height, int channels, int timeout_ms) {
+    const uint32_t rowBytes = (uint32_t)width * channels;
+    const uint32_t total = rowBytes * height;
+    const size_t outputBytes = (size_t)frames * DMA_OUTPUT_FRAME(rowBytes, height, channels);
+
+    if (kernel_csr == NULL || frames < 1 || channels < 1 || channels > 4 || width < 2 || height < 2 ||
+        (size_t)total * frames > src->size || outputBytes > dst->size || outputBytes > UINT32_MAX) {
+        fprintf(stderr, "Error: DMA batch does not fit the configured buffers\n");
+        return -1;
+    }
+    if (!dma_row_fits(rowBytes))
+        return -1;
+
+    volatile uint32_t *rd_csr  = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_RD_CSR_BASE);
+    volatile uint32_t *rd_desc = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_RD_DESCRIPTOR_SLAVE_BASE);
+    volatile uint32_t *wr_csr  = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_WR_CSR_BASE);
+    volatile uint32_t *wr_desc = (uint32_t *)((uintptr_t)lw_bridge_base + MSGDMA_WR_DESCRIPTOR_SLAVE_BASE);
+
+    // Frame done is raised once the rows of every frame have come out
+    ctrl_shadow = (ctrl_shadow & ~(7u << KERNEL_CTRL_CHANNELS_SHIFT)) |
+                  ((uint32_t)channels << KERNEL_CTRL_CHANNELS_SHIFT);
+    kernel_csr[KERNEL_CSR_CTRL] = ctrl_shadow;
+    if (fpga_begin_frame(width, (uint32_t)height * channels * frames) != 0)
+        return -1;
+
+    // One write descriptor takes the whole batch, guards included
+    post_descriptor(wr_csr, wr_desc, 0, dst->phys, (uint32_t)outputBytes, 0);
+    for (int f = 0; f < frames; f++)
+        post_descriptor(rd_csr, rd_desc, src->phys + (uint32_t)f * total, 0, total,
+                        MSGDMA_DESC_GEN_SOP | MSGDMA_DESC_GEN_EOP);
+
+    if (fpga_wait_frame(timeout_ms) != 0)
+        return -1;
+    while (wr_csr[MSGDMA_CSR_STATUS] & MSGDMA_STATUS_BUSY)
+        sched_yield();
+    return 0;
+}
+
 /**
  * Cleanup function to unmap memory and close the file descriptor.
  */
 void cleanup_fpga() {
     if (lw_bridge_base != NULL) {
+#ifdef SOBEL_DMA_MODEL
+        dma_model_unmap_bridge(lw_bridge_base);
+#else
         munmap(lw_bridge_base, LW_BRIDGE_SPAN);
+#endif
         lw_bridge_base = NULL;
+        pixel_in_pio = NULL;
+        pixel_out_pio = NULL;
+        kernel_csr = NULL;
+        core_bank = NULL;
     }
     if (fd != -1) {
         close(fd);
         fd = -1;
     }
+    if (uio_fd != -1) {
+        close(uio_fd);
+        uio_fd = -1;
+    }
+    ctrl_shadow = 0;
 }
@@ -0,0 +1,316 @@
+#include "EdgeVision.h"
+
+#ifdef SOBEL_DMA_MODEL
+
+/***********************
+ **
+ ** Off-board model of the DMA streaming path
+ **
+ ** Built with -DSOBEL_DMA_MODEL (make model). The bridge is plain memory,
+ ** DMA buffers get fake physical addresses, and each posted descriptor is
+ ** run immediately through a C copy of Sobel_Stream, Sobel_Denoise,
+ ** Sobel_Window and Sobel_Core, so the driver, the output alignment, the
+ ** border modes and the denoise filters can be checked on any Linux host.
+ **
+ **********************/
+
+#define MODEL_MAX_BUFFERS  8
+#define MODEL_PHYS_BASE    0x20000000u
+#define MODEL_PHYS_STRIDE  0x04000000u
+#define MODEL_MAX_LINE     8192
+
+static unsigned char *bridge = NULL;
+static DmaBuffer *buffers[MODEL_MAX_BUFFERS];
+
+// Pending write descriptor
+static uint32_t write_addr, write_length, write_count;
+
+// Line buffers and window of one stage: the gradient, or the Sobel_Denoise pre-filter
+typedef struct {
+    uint8_t line_prev1[MODEL_MAX_LINE], line_prev2[MODEL_MAX_LINE];
+    uint32_t rows_seen;         // rows of the packet started before the current one, up to 2
+    uint8_t history[8][3];      // Sobel_Window: [column][top, middle, bottom], [0] = most recent
+    uint8_t history_border[8];
+    uint32_t position;
+} ModelStage;
+
+static ModelStage gradient_stage, denoise_stage;
+static uint32_t denoise_lead;   // beats since startofpacket, saturating past the latency
+
+static volatile uint32_t *csr() {
+    return (volatile uint32_t *)(bridge + KERNEL_CSR_BASE);
+}
+
+void *dma_model_map_bridge() {
+    bridge = calloc(1, LW_BRIDGE_SPAN);
+    if (bridge == NULL)
+        return NULL;
+
+    // Sobel_CSR reset values: Sobel coefficients, inverted gradient, idle
+    volatile uint32_t *regs = csr();
+    regs[KERNEL_CSR_KX0 + 0] = 0xFF0001;
+    regs[KERNEL_CSR_KX0 + 1] = 0xFE0002;
+    regs[KERNEL_CSR_KX0 + 2] = 0xFF0001;
+    regs[KERNEL_CSR_KY0 + 0] = 0x010201;
+    regs[KERNEL_CSR_KY0 + 1] = 0x000000;
+    regs[KERNEL_CSR_KY0 + 2] = 0xFFFEFF;
+    regs[KERNEL_CSR_ID] = 0x534F4231;
+    regs[KERNEL_CSR_STATUS] = STATUS_IDLE;
+    regs[KERNEL_CSR_LINE_MAX] = MODEL_MAX_LINE;
+    return bridge;
+}
+
+void dma_model_unmap_bridge(void *base) {
+    free(base);
+    bridge = NULL;
+}
+
+int dma_model_alloc(DmaBuffer *buffer, size_t size) {
+    for (int i = 0; i < MODEL_MAX_BUFFERS; i++) {
+        if (buffers[i] != NULL)
+            continue;
+        buffer->virt = calloc(1, size);
+        if (buffer->virt == NULL)
+            return -1;
+        buffer->phys = MODEL_PHYS_BASE + i * MODEL_PHYS_STRIDE;
+        buffer->size = size;
+        buffers[i] = buffer;
+        return 0;
+    }
+    return -1;
+}
+
+void dma_model_free(DmaBuffer *buffer) {
+    for (int i = 0; i < MODEL_MAX_BUFFERS; i++) {
+        if (buffers[i] == buffer)
+            buffers[i] = NULL;
+    }
+    free(buffer->virt);
+}
+
+/* Translate a bus address to host memory, or NULL if it is not in a buffer */
+static unsigned char *phys_to_virt(uint32_t phys, uint32_t length) {
+    for (int i = 0; i < MODEL_MAX_BUFFERS; i++) {
+        DmaBuffer *b = buffers[i];
+        if (b != NULL && phys >= b->phys && phys - b->phys + (size_t)length <= b->size)
+            return b->virt + (phys - b->phys);
+    }
+    return NULL;
+}
+
+static int8_t coefficient(uint32_t word, int column) {
+    return (int8_t)(word >> (8 * column));
+}
+
+/* Sobel_Core: one output pixel from a row-major window */
+static uint8_t model_core(const uint8_t window[9]) {
+    volatile uint32_t *regs = csr();
+    int sumX = 0, sumY = 0;
+
+    for (int k = 0; k < 9; k++) {
+        sumX += window[k] * coefficient(regs[KERNEL_CSR_KX0 + k / 3], k % 3);
+        sumY += window[k] * coefficient(regs[KERNEL_CSR_KY0 + k / 3], k % 3);
+    }
+
+    const uint32_t shift = regs[KERNEL_CSR_SHIFT];
+    const int shiftedX = sumX >> (shift & 0xF);
+    const int shiftedY = sumY >> ((shift >> 8) & 0xF);
+    const int absX = abs(shiftedX), absY = abs(shiftedY);
+    const uint32_t mode = regs[KERNEL_CSR_CTRL] & 3;
+    int magnitude;
+
+    switch (mode) {
+        case KERNEL_MODE_GRADIENT_INV:
+        case KERNEL_MODE_GRADIENT: magnitude = absX + absY; break;
+        case KERNEL_MODE_SINGLE_ABS: magnitude = absX; break;
+        default: magnitude = shiftedX < 0 ? 0 : shiftedX; break;
+    }
+
+    const uint8_t result = magnitude > 255 ? 255 : (uint8_t)magnitude;
+    return mode == KERNEL_MODE_GRADIENT_INV ? 255 - result : result;
+}
+
+/* The sample taken for one outside the image, next to `edge` and mirroring `mirror` */
+static uint8_t outside_sample(uint32_t border, uint8_t edge, uint8_t mirror, uint8_t raw) {
+    switch (border & 3) {
+        case BORDER_REPLICATE: return edge;
+        case BORDER_REFLECT101: return mirror;
+        case BORDER_CONSTANT: return (uint8_t)(border >> 8);
+        default: return raw;
+    }
+}
+
+/* Sobel_Window: shift in one column; `window` gets the one centred one pixel behind
+   it, and the result says if that pixel is blanked by BORDER_SKIP */
+static int model_window(ModelStage *stage, const uint8_t column[3], int border_row, uint32_t column_pos,
+                        uint32_t channels, uint32_t rowBytes, uint32_t border, uint8_t window[9]) {
+    const int atRowEnd = column_pos < channels;
+    const int atRowStart = !atRowEnd && column_pos < 2 * channels;
+    const uint8_t *left = stage->history[2 * channels - 1];
+    const uint8_t *centre = stage->history[channels - 1];
+
+    for (int row = 0; row < 3; row++) {
+        window[row * 3 + 0] = atRowStart ? outside_sample(border, centre[row], column[row], left[row]) : left[row];
+        window[row * 3 + 1] = centre[row];
+        window[row * 3 + 2] = atRowEnd ? outside_sample(border, centre[row], left[row], column[row]) : column[row];
+    }
+    const int blank = (border & 3) == BORDER_SKIP &&
+                      (atRowEnd || atRowStart || stage->history_border[channels - 1]);
+
+    memmove(stage->history[1], stage->history[0], sizeof(stage->history) - sizeof(stage->history[0]));
+    memmove(stage->history_border + 1, stage->history_border, sizeof(stage->history_border) - 1);
+    memcpy(stage->history[0], column, sizeof(stage->history[0]));
+    stage->history_border[0] = (uint8_t)border_row;
+    stage->position = (column_pos + 1 == rowBytes) ? 0 : column_pos + 1;
+    return blank;
+}
+
+/* Line buffers of a stage: take one byte, return the window centred one row and one pixel behind it */
+static int model_stage(ModelStage *stage, uint8_t data, int first, int pastFrame, uint32_t channels,
+                       uint32_t rowBytes, uint32_t border, uint8_t window[9]) {
+    const uint32_t column = first ? 0 : stage->position;
+    const uint32_t rowNow = first ? 0 : stage->rows_seen;
+
+    // Rows outside the image are resolved as the column is built
+    const int topOutside = !pastFrame && rowNow == 1;
+    const int bottomOutside = pastFrame;
+    const uint8_t topRaw = stage->line_prev2[column], middle = stage->line_prev1[column];
+    const uint8_t newest[3] = {
+        topOutside ? outside_sample(border, middle, data, topRaw) : topRaw,
+        middle,
+        bottomOutside ? outside_sample(border, middle, topRaw, data) : data,
+    };
+    const int blank = model_window(stage, newest, topOutside || bottomOutside, column, channels, rowBytes,
+                                   border, window);
+
+    stage->line_prev2[column] = stage->line_prev1[column];
+    stage->line_prev1[column] = data;
+    if (column + 1 == rowBytes)
+        stage->rows_seen = rowNow < 2 ? rowNow + 1 : 2;
+    else
+        stage->rows_seen = rowNow;
+    return blank;
+}
+
+#define MODEL_SORT2(a, b) { if (p[a] > p[b]) { const uint8_t t = p[a]; p[a] = p[b]; p[b] = t; } }
+
+/* Sobel_Denoise filters: rounded 1-2-1 Gaussian, or the median network */
+static uint8_t model_denoise(uint32_t filter, const uint8_t window[9]) {
+    uint8_t p[9];
+    memcpy(p, window, sizeof(p));
+    if (filter != DENOISE_MEDIAN)
+        return (uint8_t)((p[0] + 2 * p[1] + p[2] + 2 * p[3] + 4 * p[4] + 2 * p[5] + p[6] + 2 * p[7] + p[8] + 8) >> 4);
+
+    MODEL_SORT2(1, 2); MODEL_SORT2(4, 5); MODEL_SORT2(7, 8);
+    MODEL_SORT2(0, 1); MODEL_SORT2(3, 4); MODEL_SORT2(6, 7);
+    MODEL_SORT2(1, 2); MODEL_SORT2(4, 5); MODEL_SORT2(7, 8);
+    MODEL_SORT2(0, 3); MODEL_SORT2(5, 8); MODEL_SORT2(4, 7);
+    MODEL_SORT2(3, 6); MODEL_SORT2(1, 4); MODEL_SORT2(2, 5);
+    MODEL_SORT2(4, 7); MODEL_SORT2(4, 2); MODEL_SORT2(6, 4);
+    MODEL_SORT2(4, 2);
+    return p[4];
+}
+
+/* Sobel_Stream: accept one byte (or run one flush beat); returns 1 and sets
+   `out` if the gradient stage emits a byte for it. `pastFrame` is set for
+   the flush beats of the gradient stage itself. */
+static int model_stream(uint8_t data, int startofpacket, int flushing, int pastFrame, uint8_t *out) {
+    volatile uint32_t *regs = csr();
+    uint32_t channels = (regs[KERNEL_CSR_CTRL] >> KERNEL_CTRL_CHANNELS_SHIFT) & 7;
+    if (channels == 0)
+        channels = 1;
+    const uint32_t rowBytes = regs[KERNEL_CSR_ROW_LEN] * channels;
+    const uint32_t border = regs[KERNEL_CSR_BORDER];
+    const uint32_t denoise = (regs[KERNEL_CSR_CTRL] >> KERNEL_CTRL_DENOISE_SHIFT) & 3;
+    uint8_t window[9];
+    if (flushing)
+        data = 0;
+
+    // Sobel_Denoise sees SKIP as REPLICATE, and its first row and pixel of output is not valid
+    if (denoise == DENOISE_GAUSSIAN || denoise == DENOISE_MEDIAN) {
+        const uint32_t latency = DMA_OUTPUT_GUARD(rowBytes, channels);
+        const uint32_t lead = startofpacket ? 0 : denoise_lead;
+        const uint32_t edge = (border & 3) == BORDER_SKIP ? (border & ~3u) | BORDER_REPLICATE : border;
+        model_stage(&denoise_stage, data, startofpacket, flushing, channels, rowBytes, edge, window);
+        denoise_lead = lead > latency ? lead : lead + 1;
+        if (lead < latency)
+            return 0;
+        data = model_denoise(denoise, window);
+        startofpacket = lead == latency;
+    }
+    else
+        pastFrame = flushing;
+
+    const int blank = model_stage(&gradient_stage, data, startofpacket, pastFrame, channels, rowBytes, border, window);
+    *out = blank ? 0 : model_core(window);
+    return 1;
+}
+
+void dma_model_post(volatile uint32_t *descriptor_slave, uint32_t read_addr, uint32_t write_addr_in,
+                    uint32_t length, uint32_t control) {
+    volatile uint32_t *regs = csr();
+
+    if ((unsigned char *)descriptor_slave == bridge + MSGDMA_WR_DESCRIPTOR_SLAVE_BASE) {
+        write_addr = write_addr_in;
+        write_length = length;
+        write_count = 0;
+        return;
+    }
+
+    // A read descriptor streams through the core into the pending write
+    const unsigned char *src = phys_to_virt(read_addr, length);
+    unsigned char *dst = phys_to_virt(write_addr, write_length);
+    if (src == NULL || dst == NULL) {
+        fprintf(stderr, "DMA model: descriptor outside the allocated buffers\n");
+        return;
+    }
+
+    if (regs[KERNEL_CSR_CLEAR] & 1) {
+        regs[KERNEL_CSR_CYCLES] = 0;
+        regs[KERNEL_CSR_PIX_IN] = 0;
+        regs[KERNEL_CSR_PIX_OUT] = 0;
+        regs[KERNEL_CSR_STALLS] = 0;
+        regs[KERNEL_CSR_STATUS] = STATUS_IDLE;
+        regs[KERNEL_CSR_CLEAR] = 0;
+    }
+
+    uint32_t emitted = 0;
+    uint8_t out;
+    for (uint32_t i = 0; i < length; i++) {
+        if (!model_stream(src[i], i == 0 && (control & MSGDMA_DESC_GEN_SOP), 0, 0, &out))
+            continue;
+        emitted++;
+        if (write_count < write_length)
+            dst[write_count++] = out;
+    }
+
+    // After endofpacket the stream completes the last row on its own, once per stage
+    uint32_t beats = length;
+    if (control & MSGDMA_DESC_GEN_EOP) {
+        uint32_t channels = (regs[KERNEL_CSR_CTRL] >> KERNEL_CTRL_CHANNELS_SHIFT) & 7;
+        if (channels == 0)
+            channels = 1;
+        const uint32_t denoise = (regs[KERNEL_CSR_CTRL] >> KERNEL_CTRL_DENOISE_SHIFT) & 3;
+        const uint32_t guard = DMA_OUTPUT_GUARD(regs[KERNEL_CSR_ROW_LEN] * channels, channels);
+        const uint32_t flush = denoise == DENOISE_GAUSSIAN || denoise == DENOISE_MEDIAN ? 2 * guard : guard;
+        for (uint32_t i = 0; i < flush; i++) {
+            if (!model_stream(0, 0, 1, flush - i <= guard, &out))
+                continue;
+            emitted++;
+            if (write_count < write_length)
+                dst[write_count++] = out;
+        }
+        beats += flush;
+    }
+
+    // One byte per clock in, plus the one-cycle core latency; the counters see the gradient stage
+    regs[KERNEL_CSR_CYCLES] += beats + 1;
+    regs[KERNEL_CSR_PIX_IN] += emitted;
+    regs[KERNEL_CSR_PIX_OUT] += emitted;
+
+    const uint32_t expected = regs[KERNEL_CSR_ROW_LEN] * regs[KERNEL_CSR_ROWS];
+    if (expected != 0 && regs[KERNEL_CSR_PIX_OUT] >= expected)
+        regs[KERNEL_CSR_STATUS] |= STATUS_FRAME_DONE;
+}
+
+#endif /* SOBEL_DMA_MODEL */
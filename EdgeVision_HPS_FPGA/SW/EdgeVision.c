@@ -12,12 +12,24 @@ unsigned char biColourPalette[1024];
  **
  **********************/
 unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader)
+{
+    return LoadBitmapFileInto(filename, bitmapInfoHeader, bitmapFileHeader, NULL, 0);
+}
+
+/***********************
+ **
+ ** Load BMP file into a caller-provided buffer (e.g. DMA memory), or into
+ ** a new allocation when buffer is NULL
+ **
+ **********************/
+unsigned char *LoadBitmapFileInto(char *filename, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader,
+                                  unsigned char *buffer, size_t capacity)
 {
 
    /* Variables declaration */
     FILE *filePtr;               // out file pointer
     unsigned char *bitmapImage;  // store image data
-    size_t bytesRead;
+    BmpReader reader;
     
     //open filename in read binary mode
     filePtr = fopen(filename,"rb");
@@ -25,7 +37,11 @@ unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader
         return NULL;
    
     //read the bitmap file header
-    bytesRead = fread(bitmapFileHeader, sizeof(BITMAPFILEHEADER),1,filePtr);
+    if (fread(bitmapFileHeader, sizeof(BITMAPFILEHEADER),1,filePtr) != 1)
+    {
+        fclose(filePtr);
+        return NULL;
+    }
     
     printf("%c bitmap identifies\n",bitmapFileHeader->bfType);
     printf("%d bitmap identifies the size of image\n",bitmapFileHeader->bfSize);
@@ -38,10 +54,11 @@ unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader
     }
 
     //read the bitmap info header
-    bytesRead = fread(bitmapInfoHeader, sizeof(BITMAPINFOHEADER),1,filePtr);
-
-    //read colour palette
-    bytesRead = fread(&biColourPalette,1,bitmapInfoHeader->biClrUsed*4,filePtr);
+    if (fread(bitmapInfoHeader, sizeof(BITMAPINFOHEADER),1,filePtr) != 1)
+    {
+        fclose(filePtr);
+        return NULL;
+    }
 
     printf("\nIMAGE DETAILS:\n");
     printf("--------------");
@@ -56,108 +73,149 @@ unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader
     printf("\nThe Bit Offset : %d",bitmapFileHeader->bfOffBits);
     printf("\nBytes per pixel : %d ",bitmapInfoHeader->biBitCount/8);
 
-    //move file point to the begging of bitmap data
-    fseek(filePtr, bitmapFileHeader->bfOffBits, SEEK_SET);
+    //read masks and colour palette; the header now describes the decoded image
+    if (BmpReaderOpen(&reader, filePtr, bitmapFileHeader, bitmapInfoHeader) != 0)
+    {
+        fclose(filePtr);
+        return NULL;
+    }
 
-      //allocate enough memory for the bitmap image data
-    bitmapImage = (unsigned char*)malloc(bitmapInfoHeader->biSizeImage);
+    if (buffer != NULL)
+    {
+        // Pixels land directly in the caller's buffer, no staging copy
+        if (bitmapInfoHeader->biSizeImage > capacity)
+        {
+            printf("\nImage does not fit in the %u byte buffer\n", (unsigned)capacity);
+            BmpReaderClose(&reader);
+            fclose(filePtr);
+            return NULL;
+        }
+        bitmapImage = buffer;
+    }
+    else
+    {
+        //allocate enough memory for the bitmap image data
+        bitmapImage = (unsigned char*)malloc(bitmapInfoHeader->biSizeImage);
+    }
 
       //verify memory allocation
     if (!bitmapImage)
     {
-        free(bitmapImage);
+        BmpReaderClose(&reader);
         fclose(filePtr);
         return NULL;
     }
 
-    //read in the bitmap image data
-    bytesRead = fread(bitmapImage,1, bitmapInfoHeader->biSizeImage,filePtr);
-    printf("\nLOG: bytesRead :  %d\n", (int)bytesRead);
-
-    //make sure bitmap image data was read
-    if (bitmapImage == NULL)
-	{
-        printf("Data could not be read");
-        fclose(filePtr);
-        return NULL;
-	}
+    //decode rows straight into place: padding stripped, top-down flipped
+    const int stride = reader.width * reader.outBytesPerPixel;
+    for (int row = 0; row < reader.height; row++)
+    {
+        int y = BmpNextRow(&reader);
+        if (BmpReadRow(&reader, bitmapImage + (size_t)y * stride) < 0)
+        {
+            printf("Data could not be read");
+            if (bitmapImage != buffer)
+                free(bitmapImage);
+            BmpReaderClose(&reader);
+            fclose(filePtr);
+            return NULL;
+        }
+    }
+    printf("\nLOG: decoded %d rows\n", reader.height);
 
+    BmpReaderClose(&reader);
     fclose(filePtr);
     return bitmapImage;
 }
 
 void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER *bitmapInfoHeader, BITMAPFILEHEADER *bitmapFileHeader) 
 {
-    FILE *filePtr;
-    int bytesperline = 0;
-    int k,l;
+    if (!filename || !bitmapData || !bitmapInfoHeader || !bitmapFileHeader) {
+        return;
+    }
 
-    k=sizeof(BITMAPFILEHEADER);
-    l=sizeof(BITMAPINFOHEADER);
+    FILE *filePtr;
 
     if(-1 == createDirectory("output")) return;
 
-
-    bytesperline = bitmapInfoHeader->biWidth * (bitmapInfoHeader->biBitCount/8);
-    if( bytesperline & 0x0003)
-    { 
-        bytesperline |= 0x0003;
-        ++bytesperline;
+    // Calculate the correct bytes per line including padding
+    int bytesperline = bitmapInfoHeader->biWidth * (bitmapInfoHeader->biBitCount/8);
+    if (bytesperline % 4 != 0) {
+        bytesperline = (bytesperline + 3) & ~3;  // Round up to nearest multiple of 4
     }
 
-    int byteperpixel = 0;
-    byteperpixel = bitmapInfoHeader->biBitCount/8;
+    // Calculate correct file size
+    int headerSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+    int paletteSize = bitmapInfoHeader->biClrUsed * 4;
+    int imageSize = bytesperline * bitmapInfoHeader->biHeight;
 
-    unsigned char *tk;
-    tk = (unsigned char *)calloc(1,bytesperline);
+    // Update header information
+    bitmapFileHeader->bfType = 0x4D42;  // 'BM'
+    bitmapFileHeader->bfSize = headerSize + paletteSize + imageSize;
+    bitmapFileHeader->bfReserved = 0;
+    bitmapFileHeader->bfReserved2 = 0;
+    bitmapFileHeader->bfOffBits = headerSize + paletteSize;
 
-    bitmapFileHeader->bfSize= bitmapInfoHeader->biSize + (long)bytesperline* bitmapInfoHeader->biHeight;
-    bitmapFileHeader->bfOffBits = k+l+ 4* bitmapInfoHeader->biClrUsed;
-    bitmapFileHeader->bfSize = k+l+bitmapInfoHeader->biSizeImage;
+    // Update info header
+    bitmapInfoHeader->biSizeImage = imageSize;
 
-
-    // Open the BMP file for writing
+    // Open the file
     filePtr = fopen(filename, "wb");
     if (!filePtr) {
         perror("Error opening output BMP file");
         return;
     }
 
+    // Write headers
+    fwrite(bitmapFileHeader, sizeof(BITMAPFILEHEADER), 1, filePtr);
+    fwrite(bitmapInfoHeader, sizeof(BITMAPINFOHEADER), 1, filePtr);
 
-    fwrite(bitmapFileHeader, 1, sizeof(BITMAPFILEHEADER), filePtr);
-    fwrite(bitmapInfoHeader, 1,sizeof(BITMAPINFOHEADER), filePtr);
-    fwrite(biColourPalette,bitmapInfoHeader->biClrUsed*4,1,filePtr);
+    // Write color palette if present
+    if (bitmapInfoHeader->biClrUsed > 0) {
+        fwrite(biColourPalette, 4, bitmapInfoHeader->biClrUsed, filePtr);
+    }
 
+    // Print debug information
     printf("\nOUTPUT IMAGE DETAILS:\n");
-    printf("---------------------");
-    printf("\nSize of info header : %d",bitmapInfoHeader->biSize);
-    printf("\nHorizontal width : %x",bitmapInfoHeader->biWidth);
-    printf("\nVertical height : %x",bitmapInfoHeader->biHeight);
-    printf("\nNum of planes : %d",bitmapInfoHeader->biPlanes);
-    printf("\nBits per pixel : %d",bitmapInfoHeader->biBitCount);
-    printf("\nCompression specs : %d",bitmapInfoHeader->biCompression);
-    printf("\nSize of the image : %d",bitmapInfoHeader->biSizeImage);
-    printf("\nThe num of colours used : %x\n",bitmapInfoHeader->biClrUsed);
-    printf("\n%s\n", "----------------------------------------------------------------");
+    printf("---------------------\n");
+    printf("Size of info header: %d\n", bitmapInfoHeader->biSize);
+    printf("Horizontal width: %d\n", bitmapInfoHeader->biWidth);
+    printf("Vertical height: %d\n", bitmapInfoHeader->biHeight);
+    printf("Bits per pixel: %d\n", bitmapInfoHeader->biBitCount);
+    printf("Image size: %d\n", bitmapInfoHeader->biSizeImage);
+    printf("Colors used: %d\n", bitmapInfoHeader->biClrUsed);
+    printf("----------------------------------------------------------------\n");
+
+    // Allocate buffer for a single line including padding
+    unsigned char *lineBuffer = (unsigned char *)calloc(bytesperline, 1);
+    if (!lineBuffer) {
+        fclose(filePtr);
+        return;
+    }
 
-    int i, n = 0,j,x;
-    for(x=0; x<  byteperpixel ; x++)
-    {
-        for(i=0; i<= (bitmapInfoHeader->biHeight-1); i++)
-        { 
-            for(j=0;j<=bytesperline-1;j++)
-            {
-                tk[j] = bitmapData[n++];
+    // Write image data line by line
+    int bytesPerPixel = bitmapInfoHeader->biBitCount / 8;
+    int width = bitmapInfoHeader->biWidth;
+    int height = bitmapInfoHeader->biHeight;
+    
+    for (int y = 0; y < height; y++) {
+        // Copy pixel data to line buffer
+        for (int x = 0; x < width; x++) {
+            for (int b = 0; b < bytesPerPixel; b++) {
+                int srcIndex = (y * width * bytesPerPixel) + (x * bytesPerPixel) + b;
+                int destIndex = (x * bytesPerPixel) + b;
+                lineBuffer[destIndex] = bitmapData[srcIndex];
             }
-            // Write pixel data
-            fwrite(tk, 1,bytesperline , filePtr);
         }
+        // Write the line including padding
+        fwrite(lineBuffer, 1, bytesperline, filePtr);
     }
 
+    // Clean up
+    free(lineBuffer);
     fclose(filePtr);
 }
 
-
 int createDirectory(const char *path) {
     struct stat st = {0};
 
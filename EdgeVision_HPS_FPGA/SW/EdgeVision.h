@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/stat.h>
@@ -12,47 +13,19 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <poll.h>
+#include <sched.h>
 #include <time.h>
 #include "hps_0.h"  // Include the hps_0.h header
+// Altera hardware library; only the board build (SOBEL_HWLIB) needs it
+#ifdef SOBEL_HWLIB
 #include "hwlib.h"
 #include "socal/socal.h"
 #include "socal/hps.h"
 #include "socal/alt_gpio.h"
+#endif
 
-unsigned char biColourPalette[1024];
-
-typedef int LONG;
-typedef unsigned short WORD;
-typedef unsigned int DWORD;
-typedef char BYTE;
-
-#pragma pack(push,1)
-typedef struct {
-  WORD  bfType;                       // The type of the image
- 
-  DWORD bfSize;                       //size of the file
-  WORD  bfReserved;                 // reserved type
-  WORD  bfReserved2;               
-  DWORD bfOffBits;                   //offset bytes from the file header to the image data
-} BITMAPFILEHEADER, *PBITMAPFILEHEADER;
-#pragma pack(pop)
-
-#pragma pack(push,1)
-typedef struct tagBITMAPINFOHEADER {
-  DWORD biSize;                   //the size of the header
-  LONG  biWidth;                 //the width in pixels
-  LONG  biHeight;                //the height in pixels
-  WORD  biPlanes;                //the no. of planes in the bitmap
-  WORD  biBitCount;              //bits per pixel
-  DWORD biCompression;           //compression specifications
-  DWORD biSizeImage;            //size of the bitmap data
-  LONG  biXPelsPerMeter;        //horizontal res(pixels per meter)
-  LONG  biYPelsPerMeter;        //vertical res(pixels per meter) 
-  DWORD biClrUsed;              //colours used in the image
-  DWORD biClrImportant;        //num of important colours used
-} BITMAPINFOHEADER, *PBITMAPINFOHEADER;
-#pragma pack(pop)
-
+#include "../../EdgeVision_HPS/BmpDecode.h"   // shared with the HPS build
 
 #define SIZE_BUFFER 3
 
@@ -62,8 +35,123 @@ typedef struct tagBITMAPINFOHEADER {
 
 #define PIXEL_IN_PIO_BASE 0x50000  // Offset for pixel_in_pio
 #define PIXEL_OUT_PIO_BASE 0x40000 // Offset for pixel_out_pio
+#define KERNEL_CSR_BASE 0x70000    // Offset for the kernel coefficient CSR block
+
+// Kernel CSR register map (word offsets, see Sobel_CSR.v)
+#define KERNEL_CSR_CTRL   0
+#define KERNEL_CSR_SHIFT  1
+#define KERNEL_CSR_KX0    2
+#define KERNEL_CSR_KY0    5
+#define KERNEL_CSR_ID     8
+#define KERNEL_CSR_STATUS    9
+#define KERNEL_CSR_IRQ_EN    10
+#define KERNEL_CSR_ROW_LEN   11
+#define KERNEL_CSR_ROWS      12
+#define KERNEL_CSR_CYCLES    13
+#define KERNEL_CSR_PIX_IN    14
+#define KERNEL_CSR_PIX_OUT   15
+#define KERNEL_CSR_STALLS    16
+#define KERNEL_CSR_CLEAR     17
+#define KERNEL_CSR_BORDER    18          // [1:0] border mode, [15:8] constant value
+#define KERNEL_CSR_LINE_MAX  19          // read-only: widest streamed row in bytes
+
+#define KERNEL_CTRL_STROBED  (1u << 2)   // advance the window only on a pixel strobe
+#define KERNEL_CTRL_CHANNELS_SHIFT 4     // bytes per pixel of the streamed image
+#define KERNEL_CTRL_DENOISE_SHIFT  8     // filter ahead of the streamed gradient
+#define STATUS_IDLE          (1u << 0)
+#define STATUS_ROW_DONE      (1u << 1)
+#define STATUS_FRAME_DONE    (1u << 2)
+
+#define PIXEL_STROBE_BIT     (1u << 24)  // toggled by write_to_fpga() in strobed mode
+#define PIXEL_BORDER_ROW_BIT (1u << 25)  // the column's middle sample is in the first or last row
+#define FPGA_CLOCK_HZ        50000000
+#define FPGA_UIO_DEVICE      "/dev/uio0" // generic-uio node for the Sobel interrupt
+
+// Output modes for KERNEL_CSR_CTRL[1:0]
+#define KERNEL_MODE_GRADIENT_INV  0   // 255 - sat(|X| + |Y|), the default edge map
+#define KERNEL_MODE_GRADIENT      1   // sat(|X| + |Y|)
+#define KERNEL_MODE_SINGLE_ABS    2   // sat(|X|), e.g. Laplacian
+#define KERNEL_MODE_SINGLE        3   // clamp(X, 0, 255), e.g. blur
+
+// Border modes for KERNEL_CSR_BORDER[1:0], the same as the CPU build's --border
+typedef enum {
+    BORDER_SKIP = 0,        // frame pixels are output as 0
+    BORDER_REPLICATE,       // outside samples repeat the edge
+    BORDER_REFLECT101,      // outside samples mirror about the edge (gfedcb|abcdefgh|gfedcba)
+    BORDER_CONSTANT,        // outside samples are a fixed value
+    BORDER_COUNT
+} SobelBorder;
+
+// Denoise filters for KERNEL_CSR_CTRL[9:8] (DMA path), the same as the CPU build's --denoise
+typedef enum {
+    DENOISE_NONE = 0,
+    DENOISE_GAUSSIAN,       // rounded 1-2-1 x 1-2-1 / 16
+    DENOISE_MEDIAN,         // median of the 3x3 neighbourhood
+    DENOISE_COUNT
+} SobelDenoise;
+
+// Parallel lane bank (word offsets, see Sobel_Bank.v)
+#define CORE_BANK_LANE0      0           // one column word per lane
+#define CORE_BANK_RESULT0    8           // lanes 0..3, one byte each
+#define CORE_BANK_CONFIG     10          // [3:0] active lanes, [11:8] lanes built
+#define CORE_BANK_MAX_LANES  8
+
+// Coefficient set loaded into the hardware by set_kernel()
+typedef struct {
+    const char *name;
+    int8_t kx[3][3];
+    int8_t ky[3][3];
+    uint8_t shift_x;
+    uint8_t shift_y;
+    uint8_t mode;
+} FpgaKernel;
+
+// mSGDMA dispatcher registers (word offsets)
+#define MSGDMA_CSR_STATUS       0
+#define MSGDMA_CSR_CONTROL      1
+#define MSGDMA_STATUS_BUSY      (1u << 0)
+#define MSGDMA_STATUS_FULL      (1u << 2)
+#define MSGDMA_CONTROL_RESET    (1u << 1)
+
+#define MSGDMA_DESC_READ_ADDR   0
+#define MSGDMA_DESC_WRITE_ADDR  1
+#define MSGDMA_DESC_LENGTH      2
+#define MSGDMA_DESC_CONTROL     3       // writing this word commits the descriptor
+#define MSGDMA_DESC_GEN_SOP     (1u << 8)
+#define MSGDMA_DESC_GEN_EOP     (1u << 9)
+#define MSGDMA_DESC_END_ON_EOP  (1u << 12)
+#define MSGDMA_DESC_GO          (1u << 31)
+
+// u-dma-buf nodes providing physically contiguous, DMA-able frame buffers
+#define UDMABUF_SRC_DEVICE      "udmabuf0"
+#define UDMABUF_DST_DEVICE      "udmabuf1"
+
+// The stream core writes each result one row and one pixel after its centre,
+// and runs that many flush beats after the frame to emit the last ones
+#define DMA_OUTPUT_GUARD(rowBytes, channels) ((rowBytes) + (channels))
+// Output bytes of one frame, guard included: the stride of frames in a batch
+#define DMA_OUTPUT_FRAME(rowBytes, height, channels) \
+    ((size_t)(rowBytes) * (height) + DMA_OUTPUT_GUARD(rowBytes, channels))
+
+// A physically contiguous buffer shared with the DMA engine
+typedef struct {
+    unsigned char *virt;
+    uint32_t phys;
+    size_t size;
+    int fd;
+} DmaBuffer;
+
+// Hardware performance counters, read over the bridge
+typedef struct {
+    uint32_t cycles;
+    uint32_t pixels_in;
+    uint32_t pixels_out;
+    uint32_t stalls;
+} FpgaCounters;
 
 unsigned char *LoadBitmapFile(char *filename, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader);
+unsigned char *LoadBitmapFileInto(char *filename, BITMAPINFOHEADER *bitmapInfoHeader,BITMAPFILEHEADER *bitmapFileHeader,
+                                  unsigned char *buffer, size_t capacity);
 void SaveBitmapFile(char *filename, unsigned char *bitmapData, BITMAPINFOHEADER *bitmapInfoHeader, BITMAPFILEHEADER *bitmapFileHeader);
 int createDirectory(const char *path);
 void print_image_header(const char* filename);
@@ -74,5 +162,37 @@ int configure_fpga();
 void write_to_fpga(uint32_t data);
 uint8_t read_from_fpga();
 void cleanup_fpga();
+int set_kernel(const FpgaKernel *kernel);
+int parse_border(const char *text, SobelBorder *border, uint8_t *value);
+int set_border(SobelBorder border, uint8_t value);
+int parse_denoise(const char *text, SobelDenoise *denoise);
+int set_denoise(SobelDenoise denoise);
+const FpgaKernel *find_kernel_preset(const char *name);
+int enable_strobed_mode();
+int open_fpga_irq(const char *uio_device);
+int fpga_begin_frame(uint32_t row_length, uint32_t rows);
+int fpga_wait_frame(int timeout_ms);
+int read_fpga_counters(FpgaCounters *counters);
+int fpga_core_count();
+int set_active_lanes(int lanes);
+void write_lane(int lane, uint32_t column);
+void read_lane_results(uint8_t *results, int lanes);
+int dma_alloc(DmaBuffer *buffer, const char *name);
+void dma_free(DmaBuffer *buffer);
+uint32_t dma_max_row_bytes();
+int dma_sobel_frame(const DmaBuffer *src, int srcStride, DmaBuffer *dst,
+                    int width, int height, int channels, int timeout_ms);
+int dma_sobel_batch(const DmaBuffer *src, DmaBuffer *dst, int frames,
+                    int width, int height, int channels, int timeout_ms);
+
+#ifdef SOBEL_DMA_MODEL
+// Off-board software model of the bridge, the mSGDMA engine and Sobel_Stream
+void *dma_model_map_bridge();
+void dma_model_unmap_bridge(void *bridge);
+int dma_model_alloc(DmaBuffer *buffer, size_t size);
+void dma_model_free(DmaBuffer *buffer);
+void dma_model_post(volatile uint32_t *descriptor_slave, uint32_t read_addr, uint32_t write_addr,
+                    uint32_t length, uint32_t control);
+#endif
 
 #endif /* EDGEVISION_H */
\ No newline at end of file
@@ -140,5 +140,70 @@
 #define PIXEL_IN_1_PIO_IRQ_TYPE NONE
 #define PIXEL_IN_1_PIO_RESET_VALUE 0
 
+/*
+ * Macros for device 'kernel_csr', class 'altera_avalon_mm_bridge'
+ * The macros are prefixed with 'KERNEL_CSR_'.
+ * The prefix is the slave descriptor.
+ */
+#define KERNEL_CSR_COMPONENT_TYPE altera_avalon_mm_bridge
+#define KERNEL_CSR_COMPONENT_NAME kernel_csr
+#define KERNEL_CSR_BASE 0x70000
+#define KERNEL_CSR_SPAN 128
+#define KERNEL_CSR_END 0x7007f
+
+/*
+ * Macros for device 'msgdma_rd_csr', class 'altera_msgdma'
+ * The macros are prefixed with 'MSGDMA_RD_CSR_'.
+ * The prefix is the slave descriptor.
+ */
+#define MSGDMA_RD_CSR_COMPONENT_TYPE altera_msgdma
+#define MSGDMA_RD_CSR_COMPONENT_NAME msgdma_rd
+#define MSGDMA_RD_CSR_BASE 0x80000
+#define MSGDMA_RD_CSR_SPAN 32
+#define MSGDMA_RD_CSR_END 0x8001f
+
+/*
+ * Macros for device 'msgdma_rd_descriptor_slave', class 'altera_msgdma'
+ * The macros are prefixed with 'MSGDMA_RD_DESCRIPTOR_SLAVE_'.
+ * The prefix is the slave descriptor.
+ */
+#define MSGDMA_RD_DESCRIPTOR_SLAVE_COMPONENT_TYPE altera_msgdma
+#define MSGDMA_RD_DESCRIPTOR_SLAVE_COMPONENT_NAME msgdma_rd
+#define MSGDMA_RD_DESCRIPTOR_SLAVE_BASE 0x80020
+#define MSGDMA_RD_DESCRIPTOR_SLAVE_SPAN 16
+#define MSGDMA_RD_DESCRIPTOR_SLAVE_END 0x8002f
+
+/*
+ * Macros for device 'msgdma_wr_csr', class 'altera_msgdma'
+ * The macros are prefixed with 'MSGDMA_WR_CSR_'.
+ * The prefix is the slave descriptor.
+ */
+#define MSGDMA_WR_CSR_COMPONENT_TYPE altera_msgdma
+#define MSGDMA_WR_CSR_COMPONENT_NAME msgdma_wr
+#define MSGDMA_WR_CSR_BASE 0x90000
+#define MSGDMA_WR_CSR_SPAN 32
+#define MSGDMA_WR_CSR_END 0x9001f
+
+/*
+ * Macros for device 'msgdma_wr_descriptor_slave', class 'altera_msgdma'
+ * The macros are prefixed with 'MSGDMA_WR_DESCRIPTOR_SLAVE_'.
+ * The prefix is the slave descriptor.
+ */
+#define MSGDMA_WR_DESCRIPTOR_SLAVE_COMPONENT_TYPE altera_msgdma
+#define MSGDMA_WR_DESCRIPTOR_SLAVE_COMPONENT_NAME msgdma_wr
+#define MSGDMA_WR_DESCRIPTOR_SLAVE_BASE 0x90020
+#define MSGDMA_WR_DESCRIPTOR_SLAVE_SPAN 16
+#define MSGDMA_WR_DESCRIPTOR_SLAVE_END 0x9002f
+
+/*
+ * Macros for device 'core_bank', class 'altera_avalon_mm_bridge'
+ * The macros are prefixed with 'CORE_BANK_'.
+ * The prefix is the slave descriptor.
+ */
+#define CORE_BANK_COMPONENT_TYPE altera_avalon_mm_bridge
+#define CORE_BANK_COMPONENT_NAME core_bank
+#define CORE_BANK_BASE 0xa0000
+#define CORE_BANK_SPAN 64
+#define CORE_BANK_END 0xa003f
 
 #endif /* _ALTERA_HPS_0_H_ */
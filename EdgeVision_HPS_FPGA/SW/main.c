@@ -9,18 +9,377 @@ extern unsigned char output_row;
 
 
 
+static void print_usage(const char *prog)
+{
+    print_footer();
+    printf("Error: Program accepts minimum 1 and maximum 3 input files (any number with --batch)\n");
+    printf("Usage: %s -o/-w [--kernel=sobel|scharr|prewitt|laplacian|blur] [--dma] [--batch] [--lanes=N]\n"
+           "       [--border=skip|replicate|reflect101|constant[:V]] [--denoise=gaussian|median]\n"
+           "       input1.bmp [input2.bmp input3.bmp]\n", prog);
+    printf("Example: %s -o/-w image.bmp\n", prog);
+    printf("Example: %s -o/-w image1.bmp image2.bmp image3.bmp\n", prog);
+    print_footer();
+}
+
+/* The sample taken for a row outside the image, next to `edge` and mirroring `mirror` */
+static uint8_t outside_row(SobelBorder border, uint8_t value, uint8_t edge, uint8_t mirror)
+{
+    switch (border)
+    {
+        case BORDER_REPLICATE: return edge;
+        case BORDER_REFLECT101: return mirror;
+        case BORDER_CONSTANT: return value;
+        default: return 0;
+    }
+}
+
+/**
+ * Pack the column of `row` for the PIO and lane paths. `sample` points at
+ * the pixel's byte in row 0 and `cols` is the row stride. Rows outside the
+ * image are resolved here (columns outside it in the window logic), and
+ * the first and last rows are flagged for the skip mode.
+ */
+static uint32_t border_column(const unsigned char *sample, int cols, int row, int height,
+                              SobelBorder border, uint8_t value)
+{
+    uint8_t column[SIZE_BUFFER];
+    const uint8_t middle = sample[row * cols];
+
+    column[0] = (row > 0) ? sample[(row - 1) * cols]
+                          : outside_row(border, value, middle, sample[(row + 1) * cols]);
+    column[1] = middle;
+    column[2] = (row < height - 1) ? sample[(row + 1) * cols]
+                                   : outside_row(border, value, middle, sample[(row - 1) * cols]);
+
+    uint32_t packed = prepareDataforTx(column, SIZE_BUFFER);
+    if (row == 0 || row == height - 1)
+        packed |= PIXEL_BORDER_ROW_BIT;
+    return packed;
+}
+
+// One lane's share of a frame: a band of rows in one colour plane
+typedef struct {
+    int channel;
+    int rowStart, rowEnd;
+} LaneTask;
+
+/**
+ * Filter a frame on the parallel lane bank. Colour planes are spread over
+ * the lanes first and any spare lanes split each plane into horizontal
+ * bands, so all of them advance together on every step. A step returns
+ * each lane's previous pixel, so one last step collects the final ones.
+ */
+static void runCoreBank(const unsigned char *bitmapData, unsigned char *bitmapFinalImage,
+                        int width, int height, int bytesPerPixel, int lanes,
+                        SobelBorder border, uint8_t borderValue)
+{
+    const int cols = width * bytesPerPixel;
+    int bands = lanes / bytesPerPixel;
+    if (bands < 1)
+        bands = 1;
+    if (bands > height)
+        bands = height;
+
+    // Planes times bands tasks, run in groups of `lanes`
+    const int taskCount = bytesPerPixel * bands;
+    LaneTask tasks[taskCount];
+    for (int t = 0; t < taskCount; t++)
+    {
+        int band = t % bands;
+        tasks[t].channel = t / bands;
+        tasks[t].rowStart = (int)((long)height * band / bands);
+        tasks[t].rowEnd = (int)((long)height * (band + 1) / bands);
+    }
+
+    // The bank raises one event per step, so the frame is counted in steps
+    const int bandRows = (height + bands - 1) / bands;
+    const int groups = (taskCount + lanes - 1) / lanes;
+    fpga_begin_frame(width, groups * bandRows);
+
+    uint8_t results[CORE_BANK_MAX_LANES];
+    long previous[CORE_BANK_MAX_LANES];     // output index of each lane's last column, or -1
+    int groupSize = 0;
+
+    for (int l = 0; l < lanes; l++)
+        previous[l] = -1;
+
+    for (int first = 0; first < taskCount; first += lanes)
+    {
+        const LaneTask *group = &tasks[first];
+        groupSize = (taskCount - first < lanes) ? taskCount - first : lanes;
+
+        set_active_lanes(groupSize);
+
+        for (int row = 0; row < bandRows; row++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                // Idle lanes (shorter bands) are fed zeros
+                for (int l = 0; l < groupSize; l++)
+                {
+                    const int i = group[l].rowStart + row;
+                    const int j = x * bytesPerPixel + group[l].channel;
+                    if (i < group[l].rowEnd)
+                        write_lane(l, border_column(bitmapData + j, cols, i, height, border, borderValue));
+                    else
+                        write_lane(l, 0);
+                }
+
+                // Every lane stepped, including those left over from the last group
+                read_lane_results(results, lanes);
+                for (int l = 0; l < lanes; l++)
+                {
+                    const int i = (l < groupSize) ? group[l].rowStart + row : height;
+                    if (previous[l] >= 0)
+                        bitmapFinalImage[previous[l]] = results[l];
+                    previous[l] = (l < groupSize && i < group[l].rowEnd)
+                                  ? (long)i * cols + x * bytesPerPixel + group[l].channel : -1;
+                }
+            }
+        }
+    }
+
+    // Flush: one more step returns the last pixel of every lane
+    write_lane(groupSize - 1, 0);
+    read_lane_results(results, lanes);
+    for (int l = 0; l < lanes; l++)
+    {
+        if (previous[l] >= 0)
+            bitmapFinalImage[previous[l]] = results[l];
+    }
+}
+
+/* Output path for an input file: output/<name>_FPGAoutput.bmp. Returns -1 if it does not fit. */
+static int output_name(const char *input, char *name, size_t size)
+{
+    const char *baseFileName = strrchr(input, '/');
+    baseFileName = (baseFileName != NULL) ? baseFileName + 1 : input;
+    const size_t baseNameLen = strlen(baseFileName);
+    if (baseNameLen < 4)
+        return -1;
+    int length = snprintf(name, size, "output/%.*s_FPGAoutput.bmp", (int)(baseNameLen - 4), baseFileName);
+    return (length < 0 || (size_t)length >= size) ? -1 : 0;
+}
+
+// A frame waiting in the DMA source buffer for its batch to run
+typedef struct {
+    const char *path;
+    BITMAPINFOHEADER info;
+    BITMAPFILEHEADER header;
+    unsigned char palette[sizeof(biColourPalette)];
+} BatchFrame;
+
+/* Run the frames packed in src as one stream, then save each edge map */
+static int flushBatch(const BatchFrame *frames, int count, DmaBuffer *src, DmaBuffer *dst)
+{
+    const int width = frames[0].info.biWidth, height = frames[0].info.biHeight;
+    const int channels = frames[0].info.biBitCount / 8;
+    const size_t rowBytes = (size_t)width * channels;
+    const size_t stride = DMA_OUTPUT_FRAME(rowBytes, height, channels);
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // One byte per clock, plus a second of slack
+    const int timeout_ms = 1000 + (int)(stride * count / (FPGA_CLOCK_HZ / 1000));
+    if (dma_sobel_batch(src, dst, count, width, height, channels, timeout_ms) != 0)
+    {
+        printf("DMA transfer failed\n");
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    FpgaCounters counters;
+    if (read_fpga_counters(&counters) == 0)
+        printf("HW cycles : %u, pixels in : %u, pixels out : %u, stalls : %u\n",
+               counters.cycles, counters.pixels_in, counters.pixels_out, counters.stalls);
+    printf("Batch : %d frame(s) of %dx%d, %f seconds, %.1f frames/s\n", count, width, height, seconds,
+           seconds > 0 ? count / seconds : 0.0);
+
+    for (int f = 0; f < count; f++)
+    {
+        char outputFileName[FILENAME_MAX];
+        if (output_name(frames[f].path, outputFileName, sizeof(outputFileName)) != 0)
+        {
+            printf("Invalid output filename for %s\n", frames[f].path);
+            return -1;
+        }
+        // 8-bit frames are saved with their own palette
+        BITMAPINFOHEADER info = frames[f].info;
+        BITMAPFILEHEADER header = frames[f].header;
+        memcpy(biColourPalette, frames[f].palette, sizeof(biColourPalette));
+        SaveBitmapFile(outputFileName, dst->virt + f * stride + DMA_OUTPUT_GUARD(rowBytes, channels),
+                       &info, &header);
+    }
+    printf("%s\n", "----------------------------------------------------------------");
+    return 0;
+}
+
+/**
+ * --batch: consecutive frames of the same size are packed back to back in
+ * the DMA source buffer and filtered as one stream by dma_sobel_batch(),
+ * so small images share one setup and one interrupt instead of paying for
+ * them each. A batch ends when the size changes or either buffer is full.
+ * Returns 0 on success, 1 on failure.
+ */
+static int runBatch(int argc, char *argv[], DmaBuffer *src, DmaBuffer *dst)
+{
+    BatchFrame *frames = (BatchFrame *)calloc(argc, sizeof(BatchFrame));
+    int count = 0, status = 0;
+    size_t used = 0;
+
+    if (frames == NULL)
+        return 1;
+
+    for (int a = 2; a < argc && status == 0; a++)
+    {
+        if (strncmp(argv[a], "--", 2) == 0)
+            continue;
+
+        print_image_header(argv[a]);
+        BatchFrame next = { .path = argv[a] };
+        unsigned char *data = LoadBitmapFileInto(argv[a], &next.info, &next.header, src->virt + used,
+                                                 src->size - used);
+        memcpy(next.palette, biColourPalette, sizeof(biColourPalette));
+
+        // Same geometry as the pending frames, and room for one more edge map
+        int joins = 0;
+        if (data != NULL && count > 0)
+        {
+            const BITMAPINFOHEADER *first = &frames[0].info;
+            const size_t stride = DMA_OUTPUT_FRAME((size_t)first->biWidth * (first->biBitCount / 8),
+                                                   first->biHeight, first->biBitCount / 8);
+            joins = next.info.biWidth == first->biWidth && next.info.biHeight == first->biHeight &&
+                    next.info.biBitCount == first->biBitCount && stride * (count + 1) <= dst->size;
+        }
+
+        if (count > 0 && !joins)
+        {
+            if (flushBatch(frames, count, src, dst) != 0)
+            {
+                status = 1;
+                break;
+            }
+            // The new frame starts the next batch at the front of the buffer.
+            // flushBatch() left the last saved palette in biColourPalette, so
+            // only a reload may capture it again.
+            if (data != NULL)
+                memmove(src->virt, data, next.info.biSizeImage);
+            else
+            {
+                data = LoadBitmapFileInto(argv[a], &next.info, &next.header, src->virt, src->size);
+                memcpy(next.palette, biColourPalette, sizeof(biColourPalette));
+            }
+            count = 0;
+            used = 0;
+        }
+
+        if (data == NULL)
+        {
+            printf("No image found!\n");
+            status = 1;
+            break;
+        }
+        printf("bytes per pixel : %d \n", next.info.biBitCount / 8);
+        if (next.info.biWidth < 2 || next.info.biHeight < 2)
+        {
+            printf("Image too small: at least 2x2 pixels needed\n");
+            status = 1;
+            break;
+        }
+
+        frames[count++] = next;
+        used += next.info.biSizeImage;
+    }
+
+    if (status == 0 && count > 0 && flushBatch(frames, count, src, dst) != 0)
+        status = 1;
+    free(frames);
+    return status;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc > 5 || argc < 3 ||
+    if (argc < 3 ||
     (strcmp("-o",argv[1]) != 0 &&
     strcmp("-w",argv[1]) != 0))
     {
-        print_footer();
-        printf("Error: Program accepts minimum 1 and maximum 3 input files\n");
-        printf("Usage: %s -o/-w input1.bmp [input2.bmp input3.bmp]\n", argv[0]);
-        printf("Example: %s -o/-w image.bmp\n", argv[0]);
-        printf("Example: %s -o/-w image1.bmp image2.bmp image3.bmp\n", argv[0]);
-        print_footer();
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Options may appear anywhere after -o/-w; everything else is an input file
+    const FpgaKernel *kernel = NULL;
+    int useDma = 0;
+    int batch = 0;
+    int lanesRequested = CORE_BANK_MAX_LANES;
+    SobelBorder border = BORDER_SKIP;
+    uint8_t borderValue = 0;
+    SobelDenoise denoise = DENOISE_NONE;
+    int fileCount = 0;
+    for (int a = 2; a < argc; a++)
+    {
+        if (strncmp(argv[a], "--kernel=", 9) == 0)
+        {
+            kernel = find_kernel_preset(argv[a] + 9);
+            if (kernel == NULL)
+            {
+                printf("Unknown kernel: %s\n", argv[a] + 9);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--dma") == 0)
+            useDma = 1;
+        else if (strcmp(argv[a], "--batch") == 0)
+        {
+            // Batches are packed into the DMA buffers, so they imply --dma
+            batch = 1;
+            useDma = 1;
+        }
+        else if (strncmp(argv[a], "--lanes=", 8) == 0)
+        {
+            lanesRequested = atoi(argv[a] + 8);
+            if (lanesRequested < 1)
+            {
+                printf("Invalid lane count: %s\n", argv[a] + 8);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[a], "--border=", 9) == 0)
+        {
+            if (parse_border(argv[a] + 9, &border, &borderValue) != 0)
+            {
+                printf("Invalid border (skip, replicate, reflect101 or constant[:V]): %s\n", argv[a] + 9);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[a], "--denoise=", 10) == 0)
+        {
+            if (parse_denoise(argv[a] + 10, &denoise) != 0)
+            {
+                printf("Invalid denoise filter (none, gaussian or median): %s\n", argv[a] + 10);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[a], "--", 2) == 0)
+        {
+            printf("Unknown option: %s\n", argv[a]);
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+            fileCount++;
+    }
+
+    if (fileCount < 1 || (!batch && fileCount > 3))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    // The filter sits in the streaming front end, which has the line buffers for it
+    if (denoise != DENOISE_NONE && !useDma)
+    {
+        printf("--denoise needs the DMA path (--dma or --batch)\n");
         return 1;
     }
 
@@ -38,41 +397,95 @@ int main(int argc, char *argv[])
         return -1; // Exit if configuration fails
     }
 
+    // Swap the hardware operator for this job; the bitstream stays loaded
+    if (kernel != NULL && set_kernel(kernel) != 0) {
+        cleanup_fpga();
+        return -1;
+    }
+
+    // Always written, so a mode left by an earlier job does not carry over
+    if (set_border(border, borderValue) != 0 || set_denoise(denoise) != 0) {
+        cleanup_fpga();
+        return -1;
+    }
+
+    // Strobed handshake gives exact pixel counts; completion comes in by IRQ
+    if (enable_strobed_mode() != 0) {
+        cleanup_fpga();
+        return -1;
+    }
+    open_fpga_irq(FPGA_UIO_DEVICE);
+
+    // Parallel lanes, if the bitstream has them; one lane uses the PIO path
+    int lanes = fpga_core_count();
+    if (lanes > lanesRequested)
+        lanes = lanesRequested;
+    if (lanes > 1)
+        printf("Filter lanes : %d\n", lanes);
+
+    // DMA mode: frames go DDR3 -> core -> DDR3 without passing through the CPU
+    DmaBuffer dmaSrc, dmaDst;
+    if (useDma)
+    {
+        if (dma_alloc(&dmaSrc, UDMABUF_SRC_DEVICE) != 0)
+        {
+            cleanup_fpga();
+            return -1;
+        }
+        if (dma_alloc(&dmaDst, UDMABUF_DST_DEVICE) != 0)
+        {
+            dma_free(&dmaSrc);
+            cleanup_fpga();
+            return -1;
+        }
+    }
+
+    if (batch)
+    {
+        int status = runBatch(argc, argv, &dmaSrc, &dmaDst);
+        dma_free(&dmaSrc);
+        dma_free(&dmaDst);
+        cleanup_fpga();
+        return status;
+    }
+
     while(totalImg < argc)
     {
+        if (strncmp(argv[totalImg], "--", 2) == 0)
+        {
+            totalImg++;
+            continue;
+        }
+
         print_image_header(argv[totalImg]);
 
-        int COLS, ROWS, BYTES_PER_PIXEL;
+        int COLS, BYTES_PER_PIXEL;
         clock_t start, end;
         double cpu_time_used;
         start = clock();
 
 
-        size_t inputLen = strlen(argv[totalImg]);
-        if (inputLen < 4) 
-        {
-            printf("Invalid input filename\n");
-            return 1;
-        }
         // Get the base filename
         char *baseFileName = argv[totalImg];
         char *lastSlash = strrchr(baseFileName, '/');
         if (lastSlash != NULL) {
             baseFileName = lastSlash + 1;  // Skip the last slash to get just the filename
         }
-        size_t baseNameLen = strlen(baseFileName);
-        char outputFileName[baseNameLen + 30];
-        if (snprintf(outputFileName, sizeof(outputFileName), "output/%.*s_FPGAoutput.bmp",
-            (int)(baseNameLen - 4), baseFileName) >= sizeof(outputFileName))
+        char outputFileName[FILENAME_MAX];
+        if (output_name(argv[totalImg], outputFileName, sizeof(outputFileName)) != 0)
         {
-            printf("Output filename too long\n");
+            printf("Invalid input filename\n");
             return 1;
         }
         BITMAPINFOHEADER bitmapInfoHeader;
         BITMAPFILEHEADER bitmapFileHeader; //our bitmap file header
         unsigned char *bitmapData;
         unsigned char *bitmapFinalImage;
-        bitmapData = LoadBitmapFile(argv[totalImg],&bitmapInfoHeader, &bitmapFileHeader);
+        if (useDma)
+            bitmapData = LoadBitmapFileInto(argv[totalImg], &bitmapInfoHeader, &bitmapFileHeader,
+                                            dmaSrc.virt, dmaSrc.size);
+        else
+            bitmapData = LoadBitmapFile(argv[totalImg],&bitmapInfoHeader, &bitmapFileHeader);
 
         if(NULL == bitmapData)
         {
@@ -82,62 +495,87 @@ int main(int argc, char *argv[])
 
         BYTES_PER_PIXEL = bitmapInfoHeader.biBitCount / 8;
         COLS = bitmapInfoHeader.biWidth * BYTES_PER_PIXEL;
-        ROWS = bitmapInfoHeader.biHeight * BYTES_PER_PIXEL;
 
-        // Allocate memory for the filtered image
         printf("bytes per pixel : %d \n",BYTES_PER_PIXEL);
-        bitmapFinalImage = (unsigned char*)malloc(ROWS*COLS);
 
-        i=0;
-        j=0;
+        // The window needs a neighbour on each side to resolve the border
+        if (bitmapInfoHeader.biWidth < 2 || bitmapInfoHeader.biHeight < 2)
+        {
+            printf("Image too small: at least 2x2 pixels needed\n");
+            break;
+        }
 
-        
-        uint32_t data_to_fpga;
-        // Process image using FPGA
-        for (k = 0; k < BYTES_PER_PIXEL; k++) 
+        if (useDma)
         {
-            for (i = 0; i < ROWS; i++) 
+            // The loader leaves unpadded rows, so one descriptor covers the frame
+            if (dma_sobel_frame(&dmaSrc, COLS, &dmaDst, bitmapInfoHeader.biWidth,
+                                bitmapInfoHeader.biHeight, BYTES_PER_PIXEL, 1000) != 0)
+            {
+                printf("DMA transfer failed\n");
+                break;
+            }
+            bitmapFinalImage = dmaDst.virt + DMA_OUTPUT_GUARD(COLS, BYTES_PER_PIXEL);
+        }
+        else if (lanes > 1)
+        {
+            int width = bitmapInfoHeader.biWidth;
+            int height = bitmapInfoHeader.biHeight;
+            bitmapFinalImage = (unsigned char*)calloc(height, COLS);
+            runCoreBank(bitmapData, bitmapFinalImage, width, height, BYTES_PER_PIXEL, lanes,
+                        border, borderValue);
+        }
+        else
+        {
+            int width = bitmapInfoHeader.biWidth;
+            int height = bitmapInfoHeader.biHeight;
+
+            // Allocate memory for the filtered image
+            bitmapFinalImage = (unsigned char*)malloc((size_t)height * COLS);
+
+            fpga_begin_frame(width, height * BYTES_PER_PIXEL);
+
+            // Each read returns the pixel before the column just written, so
+            // the planes run back to back and one more column flushes the last
+            long previous = -1;
+            for (k = 0; k < BYTES_PER_PIXEL; k++)
             {
-                for (j = 0; j < COLS; j+=BYTES_PER_PIXEL) 
+                for (i = 0; i < height; i++)
                 {
-                    // Calculate indices first
-                    int prev_index = ((i - 1) * COLS) + j + k;
-                    int curr_index = (i * COLS) + j + k;
-                    int next_index = ((i + 1) * COLS) + j + k;
-                    // Add bounds checking
-                    if (prev_index >= 0 && prev_index < bitmapInfoHeader.biSizeImage &&
-                        curr_index >= 0 && curr_index < bitmapInfoHeader.biSizeImage &&
-                        next_index >= 0 && next_index < bitmapInfoHeader.biSizeImage) {
-
-                        input_row[0] = (i == 0) ? 0 : bitmapData[prev_index];
-                        input_row[1] = bitmapData[curr_index];
-                        input_row[2] = (i == ROWS - 1) ? 0 : bitmapData[next_index];
-
-                    } 
-                    else 
+                    for (j = k; j < COLS; j += BYTES_PER_PIXEL)
                     {
-                        // Handle edge case
-                        input_row[0] = 0;
-                        input_row[1] = 0;
-                        input_row[2] = 0;
-                        
+                        write_to_fpga(border_column(bitmapData + j, COLS, i, height, border, borderValue));
+                        uint8_t output_pixel = read_from_fpga();
+                        if (previous >= 0)
+                            bitmapFinalImage[previous] = output_pixel;
+                        previous = (long)i * COLS + j;
                     }
-                    data_to_fpga = prepareDataforTx(input_row, sizeof(unsigned char) * SIZE_BUFFER);
-                    // Write to FPGA and read the result
-                    write_to_fpga(data_to_fpga);
-                    uint8_t output_pixel = read_from_fpga();
-                    bitmapFinalImage[curr_index] = output_pixel;
                 }
             }
-            input_row[0]=0;
-            input_row[1]=0;
-            input_row[2]=0;
+            write_to_fpga(0);
+            bitmapFinalImage[previous] = read_from_fpga();
         }
+        // Sleep until the core reports the frame complete (dma_sobel_frame already
+        // did), then report utilisation
+        FpgaCounters counters;
+        if (!useDma && fpga_wait_frame(1000) != 0)
+            printf("Warning: frame completion not signalled by the FPGA\n");
+        if (read_fpga_counters(&counters) == 0)
+        {
+            printf("HW cycles : %u, pixels in : %u, pixels out : %u, stalls : %u\n",
+                   counters.cycles, counters.pixels_in, counters.pixels_out, counters.stalls);
+            printf("HW busy time : %f seconds at %d MHz, datapath utilization : %.2f%%\n",
+                   (double)counters.pixels_out / FPGA_CLOCK_HZ, FPGA_CLOCK_HZ / 1000000,
+                   counters.cycles ? 100.0 * counters.pixels_out / counters.cycles : 0.0);
+        }
+
         SaveBitmapFile(outputFileName, bitmapFinalImage, &bitmapInfoHeader, &bitmapFileHeader);
 
-        // Clean up
-        free(bitmapData);
-        free(bitmapFinalImage);
+        // Clean up; DMA buffers are reused for the next frame
+        if (!useDma)
+        {
+            free(bitmapData);
+            free(bitmapFinalImage);
+        }
 
         end = clock();
         cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
@@ -149,6 +587,11 @@ int main(int argc, char *argv[])
     }
 
     // Cleanup resources
+    if (useDma)
+    {
+        dma_free(&dmaSrc);
+        dma_free(&dmaDst);
+    }
     cleanup_fpga();
 
     return 0;